@@ -6,9 +6,59 @@ in vec2 FragTexture;
 
 out vec4 FragColor;
 
-uniform vec3 color;
+layout(std140) uniform Object {
+    mat4 model, normal;
+    vec4 color;
+    int material;
+};
+
+struct Material {
+    vec4 diffuse, specular;
+    int texture_slot, texture_layer;
+};
+
+// Same length as SHADER_MATERIALS
+layout(std140) uniform Materials {
+    Material materials[64];
+};
+
+#ifdef TEXTURE
+// Same length as SHADER_TEXTURE_SLOTS, GLSL 330 only indexes sampler arrays with constants
+uniform sampler2DArray textures[8];
+
+vec3 sample_diffuse(int slot, int layer, vec2 uv)
+{
+    // Gradients are taken up front, they are undefined inside branches that neighbouring pixels may skip
+    vec3 coord = vec3(uv, layer);
+    vec2 dx = dFdx(uv), dy = dFdy(uv);
+
+    switch (slot) {
+    case 0: return textureGrad(textures[0], coord, dx, dy).rgb;
+    case 1: return textureGrad(textures[1], coord, dx, dy).rgb;
+    case 2: return textureGrad(textures[2], coord, dx, dy).rgb;
+    case 3: return textureGrad(textures[3], coord, dx, dy).rgb;
+    case 4: return textureGrad(textures[4], coord, dx, dy).rgb;
+    case 5: return textureGrad(textures[5], coord, dx, dy).rgb;
+    case 6: return textureGrad(textures[6], coord, dx, dy).rgb;
+    case 7: return textureGrad(textures[7], coord, dx, dy).rgb;
+    }
+
+    return vec3(1.0);
+}
+#endif
 
 void main()
 {
-    FragColor = vec4(color, 1.0f);
-}
\ No newline at end of file
+    vec3 albedo = mix(materials[material].diffuse.rgb, color.rgb, color.a);
+
+#ifdef TEXTURE
+    albedo *= sample_diffuse(materials[material].texture_slot, materials[material].texture_layer, FragTexture);
+#endif
+
+#ifdef LIGHTING
+    vec3 light = normalize(vec3(0.5, 1.0, 0.75));
+    albedo *= 0.25 + 0.75 * max(dot(normalize(FragNormal), light), 0.0);
+#endif
+
+    FragColor = vec4(albedo, 1.0f);
+}
@@ -2,9 +2,13 @@
 
 out vec4 FragColor;
 
-uniform vec3 color;
+layout(std140) uniform Object {
+    mat4 model, normal;
+    vec4 color;
+    int material;
+};
 
 void main()
 {
-    FragColor = vec4(color, 1.0f);
+    FragColor = vec4(color.rgb, 1.0f);
 }
\ No newline at end of file
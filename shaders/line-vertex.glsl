@@ -2,7 +2,15 @@
 
 layout(location = 0) in vec3 vPos;
 
-uniform mat4 model, view, projection;
+layout(std140) uniform Frame {
+    mat4 view, projection;
+};
+
+layout(std140) uniform Object {
+    mat4 model, normal;
+    vec4 color;
+    int material;
+};
 
 void main()
 {
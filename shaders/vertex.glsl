@@ -8,8 +8,15 @@ out vec3 FragPos;
 out vec3 FragNormal;
 out vec2 FragTexture;
 
-uniform mat4 model, view, projection;
-uniform mat4 normal;
+layout(std140) uniform Frame {
+    mat4 view, projection;
+};
+
+layout(std140) uniform Object {
+    mat4 model, normal;
+    vec4 color;
+    int material;
+};
 
 void main()
 {
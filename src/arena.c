@@ -0,0 +1,169 @@
+#include "arena.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_ARENA_SIZE (1 << 20)
+#define MAX_FRAME_THREADS 64
+
+struct _thread_arenas_t {
+    arena_t arenas[2];
+};
+
+typedef struct _thread_arenas_t thread_arenas_t;
+
+thread_arenas_t frame_arenas[MAX_FRAME_THREADS];
+int frame_arenas_n;
+
+pthread_mutex_t frame_arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+unsigned int current_frame;
+
+_Thread_local thread_arenas_t* local_arenas;
+
+arena_block_t* new_block(size_t size) {
+    arena_block_t* block = malloc(sizeof(arena_block_t) + size);
+
+    block->next = NULL;
+    block->size = size;
+    block->head = 0;
+
+    return block;
+}
+
+void init_arena(arena_t* arena, size_t block_size) {
+    memset(arena, 0, sizeof(arena_t));
+
+    arena->block_size = block_size;
+    arena->blocks = new_block(block_size);
+}
+
+void free_arena(arena_t* arena) {
+    arena_block_t *block = arena->blocks, *next;
+    while (block != NULL) {
+        next = block->next;
+
+        free(block);
+        block = next;
+    }
+
+    arena->blocks = NULL;
+    arena->used = 0;
+}
+
+void reset_arena(arena_t* arena) {
+    if (arena->blocks == NULL)
+        return;
+
+    // Overflowed last time, fold everything into one block big enough for the whole peak
+    if (arena->blocks->next != NULL) {
+        size_t peak = arena->high_water + arena->high_water / 4;
+        size_t size = arena->block_size > peak ? arena->block_size : peak;
+
+        free_arena(arena);
+        arena->blocks = new_block(size);
+    }
+
+    arena->blocks->head = 0;
+    arena->used = 0;
+}
+
+void* arena_alloc(arena_t* arena, size_t size, size_t align) {
+    if (align == 0)
+        align = sizeof(void*);
+
+    arena_block_t* block = arena->blocks;
+
+    uintptr_t base = (uintptr_t)(block + 1);
+    uintptr_t start = (base + block->head + align - 1) & ~(uintptr_t)(align - 1);
+
+    if (start + size > base + block->size) {
+        size_t block_size = arena->block_size > size + align ? arena->block_size : size + align;
+
+        block = new_block(block_size);
+        block->next = arena->blocks;
+        arena->blocks = block;
+
+        base = (uintptr_t)(block + 1);
+        start = (base + align - 1) & ~(uintptr_t)(align - 1);
+    }
+
+    size_t padding = start - (base + block->head);
+    block->head = start + size - base;
+
+    arena->used += padding + size;
+    if (arena->used > arena->high_water)
+        arena->high_water = arena->used;
+
+    return (void*)start;
+}
+
+thread_arenas_t* get_local_arenas() {
+    if (local_arenas != NULL)
+        return local_arenas;
+
+    pthread_mutex_lock(&frame_arenas_lock);
+
+    if (frame_arenas_n == MAX_FRAME_THREADS) {
+        pthread_mutex_unlock(&frame_arenas_lock);
+        return NULL;
+    }
+
+    local_arenas = &frame_arenas[frame_arenas_n++];
+    init_arena(&local_arenas->arenas[0], FRAME_ARENA_SIZE);
+    init_arena(&local_arenas->arenas[1], FRAME_ARENA_SIZE);
+
+    pthread_mutex_unlock(&frame_arenas_lock);
+    return local_arenas;
+}
+
+void begin_frame_arenas(unsigned int frame) {
+    current_frame = frame;
+
+    // Only called between frames, when no job can be holding a pointer into this half
+    pthread_mutex_lock(&frame_arenas_lock);
+
+    for (int i = 0; i < frame_arenas_n; i++)
+        reset_arena(&frame_arenas[i].arenas[frame & 1]);
+
+    pthread_mutex_unlock(&frame_arenas_lock);
+}
+
+void free_frame_arenas() {
+    pthread_mutex_lock(&frame_arenas_lock);
+
+    for (int i = 0; i < frame_arenas_n; i++) {
+        free_arena(&frame_arenas[i].arenas[0]);
+        free_arena(&frame_arenas[i].arenas[1]);
+    }
+
+    frame_arenas_n = 0;
+    pthread_mutex_unlock(&frame_arenas_lock);
+}
+
+void* frame_alloc(size_t size, size_t align) {
+    thread_arenas_t* arenas = get_local_arenas();
+
+    if (arenas == NULL) {
+        fprintf(stderr, "Too many threads using frame arenas\n");
+        return NULL;
+    }
+
+    return arena_alloc(&arenas->arenas[current_frame & 1], size, align);
+}
+
+size_t frame_arena_high_water() {
+    size_t high_water = 0;
+
+    pthread_mutex_lock(&frame_arenas_lock);
+
+    for (int i = 0; i < frame_arenas_n; i++)
+        for (int j = 0; j < 2; j++)
+            if (frame_arenas[i].arenas[j].high_water > high_water)
+                high_water = frame_arenas[i].arenas[j].high_water;
+
+    pthread_mutex_unlock(&frame_arenas_lock);
+    return high_water;
+}
@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+struct _arena_block_t {
+    struct _arena_block_t* next;
+    size_t size, head;
+};
+
+// Bump allocator, everything is released at once by reset_arena or free_arena
+struct _arena_t {
+    struct _arena_block_t* blocks;
+    size_t block_size;
+
+    size_t used, high_water;
+};
+
+typedef struct _arena_block_t arena_block_t;
+typedef struct _arena_t arena_t;
+
+void init_arena(arena_t* arena, size_t block_size);
+void free_arena(arena_t* arena);
+void reset_arena(arena_t* arena);
+
+void* arena_alloc(arena_t* arena, size_t size, size_t align);
+
+// Per thread, double buffered so data built for frame N survives while frame N + 1 is being built
+void begin_frame_arenas(unsigned int frame);
+void free_frame_arenas();
+
+void* frame_alloc(size_t size, size_t align);
+size_t frame_arena_high_water();
+
+#endif  // ARENA_H
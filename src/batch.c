@@ -0,0 +1,334 @@
+#include "batch.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BATCH_X86
+#include <immintrin.h>
+#endif
+
+const char* isa = "scalar";
+
+// Scalar
+
+void scalar_mat4x4_mul(mat4x4* out, const mat4x4 a, const mat4x4* b, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        mat4x4_mul(out[i], a, b[i]);
+}
+
+void scalar_normal_matrix(mat4x4* out, const mat4x4* m, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        vec3 c0, c1, c2;
+        vec3_cross(c0, m[i][1], m[i][2]);
+        vec3_cross(c1, m[i][2], m[i][0]);
+        vec3_cross(c2, m[i][0], m[i][1]);
+
+        float idet = 1.0f / vec3_dot(m[i][0], c0);
+
+        mat4x4_identity(out[i]);
+        vec3_scale(out[i][0], c0, idet);
+        vec3_scale(out[i][1], c1, idet);
+        vec3_scale(out[i][2], c2, idet);
+    }
+}
+
+void scalar_transform_aabb(vec3* out_min, vec3* out_max, const mat4x4* m, const vec3* min, const vec3* max,
+                           size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        for (int j = 0; j < 3; j++) {
+            out_min[i][j] = out_max[i][j] = m[i][3][j];
+
+            for (int k = 0; k < 3; k++) {
+                float a = m[i][k][j] * min[i][k];
+                float b = m[i][k][j] * max[i][k];
+
+                out_min[i][j] += a < b ? a : b;
+                out_max[i][j] += a < b ? b : a;
+            }
+        }
+    }
+}
+
+void scalar_transform_points(vec3* out, const mat4x4 m, const vec3* points, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        vec3 p;
+        for (int j = 0; j < 3; j++)
+            p[j] = m[0][j] * points[i][0] + m[1][j] * points[i][1] + m[2][j] * points[i][2] + m[3][j];
+
+        vec3_copy(out[i], p);
+    }
+}
+
+void (*batch_mat4x4_mul)(mat4x4*, const mat4x4, const mat4x4*, size_t) = scalar_mat4x4_mul;
+void (*batch_normal_matrix)(mat4x4*, const mat4x4*, size_t) = scalar_normal_matrix;
+void (*batch_transform_aabb)(vec3*, vec3*, const mat4x4*, const vec3*, const vec3*, size_t) = scalar_transform_aabb;
+void (*batch_transform_points)(vec3*, const mat4x4, const vec3*, size_t) = scalar_transform_points;
+
+#ifdef BATCH_X86
+
+// vec3 arrays are packed, so never load or store a full lane past the last element
+
+static inline __m128 load_vec3(const float* v) {
+    return _mm_setr_ps(v[0], v[1], v[2], 0.0f);
+}
+
+static inline void store_vec3(float* r, __m128 v) {
+    float tmp[4];
+    _mm_storeu_ps(tmp, v);
+    memcpy(r, tmp, sizeof(float) * 3);
+}
+
+static inline __m128 cross_sse(__m128 a, __m128 b) {
+    __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+static inline float dot3_sse(__m128 a, __m128 b) {
+    __m128 m = _mm_mul_ps(a, b);
+    return _mm_cvtss_f32(m) + _mm_cvtss_f32(_mm_shuffle_ps(m, m, 1)) + _mm_cvtss_f32(_mm_shuffle_ps(m, m, 2));
+}
+
+// SSE
+
+void sse_mat4x4_mul(mat4x4* out, const mat4x4 a, const mat4x4* b, size_t n) {
+    __m128 a0 = _mm_loadu_ps(a[0]);
+    __m128 a1 = _mm_loadu_ps(a[1]);
+    __m128 a2 = _mm_loadu_ps(a[2]);
+    __m128 a3 = _mm_loadu_ps(a[3]);
+
+    for (size_t i = 0; i < n; i++) {
+        for (int j = 0; j < 4; j++) {
+            __m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[i][j][0]));
+            r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[i][j][1])));
+            r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[i][j][2])));
+            r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[i][j][3])));
+
+            _mm_storeu_ps(out[i][j], r);
+        }
+    }
+}
+
+void sse_normal_matrix(mat4x4* out, const mat4x4* m, size_t n) {
+    const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+
+    for (size_t i = 0; i < n; i++) {
+        __m128 m0 = _mm_and_ps(_mm_loadu_ps(m[i][0]), xyz);
+        __m128 m1 = _mm_and_ps(_mm_loadu_ps(m[i][1]), xyz);
+        __m128 m2 = _mm_and_ps(_mm_loadu_ps(m[i][2]), xyz);
+
+        __m128 c0 = cross_sse(m1, m2);
+        __m128 c1 = cross_sse(m2, m0);
+        __m128 c2 = cross_sse(m0, m1);
+
+        __m128 idet = _mm_set1_ps(1.0f / dot3_sse(m0, c0));
+
+        _mm_storeu_ps(out[i][0], _mm_mul_ps(c0, idet));
+        _mm_storeu_ps(out[i][1], _mm_mul_ps(c1, idet));
+        _mm_storeu_ps(out[i][2], _mm_mul_ps(c2, idet));
+        _mm_storeu_ps(out[i][3], _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+}
+
+void sse_transform_aabb(vec3* out_min, vec3* out_max, const mat4x4* m, const vec3* min, const vec3* max, size_t n) {
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+    for (size_t i = 0; i < n; i++) {
+        __m128 lo = load_vec3(min[i]), hi = load_vec3(max[i]);
+
+        // Centre and half extent, the extent only needs the absolute matrix
+        __m128 c = _mm_mul_ps(_mm_add_ps(lo, hi), half);
+        __m128 e = _mm_mul_ps(_mm_sub_ps(hi, lo), half);
+
+        __m128 m0 = _mm_loadu_ps(m[i][0]), m1 = _mm_loadu_ps(m[i][1]);
+        __m128 m2 = _mm_loadu_ps(m[i][2]), m3 = _mm_loadu_ps(m[i][3]);
+
+        __m128 wc = m3;
+        wc = _mm_add_ps(wc, _mm_mul_ps(m0, _mm_shuffle_ps(c, c, 0x00)));
+        wc = _mm_add_ps(wc, _mm_mul_ps(m1, _mm_shuffle_ps(c, c, 0x55)));
+        wc = _mm_add_ps(wc, _mm_mul_ps(m2, _mm_shuffle_ps(c, c, 0xaa)));
+
+        __m128 we = _mm_mul_ps(_mm_and_ps(m0, abs_mask), _mm_shuffle_ps(e, e, 0x00));
+        we = _mm_add_ps(we, _mm_mul_ps(_mm_and_ps(m1, abs_mask), _mm_shuffle_ps(e, e, 0x55)));
+        we = _mm_add_ps(we, _mm_mul_ps(_mm_and_ps(m2, abs_mask), _mm_shuffle_ps(e, e, 0xaa)));
+
+        store_vec3(out_min[i], _mm_sub_ps(wc, we));
+        store_vec3(out_max[i], _mm_add_ps(wc, we));
+    }
+}
+
+void sse_transform_points(vec3* out, const mat4x4 m, const vec3* points, size_t n) {
+    __m128 m0 = _mm_loadu_ps(m[0]), m1 = _mm_loadu_ps(m[1]);
+    __m128 m2 = _mm_loadu_ps(m[2]), m3 = _mm_loadu_ps(m[3]);
+
+    for (size_t i = 0; i < n; i++) {
+        __m128 r = m3;
+        r = _mm_add_ps(r, _mm_mul_ps(m0, _mm_set1_ps(points[i][0])));
+        r = _mm_add_ps(r, _mm_mul_ps(m1, _mm_set1_ps(points[i][1])));
+        r = _mm_add_ps(r, _mm_mul_ps(m2, _mm_set1_ps(points[i][2])));
+
+        store_vec3(out[i], r);
+    }
+}
+
+// AVX2, two matrices or points per 256 bit register
+
+#define AVX2 __attribute__((target("avx2,fma")))
+
+AVX2 void avx2_mat4x4_mul(mat4x4* out, const mat4x4 a, const mat4x4* b, size_t n) {
+    __m256 a0 = _mm256_broadcast_ps((const __m128*)a[0]);
+    __m256 a1 = _mm256_broadcast_ps((const __m128*)a[1]);
+    __m256 a2 = _mm256_broadcast_ps((const __m128*)a[2]);
+    __m256 a3 = _mm256_broadcast_ps((const __m128*)a[3]);
+
+    for (size_t i = 0; i < n; i++) {
+        // Columns 0 and 1, then 2 and 3
+        for (int j = 0; j < 4; j += 2) {
+            __m256 col = _mm256_loadu_ps(b[i][j]);
+
+            __m256 r = _mm256_mul_ps(a0, _mm256_shuffle_ps(col, col, 0x00));
+            r = _mm256_fmadd_ps(a1, _mm256_shuffle_ps(col, col, 0x55), r);
+            r = _mm256_fmadd_ps(a2, _mm256_shuffle_ps(col, col, 0xaa), r);
+            r = _mm256_fmadd_ps(a3, _mm256_shuffle_ps(col, col, 0xff), r);
+
+            _mm256_storeu_ps(out[i][j], r);
+        }
+    }
+}
+
+static inline AVX2 __m256 cross_avx2(__m256 a, __m256 b) {
+    __m256 a_yzx = _mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m256 b_yzx = _mm256_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m256 c = _mm256_fmsub_ps(a, b_yzx, _mm256_mul_ps(a_yzx, b));
+
+    return _mm256_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+AVX2 void avx2_normal_matrix(mat4x4* out, const mat4x4* m, size_t n) {
+    const __m256 xyz = _mm256_castsi256_ps(_mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0));
+    const __m256 w = _mm256_setr_ps(0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m256 m0 = _mm256_and_ps(_mm256_setr_m128(_mm_loadu_ps(m[i][0]), _mm_loadu_ps(m[i + 1][0])), xyz);
+        __m256 m1 = _mm256_and_ps(_mm256_setr_m128(_mm_loadu_ps(m[i][1]), _mm_loadu_ps(m[i + 1][1])), xyz);
+        __m256 m2 = _mm256_and_ps(_mm256_setr_m128(_mm_loadu_ps(m[i][2]), _mm_loadu_ps(m[i + 1][2])), xyz);
+
+        __m256 c0 = cross_avx2(m1, m2);
+        __m256 c1 = cross_avx2(m2, m0);
+        __m256 c2 = cross_avx2(m0, m1);
+
+        // Each half's determinant broadcast across that half
+        __m256 idet = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_dp_ps(m0, c0, 0x7f));
+
+        c0 = _mm256_mul_ps(c0, idet);
+        c1 = _mm256_mul_ps(c1, idet);
+        c2 = _mm256_mul_ps(c2, idet);
+
+        _mm_storeu_ps(out[i][0], _mm256_castps256_ps128(c0));
+        _mm_storeu_ps(out[i][1], _mm256_castps256_ps128(c1));
+        _mm_storeu_ps(out[i][2], _mm256_castps256_ps128(c2));
+        _mm_storeu_ps(out[i][3], _mm256_castps256_ps128(w));
+
+        _mm_storeu_ps(out[i + 1][0], _mm256_extractf128_ps(c0, 1));
+        _mm_storeu_ps(out[i + 1][1], _mm256_extractf128_ps(c1, 1));
+        _mm_storeu_ps(out[i + 1][2], _mm256_extractf128_ps(c2, 1));
+        _mm_storeu_ps(out[i + 1][3], _mm256_extractf128_ps(w, 1));
+    }
+
+    sse_normal_matrix(out + i, m + i, n - i);
+}
+
+AVX2 void avx2_transform_aabb(vec3* out_min, vec3* out_max, const mat4x4* m, const vec3* min, const vec3* max,
+                              size_t n) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m256 lo = _mm256_setr_ps(min[i][0], min[i][1], min[i][2], 0.0f, min[i + 1][0], min[i + 1][1], min[i + 1][2],
+                                   0.0f);
+        __m256 hi = _mm256_setr_ps(max[i][0], max[i][1], max[i][2], 0.0f, max[i + 1][0], max[i + 1][1], max[i + 1][2],
+                                   0.0f);
+
+        __m256 c = _mm256_mul_ps(_mm256_add_ps(lo, hi), half);
+        __m256 e = _mm256_mul_ps(_mm256_sub_ps(hi, lo), half);
+
+        __m256 m0 = _mm256_setr_m128(_mm_loadu_ps(m[i][0]), _mm_loadu_ps(m[i + 1][0]));
+        __m256 m1 = _mm256_setr_m128(_mm_loadu_ps(m[i][1]), _mm_loadu_ps(m[i + 1][1]));
+        __m256 m2 = _mm256_setr_m128(_mm_loadu_ps(m[i][2]), _mm_loadu_ps(m[i + 1][2]));
+        __m256 m3 = _mm256_setr_m128(_mm_loadu_ps(m[i][3]), _mm_loadu_ps(m[i + 1][3]));
+
+        __m256 wc = _mm256_fmadd_ps(m0, _mm256_shuffle_ps(c, c, 0x00), m3);
+        wc = _mm256_fmadd_ps(m1, _mm256_shuffle_ps(c, c, 0x55), wc);
+        wc = _mm256_fmadd_ps(m2, _mm256_shuffle_ps(c, c, 0xaa), wc);
+
+        __m256 we = _mm256_mul_ps(_mm256_and_ps(m0, abs_mask), _mm256_shuffle_ps(e, e, 0x00));
+        we = _mm256_fmadd_ps(_mm256_and_ps(m1, abs_mask), _mm256_shuffle_ps(e, e, 0x55), we);
+        we = _mm256_fmadd_ps(_mm256_and_ps(m2, abs_mask), _mm256_shuffle_ps(e, e, 0xaa), we);
+
+        __m256 rmin = _mm256_sub_ps(wc, we), rmax = _mm256_add_ps(wc, we);
+
+        store_vec3(out_min[i], _mm256_castps256_ps128(rmin));
+        store_vec3(out_min[i + 1], _mm256_extractf128_ps(rmin, 1));
+        store_vec3(out_max[i], _mm256_castps256_ps128(rmax));
+        store_vec3(out_max[i + 1], _mm256_extractf128_ps(rmax, 1));
+    }
+
+    sse_transform_aabb(out_min + i, out_max + i, m + i, min + i, max + i, n - i);
+}
+
+AVX2 void avx2_transform_points(vec3* out, const mat4x4 m, const vec3* points, size_t n) {
+    __m256 m0 = _mm256_broadcast_ps((const __m128*)m[0]);
+    __m256 m1 = _mm256_broadcast_ps((const __m128*)m[1]);
+    __m256 m2 = _mm256_broadcast_ps((const __m128*)m[2]);
+    __m256 m3 = _mm256_broadcast_ps((const __m128*)m[3]);
+
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const float* p = points[i];
+
+        // Two packed vec3s are six consecutive floats
+        __m256 x = _mm256_setr_m128(_mm_set1_ps(p[0]), _mm_set1_ps(p[3]));
+        __m256 y = _mm256_setr_m128(_mm_set1_ps(p[1]), _mm_set1_ps(p[4]));
+        __m256 z = _mm256_setr_m128(_mm_set1_ps(p[2]), _mm_set1_ps(p[5]));
+
+        __m256 r = _mm256_fmadd_ps(m0, x, m3);
+        r = _mm256_fmadd_ps(m1, y, r);
+        r = _mm256_fmadd_ps(m2, z, r);
+
+        store_vec3(out[i], _mm256_castps256_ps128(r));
+        store_vec3(out[i + 1], _mm256_extractf128_ps(r, 1));
+    }
+
+    sse_transform_points(out + i, m, points + i, n - i);
+}
+
+#endif
+
+void init_batch_math() {
+#ifdef BATCH_X86
+    __builtin_cpu_init();
+
+    batch_mat4x4_mul = sse_mat4x4_mul;
+    batch_normal_matrix = sse_normal_matrix;
+    batch_transform_aabb = sse_transform_aabb;
+    batch_transform_points = sse_transform_points;
+    isa = "sse";
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        batch_mat4x4_mul = avx2_mat4x4_mul;
+        batch_normal_matrix = avx2_normal_matrix;
+        batch_transform_aabb = avx2_transform_aabb;
+        batch_transform_points = avx2_transform_points;
+        isa = "avx2";
+    }
+#endif
+}
+
+const char* batch_math_isa() {
+    return isa;
+}
@@ -0,0 +1,26 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+#include "linmath.h"
+
+// Batch versions of linmath.h operations, dispatched to SSE or AVX2 at runtime by init_batch_math
+
+// out[i] = a * b[i]
+extern void (*batch_mat4x4_mul)(mat4x4* out, const mat4x4 a, const mat4x4* b, size_t n);
+
+// Inverse transpose of the upper 3x3 of each affine matrix, translation cleared
+extern void (*batch_normal_matrix)(mat4x4* out, const mat4x4* m, size_t n);
+
+// World space bounds of each box under its own matrix
+extern void (*batch_transform_aabb)(vec3* out_min, vec3* out_max, const mat4x4* m, const vec3* min, const vec3* max,
+                                    size_t n);
+
+// out[i] = m * (points[i], 1)
+extern void (*batch_transform_points)(vec3* out, const mat4x4 m, const vec3* points, size_t n);
+
+void init_batch_math();
+const char* batch_math_isa();
+
+#endif  // BATCH_H
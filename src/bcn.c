@@ -0,0 +1,450 @@
+#include "bcn.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "job.h"
+
+// Interpolation weights of BC7's four bit indices, out of 64
+static const int bc7_weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+size_t bcn_block_bytes(int format) {
+    return format == BCN_BC1 ? 8 : 16;
+}
+
+size_t bcn_size(int format, int width, int height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * bcn_block_bytes(format);
+}
+
+float clamp_channel(float value) {
+    return value < 0.0f ? 0.0f : value > 255.0f ? 255.0f : value;
+}
+
+void load_block(float colors[16][4], const uint8_t* pixels, size_t stride) {
+    for (int y = 0; y < 4; y++)
+        for (int x = 0; x < 4; x++)
+            for (int c = 0; c < 4; c++)
+                colors[y * 4 + x][c] = pixels[y * stride + x * 4 + c];
+}
+
+// Endpoints along the block's principal axis, found by power iteration on the covariance
+void fit_endpoints(float* e0, float* e1, float colors[16][4], int dims) {
+    float mean[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < dims; c++)
+            mean[c] += colors[i][c] * (1.0f / 16.0f);
+
+    float covariance[4][4] = {{0.0f}};
+
+    for (int i = 0; i < 16; i++)
+        for (int a = 0; a < dims; a++)
+            for (int b = 0; b < dims; b++)
+                covariance[a][b] += (colors[i][a] - mean[a]) * (colors[i][b] - mean[b]);
+
+    float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {0.0f, 0.0f, 0.0f, 0.0f}, length = 0.0f;
+
+        for (int a = 0; a < dims; a++) {
+            for (int b = 0; b < dims; b++)
+                next[a] += covariance[a][b] * axis[b];
+
+            length += next[a] * next[a];
+        }
+
+        // Flat blocks have no axis, every pixel then projects onto the mean
+        if (length < 1e-12f)
+            break;
+
+        length = 1.0f / sqrtf(length);
+        for (int a = 0; a < dims; a++)
+            axis[a] = next[a] * length;
+    }
+
+    float min = INFINITY, max = -INFINITY;
+
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < dims; c++)
+            t += (colors[i][c] - mean[c]) * axis[c];
+
+        min = t < min ? t : min;
+        max = t > max ? t : max;
+    }
+
+    // Pulling the ends in a little lowers the error of the interpolated entries more than it costs the extremes
+    float inset = (max - min) / 16.0f;
+    min += inset;
+    max -= inset;
+
+    for (int c = 0; c < dims; c++) {
+        e0[c] = clamp_channel(mean[c] + axis[c] * max);
+        e1[c] = clamp_channel(mean[c] + axis[c] * min);
+    }
+}
+
+// Least squares endpoints for fixed indices, weights[i] is how much of e0 pixel i takes
+int refine_endpoints(float* e0, float* e1, float colors[16][4], const float* weights, int dims) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {0.0f, 0.0f, 0.0f, 0.0f}, bx[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    for (int i = 0; i < 16; i++) {
+        float a = weights[i], b = 1.0f - a;
+
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+
+        for (int c = 0; c < dims; c++) {
+            ax[c] += a * colors[i][c];
+            bx[c] += b * colors[i][c];
+        }
+    }
+
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f)
+        return 0;
+
+    det = 1.0f / det;
+    for (int c = 0; c < dims; c++) {
+        e0[c] = clamp_channel((ax[c] * bb - bx[c] * ab) * det);
+        e1[c] = clamp_channel((bx[c] * aa - ax[c] * ab) * det);
+    }
+
+    return 1;
+}
+
+// BC1
+
+uint16_t pack_565(const float* color) {
+    uint16_t r = (uint16_t)(color[0] * 31.0f / 255.0f + 0.5f);
+    uint16_t g = (uint16_t)(color[1] * 63.0f / 255.0f + 0.5f);
+    uint16_t b = (uint16_t)(color[2] * 31.0f / 255.0f + 0.5f);
+
+    return r << 11 | g << 5 | b;
+}
+
+void unpack_565(float* color, uint16_t value) {
+    int r = value >> 11, g = (value >> 5) & 63, b = value & 31;
+
+    color[0] = (float)(r << 3 | r >> 2);
+    color[1] = (float)(g << 2 | g >> 4);
+    color[2] = (float)(b << 3 | b >> 2);
+}
+
+// Picks the nearest of the four palette entries for each pixel, returns the squared error
+float bc1_indices(uint16_t* c0, uint16_t* c1, uint32_t* bits, float colors[16][4], float* weights) {
+    // Equal endpoints would select three colour mode, where index 0 is still c0
+    if (*c0 < *c1) {
+        uint16_t swap = *c0;
+        *c0 = *c1;
+        *c1 = swap;
+    }
+
+    float palette[4][3];
+    unpack_565(palette[0], *c0);
+    unpack_565(palette[1], *c1);
+
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    static const float palette_weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    int entries = *c0 == *c1 ? 1 : 4;
+
+    float error = 0.0f;
+    *bits = 0;
+
+    for (int i = 0; i < 16; i++) {
+        int best = 0;
+        float best_error = INFINITY;
+
+        for (int j = 0; j < entries; j++) {
+            float e = 0.0f;
+            for (int c = 0; c < 3; c++)
+                e += (colors[i][c] - palette[j][c]) * (colors[i][c] - palette[j][c]);
+
+            if (e < best_error) {
+                best = j;
+                best_error = e;
+            }
+        }
+
+        *bits |= (uint32_t)best << (i * 2);
+        weights[i] = palette_weights[best];
+        error += best_error;
+    }
+
+    return error;
+}
+
+void encode_bc1_block(uint8_t* out, const uint8_t* pixels, size_t stride) {
+    float colors[16][4], e0[4], e1[4], weights[16], refined_weights[16];
+    load_block(colors, pixels, stride);
+    fit_endpoints(e0, e1, colors, 3);
+
+    uint16_t c0 = pack_565(e0), c1 = pack_565(e1);
+    uint32_t bits;
+    float error = bc1_indices(&c0, &c1, &bits, colors, weights);
+
+    if (refine_endpoints(e0, e1, colors, weights, 3)) {
+        uint16_t r0 = pack_565(e0), r1 = pack_565(e1);
+        uint32_t refined_bits;
+
+        if (bc1_indices(&r0, &r1, &refined_bits, colors, refined_weights) < error) {
+            c0 = r0;
+            c1 = r1;
+            bits = refined_bits;
+        }
+    }
+
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (bits >> (i * 8)) & 0xff;
+}
+
+// BC4
+
+void encode_bc4_block(uint8_t* out, const uint8_t* pixels, size_t stride, int channel) {
+    int values[16], min = 255, max = 0;
+
+    for (int i = 0; i < 16; i++) {
+        values[i] = pixels[(i / 4) * stride + (i % 4) * 4 + channel];
+        min = values[i] < min ? values[i] : min;
+        max = values[i] > max ? values[i] : max;
+    }
+
+    // Eight entry mode, max and min at the ends with six steps between them
+    uint64_t bits = 0;
+
+    if (max > min) {
+        for (int i = 0; i < 16; i++) {
+            int step = ((max - values[i]) * 14 + (max - min)) / ((max - min) * 2);
+            uint64_t index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+
+            bits |= index << (i * 3);
+        }
+    }
+
+    out[0] = (uint8_t)max;
+    out[1] = (uint8_t)min;
+
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (bits >> (i * 8)) & 0xff;
+}
+
+// BC7
+
+void put_bits(uint8_t* out, int* position, uint32_t value, int count) {
+    for (int i = 0; i < count; i++, (*position)++)
+        if ((value >> i) & 1)
+            out[*position >> 3] |= 1 << (*position & 7);
+}
+
+// Seven bits per channel plus a parity bit shared by all four, whichever parity lands closer
+void quantize_bc7_endpoint(int* quantized, int* parity, const float* endpoint) {
+    float best_error = INFINITY;
+
+    for (int p = 0; p < 2; p++) {
+        int q[4];
+        float error = 0.0f;
+
+        for (int c = 0; c < 4; c++) {
+            int value = (int)floorf((endpoint[c] - p) * 0.5f + 0.5f);
+            q[c] = value < 0 ? 0 : value > 127 ? 127 : value;
+
+            float d = (float)(q[c] << 1 | p) - endpoint[c];
+            error += d * d;
+        }
+
+        if (error < best_error) {
+            best_error = error;
+            memcpy(quantized, q, sizeof(q));
+            *parity = p;
+        }
+    }
+}
+
+float bc7_indices(const int* q0, int p0, const int* q1, int p1, int* indices, float colors[16][4], float* weights) {
+    float palette[16][4];
+
+    for (int j = 0; j < 16; j++)
+        for (int c = 0; c < 4; c++)
+            palette[j][c] =
+                (float)(((64 - bc7_weights[j]) * (q0[c] << 1 | p0) + bc7_weights[j] * (q1[c] << 1 | p1) + 32) >> 6);
+
+    float axis[4], length = 0.0f;
+    for (int c = 0; c < 4; c++) {
+        axis[c] = palette[15][c] - palette[0][c];
+        length += axis[c] * axis[c];
+    }
+
+    length = length > 0.0f ? 1.0f / length : 0.0f;
+
+    float error = 0.0f;
+
+    for (int i = 0; i < 16; i++) {
+        // Projecting onto the segment lands next to the nearest entry, only its neighbours need checking
+        float t = 0.0f;
+        for (int c = 0; c < 4; c++)
+            t += (colors[i][c] - palette[0][c]) * axis[c];
+
+        float weight = t * length * 64.0f;
+
+        int guess = 0;
+        while (guess < 15 && (bc7_weights[guess] + bc7_weights[guess + 1]) * 0.5f < weight)
+            guess++;
+
+        int best = 0;
+        float best_error = INFINITY;
+
+        for (int j = guess > 0 ? guess - 1 : 0; j <= guess + 1 && j < 16; j++) {
+            float e = 0.0f;
+            for (int c = 0; c < 4; c++)
+                e += (colors[i][c] - palette[j][c]) * (colors[i][c] - palette[j][c]);
+
+            if (e < best_error) {
+                best = j;
+                best_error = e;
+            }
+        }
+
+        indices[i] = best;
+        weights[i] = 1.0f - bc7_weights[best] / 64.0f;
+        error += best_error;
+    }
+
+    return error;
+}
+
+void encode_bc7_block(uint8_t* out, const uint8_t* pixels, size_t stride) {
+    float colors[16][4], e0[4], e1[4], weights[16], refined_weights[16];
+    load_block(colors, pixels, stride);
+    fit_endpoints(e0, e1, colors, 4);
+
+    int q0[4], q1[4], p0, p1, indices[16];
+    quantize_bc7_endpoint(q0, &p0, e0);
+    quantize_bc7_endpoint(q1, &p1, e1);
+
+    float error = bc7_indices(q0, p0, q1, p1, indices, colors, weights);
+
+    if (refine_endpoints(e0, e1, colors, weights, 4)) {
+        int r0[4], r1[4], rp0, rp1, refined[16];
+        quantize_bc7_endpoint(r0, &rp0, e0);
+        quantize_bc7_endpoint(r1, &rp1, e1);
+
+        if (bc7_indices(r0, rp0, r1, rp1, refined, colors, refined_weights) < error) {
+            memcpy(q0, r0, sizeof(r0));
+            memcpy(q1, r1, sizeof(r1));
+            memcpy(indices, refined, sizeof(refined));
+            p0 = rp0;
+            p1 = rp1;
+        }
+    }
+
+    // The first index is stored without its top bit, so it must be below 8
+    if (indices[0] >= 8) {
+        int swap[4];
+        memcpy(swap, q0, sizeof(swap));
+        memcpy(q0, q1, sizeof(swap));
+        memcpy(q1, swap, sizeof(swap));
+
+        int parity = p0;
+        p0 = p1;
+        p1 = parity;
+
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(out, 0, 16);
+    int position = 0;
+
+    // Mode 6, a single subset with RGBA endpoints and four bit indices
+    put_bits(out, &position, 1 << 6, 7);
+
+    for (int c = 0; c < 4; c++) {
+        put_bits(out, &position, q0[c], 7);
+        put_bits(out, &position, q1[c], 7);
+    }
+
+    put_bits(out, &position, p0, 1);
+    put_bits(out, &position, p1, 1);
+
+    put_bits(out, &position, indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        put_bits(out, &position, indices[i], 4);
+}
+
+// Images
+
+struct _compress_job_t {
+    uint8_t* out;
+    const uint8_t* pixels;
+    int width, height, format;
+};
+
+typedef struct _compress_job_t compress_job_t;
+
+void compress_rows(void* data, uint32_t begin, uint32_t end) {
+    compress_job_t* job = data;
+
+    int blocks_x = (job->width + 3) / 4;
+    size_t block_bytes = bcn_block_bytes(job->format);
+    size_t pitch = (size_t)job->width * 4;
+
+    for (uint32_t by = begin; by < end; by++) {
+        uint8_t* out = job->out + (size_t)by * blocks_x * block_bytes;
+
+        for (int bx = 0; bx < blocks_x; bx++, out += block_bytes) {
+            const uint8_t* block = job->pixels + by * 4 * pitch + bx * 16;
+            size_t stride = pitch;
+
+            // Partial blocks at the right and bottom edges are padded by repeating the last texels
+            uint8_t padded[64];
+
+            if (bx * 4 + 4 > job->width || (int)by * 4 + 4 > job->height) {
+                for (int y = 0; y < 4; y++) {
+                    int sy = (int)by * 4 + y < job->height ? (int)by * 4 + y : job->height - 1;
+
+                    for (int x = 0; x < 4; x++) {
+                        int sx = bx * 4 + x < job->width ? bx * 4 + x : job->width - 1;
+                        memcpy(padded + y * 16 + x * 4, job->pixels + sy * pitch + sx * 4, 4);
+                    }
+                }
+
+                block = padded;
+                stride = 16;
+            }
+
+            switch (job->format) {
+            case BCN_BC1:
+                encode_bc1_block(out, block, stride);
+                break;
+            case BCN_BC3:
+                encode_bc4_block(out, block, stride, 3);
+                encode_bc1_block(out + 8, block, stride);
+                break;
+            case BCN_BC5:
+                encode_bc4_block(out, block, stride, 0);
+                encode_bc4_block(out + 8, block, stride, 1);
+                break;
+            case BCN_BC7:
+                encode_bc7_block(out, block, stride);
+                break;
+            }
+        }
+    }
+}
+
+void compress_image(uint8_t* out, const uint8_t* pixels, int width, int height, int format) {
+    compress_job_t job = {out, pixels, width, height, format};
+    parallel_for((height + 3) / 4, 4, compress_rows, &job);
+}
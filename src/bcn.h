@@ -0,0 +1,30 @@
+#ifndef BCN_H
+#define BCN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Block compressed formats, every one encodes a 4x4 pixel block
+enum {
+    // RGB at 4 bits per pixel, alpha is dropped
+    BCN_BC1,
+    // BC1 colour plus a BC4 alpha block, 8 bits per pixel
+    BCN_BC3,
+    // Two BC4 blocks for red and green, meant for normal maps and other two channel data
+    BCN_BC5,
+    // RGBA at 8 bits per pixel, only mode 6 is emitted
+    BCN_BC7,
+};
+
+size_t bcn_block_bytes(int format);
+size_t bcn_size(int format, int width, int height);
+
+// pixels is RGBA8, the 16 texels of a block are row major with rows stride bytes apart
+void encode_bc1_block(uint8_t* out, const uint8_t* pixels, size_t stride);
+void encode_bc4_block(uint8_t* out, const uint8_t* pixels, size_t stride, int channel);
+void encode_bc7_block(uint8_t* out, const uint8_t* pixels, size_t stride);
+
+// Encodes a whole image in parallel over block rows, edge blocks repeat the last row and column
+void compress_image(uint8_t* out, const uint8_t* pixels, int width, int height, int format);
+
+#endif  // BCN_H
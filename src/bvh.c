@@ -0,0 +1,428 @@
+#include "bvh.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "glfw.h"
+
+struct _bvh_bin_t {
+    vec3 min, max;
+    uint32_t count;
+};
+
+typedef struct _bvh_bin_t bvh_bin_t;
+
+float aabb_area(const vec3 min, const vec3 max) {
+    vec3 d;
+    vec3_sub(d, max, min);
+
+    if (d[0] < 0.0f || d[1] < 0.0f || d[2] < 0.0f)
+        return 0.0f;
+
+    return 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+}
+
+void aabb_empty(vec3 min, vec3 max) {
+    for (int i = 0; i < 3; i++) {
+        min[i] = 1e30f;
+        max[i] = -1e30f;
+    }
+}
+
+void aabb_grow(vec3 min, vec3 max, const vec3 other_min, const vec3 other_max) {
+    for (int i = 0; i < 3; i++) {
+        min[i] = other_min[i] < min[i] ? other_min[i] : min[i];
+        max[i] = other_max[i] > max[i] ? other_max[i] : max[i];
+    }
+}
+
+void init_scene_bvh(scene_bvh_t* bvh) {
+    memset(bvh, 0, sizeof(scene_bvh_t));
+}
+
+void free_scene_bvh(scene_bvh_t* bvh) {
+    free(bvh->nodes);
+    free(bvh->items);
+    free(bvh->item_min);
+    free(bvh->item_max);
+
+    memset(bvh, 0, sizeof(scene_bvh_t));
+}
+
+float scene_bvh_cost(const scene_bvh_t* bvh) {
+    if (bvh->nodes_n == 0)
+        return 0.0f;
+
+    float cost = 0.0f;
+
+    for (uint32_t i = 0; i < bvh->nodes_n; i++) {
+        const bvh_node_t* node = &bvh->nodes[i];
+        cost += aabb_area(node->min, node->max) * (node->child ? 1 : node->count);
+    }
+
+    float root = aabb_area(bvh->nodes[0].min, bvh->nodes[0].max);
+    return root > 0.0f ? cost / root : 0.0f;
+}
+
+void compute_node_bounds(bvh_node_t* node, const uint32_t* items, const vec3* item_min, const vec3* item_max) {
+    aabb_empty(node->min, node->max);
+
+    for (uint32_t i = 0; i < node->count; i++) {
+        uint32_t item = items[node->first + i];
+        aabb_grow(node->min, node->max, item_min[item], item_max[item]);
+    }
+}
+
+// Best binned SAH split over all three axes, returns 0 if there is no usable split
+int find_split(const bvh_node_t* node, const uint32_t* items, const vec3* item_min, const vec3* item_max,
+               int* split_axis, float* split_pos, float* split_cost) {
+    vec3 centroid_min, centroid_max;
+    aabb_empty(centroid_min, centroid_max);
+
+    for (uint32_t i = 0; i < node->count; i++) {
+        uint32_t item = items[node->first + i];
+
+        vec3 centroid;
+        vec3_add(centroid, item_min[item], item_max[item]);
+        vec3_scale(centroid, centroid, 0.5f);
+
+        aabb_grow(centroid_min, centroid_max, centroid, centroid);
+    }
+
+    int found = 0;
+    *split_cost = 1e30f;
+
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = centroid_max[axis] - centroid_min[axis];
+        if (extent <= 0.0f)
+            continue;
+
+        bvh_bin_t bins[BVH_BINS];
+        for (int i = 0; i < BVH_BINS; i++) {
+            aabb_empty(bins[i].min, bins[i].max);
+            bins[i].count = 0;
+        }
+
+        float scale = BVH_BINS / extent;
+
+        for (uint32_t i = 0; i < node->count; i++) {
+            uint32_t item = items[node->first + i];
+            float centroid = (item_min[item][axis] + item_max[item][axis]) * 0.5f;
+
+            int bin = (int)((centroid - centroid_min[axis]) * scale);
+            bin = bin < BVH_BINS - 1 ? bin : BVH_BINS - 1;
+
+            aabb_grow(bins[bin].min, bins[bin].max, item_min[item], item_max[item]);
+            bins[bin].count++;
+        }
+
+        // Sweep from the left, then from the right accumulating the cost of each plane
+        float left_area[BVH_BINS - 1];
+        uint32_t left_count[BVH_BINS - 1];
+
+        vec3 min, max;
+        aabb_empty(min, max);
+        uint32_t count = 0;
+
+        for (int i = 0; i < BVH_BINS - 1; i++) {
+            aabb_grow(min, max, bins[i].min, bins[i].max);
+            count += bins[i].count;
+
+            left_area[i] = aabb_area(min, max);
+            left_count[i] = count;
+        }
+
+        aabb_empty(min, max);
+        count = 0;
+
+        for (int i = BVH_BINS - 1; i > 0; i--) {
+            aabb_grow(min, max, bins[i].min, bins[i].max);
+            count += bins[i].count;
+
+            if (left_count[i - 1] == 0 || count == 0)
+                continue;
+
+            float cost = left_area[i - 1] * left_count[i - 1] + aabb_area(min, max) * count;
+            if (cost < *split_cost) {
+                *split_cost = cost;
+                *split_axis = axis;
+                *split_pos = centroid_min[axis] + i / scale;
+                found = 1;
+            }
+        }
+    }
+
+    return found;
+}
+
+uint32_t build_bvh_nodes(bvh_node_t* nodes, uint32_t* items, const vec3* item_min, const vec3* item_max, uint32_t n) {
+    if (n == 0)
+        return 0;
+
+    nodes[0].first = 0;
+    nodes[0].count = n;
+    nodes[0].child = 0;
+    uint32_t nodes_n = 1;
+
+    struct {
+        uint32_t node, depth;
+    } stack[BVH_MAX_DEPTH + 1];
+    int top = 0;
+
+    stack[top].node = 0;
+    stack[top++].depth = 0;
+
+    while (top > 0) {
+        top--;
+        uint32_t depth = stack[top].depth;
+        bvh_node_t* node = &nodes[stack[top].node];
+
+        compute_node_bounds(node, items, item_min, item_max);
+
+        if (node->count <= 1 || depth >= BVH_MAX_DEPTH - 1)
+            continue;
+
+        int axis;
+        float position, cost;
+        if (!find_split(node, items, item_min, item_max, &axis, &position, &cost))
+            continue;
+
+        // Small nodes only split when it is cheaper than testing everything in them
+        float leaf_cost = aabb_area(node->min, node->max) * node->count;
+        if (node->count <= BVH_LEAF_SIZE && cost >= leaf_cost)
+            continue;
+
+        uint32_t* range = items + node->first;
+        uint32_t i = 0, j = node->count;
+
+        while (i < j) {
+            uint32_t item = range[i];
+
+            if ((item_min[item][axis] + item_max[item][axis]) * 0.5f < position) {
+                i++;
+            } else {
+                range[i] = range[--j];
+                range[j] = item;
+            }
+        }
+
+        if (i == 0 || i == node->count)
+            continue;
+
+        uint32_t left = nodes_n;
+        nodes_n += 2;
+
+        nodes[left].first = node->first;
+        nodes[left].count = i;
+        nodes[left].child = 0;
+        nodes[left + 1].first = node->first + i;
+        nodes[left + 1].count = node->count - i;
+        nodes[left + 1].child = 0;
+
+        node->child = left;
+
+        for (int k = 0; k < 2; k++) {
+            stack[top].node = left + k;
+            stack[top++].depth = depth + 1;
+        }
+    }
+
+    return nodes_n;
+}
+
+void build_scene_bvh(scene_bvh_t* bvh, const vec3* min, const vec3* max, uint32_t n) {
+    double start = glfwGetTime();
+
+    if (n > bvh->capacity) {
+        bvh->items = realloc(bvh->items, sizeof(uint32_t) * n);
+        bvh->item_min = realloc(bvh->item_min, sizeof(vec3) * n);
+        bvh->item_max = realloc(bvh->item_max, sizeof(vec3) * n);
+        bvh->nodes = realloc(bvh->nodes, sizeof(bvh_node_t) * n * 2);
+
+        bvh->capacity = n;
+    }
+
+    memcpy(bvh->item_min, min, sizeof(vec3) * n);
+    memcpy(bvh->item_max, max, sizeof(vec3) * n);
+
+    for (uint32_t i = 0; i < n; i++)
+        bvh->items[i] = i;
+
+    bvh->items_n = n;
+    bvh->nodes_n = build_bvh_nodes(bvh->nodes, bvh->items, bvh->item_min, bvh->item_max, n);
+
+    bvh->built_cost = bvh->cost = scene_bvh_cost(bvh);
+
+    bvh->builds++;
+    bvh->build_time = glfwGetTime() - start;
+}
+
+void refit_scene_bvh(scene_bvh_t* bvh, const vec3* min, const vec3* max) {
+    double start = glfwGetTime();
+
+    memcpy(bvh->item_min, min, sizeof(vec3) * bvh->items_n);
+    memcpy(bvh->item_max, max, sizeof(vec3) * bvh->items_n);
+
+    // Children always come after their parent, so a reverse pass sees them first
+    for (uint32_t i = bvh->nodes_n; i-- > 0;) {
+        bvh_node_t* node = &bvh->nodes[i];
+
+        if (!node->child) {
+            compute_node_bounds(node, bvh->items, bvh->item_min, bvh->item_max);
+        } else {
+            const bvh_node_t* left = &bvh->nodes[node->child];
+            const bvh_node_t* right = &bvh->nodes[node->child + 1];
+
+            vec3_copy(node->min, left->min);
+            vec3_copy(node->max, left->max);
+            aabb_grow(node->min, node->max, right->min, right->max);
+        }
+    }
+
+    bvh->cost = scene_bvh_cost(bvh);
+
+    bvh->refits++;
+    bvh->refit_time = glfwGetTime() - start;
+}
+
+void update_scene_bvh(scene_bvh_t* bvh, const vec3* min, const vec3* max, uint32_t n) {
+    if (n != bvh->items_n || bvh->nodes_n == 0) {
+        build_scene_bvh(bvh, min, max, n);
+        return;
+    }
+
+    refit_scene_bvh(bvh, min, max);
+
+    if (bvh->cost > bvh->built_cost * BVH_REBUILD_RATIO)
+        build_scene_bvh(bvh, min, max, n);
+}
+
+void cull_scene_bvh(const scene_bvh_t* bvh, const frustum_t* frustum, uint8_t* visible) {
+    memset(visible, 0, bvh->items_n);
+
+    if (bvh->nodes_n == 0)
+        return;
+
+    struct {
+        uint32_t node;
+        unsigned int mask;
+    } stack[BVH_MAX_DEPTH + 1];
+    int top = 0;
+
+    stack[top].node = 0;
+    stack[top++].mask = FRUSTUM_ALL_PLANES;
+
+    while (top > 0) {
+        top--;
+        const bvh_node_t* node = &bvh->nodes[stack[top].node];
+        unsigned int mask = stack[top].mask;
+
+        int result = frustum_classify_aabb(frustum, node->min, node->max, &mask);
+        if (result == FRUSTUM_OUTSIDE)
+            continue;
+
+        // Leaves and subtrees entirely inside accept their whole item range without visiting the nodes below
+        if (!node->child || result == FRUSTUM_INSIDE) {
+            for (uint32_t i = 0; i < node->count; i++)
+                visible[bvh->items[node->first + i]] = 1;
+        } else {
+            for (int k = 0; k < 2; k++) {
+                stack[top].node = node->child + k;
+                stack[top++].mask = mask;
+            }
+        }
+    }
+}
+
+int ray_aabb(const vec3 origin, const vec3 inv_dir, const vec3 min, const vec3 max, float max_t, float* t) {
+    float entry = 0.0f, exit_t = max_t;
+
+    for (int i = 0; i < 3; i++) {
+        float a = (min[i] - origin[i]) * inv_dir[i];
+        float b = (max[i] - origin[i]) * inv_dir[i];
+
+        if (a > b) {
+            float swap = a;
+            a = b;
+            b = swap;
+        }
+
+        entry = a > entry ? a : entry;
+        exit_t = b < exit_t ? b : exit_t;
+
+        if (entry > exit_t)
+            return 0;
+    }
+
+    *t = entry;
+    return 1;
+}
+
+int raycast_scene_bvh(const scene_bvh_t* bvh, const vec3 origin, const vec3 dir, float max_t, bvh_hit_func_t hit,
+                      void* data, float* t) {
+    if (bvh->nodes_n == 0)
+        return -1;
+
+    vec3 inv_dir = {1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2]};
+
+    int result = -1;
+    float best = max_t;
+
+    uint32_t stack[BVH_MAX_DEPTH + 1];
+    int top = 0;
+
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const bvh_node_t* node = &bvh->nodes[stack[--top]];
+
+        float entry;
+        if (!ray_aabb(origin, inv_dir, node->min, node->max, best, &entry))
+            continue;
+
+        if (!node->child) {
+            for (uint32_t i = 0; i < node->count; i++) {
+                uint32_t item = bvh->items[node->first + i];
+                float item_t = best;
+
+                if (hit != NULL) {
+                    if (!hit(data, item, origin, dir, &item_t))
+                        continue;
+                } else if (!ray_aabb(origin, inv_dir, bvh->item_min[item], bvh->item_max[item], best, &item_t)) {
+                    continue;
+                }
+
+                if (item_t < best) {
+                    best = item_t;
+                    result = item;
+                }
+            }
+
+            continue;
+        }
+
+        // Push the far child first so the near one is visited first and shrinks the range for the other
+        const bvh_node_t* left = &bvh->nodes[node->child];
+        const bvh_node_t* right = &bvh->nodes[node->child + 1];
+
+        float left_t, right_t;
+        int left_hit = ray_aabb(origin, inv_dir, left->min, left->max, best, &left_t);
+        int right_hit = ray_aabb(origin, inv_dir, right->min, right->max, best, &right_t);
+
+        if (left_hit && right_hit) {
+            int left_first = left_t <= right_t;
+
+            stack[top++] = node->child + left_first;
+            stack[top++] = node->child + !left_first;
+        } else if (left_hit) {
+            stack[top++] = node->child;
+        } else if (right_hit) {
+            stack[top++] = node->child + 1;
+        }
+    }
+
+    if (result >= 0 && t != NULL)
+        *t = best;
+
+    return result;
+}
@@ -0,0 +1,75 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <stdint.h>
+
+#include "frustum.h"
+#include "linmath.h"
+
+#define BVH_BINS 16
+#define BVH_LEAF_SIZE 4
+
+// Keeps traversal stacks fixed size, nodes this deep become leaves regardless of size
+#define BVH_MAX_DEPTH 64
+
+// Rebuild once refitting has made the tree this much worse than when it was built
+#define BVH_REBUILD_RATIO 1.5f
+
+// Every node covers the items from first to first + count in leaf order. Children of an interior node are stored
+// next to each other starting at child, which is 0 for leaves since the root is never a child.
+struct _bvh_node_t {
+    vec3 min;
+    uint32_t first;
+    vec3 max;
+    uint32_t count;
+    uint32_t child;
+};
+
+struct _scene_bvh_t {
+    struct _bvh_node_t* nodes;
+    uint32_t nodes_n;
+
+    // Item indices in leaf order and the bounds they were last built or refit with
+    uint32_t* items;
+    vec3 *item_min, *item_max;
+    uint32_t items_n, capacity;
+
+    // SAH cost relative to the root, at build time and after the last refit
+    float built_cost, cost;
+
+    uint32_t builds, refits;
+    double build_time, refit_time;
+};
+
+// Returns 1 and the distance along the ray if the item is hit closer than *t
+typedef int (*bvh_hit_func_t)(void* data, uint32_t item, const vec3 origin, const vec3 dir, float* t);
+
+typedef struct _bvh_node_t bvh_node_t;
+typedef struct _scene_bvh_t scene_bvh_t;
+
+// Binary SAH build over items, reordering them into leaf order, returns the node count (at most 2n - 1)
+uint32_t build_bvh_nodes(bvh_node_t* nodes, uint32_t* items, const vec3* item_min, const vec3* item_max, uint32_t n);
+
+float aabb_area(const vec3 min, const vec3 max);
+void aabb_empty(vec3 min, vec3 max);
+void aabb_grow(vec3 min, vec3 max, const vec3 other_min, const vec3 other_max);
+
+void init_scene_bvh(scene_bvh_t* bvh);
+void free_scene_bvh(scene_bvh_t* bvh);
+
+void build_scene_bvh(scene_bvh_t* bvh, const vec3* min, const vec3* max, uint32_t n);
+void refit_scene_bvh(scene_bvh_t* bvh, const vec3* min, const vec3* max);
+
+// Refits, rebuilding instead when the item count changed or the tree has degraded
+void update_scene_bvh(scene_bvh_t* bvh, const vec3* min, const vec3* max, uint32_t n);
+
+// Sets visible[item] for every item, whole subtrees inside the frustum are accepted without further tests
+void cull_scene_bvh(const scene_bvh_t* bvh, const frustum_t* frustum, uint8_t* visible);
+
+// Closest item along the ray or -1, hit refines box hits into exact ones and may be NULL
+int raycast_scene_bvh(const scene_bvh_t* bvh, const vec3 origin, const vec3 dir, float max_t, bvh_hit_func_t hit,
+                      void* data, float* t);
+
+int ray_aabb(const vec3 origin, const vec3 inv_dir, const vec3 min, const vec3 max, float max_t, float* t);
+
+#endif  // BVH_H
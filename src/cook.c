@@ -0,0 +1,642 @@
+#include "cook.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "job.h"
+#include "simplify.h"
+
+submodel_t** finalise_submodel(model_data_t* data, submodel_t* submodel);
+
+struct _vertex_coding_t {
+    float* vertices;
+    cooked_vertex_t* cooked;
+    const quantization_t* quantization;
+};
+
+struct _cache_optimize_t {
+    model_data_t* data;
+
+    // First index and count of each run of triangles that is reordered on its own
+    uint32_t* ranges;
+};
+
+typedef struct _vertex_coding_t vertex_coding_t;
+typedef struct _cache_optimize_t cache_optimize_t;
+
+uint32_t weld_vertices(model_data_t* data) {
+    uint32_t vertices_n = data->vertices_n;
+
+    uint32_t size = 1;
+    while (size < vertices_n * 2)
+        size <<= 1;
+
+    uint32_t* table = malloc(sizeof(uint32_t) * size);
+    memset(table, 0xff, sizeof(uint32_t) * size);
+
+    uint32_t* ids = malloc(sizeof(uint32_t) * (vertices_n + 1));
+    uint32_t* remap = malloc(sizeof(uint32_t) * (vertices_n + 1));
+    uint32_t unique_n = 0;
+
+    for (uint32_t i = 0; i < vertices_n; i++)
+        remap[i] = dedupe(table, size - 1, data->vertices, 8, 8, i, ids, &unique_n);
+
+    // Each kept vertex is the first of its kind, so moving them down never overwrites one still to come
+    for (uint32_t i = 0; i < unique_n; i++)
+        memmove(data->vertices + i * 8, data->vertices + ids[i] * 8, sizeof(float) * 8);
+
+    for (size_t i = 0; i < data->indices_n; i++)
+        data->indices[i] = remap[data->indices[i]];
+
+    data->vertices = realloc(data->vertices, sizeof(float) * 8 * (unique_n + 1));
+    data->vertices_n = unique_n;
+
+    free(table);
+    free(ids);
+    free(remap);
+
+    return unique_n;
+}
+
+// Tipsify, Sander et al. 2007. Fans out from one vertex at a time and moves on to a vertex of the fan that will still
+// be in the cache, falling back to recently used vertices and then to the next one with triangles left.
+void tipsify(uint32_t* out, const uint32_t* indices, uint32_t count, uint32_t vertices_n, const uint32_t* globals) {
+    uint32_t triangles_n = count / 3;
+
+    // Triangles around each vertex, vertex v's run ends where v + 1's starts
+    uint32_t* live = calloc(vertices_n + 1, sizeof(uint32_t));
+    uint32_t* offsets = calloc(vertices_n + 1, sizeof(uint32_t));
+    uint32_t* adjacency = malloc(sizeof(uint32_t) * (triangles_n * 3 + 1));
+
+    for (uint32_t i = 0; i < triangles_n * 3; i++)
+        live[indices[i]]++;
+
+    for (uint32_t v = 0; v < vertices_n; v++)
+        offsets[v + 1] = offsets[v] + live[v];
+
+    for (uint32_t i = 0; i < triangles_n * 3; i++)
+        adjacency[offsets[indices[i]]++] = i / 3;
+
+    // Filling moved every offset to the start of the next run
+    for (uint32_t v = vertices_n; v > 0; v--)
+        offsets[v] = offsets[v - 1];
+
+    offsets[0] = 0;
+
+    uint32_t* timestamps = calloc(vertices_n + 1, sizeof(uint32_t));
+    uint8_t* emitted = calloc(triangles_n + 1, 1);
+    uint32_t* dead_end = malloc(sizeof(uint32_t) * (triangles_n * 3 + 1));
+    uint32_t* candidates = malloc(sizeof(uint32_t) * (triangles_n * 3 + 1));
+
+    uint32_t time = COOK_CACHE_SIZE + 1, cursor = 0, written = 0, dead_n = 0;
+    uint32_t fan = vertices_n > 0 ? 0 : SIMPLIFY_NONE;
+
+    while (fan != SIMPLIFY_NONE) {
+        uint32_t candidates_n = 0;
+
+        for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; a++) {
+            uint32_t triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = indices[triangle * 3 + k];
+
+                out[written++] = globals[v];
+                dead_end[dead_n++] = v;
+                candidates[candidates_n++] = v;
+                live[v]--;
+
+                if (time - timestamps[v] > COOK_CACHE_SIZE)
+                    timestamps[v] = time++;
+            }
+
+            emitted[triangle] = 1;
+        }
+
+        // Prefer the candidate that has been in the cache longest and will still be there after its own fan
+        fan = SIMPLIFY_NONE;
+        int64_t best = -1;
+
+        for (uint32_t i = 0; i < candidates_n; i++) {
+            uint32_t v = candidates[i];
+            if (live[v] == 0)
+                continue;
+
+            int64_t priority = 0;
+            if (time - timestamps[v] + 2 * live[v] <= COOK_CACHE_SIZE)
+                priority = time - timestamps[v];
+
+            if (priority > best) {
+                best = priority;
+                fan = v;
+            }
+        }
+
+        while (fan == SIMPLIFY_NONE && dead_n > 0) {
+            uint32_t v = dead_end[--dead_n];
+            if (live[v] > 0)
+                fan = v;
+        }
+
+        while (fan == SIMPLIFY_NONE && cursor < vertices_n) {
+            if (live[cursor] > 0)
+                fan = cursor;
+
+            cursor++;
+        }
+    }
+
+    free(live);
+    free(offsets);
+    free(adjacency);
+    free(timestamps);
+    free(emitted);
+    free(dead_end);
+    free(candidates);
+}
+
+void tipsify_ranges(void* arg, uint32_t begin, uint32_t end) {
+    cache_optimize_t* optimize = arg;
+    model_data_t* data = optimize->data;
+
+    // Submodels share the vertex buffer, so each is given dense ids of its own
+    uint32_t* local = malloc(sizeof(uint32_t) * (data->vertices_n + 1));
+    memset(local, 0xff, sizeof(uint32_t) * (data->vertices_n + 1));
+
+    for (uint32_t i = begin; i < end; i++) {
+        uint32_t* indices = data->indices + optimize->ranges[i * 2];
+        uint32_t count = optimize->ranges[i * 2 + 1] / 3 * 3;
+
+        uint32_t* globals = malloc(sizeof(uint32_t) * (count + 1));
+        uint32_t* triangles = malloc(sizeof(uint32_t) * (count + 1));
+        uint32_t n = 0;
+
+        for (uint32_t j = 0; j < count; j++) {
+            if (local[indices[j]] == SIMPLIFY_NONE) {
+                local[indices[j]] = n;
+                globals[n++] = indices[j];
+            }
+
+            triangles[j] = local[indices[j]];
+        }
+
+        tipsify(indices, triangles, count, n, globals);
+
+        for (uint32_t j = 0; j < n; j++)
+            local[globals[j]] = SIMPLIFY_NONE;
+
+        free(globals);
+        free(triangles);
+    }
+
+    free(local);
+}
+
+uint32_t cook_meshlets(model_data_t* data) {
+    for (submodel_t* submodel = data->root; submodel != NULL; submodel = submodel->child) {
+        submodel->meshlet_first = data->meshlets_n;
+        submodel->meshlets_n = build_meshlets(&data->meshlets, &data->meshlets_n, data->vertices, 8, data->indices,
+                                              submodel->offset, submodel->count);
+    }
+
+    return data->meshlets_n;
+}
+
+void optimize_vertex_cache(model_data_t* data) {
+    uint32_t submodels_n, ranges_n;
+    submodel_t** submodels = list_submodels(data, &submodels_n);
+
+    // Meshlets are culled as a whole, so triangles must not move between them
+    ranges_n = data->meshlets != NULL ? data->meshlets_n : submodels_n;
+    uint32_t* ranges = malloc(sizeof(uint32_t) * (ranges_n * 2 + 1));
+
+    for (uint32_t i = 0; i < ranges_n; i++) {
+        ranges[i * 2] = data->meshlets != NULL ? data->meshlets[i].first : submodels[i]->offset;
+        ranges[i * 2 + 1] = data->meshlets != NULL ? data->meshlets[i].count : submodels[i]->count;
+    }
+
+    cache_optimize_t optimize = {data, ranges};
+    parallel_for(ranges_n, data->meshlets != NULL ? 64 : 1, tipsify_ranges, &optimize);
+
+    free(ranges);
+    free(submodels);
+
+    // Vertices in the order the indices first reach them, unused ones dropped
+    uint32_t* remap = malloc(sizeof(uint32_t) * (data->vertices_n + 1));
+    memset(remap, 0xff, sizeof(uint32_t) * (data->vertices_n + 1));
+
+    float* vertices = malloc(sizeof(float) * 8 * (data->vertices_n + 1));
+    uint32_t next = 0;
+
+    for (size_t i = 0; i < data->indices_n; i++) {
+        uint32_t v = data->indices[i];
+
+        if (remap[v] == SIMPLIFY_NONE) {
+            remap[v] = next;
+            memcpy(vertices + next * 8, data->vertices + v * 8, sizeof(float) * 8);
+            next++;
+        }
+
+        data->indices[i] = remap[v];
+    }
+
+    free(data->vertices);
+    free(remap);
+
+    data->vertices = vertices;
+    data->vertices_n = next;
+}
+
+float vertex_cache_misses(const model_data_t* data, uint32_t cache_size) {
+    // A vertex is still cached while fewer than cache_size misses have come after its own
+    uint32_t* inserted = malloc(sizeof(uint32_t) * (data->vertices_n + 1));
+    memset(inserted, 0xff, sizeof(uint32_t) * (data->vertices_n + 1));
+
+    uint64_t misses = 0, triangles = 0;
+
+    for (submodel_t* submodel = data->root; submodel != NULL; submodel = submodel->child) {
+        for (uint32_t i = submodel->offset; i < submodel->offset + submodel->count; i++) {
+            uint32_t v = data->indices[i];
+
+            if (inserted[v] == SIMPLIFY_NONE || misses - inserted[v] >= cache_size)
+                inserted[v] = misses++;
+        }
+
+        triangles += submodel->count / 3;
+    }
+
+    free(inserted);
+    return triangles > 0 ? (float)misses / triangles : 0.0f;
+}
+
+uint16_t encode_unorm16(float x, float min, float scale) {
+    if (!(scale > 0.0f))
+        return 0;
+
+    float q = (x - min) / scale + 0.5f;
+    return q < 0.0f ? 0 : q > 65535.0f ? 65535 : (uint16_t)q;
+}
+
+int16_t encode_snorm16(float x) {
+    x = x < -1.0f ? -1.0f : x > 1.0f ? 1.0f : x;
+    return (int16_t)lrintf(x * 32767.0f);
+}
+
+void encode_vertices(void* arg, uint32_t begin, uint32_t end) {
+    vertex_coding_t* coding = arg;
+    const quantization_t* q = coding->quantization;
+
+    for (uint32_t i = begin; i < end; i++) {
+        const float* vertex = coding->vertices + i * 8;
+        cooked_vertex_t* cooked = &coding->cooked[i];
+
+        for (int k = 0; k < 3; k++) {
+            cooked->position[k] = encode_unorm16(vertex[k], q->position_min[k], q->position_scale[k]);
+            cooked->normal[k] = encode_snorm16(vertex[3 + k]);
+        }
+
+        for (int k = 0; k < 2; k++)
+            cooked->uv[k] = encode_unorm16(vertex[6 + k], q->uv_min[k], q->uv_scale[k]);
+    }
+}
+
+void decode_vertices(void* arg, uint32_t begin, uint32_t end) {
+    vertex_coding_t* coding = arg;
+    const quantization_t* q = coding->quantization;
+
+    for (uint32_t i = begin; i < end; i++) {
+        float* vertex = coding->vertices + i * 8;
+        const cooked_vertex_t* cooked = &coding->cooked[i];
+
+        for (int k = 0; k < 3; k++) {
+            vertex[k] = q->position_min[k] + cooked->position[k] * q->position_scale[k];
+            vertex[3 + k] = cooked->normal[k] / 32767.0f;
+        }
+
+        for (int k = 0; k < 2; k++)
+            vertex[6 + k] = q->uv_min[k] + cooked->uv[k] * q->uv_scale[k];
+    }
+}
+
+cooked_vertex_t* quantize_vertices(model_data_t* data, quantization_t* quantization) {
+    float low[8], high[8];
+
+    for (int k = 0; k < 8; k++) {
+        low[k] = data->vertices_n > 0 ? data->vertices[k] : 0.0f;
+        high[k] = low[k];
+    }
+
+    for (size_t i = 0; i < data->vertices_n; i++) {
+        for (int k = 0; k < 8; k++) {
+            float x = data->vertices[i * 8 + k];
+
+            low[k] = x < low[k] ? x : low[k];
+            high[k] = x > high[k] ? x : high[k];
+        }
+    }
+
+    for (int k = 0; k < 3; k++) {
+        quantization->position_min[k] = low[k];
+        quantization->position_scale[k] = (high[k] - low[k]) / 65535.0f;
+    }
+
+    for (int k = 0; k < 2; k++) {
+        quantization->uv_min[k] = low[6 + k];
+        quantization->uv_scale[k] = (high[6 + k] - low[6 + k]) / 65535.0f;
+    }
+
+    vertex_coding_t coding = {data->vertices, malloc(sizeof(cooked_vertex_t) * (data->vertices_n + 1)), quantization};
+
+    parallel_for(data->vertices_n, 4096, encode_vertices, &coding);
+    parallel_for(data->vertices_n, 4096, decode_vertices, &coding);
+
+    return coding.cooked;
+}
+
+uint64_t align_section(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+void bound_meshlets(model_data_t* data) {
+    for (uint32_t i = 0; i < data->meshlets_n; i++)
+        compute_meshlet_bounds(&data->meshlets[i], data->vertices, 8, data->indices);
+}
+
+size_t write_cooked_model(const char* path, const model_data_t* data, const cooked_vertex_t* vertices,
+                          const quantization_t* quantization, const struct stat* source) {
+    uint32_t submodels_n;
+    submodel_t** submodels = list_submodels(data, &submodels_n);
+
+    cooked_submodel_t* cooked_submodels = calloc(submodels_n + 1, sizeof(cooked_submodel_t));
+    cooked_material_t* cooked_materials = calloc(data->materials_n + 1, sizeof(cooked_material_t));
+
+    for (uint32_t i = 0; i < submodels_n; i++) {
+        const submodel_t* submodel = submodels[i];
+        cooked_submodel_t* cooked = &cooked_submodels[i];
+
+        cooked->offset = submodel->offset;
+        cooked->count = submodel->count;
+        cooked->lods_n = submodel->lods_n;
+        cooked->material = submodel->material;
+        cooked->meshlet_first = submodel->meshlet_first;
+        cooked->meshlets_n = submodel->meshlets_n;
+        cooked->uv_extent = submodel->uv_extent;
+
+        memcpy(cooked->lod_offset, submodel->lod_offset, sizeof(cooked->lod_offset));
+        memcpy(cooked->lod_count, submodel->lod_count, sizeof(cooked->lod_count));
+        memcpy(cooked->bbox_min, submodel->bbox_min, sizeof(cooked->bbox_min));
+        memcpy(cooked->bbox_max, submodel->bbox_max, sizeof(cooked->bbox_max));
+    }
+
+    uint64_t strings_size = 0;
+
+    for (uint32_t i = 0; i < data->materials_n; i++) {
+        const material_t* material = &data->materials[i];
+        cooked_material_t* cooked = &cooked_materials[i];
+
+        memcpy(cooked->name, material->name, sizeof(cooked->name));
+        cooked->data = material->data;
+        cooked->diffuse_map = UINT32_MAX;
+
+        if (material->diffuse_map != NULL) {
+            cooked->diffuse_map = strings_size;
+            strings_size += strlen(material->diffuse_map) + 1;
+        }
+    }
+
+    cooked_model_header_t header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, "BMDL", 4);
+    header.version = MODEL_COOKED_VERSION;
+    header.source_size = source->st_size;
+    header.source_mtime = source->st_mtime;
+    header.vertices_n = data->vertices_n;
+    header.indices_n = data->indices_n;
+    header.submodels_n = submodels_n;
+    header.materials_n = data->materials_n;
+    header.meshlets_n = data->meshlets_n;
+    header.quantization = *quantization;
+
+    header.vertices_offset = align_section(sizeof(header));
+    header.indices_offset = align_section(header.vertices_offset + sizeof(cooked_vertex_t) * header.vertices_n);
+    header.submodels_offset = align_section(header.indices_offset + sizeof(uint32_t) * header.indices_n);
+    header.materials_offset = align_section(header.submodels_offset + sizeof(cooked_submodel_t) * submodels_n);
+    header.meshlets_offset = align_section(header.materials_offset + sizeof(cooked_material_t) * header.materials_n);
+    header.strings_offset = align_section(header.meshlets_offset + sizeof(meshlet_t) * header.meshlets_n);
+    header.strings_size = strings_size;
+
+    char temporary[MODEL_PATH_MAX + 8];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+
+    // Written aside and renamed so the runtime never maps a partial file
+    static const char zeros[8];
+    FILE* file = fopen(temporary, "wb");
+    int written = file != NULL;
+
+    struct {
+        uint64_t offset;
+        const void* data;
+        size_t size;
+    } sections[] = {
+        {0, &header, sizeof(header)},
+        {header.vertices_offset, vertices, sizeof(cooked_vertex_t) * header.vertices_n},
+        {header.indices_offset, data->indices, sizeof(uint32_t) * header.indices_n},
+        {header.submodels_offset, cooked_submodels, sizeof(cooked_submodel_t) * submodels_n},
+        {header.materials_offset, cooked_materials, sizeof(cooked_material_t) * header.materials_n},
+        {header.meshlets_offset, data->meshlets, sizeof(meshlet_t) * header.meshlets_n},
+    };
+
+    uint64_t position = 0;
+
+    for (size_t i = 0; i < sizeof(sections) / sizeof(sections[0]) && written; i++) {
+        written = fwrite(zeros, 1, sections[i].offset - position, file) == sections[i].offset - position &&
+                  fwrite(sections[i].data, 1, sections[i].size, file) == sections[i].size;
+        position = sections[i].offset + sections[i].size;
+    }
+
+    if (written)
+        written = fwrite(zeros, 1, header.strings_offset - position, file) == header.strings_offset - position;
+
+    for (uint32_t i = 0; i < data->materials_n && written; i++)
+        if (data->materials[i].diffuse_map != NULL)
+            written = fputs(data->materials[i].diffuse_map, file) >= 0 && fputc('\0', file) == 0;
+
+    if (file != NULL)
+        written = fclose(file) == 0 && written;
+
+    free(submodels);
+    free(cooked_submodels);
+    free(cooked_materials);
+
+    if (!written || rename(temporary, path) != 0) {
+        fprintf(stderr, "Failed to write cooked model: %s\n", path);
+        unlink(temporary);
+        return 0;
+    }
+
+    return header.strings_offset + strings_size;
+}
+
+int restamp_cooked_model(const char* path, const struct stat* source) {
+    int fd = open(path, O_RDWR);
+    if (fd < 0)
+        return 0;
+
+    cooked_model_header_t header;
+    int ok = pread(fd, &header, sizeof(header), 0) == sizeof(header) && memcmp(header.magic, "BMDL", 4) == 0 &&
+             header.version == MODEL_COOKED_VERSION;
+
+    if (ok && (header.source_size != (uint64_t)source->st_size || header.source_mtime != source->st_mtime)) {
+        header.source_size = source->st_size;
+        header.source_mtime = source->st_mtime;
+        ok = pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+    }
+
+    close(fd);
+    return ok;
+}
+
+int find_cooked_model(char* out, size_t size, const char* path) {
+    if ((size_t)snprintf(out, size, "%s%s", path, MODEL_COOKED_SUFFIX) >= size)
+        return 0;
+
+    return vfs_packed(out) || access(out, R_OK) == 0;
+}
+
+int section_fits(const vfs_file_t* file, uint64_t offset, uint64_t n, uint64_t size) {
+    return offset <= file->size && n <= (file->size - offset) / size;
+}
+
+int parse_cooked_model(model_data_t* data, const vfs_file_t* file, const char* path) {
+    memset(data, 0, sizeof(model_data_t));
+
+    const cooked_model_header_t* header = (const cooked_model_header_t*)file->data;
+
+    int valid = file->size >= sizeof(cooked_model_header_t) && memcmp(header->magic, "BMDL", 4) == 0 &&
+                header->version == MODEL_COOKED_VERSION && header->materials_n > 0 &&
+                header->vertices_offset % 8 == 0 && header->indices_offset % 8 == 0 &&
+                header->submodels_offset % 8 == 0 && header->materials_offset % 8 == 0 &&
+                header->meshlets_offset % 8 == 0 &&
+                section_fits(file, header->vertices_offset, header->vertices_n, sizeof(cooked_vertex_t)) &&
+                section_fits(file, header->indices_offset, header->indices_n, sizeof(uint32_t)) &&
+                section_fits(file, header->submodels_offset, header->submodels_n, sizeof(cooked_submodel_t)) &&
+                section_fits(file, header->materials_offset, header->materials_n, sizeof(cooked_material_t)) &&
+                section_fits(file, header->meshlets_offset, header->meshlets_n, sizeof(meshlet_t)) &&
+                section_fits(file, header->strings_offset, header->strings_size, 1);
+
+    const char* base = file->data;
+    const uint32_t* indices = valid ? (const uint32_t*)(base + header->indices_offset) : NULL;
+    const cooked_submodel_t* submodels = valid ? (const cooked_submodel_t*)(base + header->submodels_offset) : NULL;
+    const cooked_material_t* materials = valid ? (const cooked_material_t*)(base + header->materials_offset) : NULL;
+    const meshlet_t* meshlets = valid ? (const meshlet_t*)(base + header->meshlets_offset) : NULL;
+    const char* strings = valid ? base + header->strings_offset : NULL;
+
+    valid = valid && (header->strings_size == 0 || strings[header->strings_size - 1] == '\0');
+
+    for (uint32_t i = 0; i < header->indices_n && valid; i++)
+        valid = indices[i] < header->vertices_n;
+
+    for (uint32_t i = 0; i < header->submodels_n && valid; i++) {
+        const cooked_submodel_t* submodel = &submodels[i];
+
+        valid = submodel->offset <= header->indices_n && submodel->count <= header->indices_n - submodel->offset &&
+                submodel->lods_n >= 1 && submodel->lods_n <= MODEL_LODS &&
+                submodel->material < header->materials_n && submodel->meshlet_first <= header->meshlets_n &&
+                submodel->meshlets_n <= header->meshlets_n - submodel->meshlet_first;
+
+        for (uint32_t level = 0; level < submodel->lods_n && valid; level++)
+            valid = submodel->lod_offset[level] <= header->indices_n &&
+                    submodel->lod_count[level] <= header->indices_n - submodel->lod_offset[level];
+    }
+
+    for (uint32_t i = 0; i < header->meshlets_n && valid; i++)
+        valid = meshlets[i].first <= header->indices_n && meshlets[i].count <= header->indices_n - meshlets[i].first;
+
+    for (uint32_t i = 0; i < header->materials_n && valid; i++)
+        valid = materials[i].diffuse_map == UINT32_MAX || materials[i].diffuse_map < header->strings_size;
+
+    if (!valid) {
+        fprintf(stderr, "Invalid cooked model: %s\n", path);
+        return 0;
+    }
+
+    // Sources shipped in a pack have nothing on disk to compare against
+    char source_path[MODEL_PATH_MAX];
+    size_t source_length = strlen(path) - strlen(MODEL_COOKED_SUFFIX);
+    struct stat source;
+
+    if (source_length < sizeof(source_path)) {
+        memcpy(source_path, path, source_length);
+        source_path[source_length] = '\0';
+
+        if (stat(source_path, &source) == 0 &&
+            (header->source_size != (uint64_t)source.st_size || header->source_mtime != source.st_mtime)) {
+            fprintf(stderr, "Cooked model is out of date: %s\n", path);
+            return 0;
+        }
+    }
+
+    data->vertices = malloc(sizeof(float) * 8 * (header->vertices_n + 1));
+    data->vertices_n = header->vertices_n;
+
+    vertex_coding_t coding = {data->vertices, (cooked_vertex_t*)(base + header->vertices_offset),
+                              &header->quantization};
+    parallel_for(header->vertices_n, 4096, decode_vertices, &coding);
+
+    data->indices = malloc(sizeof(uint32_t) * (header->indices_n + 1));
+    data->indices_n = header->indices_n;
+    memcpy(data->indices, indices, sizeof(uint32_t) * header->indices_n);
+
+    // Built by the cooker, so the runtime does not reorder level 0 again
+    if (header->meshlets_n > 0) {
+        data->meshlets = malloc(sizeof(meshlet_t) * header->meshlets_n);
+        data->meshlets_n = header->meshlets_n;
+        memcpy(data->meshlets, meshlets, sizeof(meshlet_t) * header->meshlets_n);
+    }
+
+    data->materials = malloc(sizeof(material_t) * header->materials_n);
+    data->materials_n = header->materials_n;
+
+    for (uint32_t i = 0; i < header->materials_n; i++) {
+        material_t* material = &data->materials[i];
+
+        default_material(material);
+        memcpy(material->name, materials[i].name, MATERIAL_NAME - 1);
+        material->data = materials[i].data;
+
+        if (materials[i].diffuse_map != UINT32_MAX)
+            material->diffuse_map = strdup(strings + materials[i].diffuse_map);
+    }
+
+    submodel_t** submodel = &data->root;
+
+    for (uint32_t i = 0; i < header->submodels_n; i++) {
+        const cooked_submodel_t* cooked = &submodels[i];
+
+        *submodel = calloc(1, sizeof(submodel_t));
+        (*submodel)->offset = cooked->offset;
+        (*submodel)->count = cooked->count;
+        (*submodel)->lods_n = cooked->lods_n;
+        // Boxes are appended in submodel order below, whatever the file says
+        (*submodel)->bb_index = i;
+        (*submodel)->material = cooked->material;
+        (*submodel)->meshlet_first = cooked->meshlet_first;
+        (*submodel)->meshlets_n = cooked->meshlets_n;
+        (*submodel)->uv_extent = cooked->uv_extent;
+
+        memcpy((*submodel)->lod_offset, cooked->lod_offset, sizeof(cooked->lod_offset));
+        memcpy((*submodel)->lod_count, cooked->lod_count, sizeof(cooked->lod_count));
+        memcpy((*submodel)->bbox_min, cooked->bbox_min, sizeof(cooked->bbox_min));
+        memcpy((*submodel)->bbox_max, cooked->bbox_max, sizeof(cooked->bbox_max));
+
+        submodel = finalise_submodel(data, *submodel);
+    }
+
+    return 1;
+}
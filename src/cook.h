@@ -0,0 +1,108 @@
+#ifndef COOK_H
+#define COOK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "material.h"
+#include "model.h"
+#include "vfs.h"
+
+// Written by tools/cook next to the source, loaded in its place without parsing or simplifying anything
+#define MODEL_COOKED_SUFFIX ".bmdl"
+#define MODEL_COOKED_VERSION 2
+
+// Post-transform cache the triangle order is optimised for
+#define COOK_CACHE_SIZE 16
+
+// Positions and texture coordinates as unorm16 across the model's range, normals as snorm16
+struct _cooked_vertex_t {
+    uint16_t position[3];
+    int16_t normal[3];
+    uint16_t uv[2];
+};
+
+// Decoding is min + value * scale per component
+struct _quantization_t {
+    float position_min[3], position_scale[3];
+    float uv_min[2], uv_scale[2];
+};
+
+// Sections follow at the offsets, all from the start of the file
+struct _cooked_model_header_t {
+    char magic[4];
+    uint32_t version;
+
+    // Cooked models that do not match a source on disk are ignored. Material libraries are not checked, the cooker's
+    // manifest tracks those.
+    uint64_t source_size;
+    int64_t source_mtime;
+
+    uint32_t vertices_n, indices_n, submodels_n, materials_n, meshlets_n;
+    struct _quantization_t quantization;
+
+    uint64_t vertices_offset, indices_offset, submodels_offset, materials_offset, meshlets_offset;
+    uint64_t strings_offset, strings_size;
+};
+
+struct _cooked_submodel_t {
+    uint32_t offset, count, lods_n, material;
+    uint32_t lod_offset[MODEL_LODS], lod_count[MODEL_LODS];
+
+    // Level 0 is already in meshlet order, the runtime takes these as they are
+    uint32_t meshlet_first, meshlets_n;
+
+    float bbox_min[3], bbox_max[3], uv_extent;
+};
+
+struct _cooked_material_t {
+    char name[MATERIAL_NAME];
+    struct _material_data_t data;
+
+    // Offset of the diffuse map's path in the strings, UINT32_MAX when untextured
+    uint32_t diffuse_map, padding[3];
+};
+
+typedef struct _cooked_vertex_t cooked_vertex_t;
+typedef struct _quantization_t quantization_t;
+typedef struct _cooked_model_header_t cooked_model_header_t;
+typedef struct _cooked_submodel_t cooked_submodel_t;
+typedef struct _cooked_material_t cooked_material_t;
+
+// Passes over level 0 from parse_model_geometry, in the order the cooker runs them. Levels of detail and bounds come
+// after quantizing, so they are built from the vertices the runtime will see.
+
+// Merges vertices with identical attributes, returns how many are left
+uint32_t weld_vertices(model_data_t* data);
+
+// Splits each submodel's level 0 into meshlets, returns how many there are
+uint32_t cook_meshlets(model_data_t* data);
+
+// Reorders each submodel's triangles for the post-transform cache, within each meshlet once there are meshlets, then
+// the vertices into the order they are first used
+void optimize_vertex_cache(model_data_t* data);
+
+// Average cache misses per triangle of the level 0 indices with a FIFO cache of cache_size
+float vertex_cache_misses(const model_data_t* data, uint32_t cache_size);
+
+// Returns the encoded vertices and replaces data's with their decoded values, meshlet bounds are left for
+// bound_meshlets to recompute from those
+cooked_vertex_t* quantize_vertices(model_data_t* data, quantization_t* quantization);
+
+void bound_meshlets(model_data_t* data);
+
+// Takes a fully built model, returns the bytes written or 0 on failure
+size_t write_cooked_model(const char* path, const model_data_t* data, const cooked_vertex_t* vertices,
+                          const quantization_t* quantization, const struct stat* source);
+
+// Points an up to date cooked model at a source with the same content but a new timestamp
+int restamp_cooked_model(const char* path, const struct stat* source);
+
+// Writes the cooked path for a source and returns whether such a file exists, in a pack or on disk
+int find_cooked_model(char* out, size_t size, const char* path);
+
+// Returns 0 and leaves data empty when the file is invalid or does not match its source on disk
+int parse_cooked_model(model_data_t* data, const vfs_file_t* file, const char* path);
+
+#endif  // COOK_H
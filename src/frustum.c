@@ -0,0 +1,73 @@
+#include "frustum.h"
+
+void frustum_from_matrix(frustum_t* frustum, const mat4x4 m) {
+    vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        mat4x4_row(rows[i], m, i);
+
+    // Left, right, bottom, top, near, far
+    for (int i = 0; i < 3; i++) {
+        vec4_add(frustum->planes[i * 2 + 0], rows[3], rows[i]);
+        vec4_sub(frustum->planes[i * 2 + 1], rows[3], rows[i]);
+    }
+
+    for (int i = 0; i < 6; i++) {
+        float len = vec3_len(frustum->planes[i]);
+        vec4_scale(frustum->planes[i], frustum->planes[i], 1.0f / len);
+    }
+}
+
+int frustum_cull_aabb(const frustum_t* frustum, const vec3 min, const vec3 max) {
+    for (int i = 0; i < 6; i++) {
+        const float* plane = frustum->planes[i];
+
+        // Corner furthest along the plane normal
+        vec3 p = {
+            plane[0] >= 0.0f ? max[0] : min[0],
+            plane[1] >= 0.0f ? max[1] : min[1],
+            plane[2] >= 0.0f ? max[2] : min[2],
+        };
+
+        if (vec3_dot(plane, p) + plane[3] < 0.0f)
+            return 1;
+    }
+
+    return 0;
+}
+
+int frustum_cull_sphere(const frustum_t* frustum, const vec3 centre, float radius) {
+    for (int i = 0; i < 6; i++)
+        if (vec3_dot(frustum->planes[i], centre) + frustum->planes[i][3] < -radius)
+            return 1;
+
+    return 0;
+}
+
+int frustum_classify_aabb(const frustum_t* frustum, const vec3 min, const vec3 max, unsigned int* mask) {
+    for (int i = 0; i < 6; i++) {
+        if (!(*mask & (1u << i)))
+            continue;
+
+        const float* plane = frustum->planes[i];
+
+        // Furthest and nearest corners along the plane normal
+        vec3 p = {
+            plane[0] >= 0.0f ? max[0] : min[0],
+            plane[1] >= 0.0f ? max[1] : min[1],
+            plane[2] >= 0.0f ? max[2] : min[2],
+        };
+        vec3 n = {
+            plane[0] >= 0.0f ? min[0] : max[0],
+            plane[1] >= 0.0f ? min[1] : max[1],
+            plane[2] >= 0.0f ? min[2] : max[2],
+        };
+
+        if (vec3_dot(plane, p) + plane[3] < 0.0f)
+            return FRUSTUM_OUTSIDE;
+
+        if (vec3_dot(plane, n) + plane[3] >= 0.0f)
+            *mask &= ~(1u << i);
+    }
+
+    return *mask ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+}
@@ -0,0 +1,26 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "linmath.h"
+
+struct _frustum_t {
+    vec4 planes[6];
+};
+
+typedef struct _frustum_t frustum_t;
+
+enum { FRUSTUM_OUTSIDE, FRUSTUM_INTERSECTS, FRUSTUM_INSIDE };
+
+#define FRUSTUM_ALL_PLANES 0x3f
+
+void frustum_from_matrix(frustum_t* frustum, const mat4x4 view_projection);
+
+// Returns 1 if the box is entirely outside one of the planes
+int frustum_cull_aabb(const frustum_t* frustum, const vec3 min, const vec3 max);
+
+int frustum_cull_sphere(const frustum_t* frustum, const vec3 centre, float radius);
+
+// Only tests the planes set in *mask and clears the ones the box is fully inside, so children can skip them
+int frustum_classify_aabb(const frustum_t* frustum, const vec3 min, const vec3 max, unsigned int* mask);
+
+#endif  // FRUSTUM_H
@@ -0,0 +1,316 @@
+#include "geometry.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct _sort_entry_t {
+    uint32_t offset, handle;
+};
+
+typedef struct _sort_entry_t sort_entry_t;
+
+void insert_range(geometry_list_t* list, uint32_t offset, uint32_t count) {
+    uint32_t i = 0;
+    while (i < list->ranges_n && list->ranges[i].offset < offset)
+        i++;
+
+    geometry_range_t* prev = i > 0 ? &list->ranges[i - 1] : NULL;
+    geometry_range_t* next = i < list->ranges_n ? &list->ranges[i] : NULL;
+
+    int merge_prev = prev && prev->offset + prev->count == offset;
+    int merge_next = next && offset + count == next->offset;
+
+    if (merge_prev && merge_next) {
+        prev->count += count + next->count;
+
+        memmove(next, next + 1, sizeof(geometry_range_t) * (list->ranges_n - i - 1));
+        list->ranges_n--;
+    } else if (merge_prev) {
+        prev->count += count;
+    } else if (merge_next) {
+        next->offset = offset;
+        next->count += count;
+    } else {
+        if (list->ranges_n == list->ranges_cap) {
+            list->ranges_cap = list->ranges_cap ? list->ranges_cap * 2 : 16;
+            list->ranges = realloc(list->ranges, sizeof(geometry_range_t) * list->ranges_cap);
+        }
+
+        memmove(list->ranges + i + 1, list->ranges + i, sizeof(geometry_range_t) * (list->ranges_n - i));
+        list->ranges[i] = (geometry_range_t){offset, count};
+        list->ranges_n++;
+    }
+}
+
+int take_range(geometry_list_t* list, uint32_t count, uint32_t* offset) {
+    // Best fit keeps large blocks intact for large meshes
+    int best = -1;
+    for (uint32_t i = 0; i < list->ranges_n; i++) {
+        if (list->ranges[i].count < count)
+            continue;
+
+        if (best < 0 || list->ranges[i].count < list->ranges[best].count)
+            best = i;
+    }
+
+    if (best < 0)
+        return 0;
+
+    geometry_range_t* range = &list->ranges[best];
+    *offset = range->offset;
+
+    range->offset += count;
+    range->count -= count;
+
+    if (range->count == 0) {
+        memmove(range, range + 1, sizeof(geometry_range_t) * (list->ranges_n - best - 1));
+        list->ranges_n--;
+    }
+
+    list->used += count;
+    return 1;
+}
+
+void give_range(geometry_list_t* list, uint32_t offset, uint32_t count) {
+    insert_range(list, offset, count);
+    list->used -= count;
+}
+
+void reset_range_list(geometry_list_t* list, uint32_t used) {
+    list->ranges_n = 0;
+    list->used = used;
+
+    if (used < list->capacity)
+        insert_range(list, used, list->capacity - used);
+}
+
+GLuint resize_buffer(GLuint old, GLsizeiptr old_size, GLsizeiptr new_size) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+
+    // The copy targets leave the VAO's element binding alone
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, new_size, NULL, GL_STATIC_DRAW);
+
+    if (old) {
+        glBindBuffer(GL_COPY_READ_BUFFER, old);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_size);
+        glDeleteBuffers(1, &old);
+    }
+
+    return buffer;
+}
+
+void bind_arena_buffers(geometry_arena_t* arena) {
+    glBindVertexArray(arena->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, arena->vbo);
+
+    for (int i = 0; i < arena->attribs_n; i++) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribPointer(i, arena->attribs[i].size, GL_FLOAT, GL_FALSE, arena->stride,
+                              (void*)(uintptr_t)arena->attribs[i].offset);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena->ebo);
+}
+
+void init_geometry_arena(geometry_arena_t* arena, const vertex_attrib_t* attribs, int attribs_n, GLsizei stride,
+                         uint32_t vertex_capacity, uint32_t index_capacity) {
+    memset(arena, 0, sizeof(geometry_arena_t));
+
+    arena->stride = stride;
+    arena->attribs_n = attribs_n;
+    memcpy(arena->attribs, attribs, sizeof(vertex_attrib_t) * attribs_n);
+
+    arena->vertices.capacity = vertex_capacity;
+    arena->indices.capacity = index_capacity;
+
+    reset_range_list(&arena->vertices, 0);
+    reset_range_list(&arena->indices, 0);
+
+    arena->vbo = resize_buffer(0, 0, (GLsizeiptr)stride * vertex_capacity);
+    arena->ebo = resize_buffer(0, 0, sizeof(uint32_t) * index_capacity);
+
+    glGenVertexArrays(1, &arena->vao);
+    bind_arena_buffers(arena);
+}
+
+void free_geometry_arena(geometry_arena_t* arena) {
+    glDeleteVertexArrays(1, &arena->vao);
+    glDeleteBuffers(1, &arena->vbo);
+    glDeleteBuffers(1, &arena->ebo);
+
+    free(arena->vertices.ranges);
+    free(arena->indices.ranges);
+    free(arena->allocs);
+
+    memset(arena, 0, sizeof(geometry_arena_t));
+}
+
+void grow_vertices(geometry_arena_t* arena, uint32_t count) {
+    uint32_t capacity = arena->vertices.capacity;
+    uint32_t next = capacity * 2 > capacity + count ? capacity * 2 : capacity + count;
+
+    arena->vbo = resize_buffer(arena->vbo, (GLsizeiptr)arena->stride * capacity, (GLsizeiptr)arena->stride * next);
+    bind_arena_buffers(arena);
+
+    arena->vertices.capacity = next;
+    insert_range(&arena->vertices, capacity, next - capacity);
+}
+
+void grow_indices(geometry_arena_t* arena, uint32_t count) {
+    uint32_t capacity = arena->indices.capacity;
+    uint32_t next = capacity * 2 > capacity + count ? capacity * 2 : capacity + count;
+
+    arena->ebo = resize_buffer(arena->ebo, sizeof(uint32_t) * capacity, sizeof(uint32_t) * next);
+    bind_arena_buffers(arena);
+
+    arena->indices.capacity = next;
+    insert_range(&arena->indices, capacity, next - capacity);
+}
+
+uint32_t alloc_geometry(geometry_arena_t* arena, const void* vertices, uint32_t vertex_count, const uint32_t* indices,
+                        uint32_t index_count) {
+    geometry_alloc_t alloc = {0, vertex_count, 0, index_count, 1};
+
+    while (!take_range(&arena->vertices, vertex_count, &alloc.base_vertex))
+        grow_vertices(arena, vertex_count);
+
+    while (!take_range(&arena->indices, index_count, &alloc.first_index))
+        grow_indices(arena, index_count);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena->vbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)arena->stride * alloc.base_vertex,
+                    (GLsizeiptr)arena->stride * vertex_count, vertices);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena->ebo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(uint32_t) * alloc.first_index, sizeof(uint32_t) * index_count,
+                    indices);
+
+    uint32_t handle = 0;
+    while (handle < arena->allocs_n && arena->allocs[handle].live)
+        handle++;
+
+    if (handle == arena->allocs_n) {
+        if (arena->allocs_n == arena->allocs_cap) {
+            arena->allocs_cap = arena->allocs_cap ? arena->allocs_cap * 2 : 16;
+            arena->allocs = realloc(arena->allocs, sizeof(geometry_alloc_t) * arena->allocs_cap);
+        }
+
+        arena->allocs_n++;
+    }
+
+    arena->allocs[handle] = alloc;
+    return handle;
+}
+
+void free_geometry(geometry_arena_t* arena, uint32_t handle) {
+    if (handle >= arena->allocs_n || !arena->allocs[handle].live)
+        return;
+
+    geometry_alloc_t* alloc = &arena->allocs[handle];
+
+    give_range(&arena->vertices, alloc->base_vertex, alloc->vertex_count);
+    give_range(&arena->indices, alloc->first_index, alloc->index_count);
+
+    alloc->live = 0;
+}
+
+const geometry_alloc_t* get_geometry(geometry_arena_t* arena, uint32_t handle) {
+    if (handle >= arena->allocs_n || !arena->allocs[handle].live)
+        return NULL;
+
+    return &arena->allocs[handle];
+}
+
+int compare_sort_entries(const void* a, const void* b) {
+    uint32_t x = ((const sort_entry_t*)a)->offset;
+    uint32_t y = ((const sort_entry_t*)b)->offset;
+
+    return (x > y) - (x < y);
+}
+
+uint32_t sort_allocs(geometry_arena_t* arena, sort_entry_t* entries, int by_index) {
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < arena->allocs_n; i++) {
+        if (!arena->allocs[i].live)
+            continue;
+
+        entries[n].offset = by_index ? arena->allocs[i].first_index : arena->allocs[i].base_vertex;
+        entries[n].handle = i;
+        n++;
+    }
+
+    qsort(entries, n, sizeof(sort_entry_t), compare_sort_entries);
+    return n;
+}
+
+void compact_geometry(geometry_arena_t* arena) {
+    sort_entry_t* entries = malloc(sizeof(sort_entry_t) * (arena->allocs_n + 1));
+
+    // Vertices, indices are relative to the base vertex so they survive the move untouched
+    uint32_t n = sort_allocs(arena, entries, 0);
+    uint32_t cursor = 0;
+
+    GLuint vbo = resize_buffer(0, 0, (GLsizeiptr)arena->stride * arena->vertices.capacity);
+    glBindBuffer(GL_COPY_READ_BUFFER, arena->vbo);
+
+    for (uint32_t i = 0; i < n; i++) {
+        geometry_alloc_t* alloc = &arena->allocs[entries[i].handle];
+
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)arena->stride * alloc->base_vertex,
+                            (GLintptr)arena->stride * cursor, (GLsizeiptr)arena->stride * alloc->vertex_count);
+
+        alloc->base_vertex = cursor;
+        cursor += alloc->vertex_count;
+    }
+
+    glDeleteBuffers(1, &arena->vbo);
+    arena->vbo = vbo;
+    reset_range_list(&arena->vertices, cursor);
+
+    // Indices
+    n = sort_allocs(arena, entries, 1);
+    cursor = 0;
+
+    GLuint ebo = resize_buffer(0, 0, sizeof(uint32_t) * arena->indices.capacity);
+    glBindBuffer(GL_COPY_READ_BUFFER, arena->ebo);
+
+    for (uint32_t i = 0; i < n; i++) {
+        geometry_alloc_t* alloc = &arena->allocs[entries[i].handle];
+
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sizeof(uint32_t) * alloc->first_index,
+                            sizeof(uint32_t) * cursor, sizeof(uint32_t) * alloc->index_count);
+
+        alloc->first_index = cursor;
+        cursor += alloc->index_count;
+    }
+
+    glDeleteBuffers(1, &arena->ebo);
+    arena->ebo = ebo;
+    reset_range_list(&arena->indices, cursor);
+
+    bind_arena_buffers(arena);
+    free(entries);
+}
+
+float list_fragmentation(geometry_list_t* list) {
+    uint32_t free_total = list->capacity - list->used, largest = 0;
+
+    for (uint32_t i = 0; i < list->ranges_n; i++)
+        if (list->ranges[i].count > largest)
+            largest = list->ranges[i].count;
+
+    return free_total ? 1.0f - (float)largest / (float)free_total : 0.0f;
+}
+
+void geometry_stats(geometry_arena_t* arena, geometry_stats_t* stats) {
+    // An arena that was never initialised has no capacity
+    stats->vertex_occupancy = arena->vertices.capacity ? (float)arena->vertices.used / arena->vertices.capacity : 0.0f;
+    stats->index_occupancy = arena->indices.capacity ? (float)arena->indices.used / arena->indices.capacity : 0.0f;
+
+    stats->vertex_fragmentation = list_fragmentation(&arena->vertices);
+    stats->index_fragmentation = list_fragmentation(&arena->indices);
+}
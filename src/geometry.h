@@ -0,0 +1,74 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <stdint.h>
+
+#include "glfw.h"
+
+#define MAX_VERTEX_ATTRIBS 4
+
+// Handle of nothing, freeing it does nothing and looking it up returns NULL
+#define GEOMETRY_NONE UINT32_MAX
+
+struct _vertex_attrib_t {
+    GLint size;
+    GLuint offset;
+};
+
+struct _geometry_range_t {
+    uint32_t offset, count;
+};
+
+struct _geometry_list_t {
+    struct _geometry_range_t* ranges;
+    uint32_t ranges_n, ranges_cap;
+
+    uint32_t capacity, used;
+};
+
+struct _geometry_alloc_t {
+    uint32_t base_vertex, vertex_count;
+    uint32_t first_index, index_count;
+    int live;
+};
+
+// One vertex and one index buffer shared by every mesh with the same vertex format
+struct _geometry_arena_t {
+    GLuint vao, vbo, ebo;
+
+    GLsizei stride;
+    struct _vertex_attrib_t attribs[MAX_VERTEX_ATTRIBS];
+    int attribs_n;
+
+    struct _geometry_list_t vertices, indices;
+
+    struct _geometry_alloc_t* allocs;
+    uint32_t allocs_n, allocs_cap;
+};
+
+struct _geometry_stats_t {
+    float vertex_occupancy, index_occupancy;
+    float vertex_fragmentation, index_fragmentation;
+};
+
+typedef struct _vertex_attrib_t vertex_attrib_t;
+typedef struct _geometry_range_t geometry_range_t;
+typedef struct _geometry_list_t geometry_list_t;
+typedef struct _geometry_alloc_t geometry_alloc_t;
+typedef struct _geometry_arena_t geometry_arena_t;
+typedef struct _geometry_stats_t geometry_stats_t;
+
+void init_geometry_arena(geometry_arena_t* arena, const vertex_attrib_t* attribs, int attribs_n, GLsizei stride,
+                         uint32_t vertex_capacity, uint32_t index_capacity);
+void free_geometry_arena(geometry_arena_t* arena);
+
+// Returns a handle, allocations can move during compaction so always look them up with get_geometry
+uint32_t alloc_geometry(geometry_arena_t* arena, const void* vertices, uint32_t vertex_count, const uint32_t* indices,
+                        uint32_t index_count);
+void free_geometry(geometry_arena_t* arena, uint32_t handle);
+const geometry_alloc_t* get_geometry(geometry_arena_t* arena, uint32_t handle);
+
+void compact_geometry(geometry_arena_t* arena);
+void geometry_stats(geometry_arena_t* arena, geometry_stats_t* stats);
+
+#endif  // GEOMETRY_H
@@ -0,0 +1,537 @@
+#include "gltf.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "job.h"
+#include "json.h"
+#include "linmath.h"
+#include "material.h"
+#include "vfs.h"
+
+#define GLB_MAGIC 0x46546C67  // "glTF"
+#define GLB_CHUNK_JSON 0x4E4F534A
+#define GLB_CHUNK_BIN 0x004E4942
+
+#define GLTF_TRIANGLES 4
+#define GLTF_DEPTH 64
+
+enum {
+    GLTF_BYTE = 5120,
+    GLTF_UNSIGNED_BYTE = 5121,
+    GLTF_SHORT = 5122,
+    GLTF_UNSIGNED_SHORT = 5123,
+    GLTF_UNSIGNED_INT = 5125,
+    GLTF_FLOAT = 5126,
+};
+
+// Elements are read straight out of the binary chunk
+struct _gltf_accessor_t {
+    const unsigned char* data;
+    size_t stride;
+
+    uint32_t count, components;
+    int component_type, normalized;
+};
+
+struct _gltf_instance_t {
+    int mesh;
+    mat4x4 world;
+};
+
+struct _gltf_primitive_t {
+    struct _gltf_accessor_t positions, normals, uvs, indices;
+    int has_normals, has_uvs, has_indices;
+
+    uint32_t instance, material;
+    uint32_t first_vertex, vertices_n, first_index, indices_n;
+};
+
+struct _gltf_parse_t {
+    json_t json;
+
+    const unsigned char* bin;
+    size_t bin_size;
+
+    struct _gltf_instance_t* instances;
+    uint32_t instances_n;
+
+    struct _gltf_primitive_t* primitives;
+    uint32_t primitives_n;
+
+    float* vertices;
+    uint32_t* indices;
+};
+
+typedef struct _gltf_accessor_t gltf_accessor_t;
+typedef struct _gltf_instance_t gltf_instance_t;
+typedef struct _gltf_primitive_t gltf_primitive_t;
+typedef struct _gltf_parse_t gltf_parse_t;
+
+int gltf_component_size(int type) {
+    switch (type) {
+        case GLTF_BYTE:
+        case GLTF_UNSIGNED_BYTE:
+            return 1;
+        case GLTF_SHORT:
+        case GLTF_UNSIGNED_SHORT:
+            return 2;
+        case GLTF_UNSIGNED_INT:
+        case GLTF_FLOAT:
+            return 4;
+    }
+
+    return 0;
+}
+
+int get_accessor(const gltf_parse_t* parse, int index, gltf_accessor_t* accessor) {
+    const json_t* json = &parse->json;
+
+    if (index < 0)
+        return 0;
+
+    int token = json_at(json, json_get(json, 0, "accessors"), index);
+    int view_index = (int)json_number(json, json_get(json, token, "bufferView"), -1);
+
+    // Sparse accessors and ones without a view are all zeros in the spec, nothing we load uses them
+    if (token < 0 || view_index < 0)
+        return 0;
+
+    int view = json_at(json, json_get(json, 0, "bufferViews"), view_index);
+
+    if (view < 0 || json_number(json, json_get(json, view, "buffer"), 0) != 0)
+        return 0;
+
+    char type[8];
+    if (!json_string(json, json_get(json, token, "type"), type, sizeof(type)))
+        return 0;
+
+    accessor->components = strcmp(type, "SCALAR") == 0 ? 1
+                         : strcmp(type, "VEC2") == 0   ? 2
+                         : strcmp(type, "VEC3") == 0   ? 3
+                         : strcmp(type, "VEC4") == 0   ? 4
+                                                       : 0;
+
+    accessor->component_type = (int)json_number(json, json_get(json, token, "componentType"), 0);
+    int normalized = json_get(json, token, "normalized");
+    accessor->normalized = normalized >= 0 && json->text[json->tokens[normalized].start] == 't';
+    accessor->count = (uint32_t)json_number(json, json_get(json, token, "count"), 0);
+
+    size_t element = (size_t)accessor->components * gltf_component_size(accessor->component_type);
+    if (element == 0)
+        return 0;
+
+    size_t offset = (size_t)json_number(json, json_get(json, view, "byteOffset"), 0) +
+                    (size_t)json_number(json, json_get(json, token, "byteOffset"), 0);
+
+    accessor->stride = (size_t)json_number(json, json_get(json, view, "byteStride"), 0);
+    if (accessor->stride == 0)
+        accessor->stride = element;
+
+    size_t view_end = (size_t)json_number(json, json_get(json, view, "byteOffset"), 0) +
+                      (size_t)json_number(json, json_get(json, view, "byteLength"), 0);
+
+    // The last element only needs its own bytes, not a full stride
+    if (accessor->count > 0 &&
+        (offset + accessor->stride * (accessor->count - 1) + element > view_end || view_end > parse->bin_size))
+        return 0;
+
+    accessor->data = parse->bin + offset;
+    return 1;
+}
+
+float read_component(const gltf_accessor_t* accessor, uint32_t i, uint32_t c) {
+    const unsigned char* p = accessor->data + accessor->stride * i;
+    float scale = 1.0f;
+    float value = 0.0f;
+
+    switch (accessor->component_type) {
+        case GLTF_FLOAT:
+            memcpy(&value, p + c * 4, 4);
+            return value;
+        case GLTF_UNSIGNED_BYTE:
+            value = p[c];
+            scale = 1.0f / 255.0f;
+            break;
+        case GLTF_BYTE:
+            value = (int8_t)p[c];
+            scale = 1.0f / 127.0f;
+            break;
+        case GLTF_UNSIGNED_SHORT: {
+            uint16_t v;
+            memcpy(&v, p + c * 2, 2);
+            value = v;
+            scale = 1.0f / 65535.0f;
+            break;
+        }
+        case GLTF_SHORT: {
+            int16_t v;
+            memcpy(&v, p + c * 2, 2);
+            value = v;
+            scale = 1.0f / 32767.0f;
+            break;
+        }
+        case GLTF_UNSIGNED_INT: {
+            uint32_t v;
+            memcpy(&v, p + c * 4, 4);
+            value = v;
+            break;
+        }
+    }
+
+    if (accessor->normalized) {
+        value *= scale;
+        return value < -1.0f ? -1.0f : value;
+    }
+
+    return value;
+}
+
+uint32_t read_index(const gltf_accessor_t* accessor, uint32_t i) {
+    const unsigned char* p = accessor->data + accessor->stride * i;
+
+    if (accessor->component_type == GLTF_UNSIGNED_BYTE)
+        return p[0];
+
+    if (accessor->component_type == GLTF_UNSIGNED_SHORT) {
+        uint16_t v;
+        memcpy(&v, p, 2);
+        return v;
+    }
+
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+void node_matrix(const json_t* json, int node, mat4x4 local) {
+    int matrix = json_get(json, node, "matrix");
+
+    // Column major like linmath
+    if (matrix >= 0) {
+        for (int i = 0; i < 16; i++)
+            local[i / 4][i % 4] = json_number(json, json_at(json, matrix, i), i % 5 == 0 ? 1.0 : 0.0);
+
+        return;
+    }
+
+    int t = json_get(json, node, "translation");
+    int r = json_get(json, node, "rotation");
+    int s = json_get(json, node, "scale");
+
+    float x = json_number(json, json_at(json, r, 0), 0.0), y = json_number(json, json_at(json, r, 1), 0.0);
+    float z = json_number(json, json_at(json, r, 2), 0.0), w = json_number(json, json_at(json, r, 3), 1.0);
+
+    mat4x4_identity(local);
+
+    local[0][0] = 1.0f - 2.0f * (y * y + z * z);
+    local[0][1] = 2.0f * (x * y + z * w);
+    local[0][2] = 2.0f * (x * z - y * w);
+
+    local[1][0] = 2.0f * (x * y - z * w);
+    local[1][1] = 1.0f - 2.0f * (x * x + z * z);
+    local[1][2] = 2.0f * (y * z + x * w);
+
+    local[2][0] = 2.0f * (x * z + y * w);
+    local[2][1] = 2.0f * (y * z - x * w);
+    local[2][2] = 1.0f - 2.0f * (x * x + y * y);
+
+    for (int i = 0; i < 3; i++) {
+        vec4_scale(local[i], local[i], json_number(json, json_at(json, s, i), 1.0));
+        local[3][i] = json_number(json, json_at(json, t, i), 0.0);
+    }
+}
+
+void collect_instances(gltf_parse_t* parse, int node_index, const mat4x4 parent, int depth) {
+    const json_t* json = &parse->json;
+    int node = json_at(json, json_get(json, 0, "nodes"), node_index);
+
+    // Malformed files can have cycles
+    if (node < 0 || node_index < 0 || depth > GLTF_DEPTH)
+        return;
+
+    mat4x4 local, world;
+    node_matrix(json, node, local);
+    mat4x4_mul(world, parent, local);
+
+    int mesh = (int)json_number(json, json_get(json, node, "mesh"), -1);
+
+    if (mesh >= 0) {
+        parse->instances = realloc(parse->instances, sizeof(gltf_instance_t) * (parse->instances_n + 1));
+
+        gltf_instance_t* instance = &parse->instances[parse->instances_n++];
+        instance->mesh = mesh;
+        mat4x4_copy(instance->world, world);
+    }
+
+    int children = json_get(json, node, "children");
+    for (uint32_t i = 0; i < json_count(json, children); i++)
+        collect_instances(parse, (int)json_number(json, json_at(json, children, i), -1), world, depth + 1);
+}
+
+void parse_gltf_materials(gltf_parse_t* parse, model_data_t* data, const char* path) {
+    const json_t* json = &parse->json;
+    int materials = json_get(json, 0, "materials");
+    uint32_t n = json_count(json, materials);
+
+    // Entry 0 stays the default for primitives without a material
+    data->materials = malloc(sizeof(material_t) * (n + 1));
+    data->materials_n = n + 1;
+    default_material(&data->materials[0]);
+
+    for (uint32_t i = 0; i < n; i++) {
+        material_t* material = &data->materials[i + 1];
+        int token = json_at(json, materials, i);
+
+        default_material(material);
+
+        if (!json_string(json, json_get(json, token, "name"), material->name, sizeof(material->name)))
+            snprintf(material->name, sizeof(material->name), "material%u", i);
+
+        int pbr = json_get(json, token, "pbrMetallicRoughness");
+        int factor = json_get(json, pbr, "baseColorFactor");
+
+        if (factor >= 0)
+            for (int c = 0; c < 4; c++)
+                material->data.diffuse[c] = json_number(json, json_at(json, factor, c), 1.0);
+
+        int texture = (int)json_number(json, json_get(json, json_get(json, pbr, "baseColorTexture"), "index"), -1);
+        if (texture < 0)
+            continue;
+
+        int textures = json_get(json, 0, "textures");
+        int source = (int)json_number(json, json_get(json, json_at(json, textures, texture), "source"), -1);
+        int image = source >= 0 ? json_at(json, json_get(json, 0, "images"), source) : -1;
+
+        char uri[PATH_MAX], resolved[PATH_MAX];
+
+        if (!json_string(json, json_get(json, image, "uri"), uri, sizeof(uri)) || strncmp(uri, "data:", 5) == 0) {
+            fprintf(stderr, "Embedded image not supported: %s in %s\n", material->name, path);
+            continue;
+        }
+
+        if (resolve_path(resolved, sizeof(resolved), path, uri, strlen(uri)))
+            material->diffuse_map = strdup(resolved);
+    }
+}
+
+// Triangle primitives of every instance, with their ranges in the output arrays
+void collect_primitives(gltf_parse_t* parse, uint32_t materials_n, size_t* vertices_n, size_t* indices_n) {
+    const json_t* json = &parse->json;
+    int meshes = json_get(json, 0, "meshes");
+
+    for (uint32_t i = 0; i < parse->instances_n; i++) {
+        int primitives = json_get(json, json_at(json, meshes, parse->instances[i].mesh), "primitives");
+
+        for (uint32_t j = 0; j < json_count(json, primitives); j++) {
+            int token = json_at(json, primitives, j);
+            int attributes = json_get(json, token, "attributes");
+
+            if (json_number(json, json_get(json, token, "mode"), GLTF_TRIANGLES) != GLTF_TRIANGLES)
+                continue;
+
+            gltf_primitive_t primitive;
+            memset(&primitive, 0, sizeof(primitive));
+
+            int position = (int)json_number(json, json_get(json, attributes, "POSITION"), -1);
+            if (!get_accessor(parse, position, &primitive.positions) || primitive.positions.components != 3)
+                continue;
+
+            int normal = (int)json_number(json, json_get(json, attributes, "NORMAL"), -1);
+            int uv = (int)json_number(json, json_get(json, attributes, "TEXCOORD_0"), -1);
+            int index = (int)json_number(json, json_get(json, token, "indices"), -1);
+
+            primitive.has_normals = get_accessor(parse, normal, &primitive.normals) &&
+                                    primitive.normals.components == 3 &&
+                                    primitive.normals.count >= primitive.positions.count;
+            primitive.has_uvs = get_accessor(parse, uv, &primitive.uvs) && primitive.uvs.components == 2 &&
+                                primitive.uvs.count >= primitive.positions.count;
+            primitive.has_indices = get_accessor(parse, index, &primitive.indices) &&
+                                    primitive.indices.components == 1 &&
+                                    primitive.indices.component_type != GLTF_FLOAT;
+
+            uint32_t material = (uint32_t)(json_number(json, json_get(json, token, "material"), -1) + 1);
+
+            primitive.instance = i;
+            primitive.material = material < materials_n ? material : 0;
+
+            primitive.first_vertex = *vertices_n;
+            primitive.vertices_n = primitive.positions.count;
+
+            primitive.first_index = *indices_n;
+            primitive.indices_n = (primitive.has_indices ? primitive.indices.count : primitive.vertices_n) / 3 * 3;
+
+            if (primitive.indices_n == 0)
+                continue;
+
+            *vertices_n += primitive.vertices_n;
+            *indices_n += primitive.indices_n;
+
+            parse->primitives = realloc(parse->primitives, sizeof(gltf_primitive_t) * (parse->primitives_n + 1));
+            parse->primitives[parse->primitives_n++] = primitive;
+        }
+    }
+}
+
+// Interleaves each primitive into the model's vertex layout with its node transform applied
+void fill_primitives(void* arg, uint32_t begin, uint32_t end) {
+    gltf_parse_t* parse = arg;
+
+    for (uint32_t i = begin; i < end; i++) {
+        gltf_primitive_t* primitive = &parse->primitives[i];
+        const mat4x4* world = &parse->instances[primitive->instance].world;
+
+        mat4x4 inverse, normal;
+        mat4x4_invert(inverse, *world);
+        mat4x4_transpose(normal, inverse);
+
+        for (uint32_t v = 0; v < primitive->vertices_n; v++) {
+            float* out = parse->vertices + ((size_t)primitive->first_vertex + v) * 8;
+
+            vec4 position = {read_component(&primitive->positions, v, 0), read_component(&primitive->positions, v, 1),
+                             read_component(&primitive->positions, v, 2), 1.0f};
+            vec4 transformed;
+            mat4x4_mul_vec4(transformed, *world, position);
+            memcpy(out, transformed, sizeof(float) * 3);
+
+            vec3_zero(out + 3);
+
+            if (primitive->has_normals) {
+                vec4 n = {read_component(&primitive->normals, v, 0), read_component(&primitive->normals, v, 1),
+                          read_component(&primitive->normals, v, 2), 0.0f};
+                mat4x4_mul_vec4(transformed, normal, n);
+
+                float length = vec3_len(transformed);
+                if (length > 0.0f)
+                    vec3_scale(out + 3, transformed, 1.0f / length);
+            }
+
+            // glTF puts the texture origin top left, images are flipped on load for OBJ's bottom left
+            out[6] = primitive->has_uvs ? read_component(&primitive->uvs, v, 0) : 0.0f;
+            out[7] = primitive->has_uvs ? 1.0f - read_component(&primitive->uvs, v, 1) : 0.0f;
+        }
+
+        uint32_t* indices = parse->indices + primitive->first_index;
+
+        for (uint32_t k = 0; k < primitive->indices_n; k++) {
+            uint32_t index = primitive->has_indices ? read_index(&primitive->indices, k) : k;
+            indices[k] = primitive->first_vertex + (index < primitive->vertices_n ? index : 0);
+        }
+
+        // Mirroring transforms flip the winding
+        vec3 x, y, z, cross;
+        vec3_from_vec4(x, (*world)[0]);
+        vec3_from_vec4(y, (*world)[1]);
+        vec3_from_vec4(z, (*world)[2]);
+        vec3_cross(cross, x, y);
+
+        if (vec3_dot(cross, z) < 0.0f) {
+            for (uint32_t k = 0; k < primitive->indices_n; k += 3) {
+                uint32_t swap = indices[k + 1];
+                indices[k + 1] = indices[k + 2];
+                indices[k + 2] = swap;
+            }
+        }
+    }
+}
+
+int parse_glb(model_data_t* data, const vfs_file_t* mapping, const char* path) {
+    memset(data, 0, sizeof(model_data_t));
+
+    if (mapping->size < 20) {
+        fprintf(stderr, "Invalid binary glTF: %s\n", path);
+        return 0;
+    }
+
+    const unsigned char* file = (const unsigned char*)mapping->data;
+    uint32_t header[5];
+    memcpy(header, file, sizeof(header));
+
+    size_t length = header[2] < mapping->size ? header[2] : mapping->size;
+
+    gltf_parse_t parse;
+    memset(&parse, 0, sizeof(parse));
+
+    if (header[0] != GLB_MAGIC || header[1] != 2 || header[4] != GLB_CHUNK_JSON || 20 + (size_t)header[3] > length ||
+        !parse_json(&parse.json, (const char*)file + 20, header[3]) || parse.json.tokens[0].type != JSON_OBJECT) {
+        fprintf(stderr, "Invalid binary glTF: %s\n", path);
+        return 0;
+    }
+
+    // The binary chunk is optional and follows the JSON one at a 4 byte boundary
+    size_t bin = 20 + ((size_t)header[3] + 3) / 4 * 4;
+
+    if (bin + 8 <= length) {
+        uint32_t chunk[2];
+        memcpy(chunk, file + bin, sizeof(chunk));
+
+        if (chunk[1] == GLB_CHUNK_BIN) {
+            parse.bin = file + bin + 8;
+            parse.bin_size = chunk[0] < length - bin - 8 ? chunk[0] : length - bin - 8;
+        }
+    }
+
+    const json_t* json = &parse.json;
+
+    parse_gltf_materials(&parse, data, path);
+
+    // Nodes of the default scene, or every mesh once when the file has no scenes
+    mat4x4 identity;
+    mat4x4_identity(identity);
+
+    int scenes = json_get(json, 0, "scenes");
+    int scene = json_at(json, scenes, (uint32_t)json_number(json, json_get(json, 0, "scene"), 0));
+
+    if (scene >= 0) {
+        int nodes = json_get(json, scene, "nodes");
+
+        for (uint32_t i = 0; i < json_count(json, nodes); i++)
+            collect_instances(&parse, (int)json_number(json, json_at(json, nodes, i), -1), identity, 0);
+    } else {
+        parse.instances_n = json_count(json, json_get(json, 0, "meshes"));
+        parse.instances = malloc(sizeof(gltf_instance_t) * (parse.instances_n + 1));
+
+        for (uint32_t i = 0; i < parse.instances_n; i++) {
+            parse.instances[i].mesh = i;
+            mat4x4_identity(parse.instances[i].world);
+        }
+    }
+
+    size_t vertices_n = 0, indices_n = 0;
+    collect_primitives(&parse, data->materials_n, &vertices_n, &indices_n);
+
+    if (parse.primitives_n == 0)
+        fprintf(stderr, "No triangles in model: %s\n", path);
+
+    parse.vertices = malloc(sizeof(float) * 8 * (vertices_n + 1));
+    parse.indices = malloc(sizeof(uint32_t) * (indices_n + 1));
+
+    parallel_for(parse.primitives_n, 1, fill_primitives, &parse);
+
+    // One submodel per primitive, each instance of a mesh gets its own
+    submodel_t** submodel = &data->root;
+
+    for (uint32_t i = 0; i < parse.primitives_n; i++) {
+        *submodel = calloc(1, sizeof(submodel_t));
+        (*submodel)->offset = parse.primitives[i].first_index;
+        (*submodel)->count = parse.primitives[i].indices_n;
+        (*submodel)->bb_index = i;
+        (*submodel)->material = parse.primitives[i].material;
+
+        submodel = &(*submodel)->child;
+    }
+
+    data->vertices = parse.vertices;
+    data->vertices_n = vertices_n;
+
+    data->indices = parse.indices;
+    data->indices_n = indices_n;
+
+    free(parse.primitives);
+    free(parse.instances);
+    free_json(&parse.json);
+
+    return 1;
+}
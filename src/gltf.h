@@ -0,0 +1,11 @@
+#ifndef GLTF_H
+#define GLTF_H
+
+#include "model.h"
+
+// Reads accessors in place from the file's binary chunk, which stays owned by the caller. Every triangle primitive
+// reachable from the default scene becomes a level 0 submodel with its node transform baked in. Base colour images
+// are only taken from external uris, embedded ones are skipped.
+int parse_glb(model_data_t* data, const vfs_file_t* file, const char* path);
+
+#endif  // GLTF_H
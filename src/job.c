@@ -0,0 +1,431 @@
+#include "job.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEQUE_SIZE 4096
+#define DEQUE_MASK (DEQUE_SIZE - 1)
+#define SPIN_COUNT 64
+
+struct _job_t {
+    job_func_t func;
+    void* data;
+    job_counter_t* counter;
+    atomic_int busy;
+};
+
+typedef struct _job_t job_t;
+
+// Chase-Lev deque, the owner pushes and pops at the bottom while thieves take from the top
+struct _job_deque_t {
+    atomic_long top;
+    char padding[64 - sizeof(atomic_long)];
+
+    atomic_long bottom;
+    _Atomic(job_t*) jobs[DEQUE_SIZE];
+};
+
+struct _worker_t {
+    struct _job_deque_t deque;
+
+    job_t pool[DEQUE_SIZE];
+    uint32_t pool_head;
+
+    // Holds a queued job taken from the shared list while it is being executed
+    job_t queued;
+
+    pthread_t thread;
+    long executed, stolen;
+    uint32_t seed;
+};
+
+// Handed over by threads outside the pool, which have no deque of their own
+struct _queued_job_t {
+    job_t job;
+    struct _queued_job_t* next;
+};
+
+typedef struct _job_deque_t job_deque_t;
+typedef struct _worker_t worker_t;
+typedef struct _queued_job_t queued_job_t;
+
+worker_t* workers;
+int workers_n;
+
+atomic_int jobs_running;
+atomic_int jobs_pending;
+
+pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t jobs_wake = PTHREAD_COND_INITIALIZER;
+
+queued_job_t *queued_head, *queued_tail;
+atomic_int queued_n;
+pthread_mutex_t queued_lock = PTHREAD_MUTEX_INITIALIZER;
+
+_Thread_local int worker_index = -1;
+
+void push_job(job_deque_t* deque, job_t* job) {
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+
+    atomic_store_explicit(&deque->jobs[bottom & DEQUE_MASK], job, memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+}
+
+job_t* pop_job(job_deque_t* deque) {
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    job_t* job = atomic_load_explicit(&deque->jobs[bottom & DEQUE_MASK], memory_order_relaxed);
+
+    // Last job, race any thieves for it
+    if (top == bottom) {
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst,
+                                                     memory_order_relaxed))
+            job = NULL;
+
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    return job;
+}
+
+job_t* steal_job(job_deque_t* deque) {
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom)
+        return NULL;
+
+    job_t* job = atomic_load_explicit(&deque->jobs[top & DEQUE_MASK], memory_order_acquire);
+
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst,
+                                                 memory_order_relaxed))
+        return NULL;
+
+    return job;
+}
+
+job_t* take_queued_job(worker_t* worker) {
+    if (atomic_load_explicit(&queued_n, memory_order_acquire) == 0)
+        return NULL;
+
+    pthread_mutex_lock(&queued_lock);
+
+    queued_job_t* queued = queued_head;
+    if (queued != NULL) {
+        queued_head = queued->next;
+        if (queued_head == NULL)
+            queued_tail = NULL;
+
+        atomic_fetch_sub_explicit(&queued_n, 1, memory_order_relaxed);
+    }
+
+    pthread_mutex_unlock(&queued_lock);
+
+    if (queued == NULL)
+        return NULL;
+
+    worker->queued = queued->job;
+    free(queued);
+
+    return &worker->queued;
+}
+
+job_t* find_job(worker_t* worker) {
+    job_t* job = pop_job(&worker->deque);
+    if (job != NULL)
+        return job;
+
+    job = take_queued_job(worker);
+    if (job != NULL)
+        return job;
+
+    // Start from a random victim so idle workers do not all hammer the same deque
+    worker->seed = worker->seed * 1664525 + 1013904223;
+    int start = (worker->seed >> 16) % workers_n;
+
+    for (int i = 0; i < workers_n; i++) {
+        worker_t* victim = &workers[(start + i) % workers_n];
+        if (victim == worker)
+            continue;
+
+        job = steal_job(&victim->deque);
+        if (job != NULL) {
+            worker->stolen++;
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+void execute_job(worker_t* worker, job_t* job) {
+    atomic_fetch_sub_explicit(&jobs_pending, 1, memory_order_relaxed);
+
+    job_t copy = {job->func, job->data, job->counter};
+    atomic_store_explicit(&job->busy, 0, memory_order_release);
+
+    copy.func(copy.data);
+    worker->executed++;
+
+    if (copy.counter != NULL)
+        atomic_fetch_sub_explicit(&copy.counter->value, 1, memory_order_release);
+}
+
+void* worker_main(void* arg) {
+    worker_index = (int)(intptr_t)arg;
+    worker_t* worker = &workers[worker_index];
+
+    int spins = 0;
+    while (atomic_load_explicit(&jobs_running, memory_order_acquire)) {
+        job_t* job = find_job(worker);
+
+        if (job != NULL) {
+            execute_job(worker, job);
+            spins = 0;
+            continue;
+        }
+
+        if (++spins < SPIN_COUNT) {
+            sched_yield();
+            continue;
+        }
+
+        pthread_mutex_lock(&jobs_lock);
+
+        while (atomic_load(&jobs_pending) == 0 && atomic_load(&jobs_running))
+            pthread_cond_wait(&jobs_wake, &jobs_lock);
+
+        pthread_mutex_unlock(&jobs_lock);
+        spins = 0;
+    }
+
+    return NULL;
+}
+
+void start_jobs(int count) {
+    // Keep a worker besides the calling thread even on one core, so jobs still progress while it blocks in the
+    // driver or the window system
+    if (count <= 0) {
+        count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (count < MIN_WORKERS)
+            count = MIN_WORKERS;
+    }
+
+    if (count < 1)
+        count = 1;
+
+    if (count > MAX_WORKERS)
+        count = MAX_WORKERS;
+
+    workers_n = count;
+    workers = calloc(workers_n, sizeof(worker_t));
+
+    for (int i = 0; i < workers_n; i++)
+        workers[i].seed = i * 2654435761u + 1;
+
+    worker_index = 0;
+    atomic_store(&jobs_running, 1);
+
+    for (int i = 1; i < workers_n; i++)
+        pthread_create(&workers[i].thread, NULL, worker_main, (void*)(intptr_t)i);
+}
+
+void stop_jobs() {
+    pthread_mutex_lock(&jobs_lock);
+    atomic_store(&jobs_running, 0);
+    pthread_cond_broadcast(&jobs_wake);
+    pthread_mutex_unlock(&jobs_lock);
+
+    for (int i = 1; i < workers_n; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    free(workers);
+    workers = NULL;
+    workers_n = 0;
+}
+
+int job_workers() {
+    return workers_n;
+}
+
+int job_worker_index() {
+    return worker_index;
+}
+
+void run_jobs(const job_decl_t* decls, int count, job_counter_t* counter) {
+    if (counter != NULL)
+        atomic_fetch_add_explicit(&counter->value, count, memory_order_relaxed);
+
+    // Threads outside the pool, or a pool that was never started, just run inline
+    if (worker_index < 0 || workers_n == 0) {
+        for (int i = 0; i < count; i++) {
+            decls[i].func(decls[i].data);
+
+            if (counter != NULL)
+                atomic_fetch_sub_explicit(&counter->value, 1, memory_order_release);
+        }
+
+        return;
+    }
+
+    worker_t* worker = &workers[worker_index];
+
+    for (int i = 0; i < count; i++) {
+        job_t* job = &worker->pool[worker->pool_head & DEQUE_MASK];
+
+        long size = atomic_load_explicit(&worker->deque.bottom, memory_order_relaxed) -
+                    atomic_load_explicit(&worker->deque.top, memory_order_relaxed);
+
+        // Nested waits can pile up more jobs than the deque holds, run the overflow inline
+        if (size >= DEQUE_SIZE - 1 || atomic_load_explicit(&job->busy, memory_order_acquire)) {
+            decls[i].func(decls[i].data);
+            worker->executed++;
+
+            if (counter != NULL)
+                atomic_fetch_sub_explicit(&counter->value, 1, memory_order_release);
+
+            continue;
+        }
+
+        worker->pool_head++;
+        atomic_store_explicit(&job->busy, 1, memory_order_relaxed);
+
+        job->func = decls[i].func;
+        job->data = decls[i].data;
+        job->counter = counter;
+
+        atomic_fetch_add_explicit(&jobs_pending, 1, memory_order_relaxed);
+        push_job(&worker->deque, job);
+    }
+
+    pthread_mutex_lock(&jobs_lock);
+    pthread_cond_broadcast(&jobs_wake);
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+void queue_job(job_func_t func, void* data, job_counter_t* counter) {
+    if (counter != NULL)
+        atomic_fetch_add_explicit(&counter->value, 1, memory_order_relaxed);
+
+    if (workers_n == 0) {
+        func(data);
+
+        if (counter != NULL)
+            atomic_fetch_sub_explicit(&counter->value, 1, memory_order_release);
+
+        return;
+    }
+
+    queued_job_t* queued = malloc(sizeof(queued_job_t));
+    queued->job.func = func;
+    queued->job.data = data;
+    queued->job.counter = counter;
+    atomic_init(&queued->job.busy, 0);
+    queued->next = NULL;
+
+    // Counted before it is visible so a worker taking it straight away never drives the count negative
+    atomic_fetch_add_explicit(&jobs_pending, 1, memory_order_relaxed);
+
+    pthread_mutex_lock(&queued_lock);
+
+    if (queued_tail != NULL)
+        queued_tail->next = queued;
+    else
+        queued_head = queued;
+
+    queued_tail = queued;
+    atomic_fetch_add_explicit(&queued_n, 1, memory_order_release);
+
+    pthread_mutex_unlock(&queued_lock);
+
+    pthread_mutex_lock(&jobs_lock);
+    pthread_cond_broadcast(&jobs_wake);
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+int run_pending_job() {
+    job_t* job = worker_index >= 0 && workers_n > 0 ? find_job(&workers[worker_index]) : NULL;
+
+    if (job == NULL)
+        return 0;
+
+    execute_job(&workers[worker_index], job);
+    return 1;
+}
+
+void wait_for_counter(job_counter_t* counter) {
+    // Help out instead of blocking, waiting is only possible from pool threads
+    while (atomic_load_explicit(&counter->value, memory_order_acquire) > 0)
+        if (!run_pending_job())
+            sched_yield();
+}
+
+struct _range_job_t {
+    range_func_t func;
+    void* data;
+    uint32_t begin, end;
+};
+
+typedef struct _range_job_t range_job_t;
+
+void run_range_job(void* data) {
+    range_job_t* range = data;
+    range->func(range->data, range->begin, range->end);
+}
+
+void parallel_for(uint32_t count, uint32_t grain, range_func_t func, void* data) {
+    if (grain == 0)
+        grain = 1;
+
+    if (count <= grain || workers_n <= 1 || worker_index < 0) {
+        if (count > 0)
+            func(data, 0, count);
+
+        return;
+    }
+
+    // Keep well clear of the deque capacity, bigger chunks are cheaper than overflowing
+    if ((count + grain - 1) / grain > DEQUE_SIZE / 4)
+        grain = (count + DEQUE_SIZE / 4 - 1) / (DEQUE_SIZE / 4);
+
+    uint32_t chunks = (count + grain - 1) / grain;
+
+    range_job_t* ranges = malloc(sizeof(range_job_t) * chunks);
+    job_decl_t* decls = malloc(sizeof(job_decl_t) * chunks);
+
+    for (uint32_t i = 0; i < chunks; i++) {
+        ranges[i] = (range_job_t){func, data, i * grain, i * grain + grain < count ? i * grain + grain : count};
+        decls[i] = (job_decl_t){run_range_job, &ranges[i]};
+    }
+
+    job_counter_t counter = {0};
+    run_jobs(decls, chunks, &counter);
+    wait_for_counter(&counter);
+
+    free(ranges);
+    free(decls);
+}
+
+void job_stats(job_stats_t* stats) {
+    memset(stats, 0, sizeof(job_stats_t));
+
+    for (int i = 0; i < workers_n; i++) {
+        stats->executed += workers[i].executed;
+        stats->stolen += workers[i].stolen;
+    }
+}
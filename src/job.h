@@ -0,0 +1,52 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define MAX_WORKERS 32
+#define MIN_WORKERS 2
+
+typedef void (*job_func_t)(void* data);
+typedef void (*range_func_t)(void* data, uint32_t begin, uint32_t end);
+
+// Jobs decrement their counter when done, waiting on a counter is how dependencies are expressed
+struct _job_counter_t {
+    atomic_int value;
+};
+
+struct _job_decl_t {
+    job_func_t func;
+    void* data;
+};
+
+struct _job_stats_t {
+    long executed, stolen;
+};
+
+typedef struct _job_counter_t job_counter_t;
+typedef struct _job_decl_t job_decl_t;
+typedef struct _job_stats_t job_stats_t;
+
+// Spawns workers besides the calling thread, which becomes worker 0. Zero means one per core and at least MIN_WORKERS.
+void start_jobs(int workers);
+void stop_jobs();
+
+int job_workers();
+int job_worker_index();
+
+void run_jobs(const job_decl_t* decls, int count, job_counter_t* counter);
+
+// For threads outside the pool, which would otherwise run their jobs inline. Queued jobs run in the order given.
+void queue_job(job_func_t func, void* data, job_counter_t* counter);
+void wait_for_counter(job_counter_t* counter);
+
+// Runs one job on the calling pool thread if any is waiting, for loops that poll for something else between jobs
+int run_pending_job();
+
+// Splits [0, count) into chunks of at most grain items and blocks until all of them have run
+void parallel_for(uint32_t count, uint32_t grain, range_func_t func, void* data);
+
+void job_stats(job_stats_t* stats);
+
+#endif  // JOB_H
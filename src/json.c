@@ -0,0 +1,170 @@
+#include "json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JSON_DEPTH 64
+
+uint32_t push_token(json_t* json, uint32_t* capacity, int type, uint32_t start, uint32_t end) {
+    if (json->tokens_n == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 256;
+        json->tokens = realloc(json->tokens, sizeof(json_token_t) * *capacity);
+    }
+
+    json_token_t* token = &json->tokens[json->tokens_n];
+    token->type = type;
+    token->start = start;
+    token->end = end;
+    token->next = json->tokens_n + 1;
+
+    return json->tokens_n++;
+}
+
+int parse_json(json_t* json, const char* text, size_t length) {
+    memset(json, 0, sizeof(json_t));
+    json->text = text;
+
+    uint32_t capacity = 0;
+    uint32_t stack[JSON_DEPTH];
+    int depth = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        char c = text[i];
+
+        if (c == '{' || c == '[') {
+            if (depth == JSON_DEPTH)
+                goto fail;
+
+            stack[depth++] = push_token(json, &capacity, c == '{' ? JSON_OBJECT : JSON_ARRAY, i, i);
+        } else if (c == '}' || c == ']') {
+            if (depth == 0 || json->tokens[stack[depth - 1]].type != (c == '}' ? JSON_OBJECT : JSON_ARRAY))
+                goto fail;
+
+            json_token_t* token = &json->tokens[stack[--depth]];
+            token->end = i + 1;
+            token->next = json->tokens_n;
+        } else if (c == '"') {
+            size_t start = ++i;
+
+            while (i < length && text[i] != '"')
+                i += text[i] == '\\' ? 2 : 1;
+
+            if (i >= length)
+                goto fail;
+
+            push_token(json, &capacity, JSON_STRING, start, i);
+        } else if (c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != ':' && c != ',') {
+            // Numbers, true, false and null run up to the next delimiter
+            size_t start = i;
+
+            while (i + 1 < length && !strchr(" \t\n\r:,]}", text[i + 1]))
+                i++;
+
+            push_token(json, &capacity, JSON_PRIMITIVE, start, i + 1);
+        }
+    }
+
+    if (depth == 0 && json->tokens_n > 0)
+        return 1;
+
+fail:
+    free_json(json);
+    return 0;
+}
+
+void free_json(json_t* json) {
+    free(json->tokens);
+    memset(json, 0, sizeof(json_t));
+}
+
+int json_get(const json_t* json, int object, const char* key) {
+    if (object < 0 || json->tokens[object].type != JSON_OBJECT)
+        return -1;
+
+    size_t length = strlen(key);
+
+    // Keys and values alternate, a value's next is the following key
+    for (uint32_t k = object + 1; k + 1 < json->tokens[object].next; k = json->tokens[k + 1].next) {
+        const json_token_t* token = &json->tokens[k];
+
+        if (token->type == JSON_STRING && token->end - token->start == length &&
+            memcmp(json->text + token->start, key, length) == 0)
+            return k + 1;
+    }
+
+    return -1;
+}
+
+int json_at(const json_t* json, int array, uint32_t index) {
+    if (array < 0 || json->tokens[array].type != JSON_ARRAY)
+        return -1;
+
+    for (uint32_t e = array + 1, i = 0; e < json->tokens[array].next; e = json->tokens[e].next, i++)
+        if (i == index)
+            return e;
+
+    return -1;
+}
+
+uint32_t json_count(const json_t* json, int array) {
+    if (array < 0 || json->tokens[array].type != JSON_ARRAY)
+        return 0;
+
+    uint32_t n = 0;
+    for (uint32_t e = array + 1; e < json->tokens[array].next; e = json->tokens[e].next)
+        n++;
+
+    return n;
+}
+
+double json_number(const json_t* json, int token, double fallback) {
+    if (token < 0 || json->tokens[token].type != JSON_PRIMITIVE)
+        return fallback;
+
+    // The token is followed by a delimiter, so strtod stops inside the text
+    char* end;
+    double value = strtod(json->text + json->tokens[token].start, &end);
+
+    return end == json->text + json->tokens[token].start ? fallback : value;
+}
+
+int json_string(const json_t* json, int token, char* out, size_t size) {
+    if (token < 0 || json->tokens[token].type != JSON_STRING || size == 0)
+        return 0;
+
+    const char* c = json->text + json->tokens[token].start;
+    const char* end = json->text + json->tokens[token].end;
+    size_t n = 0;
+
+    while (c < end) {
+        char value = *c++;
+
+        if (value == '\\' && c < end) {
+            char escape = *c++;
+
+            // \u escapes past ASCII are not needed by anything we read
+            if (escape == 'u' && end - c >= 4) {
+                char hex[5] = {c[0], c[1], c[2], c[3], 0};
+                long code = strtol(hex, NULL, 16);
+
+                value = code < 0x80 ? (char)code : '?';
+                c += 4;
+            } else {
+                const char* from = "nrtbf";
+                const char* to = "\n\r\t\b\f";
+                const char* found = strchr(from, escape);
+
+                value = found ? to[found - from] : escape;
+            }
+        }
+
+        if (n + 1 >= size)
+            return 0;
+
+        out[n++] = value;
+    }
+
+    out[n] = '\0';
+    return 1;
+}
@@ -0,0 +1,45 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum { JSON_OBJECT, JSON_ARRAY, JSON_STRING, JSON_PRIMITIVE };
+
+// Tokens are stored depth first, a container's children follow it up to its next
+struct _json_token_t {
+    int type;
+
+    // Byte range in the text, strings exclude their quotes
+    uint32_t start, end;
+
+    // Index of the first token after this one's subtree
+    uint32_t next;
+};
+
+// Points into the text it was parsed from, which has to outlive it
+struct _json_t {
+    const char* text;
+
+    struct _json_token_t* tokens;
+    uint32_t tokens_n;
+};
+
+typedef struct _json_token_t json_token_t;
+typedef struct _json_t json_t;
+
+// Returns 0 on malformed input. Values are not validated beyond their structure.
+int parse_json(json_t* json, const char* text, size_t length);
+void free_json(json_t* json);
+
+// Lookups take and return token indices, -1 when missing, so they chain without checks in between
+int json_get(const json_t* json, int object, const char* key);
+int json_at(const json_t* json, int array, uint32_t index);
+uint32_t json_count(const json_t* json, int array);
+
+double json_number(const json_t* json, int token, double fallback);
+
+// Copies a string value with its escapes resolved, returns 0 if the token is not a string or does not fit
+int json_string(const json_t* json, int token, char* out, size_t size);
+
+#endif  // JSON_H
@@ -0,0 +1,160 @@
+#include "lz4.h"
+
+#include <string.h>
+
+#define LZ4_HASH_BITS 14
+#define LZ4_MIN_MATCH 4
+#define LZ4_MAX_OFFSET 65535
+
+// The format requires the last 5 bytes to be literals and the last match to start 12 bytes before the end
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+
+uint32_t lz4_read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+uint32_t lz4_hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+uint8_t* lz4_write_length(uint8_t* out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+uint8_t* lz4_write_sequence(uint8_t* out, const uint8_t* literals, size_t literals_n, size_t offset,
+                            size_t match_n) {
+    uint8_t* token = out++;
+    *token = (uint8_t)((literals_n < 15 ? literals_n : 15) << 4);
+
+    if (literals_n >= 15)
+        out = lz4_write_length(out, literals_n - 15);
+
+    memcpy(out, literals, literals_n);
+    out += literals_n;
+
+    // The final sequence is literals only
+    if (match_n == 0)
+        return out;
+
+    *out++ = (uint8_t)offset;
+    *out++ = (uint8_t)(offset >> 8);
+
+    match_n -= LZ4_MIN_MATCH;
+    *token |= match_n < 15 ? match_n : 15;
+
+    if (match_n >= 15)
+        out = lz4_write_length(out, match_n - 15);
+
+    return out;
+}
+
+size_t lz4_compress(uint8_t* out, const uint8_t* in, size_t size) {
+    // Positions plus one, so zero means empty
+    uint32_t table[1 << LZ4_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    uint8_t* cursor = out;
+    size_t anchor = 0, i = 0;
+
+    if (size > LZ4_MATCH_LIMIT) {
+        size_t limit = size - LZ4_MATCH_LIMIT;
+
+        while (i < limit) {
+            uint32_t sequence = lz4_read32(in + i);
+            uint32_t hash = lz4_hash(sequence);
+            size_t candidate = table[hash];
+
+            table[hash] = i + 1;
+
+            if (candidate == 0 || i - (candidate - 1) > LZ4_MAX_OFFSET || lz4_read32(in + candidate - 1) != sequence) {
+                i++;
+                continue;
+            }
+
+            size_t match = candidate - 1;
+            size_t length = LZ4_MIN_MATCH;
+
+            while (i + length < size - LZ4_LAST_LITERALS && in[match + length] == in[i + length])
+                length++;
+
+            cursor = lz4_write_sequence(cursor, in + anchor, i - anchor, i - match, length);
+
+            i += length;
+            anchor = i;
+        }
+    }
+
+    cursor = lz4_write_sequence(cursor, in + anchor, size - anchor, 0, 0);
+    return cursor - out;
+}
+
+size_t lz4_decompress(uint8_t* out, size_t out_size, const uint8_t* in, size_t in_size) {
+    const uint8_t* end = in + in_size;
+    size_t written = 0;
+
+    while (in < end) {
+        uint8_t token = *in++;
+        size_t literals_n = token >> 4;
+
+        if (literals_n == 15) {
+            uint8_t extra;
+            do {
+                if (in == end)
+                    return 0;
+
+                extra = *in++;
+                literals_n += extra;
+            } while (extra == 255);
+        }
+
+        if (literals_n > (size_t)(end - in) || literals_n > out_size - written)
+            return 0;
+
+        memcpy(out + written, in, literals_n);
+        in += literals_n;
+        written += literals_n;
+
+        if (in == end)
+            break;
+
+        if (end - in < 2)
+            return 0;
+
+        size_t offset = in[0] | (size_t)in[1] << 8;
+        in += 2;
+
+        size_t match_n = (token & 15) + LZ4_MIN_MATCH;
+
+        if ((token & 15) == 15) {
+            uint8_t extra;
+            do {
+                if (in == end)
+                    return 0;
+
+                extra = *in++;
+                match_n += extra;
+            } while (extra == 255);
+        }
+
+        if (offset == 0 || offset > written || match_n > out_size - written)
+            return 0;
+
+        // Matches may overlap their own output, so copy forwards byte by byte
+        const uint8_t* match = out + written - offset;
+        for (size_t k = 0; k < match_n; k++)
+            out[written + k] = match[k];
+
+        written += match_n;
+    }
+
+    return written == out_size ? written : 0;
+}
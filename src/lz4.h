@@ -0,0 +1,16 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Worst case output of lz4_compress for size bytes of input
+#define LZ4_BOUND(size) ((size) + (size) / 255 + 16)
+
+// LZ4 block format, greedy matching over a hash of 4 byte sequences. Returns the compressed size.
+size_t lz4_compress(uint8_t* out, const uint8_t* in, size_t size);
+
+// Returns the decompressed size, or 0 if the input is malformed or does not decode to exactly out_size bytes
+size_t lz4_decompress(uint8_t* out, size_t out_size, const uint8_t* in, size_t in_size);
+
+#endif  // LZ4_H
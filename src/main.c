@@ -5,32 +5,180 @@
 #include "glfw.h"
 #include "linmath.h"
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
 #define ENGINE_INCLUDES
+#include "arena.h"
+#include "batch.h"
+#include "bvh.h"
+#include "frustum.h"
+#include "job.h"
 #include "model.h"
+#include "pick.h"
+#include "reader.h"
 #include "shader.h"
+#include "stream.h"
+#include "texture.h"
+#include "transform.h"
+#include "vfs.h"
+#include "watch.h"
 
 GLFWwindow *window;
 
+// Set by the mouse callback, resolved in the frame loop against that frame's matrices
+int pick_requested = 0;
+double pick_x, pick_y;
+
+struct _draw_t {
+    uint64_t key;
+    int visible;
+
+    submodel_t *submodel;
+    int index;
+    uint32_t lod;
+
+    // Pixels per unit of texture coordinates, streams in the material's mips
+    float texels;
+
+    // Surviving meshlet ranges, drawn with one multi-draw when set
+    GLsizei ranges_n;
+    GLsizei *counts;
+    const void **offsets;
+    GLint *base_vertices;
+    uint32_t meshlets_culled;
+
+    object_data_t *mesh_data, *bounds_data;
+    GLintptr mesh_offset, bounds_offset;
+};
+
+struct _frame_context_t {
+    mat4x4 view;
+    frustum_t frustum;
+
+    transforms_t *transforms;
+    int selected;
+
+    // Pixels per unit of size at unit view depth
+    float lod_scale;
+
+    model_t *model;
+    const geometry_alloc_t *geometry;
+    vec3 camera;
+
+    struct _draw_t *draws;
+
+    // World bounds indexed by draw index, the items of the scene BVH
+    vec3 *world_min, *world_max;
+};
+
+// glfwGetTime stamps of the startup phases, the model batch holds the per file ones
+struct _startup_t {
+    double start;
+    double window_begin, window_end;
+    double uploads_begin, uploads_end;
+    double shaders_end, first_frame;
+};
+
+typedef struct _draw_t draw_t;
+typedef struct _frame_context_t frame_context_t;
+typedef struct _startup_t startup_t;
+
 void init();
+void create_window();
 void deinit();
 
+void print_startup(const startup_t *startup, const model_batch_t *models);
+
+void update_draws(void *data, uint32_t begin, uint32_t end);
+void cull_draw_meshlets(void *data, uint32_t begin, uint32_t end);
+int compare_draws(const void *a, const void *b);
+
 int main() {
     init();
 
-    shader_t shader, line_shader;
-    load_shader(&shader, "shaders/vertex.glsl", "shaders/fragment.glsl");
-    load_shader(&line_shader, "shaders/line-vertex.glsl", "shaders/line-fragment.glsl");
+    startup_t startup;
+    startup.start = glfwGetTime();
+
+    start_jobs(0);
+    init_batch_math();
+
+    // Deployments ship a pack instead of loose files, which then only serve files the pack lacks
+    if (mount_pack(VFS_DEFAULT_PACK))
+        printf("Mounted %s\n", VFS_DEFAULT_PACK);
+
+    start_reader();
+
+    // Reads and parses need no context, so they run on the workers while the window comes up
+    const char *model_paths[] = {"assets/bulb.obj"};
+    const uint32_t models_n = sizeof(model_paths) / sizeof(model_paths[0]);
 
     model_t object;
-    load_model(&object, "assets/bulb.obj");
+    model_batch_t models;
+    begin_model_loads(&models, &object, model_paths, models_n, MODEL_KEEP_POSITIONS | MODEL_MESHLETS);
+
+    shader_set_t mesh_shaders;
+    load_shader_set(&mesh_shaders, "shaders/vertex.glsl", "shaders/fragment.glsl");
+
+    shader_set_t line_shaders;
+    load_shader_set(&line_shaders, "shaders/line-vertex.glsl", "shaders/line-fragment.glsl");
+
+    startup.window_begin = glfwGetTime();
+    create_window();
+    startup.window_end = glfwGetTime();
+
+    // Only the variants the scene actually draws with get compiled, the driver works on them during the uploads
+    shader_t *shader = get_shader_variant(&mesh_shaders, SHADER_LIGHTING);
+    shader_t *line_shader = get_shader_variant(&line_shaders, 0);
+
+    init_texture_cache(&texture_cache, TEXTURE_UPLOAD_BUDGET, TEXTURE_VRAM_BUDGET);
+
+    startup.uploads_begin = glfwGetTime();
+    finish_model_loads(&models);
+    startup.uploads_end = glfwGetTime();
+
+    // Materials are only known once parsed, the textured variant then compiles alongside the others instead of
+    // stalling the frame its first texture becomes ready
+    shader_t *textured_shader = NULL;
+
+    for (uint32_t i = 0; i < object.materials_n && textured_shader == NULL; i++)
+        if (object.materials[i].diffuse_map != NULL)
+            textured_shader = get_shader_variant(&mesh_shaders, SHADER_TEXTURE | SHADER_LIGHTING);
+
+    finish_shader(shader);
+    finish_shader(line_shader);
+
+    if (textured_shader != NULL)
+        finish_shader(textured_shader);
+    startup.shaders_end = glfwGetTime();
+
+    transforms_t transforms;
+    init_transforms(&transforms);
+    attach_model_transforms(&object, &transforms, NO_PARENT);
+
+    geometry_stats_t stats;
+    geometry_stats(&mesh_arena, &stats);
 
-    char title[16];
+    printf("Geometry: %.1f%% vertices, %.1f%% indices used (%.1f%%, %.1f%% fragmented)\n",
+           stats.vertex_occupancy * 100.0f, stats.index_occupancy * 100.0f, stats.vertex_fragmentation * 100.0f,
+           stats.index_fragmentation * 100.0f);
+
+    start_watch();
+    watch_shader_set(&mesh_shaders, "shaders/vertex.glsl", "shaders/fragment.glsl");
+    watch_shader_set(&line_shaders, "shaders/line-vertex.glsl", "shaders/line-fragment.glsl");
+    watch_model(&object, "assets/bulb.obj");
+
+    scene_bvh_t scene;
+    init_scene_bvh(&scene);
+
+    stream_buffer_t stream;
+    init_stream_buffer(&stream, GL_UNIFORM_BUFFER, 1 << 20);
+
+    char title[96];
+    uint32_t meshlets_culled = 0;
+    int first_frame = 1;
+    int selected = -1;
 
     double time_elapsed = 0, last_second = 0;
     int frames = 0;
+    unsigned int frame_index = 0;
 
     while (!glfwWindowShouldClose(window)) {
         double current_time = glfwGetTime();
@@ -41,102 +189,360 @@ int main() {
         if (current_time - last_second > 1.0) {
             double fps = frames / (current_time - last_second);
 
-            sprintf(title, "FPS: %.2f", fps);
+            sprintf(title, "FPS: %.2f, Stalls: %d, Meshlets culled: %u", fps, stream.stalls, meshlets_culled);
             glfwSetWindowTitle(window, title);
 
             frames = 0;
             last_second = current_time;
         }
 
+        begin_frame_arenas(frame_index++);
+        apply_reloads();
+        update_textures(&texture_cache);
+
+        // Materials refer to array layers, so the arrays are bound once and draws never switch textures
+        int textured = update_model_materials(&object);
+        bind_texture_arrays(&texture_cache);
+
         int width, height;
         glfwGetFramebufferSize(window, &width, &height);
 
         // Render
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        mat4x4 model, view, projection;
-        mat4x4_identity(model);
-        mat4x4_look_at(view, (vec3){0, 0, 10}, (vec3){0, 2, 0}, (vec3){0, 1, 0});
-        mat4x4_perspective(projection, 45.0f, (float)width / (float)height, 0.1f, 100.0f);
+        // Two Object blocks per submodel, the region grows between frames when a reload adds submodels
+        int draws_n = 0;
+        for (submodel_t *submodel = object.root; submodel != NULL; submodel = submodel->child)
+            draws_n++;
+
+        reserve_stream_buffer(&stream, stream_aligned_size(&stream, sizeof(frame_data_t)) +
+                                           stream_aligned_size(&stream, sizeof(object_data_t)) * 2 * draws_n);
+
+        begin_stream_frame(&stream);
+
+        GLintptr frame_offset;
+        frame_data_t *frame = stream_alloc(&stream, sizeof(frame_data_t), &frame_offset);
+
+        mat4x4_look_at(frame->view, (vec3){0, 0, 10}, (vec3){0, 2, 0}, (vec3){0, 1, 0});
+        mat4x4_perspective(frame->projection, 45.0f, (float)width / (float)height, 0.1f, 100.0f);
+
+        // Animate, only nodes touched here and their descendants get recomputed
+        int index = 0;
+        for (submodel_t *submodel = object.root; submodel != NULL; submodel = submodel->child, index++) {
+            mat4x4 local;
+            mat4x4_translation(local, 0, sin(time_elapsed * (index + 1)) * 0.1f, 0);
+
+            set_local_transform(&transforms, submodel->transform, local);
+        }
+
+        update_transforms(&transforms);
+
+        frame_context_t context;
+        context.transforms = &transforms;
+        context.selected = selected;
+        context.lod_scale = frame->projection[1][1] * 0.5f * height;
+        mat4x4_copy(context.view, frame->view);
+
+        mat4x4 inverse_view;
+        mat4x4_invert(inverse_view, frame->view);
+        vec3_copy(context.camera, inverse_view[3]);
 
-        mat4x4 normal, temp;
-        mat4x4_transpose(temp, model);
-        mat4x4_invert(normal, temp);
+        mat4x4 view_projection;
+        mat4x4_mul(view_projection, frame->projection, frame->view);
+        frustum_from_matrix(&context.frustum, view_projection);
+
+        // Stream allocation is single threaded, the blocks are filled in by the jobs
+        draw_t *draws = frame_alloc(sizeof(draw_t) * draws_n, 0);
 
         int i = 0;
-        submodel_t *submodel = object.root;
-        while (submodel != NULL) {
-            glUseProgram(shader.program);
+        for (submodel_t *submodel = object.root; submodel != NULL; submodel = submodel->child, i++) {
+            draws[i].submodel = submodel;
+            draws[i].index = i;
+
+            draws[i].mesh_data = stream_alloc(&stream, sizeof(object_data_t), &draws[i].mesh_offset);
+            draws[i].bounds_data = stream_alloc(&stream, sizeof(object_data_t), &draws[i].bounds_offset);
+
+            if (draws[i].mesh_data == NULL || draws[i].bounds_data == NULL)
+                break;
+        }
+
+        draws_n = i;
+
+        context.draws = draws;
+        context.world_min = frame_alloc(sizeof(vec3) * draws_n, 16);
+        context.world_max = frame_alloc(sizeof(vec3) * draws_n, 16);
+
+        parallel_for(draws_n, 256, update_draws, &context);
+
+        // Culling
+        update_scene_bvh(&scene, context.world_min, context.world_max, draws_n);
 
-            GLint model_loc = glGetUniformLocation(shader.program, "model");
-            glUniformMatrix4fv(model_loc, 1, GL_FALSE, (float *)model);
+        uint8_t *visible = frame_alloc(draws_n, 0);
+        cull_scene_bvh(&scene, &context.frustum, visible);
 
-            GLint view_loc = glGetUniformLocation(shader.program, "view");
-            glUniformMatrix4fv(view_loc, 1, GL_FALSE, (float *)view);
+        for (i = 0; i < draws_n; i++) {
+            draws[i].visible = visible[draws[i].index];
+            draws[i].key |= (uint64_t)!draws[i].visible << 63;
+        }
+
+        // Meshlet culling only for draws that survived the BVH
+        context.model = &object;
+        context.geometry = get_geometry(&mesh_arena, object.geometry);
+        parallel_for(draws_n, 64, cull_draw_meshlets, &context);
+
+        meshlets_culled = 0;
+        for (i = 0; i < draws_n; i++)
+            meshlets_culled += draws[i].meshlets_culled;
+
+        // Only what is on screen asks for detail, update_textures picks it up next frame
+        for (i = 0; i < draws_n; i++) {
+            texture_t *texture = object.materials[draws[i].submodel->material].diffuse_texture;
 
-            GLint projection_loc = glGetUniformLocation(shader.program, "projection");
-            glUniformMatrix4fv(projection_loc, 1, GL_FALSE, (float *)projection);
+            if (draws[i].visible && texture != NULL && draws[i].texels > 0.0f)
+                request_texture(texture, draws[i].texels);
+        }
+
+        // Picking, the scene BVH now matches what is on screen
+        if (pick_requested) {
+            double pick_start = glfwGetTime();
 
-            GLint normal_loc = glGetUniformLocation(shader.program, "normal");
-            glUniformMatrix4fv(normal_loc, 1, GL_FALSE, (float *)normal);
+            int window_width, window_height;
+            glfwGetWindowSize(window, &window_width, &window_height);
 
-            GLint color_loc = glGetUniformLocation(shader.program, "color");
-            glUniform3f(color_loc, 1.0f, 1.0f, 1.0f);
+            float x = (float)(pick_x / window_width) * 2.0f - 1.0f;
+            float y = 1.0f - (float)(pick_y / window_height) * 2.0f;
 
-            // Draw model
+            vec3 origin, dir;
+            unproject_ray(origin, dir, frame->view, frame->projection, x, y);
 
-            // clang-format off
-            float colors[] = { 0.5f, 0.0f, 0.0f, 
-                               0.0f, 0.5f, 0.0f,
-                               0.0f, 0.0f, 0.5f };
-            // clang-format on
+            ray_hit_t hit;
+            selected = pick_submodel(&scene, &object, &transforms, origin, dir, &hit);
 
-            glUniform3fv(color_loc, 1, colors + i++ * 3);
+            if (selected >= 0)
+                printf("Picked submodel %d, triangle %u at %.2f (%.3f ms)\n", selected, hit.triangle, hit.t,
+                       (glfwGetTime() - pick_start) * 1000.0);
 
-            mat4x4_identity(model);
-            mat4x4_translate(model, model, 0, sin(time_elapsed * i) * 0.1f, 0);
-            glUniformMatrix4fv(model_loc, 1, GL_FALSE, (float *)model);
+            pick_requested = 0;
+        }
 
-            glBindVertexArray(object.vao);
-            glDrawElements(GL_TRIANGLES, submodel->count, GL_UNSIGNED_INT, (void *)(sizeof(u_int32_t) * submodel->offset));
+        // Culled draws sort to the end, visible ones front to back
+        qsort(draws, draws_n, sizeof(draw_t), compare_draws);
 
-            glUseProgram(line_shader.program);
+        flush_stream(&stream);
 
-            model_loc = glGetUniformLocation(line_shader.program, "model");
-            glUniformMatrix4fv(model_loc, 1, GL_FALSE, (float *)model);
+        glBindBufferRange(GL_UNIFORM_BUFFER, SHADER_BLOCK_FRAME, stream.buffer, frame_offset, sizeof(frame_data_t));
+        glBindBufferBase(GL_UNIFORM_BUFFER, SHADER_BLOCK_MATERIALS, object.material_buffer);
 
-            view_loc = glGetUniformLocation(line_shader.program, "view");
-            glUniformMatrix4fv(view_loc, 1, GL_FALSE, (float *)view);
+        const geometry_alloc_t *geometry = get_geometry(&mesh_arena, object.geometry);
+        const geometry_alloc_t *bounds = get_geometry(&bounds_arena, object.bb_geometry);
 
-            projection_loc = glGetUniformLocation(line_shader.program, "projection");
-            glUniformMatrix4fv(projection_loc, 1, GL_FALSE, (float *)projection);
+        // Untextured materials sample nothing, so one program covers every draw
+        use_shader(textured ? get_shader_variant(&mesh_shaders, SHADER_TEXTURE | SHADER_LIGHTING) : shader);
+        glBindVertexArray(mesh_arena.vao);
 
-            color_loc = glGetUniformLocation(line_shader.program, "color");
-            glUniform3f(color_loc, 1.0f, 1.0f, 1.0f);
+        for (i = 0; i < draws_n && draws[i].visible; i++) {
+            submodel_t *submodel = draws[i].submodel;
 
-            glBindVertexArray(object.bb_vao);
+            glBindBufferRange(GL_UNIFORM_BUFFER, SHADER_BLOCK_OBJECT, stream.buffer, draws[i].mesh_offset,
+                              sizeof(object_data_t));
 
-            uint32_t offset = submodel->bb_index * 25;
-            glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, (void *)(sizeof(u_int32_t) * offset));
+            uint32_t lod = draws[i].lod;
+
+            if (draws[i].counts != NULL)
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, draws[i].counts, GL_UNSIGNED_INT, draws[i].offsets,
+                                              draws[i].ranges_n, draws[i].base_vertices);
+            else
+                glDrawElementsBaseVertex(
+                    GL_TRIANGLES, submodel->lod_count[lod], GL_UNSIGNED_INT,
+                    (void *)(sizeof(uint32_t) * (geometry->first_index + submodel->lod_offset[lod])),
+                    geometry->base_vertex);
+        }
+
+        // Bounding boxes
+        use_shader(line_shader);
+        glBindVertexArray(bounds_arena.vao);
+
+        for (i = 0; i < draws_n && draws[i].visible; i++) {
+            submodel_t *submodel = draws[i].submodel;
+
+            glBindBufferRange(GL_UNIFORM_BUFFER, SHADER_BLOCK_OBJECT, stream.buffer, draws[i].bounds_offset,
+                              sizeof(object_data_t));
+
+            uint32_t offset = bounds->first_index + submodel->bb_index * 25;
+            glDrawElementsBaseVertex(GL_LINES, 24, GL_UNSIGNED_INT, (void *)(sizeof(uint32_t) * offset),
+                                     bounds->base_vertex);
 
             glDisable(GL_DEPTH_TEST);
-            glDrawElements(GL_POINTS, 1, GL_UNSIGNED_INT, (void *)(sizeof(u_int32_t) * (offset + 24)));
+            glDrawElementsBaseVertex(GL_POINTS, 1, GL_UNSIGNED_INT, (void *)(sizeof(uint32_t) * (offset + 24)),
+                                     bounds->base_vertex);
             glEnable(GL_DEPTH_TEST);
-
-            submodel = submodel->child;
         }
 
+        end_stream_frame(&stream);
+
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (first_frame) {
+            startup.first_frame = glfwGetTime();
+            print_startup(&startup, &models);
+            free_model_batch(&models);
+
+            first_frame = 0;
+        }
     }
 
+    if (first_frame)
+        free_model_batch(&models);
+
+    stop_watch();
+
+    printf("Textures: %u of %u ready, %.1f MB in VRAM (%.1f MB as RGBA8), %u levels streamed, %u evicted, "
+           "%.1f ms decoding\n",
+           texture_cache.ready, texture_cache.textures_n, texture_cache.resident / (1024.0 * 1024.0),
+           texture_cache.resident_uncompressed / (1024.0 * 1024.0), texture_cache.streamed, texture_cache.evicted,
+           texture_cache.decode_time * 1000.0);
+    free_texture_cache(&texture_cache);
+
+    printf("Scene BVH: %u builds (last %.3f ms), %u refits (last %.3f ms), SAH cost %.2f\n", scene.builds,
+           scene.build_time * 1000.0, scene.refits, scene.refit_time * 1000.0, scene.cost);
+    free_scene_bvh(&scene);
+
+    free_stream_buffer(&stream);
+
+    job_stats_t job_totals;
+    job_stats(&job_totals);
+    printf("Jobs: %ld executed, %ld stolen\n", job_totals.executed, job_totals.stolen);
+
+    stop_reader();
+    stop_jobs();
+
+    printf("Frame arena: %zu bytes high water\n", frame_arena_high_water());
+    free_frame_arenas();
+
     free_model(&object);
-    glDeleteProgram(shader.program);
+    free_transforms(&transforms);
+    free_geometry_arena(&mesh_arena);
+    free_geometry_arena(&bounds_arena);
+    free_shader_set(&mesh_shaders);
+    free_shader_set(&line_shaders);
+    unmount_packs();
 
     deinit();
     return EXIT_SUCCESS;
 }
 
+void update_draws(void *data, uint32_t begin, uint32_t end) {
+    frame_context_t *context = data;
+    uint32_t n = end - begin;
+
+    transforms_t *transforms = context->transforms;
+
+    mat4x4 *models = frame_alloc(sizeof(mat4x4) * n, 32);
+
+    vec3 *local_min = frame_alloc(sizeof(vec3) * n, 16), *local_max = frame_alloc(sizeof(vec3) * n, 16);
+    vec3 *world_min = context->world_min + begin, *world_max = context->world_max + begin;
+
+    // Gather world matrices so the bounds transform sees contiguous input
+    for (uint32_t i = 0; i < n; i++) {
+        draw_t *draw = &context->draws[begin + i];
+
+        mat4x4_copy(models[i], transforms->world[draw->submodel->transform]);
+
+        vec3_copy(local_min[i], draw->submodel->bbox_min);
+        vec3_copy(local_max[i], draw->submodel->bbox_max);
+    }
+
+    batch_transform_aabb(world_min, world_max, models, local_min, local_max, n);
+
+    // Sort depth from the world box centres, which are the submodel box centres moved by their matrices
+    vec3 *centres = frame_alloc(sizeof(vec3) * n, 16), *view_centres = frame_alloc(sizeof(vec3) * n, 16);
+
+    for (uint32_t i = 0; i < n; i++)
+        for (int k = 0; k < 3; k++)
+            centres[i][k] = (world_min[i][k] + world_max[i][k]) * 0.5f;
+
+    batch_transform_points(view_centres, context->view, centres, n);
+
+    for (uint32_t i = 0; i < n; i++) {
+        draw_t *draw = &context->draws[begin + i];
+        mat4x4 *normal = &transforms->normal[draw->submodel->transform];
+
+        mat4x4_copy(draw->mesh_data->model, models[i]);
+        mat4x4_copy(draw->mesh_data->normal, *normal);
+        draw->mesh_data->material = draw->submodel->material;
+
+        // The selection highlight mostly replaces the material colour
+        if (draw->index == context->selected)
+            vec4_set(draw->mesh_data->color, 1.0f, 0.8f, 0.2f, 0.75f);
+        else
+            vec4_set(draw->mesh_data->color, 0.0f, 0.0f, 0.0f, 0.0f);
+
+        mat4x4_copy(draw->bounds_data->model, models[i]);
+        mat4x4_copy(draw->bounds_data->normal, *normal);
+        vec4_set(draw->bounds_data->color, 1.0f, 1.0f, 1.0f, 1.0f);
+        draw->bounds_data->material = 0;
+
+        // Sort key, front to back by view depth of the box centre
+        float depth = -view_centres[i][2] > 0.0f ? -view_centres[i][2] : 0.0f;
+
+        // Level of detail from the projected size of the world box
+        vec3 diagonal;
+        vec3_sub(diagonal, world_max[i], world_min[i]);
+
+        float screen_size = depth > 0.0f ? vec3_len(diagonal) / depth * context->lod_scale : INFINITY;
+        draw->lod = select_lod(draw->submodel, screen_size);
+        draw->texels = draw->submodel->uv_extent > 0.0f ? screen_size / draw->submodel->uv_extent : 0.0f;
+
+        uint32_t depth_bits;
+        memcpy(&depth_bits, &depth, sizeof(float));
+
+        // Visibility is or-ed into the top bit once the scene BVH has been culled
+        draw->key = depth_bits;
+    }
+}
+
+void cull_draw_meshlets(void *data, uint32_t begin, uint32_t end) {
+    frame_context_t *context = data;
+
+    for (uint32_t i = begin; i < end; i++) {
+        draw_t *draw = &context->draws[i];
+        submodel_t *submodel = draw->submodel;
+
+        draw->counts = NULL;
+        draw->meshlets_culled = 0;
+
+        // Meshlets only cover the full resolution level
+        if (!draw->visible || draw->lod != 0 || submodel->meshlets_n == 0)
+            continue;
+
+        uint32_t n = submodel->meshlets_n;
+        uint32_t *firsts = frame_alloc(sizeof(uint32_t) * n * 2, 0), *counts = firsts + n;
+
+        const mat4x4 *world = &context->transforms->world[submodel->transform];
+        uint32_t ranges_n = cull_meshlets(context->model->meshlets + submodel->meshlet_first, n, *world,
+                                          &context->frustum, context->camera, firsts, counts, &draw->meshlets_culled);
+
+        draw->ranges_n = ranges_n;
+        draw->counts = frame_alloc(sizeof(GLsizei) * (ranges_n + 1), 0);
+        draw->offsets = frame_alloc(sizeof(void *) * (ranges_n + 1), 0);
+        draw->base_vertices = frame_alloc(sizeof(GLint) * (ranges_n + 1), 0);
+
+        for (uint32_t j = 0; j < ranges_n; j++) {
+            draw->counts[j] = counts[j];
+            draw->offsets[j] = (const void *)(sizeof(uint32_t) * (context->geometry->first_index + firsts[j]));
+            draw->base_vertices[j] = context->geometry->base_vertex;
+        }
+    }
+}
+
+int compare_draws(const void *a, const void *b) {
+    uint64_t x = ((const draw_t *)a)->key;
+    uint64_t y = ((const draw_t *)b)->key;
+
+    return (x > y) - (x < y);
+}
+
 void error_callback(int error, const char *description) {
     fprintf(stderr, "Error: %s\n", description);
 }
@@ -146,11 +552,20 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         glfwSetWindowShouldClose(window, GLFW_TRUE);
 }
 
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods) {
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        glfwGetCursorPos(window, &pick_x, &pick_y);
+        pick_requested = 1;
+    }
+}
+
 void init() {
     glfwSetErrorCallback(error_callback);
     if (!glfwInit())
         exit(EXIT_FAILURE);
+}
 
+void create_window() {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -166,6 +581,7 @@ void init() {
     glfwSwapInterval(1);
 
     glfwSetKeyCallback(window, key_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
 
     // OpenGL setup
 
@@ -183,3 +599,42 @@ void deinit() {
     glfwDestroyWindow(window);
     glfwTerminate();
 }
+
+void print_startup(const startup_t *startup, const model_batch_t *models) {
+    double t0 = startup->start;
+    double reads_begin = t0, reads_end = t0, parses_begin = t0, parses_end = t0;
+    double slowest = 0.0, total = 0.0;
+    const char *slowest_path = "none";
+
+    for (uint32_t i = 0; i < models->count; i++) {
+        const model_load_t *load = &models->loads[i];
+        double parse = load->parse_time - load->read_time;
+
+        if (i == 0 || load->start_time < reads_begin)
+            reads_begin = load->start_time;
+        if (i == 0 || load->read_time < parses_begin)
+            parses_begin = load->read_time;
+        if (load->read_time > reads_end)
+            reads_end = load->read_time;
+        if (load->parse_time > parses_end)
+            parses_end = load->parse_time;
+
+        total += parse;
+        if (parse > slowest) {
+            slowest = parse;
+            slowest_path = load->read.path;
+        }
+    }
+
+    // Phases overlap, first frame time is bounded by the window and the slowest parse rather than their sum
+    printf("Startup timeline, ms since launch:\n");
+    printf("  reads    %8.2f - %8.2f  %u files, %s\n", (reads_begin - t0) * 1000.0, (reads_end - t0) * 1000.0,
+           models->count, reader_backend());
+    printf("  parses   %8.2f - %8.2f  slowest %.2f (%s), %.2f total\n", (parses_begin - t0) * 1000.0,
+           (parses_end - t0) * 1000.0, slowest * 1000.0, slowest_path, total * 1000.0);
+    printf("  window   %8.2f - %8.2f\n", (startup->window_begin - t0) * 1000.0, (startup->window_end - t0) * 1000.0);
+    printf("  shaders  %8.2f - %8.2f  %d cached, %d compiled\n", (startup->window_end - t0) * 1000.0,
+           (startup->shaders_end - t0) * 1000.0, shader_cache_stats.hits, shader_cache_stats.misses);
+    printf("  uploads  %8.2f - %8.2f\n", (startup->uploads_begin - t0) * 1000.0, (startup->uploads_end - t0) * 1000.0);
+    printf("  first frame %.2f\n", (startup->first_frame - t0) * 1000.0);
+}
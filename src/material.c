@@ -0,0 +1,131 @@
+#include "material.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vfs.h"
+
+const char* next_line(const char* line, const char* end);
+void parse_floats(const char* cursor, float* out, int n);
+
+void default_material(material_t* material) {
+    memset(material, 0, sizeof(material_t));
+
+    strcpy(material->name, "default");
+    vec4_set(material->data.diffuse, 0.8f, 0.8f, 0.8f, 1.0f);
+    vec4_set(material->data.specular, 0.0f, 0.0f, 0.0f, 1.0f);
+    material->data.texture_slot = -1;
+}
+
+int resolve_path(char* out, size_t size, const char* base, const char* name, size_t length) {
+    const char* slash = strrchr(base, '/');
+    size_t directory = slash ? slash - base + 1 : 0;
+
+    if (directory + length + 1 > size)
+        return 0;
+
+    memcpy(out, base, directory);
+    memcpy(out + directory, name, length);
+    out[directory + length] = '\0';
+
+    return 1;
+}
+
+// Length of the rest of the line without trailing whitespace
+size_t line_length(const char* line, const char* end) {
+    const char* last = memchr(line, '\n', end - line);
+    last = last ? last : end;
+
+    while (last > line && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r'))
+        last--;
+
+    return last - line;
+}
+
+int parse_materials(material_t** materials, uint32_t* materials_n, const char* path) {
+    vfs_file_t file;
+
+    if (!vfs_open(&file, path))
+        return 0;
+
+    const char* source = file.data;
+    const char* end = source + file.size;
+    material_t* material = NULL;
+
+    for (const char* line = source; line < end; line = next_line(line, end)) {
+        while (*line == ' ' || *line == '\t')
+            line++;
+
+        if (strncmp(line, "newmtl ", 7) == 0) {
+            *materials = realloc(*materials, sizeof(material_t) * (*materials_n + 1));
+            material = &(*materials)[(*materials_n)++];
+
+            default_material(material);
+
+            size_t length = line_length(line + 7, end);
+            length = length < MATERIAL_NAME - 1 ? length : MATERIAL_NAME - 1;
+
+            memcpy(material->name, line + 7, length);
+            material->name[length] = '\0';
+
+        } else if (material == NULL) {
+            continue;
+
+        } else if (strncmp(line, "Kd ", 3) == 0) {
+            parse_floats(line + 3, material->data.diffuse, 3);
+
+        } else if (strncmp(line, "Ks ", 3) == 0) {
+            parse_floats(line + 3, material->data.specular, 3);
+
+        } else if (strncmp(line, "Ns ", 3) == 0) {
+            parse_floats(line + 3, material->data.specular + 3, 1);
+
+        } else if (strncmp(line, "d ", 2) == 0) {
+            parse_floats(line + 2, material->data.diffuse + 3, 1);
+
+        } else if (strncmp(line, "Tr ", 3) == 0) {
+            parse_floats(line + 3, material->data.diffuse + 3, 1);
+            material->data.diffuse[3] = 1.0f - material->data.diffuse[3];
+
+        } else if (strncmp(line, "map_Kd ", 7) == 0) {
+            // Options come before the file name, so only the last word is kept
+            size_t length = line_length(line + 7, end);
+            const char* name = line + 7;
+
+            for (size_t i = 0; i < length; i++)
+                if (line[7 + i] == ' ')
+                    name = line + 7 + i + 1;
+
+            length -= name - (line + 7);
+
+            char resolved[1024];
+            free(material->diffuse_map);
+            material->diffuse_map = NULL;
+
+            if (resolve_path(resolved, sizeof(resolved), path, name, length))
+                material->diffuse_map = strdup(resolved);
+        }
+    }
+
+    vfs_close(&file);
+    return 1;
+}
+
+uint32_t find_material(const material_t* materials, uint32_t materials_n, const char* name, size_t length) {
+    // Names were truncated the same way when parsed
+    length = length < MATERIAL_NAME - 1 ? length : MATERIAL_NAME - 1;
+
+    for (uint32_t i = 1; i < materials_n; i++)
+        if (strlen(materials[i].name) == length && strncmp(materials[i].name, name, length) == 0)
+            return i;
+
+    return 0;
+}
+
+void free_materials(material_t* materials, uint32_t materials_n) {
+    for (uint32_t i = 0; i < materials_n; i++)
+        free(materials[i].diffuse_map);
+
+    free(materials);
+}
@@ -0,0 +1,39 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shader.h"
+
+#define MATERIAL_NAME 64
+
+struct _material_t {
+    char name[MATERIAL_NAME];
+
+    // Uploaded as is into the Materials block
+    struct _material_data_t data;
+
+    // map_Kd resolved against the library's directory, NULL when untextured
+    char* diffuse_map;
+
+    // Requested from the texture cache once the model is uploaded
+    struct _texture_t* diffuse_texture;
+};
+
+typedef struct _material_t material_t;
+
+void default_material(material_t* material);
+
+// Appends every newmtl of a .mtl library, returns 0 if the file could not be read
+int parse_materials(material_t** materials, uint32_t* materials_n, const char* path);
+
+// Index of the material called name, or 0 (the default material) when there is none
+uint32_t find_material(const material_t* materials, uint32_t materials_n, const char* name, size_t length);
+
+void free_materials(material_t* materials, uint32_t materials_n);
+
+// Joins name onto the directory of base, returns 0 if it does not fit
+int resolve_path(char* out, size_t size, const char* base, const char* name, size_t length);
+
+#endif  // MATERIAL_H
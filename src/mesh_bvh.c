@@ -0,0 +1,296 @@
+#include "mesh_bvh.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bvh.h"
+
+#if defined(__SSE__) || defined(__x86_64__)
+#define MESH_BVH_SSE
+#include <xmmintrin.h>
+#endif
+
+uint32_t new_bvh4_node(mesh_bvh_t* bvh) {
+    if (bvh->nodes_n == bvh->nodes_capacity) {
+        bvh->nodes_capacity = bvh->nodes_capacity ? bvh->nodes_capacity * 2 : 64;
+        bvh->nodes = realloc(bvh->nodes, sizeof(bvh4_node_t) * bvh->nodes_capacity);
+    }
+
+    return bvh->nodes_n++;
+}
+
+// Pulls grandchildren up until each wide node has four children, always opening the largest box first
+uint32_t collapse_nodes(mesh_bvh_t* bvh, const bvh_node_t* nodes, uint32_t index, uint32_t base) {
+    uint32_t children[4];
+    int n = 0;
+
+    if (!nodes[index].child) {
+        children[n++] = index;
+    } else {
+        children[n++] = nodes[index].child;
+        children[n++] = nodes[index].child + 1;
+    }
+
+    while (n < 4) {
+        int largest = -1;
+        float largest_area = -1.0f;
+
+        for (int i = 0; i < n; i++) {
+            const bvh_node_t* child = &nodes[children[i]];
+            float area = aabb_area(child->min, child->max);
+
+            if (child->child && area > largest_area) {
+                largest = i;
+                largest_area = area;
+            }
+        }
+
+        if (largest < 0)
+            break;
+
+        uint32_t first = nodes[children[largest]].child;
+        children[largest] = first;
+        children[n++] = first + 1;
+    }
+
+    uint32_t result = new_bvh4_node(bvh);
+
+    for (int i = 0; i < 4; i++) {
+        // Recursing may move the node array, so always index it again
+        if (i >= n) {
+            bvh->nodes[result].child[i] = BVH4_EMPTY;
+            bvh->nodes[result].count[i] = 0;
+            continue;
+        }
+
+        const bvh_node_t* child = &nodes[children[i]];
+        uint32_t target, count = child->child ? 0 : child->count;
+
+        if (count)
+            target = base + child->first;
+        else
+            target = collapse_nodes(bvh, nodes, children[i], base);
+
+        bvh4_node_t* node = &bvh->nodes[result];
+
+        node->min_x[i] = child->min[0];
+        node->min_y[i] = child->min[1];
+        node->min_z[i] = child->min[2];
+        node->max_x[i] = child->max[0];
+        node->max_y[i] = child->max[1];
+        node->max_z[i] = child->max[2];
+
+        node->child[i] = target;
+        node->count[i] = count;
+    }
+
+    return result;
+}
+
+void build_mesh_bvh(mesh_bvh_t* bvh, const float* vertices, uint32_t stride, uint32_t vertices_n,
+                    const uint32_t* indices, uint32_t indices_n, const uint32_t* range_first,
+                    const uint32_t* range_count, uint32_t ranges_n, uint32_t* roots) {
+    memset(bvh, 0, sizeof(mesh_bvh_t));
+
+    // Only positions are kept, the rest of the vertex lives on the GPU
+    bvh->positions = malloc(sizeof(vec3) * vertices_n);
+    bvh->positions_n = vertices_n;
+
+    for (uint32_t i = 0; i < vertices_n; i++)
+        vec3_copy(bvh->positions[i], vertices + (size_t)i * stride);
+
+    bvh->triangles_n = indices_n / 3;
+    bvh->triangles = malloc(sizeof(uint32_t) * 3 * bvh->triangles_n);
+    bvh->triangle_ids = malloc(sizeof(uint32_t) * bvh->triangles_n);
+
+    // Scratch sized for the whole mesh, reused by each range
+    uint32_t* items = malloc(sizeof(uint32_t) * bvh->triangles_n);
+    vec3* item_min = malloc(sizeof(vec3) * bvh->triangles_n);
+    vec3* item_max = malloc(sizeof(vec3) * bvh->triangles_n);
+    bvh_node_t* nodes = malloc(sizeof(bvh_node_t) * bvh->triangles_n * 2);
+
+    for (uint32_t r = 0; r < ranges_n; r++) {
+        uint32_t first = range_first[r] / 3;
+        uint32_t n = range_count[r] / 3;
+
+        roots[r] = BVH4_EMPTY;
+        if (n == 0)
+            continue;
+
+        for (uint32_t i = 0; i < n; i++) {
+            const uint32_t* triangle = indices + (size_t)(first + i) * 3;
+
+            aabb_empty(item_min[i], item_max[i]);
+            for (int k = 0; k < 3; k++) {
+                const float* p = bvh->positions[triangle[k]];
+                aabb_grow(item_min[i], item_max[i], p, p);
+            }
+
+            items[i] = i;
+        }
+
+        build_bvh_nodes(nodes, items, item_min, item_max, n);
+
+        // Store the range's triangles in leaf order so leaves are contiguous runs
+        for (uint32_t i = 0; i < n; i++) {
+            memcpy(bvh->triangles + (size_t)(first + i) * 3, indices + (size_t)(first + items[i]) * 3,
+                   sizeof(uint32_t) * 3);
+            bvh->triangle_ids[first + i] = first + items[i];
+        }
+
+        roots[r] = collapse_nodes(bvh, nodes, 0, first);
+    }
+
+    free(items);
+    free(item_min);
+    free(item_max);
+    free(nodes);
+}
+
+void free_mesh_bvh(mesh_bvh_t* bvh) {
+    free(bvh->nodes);
+    free(bvh->positions);
+    free(bvh->triangles);
+    free(bvh->triangle_ids);
+
+    memset(bvh, 0, sizeof(mesh_bvh_t));
+}
+
+int ray_triangle(const vec3 origin, const vec3 dir, const vec3 p0, const vec3 p1, const vec3 p2, mesh_hit_t* hit) {
+    // Möller-Trumbore, double sided
+    vec3 e1, e2, p, s, q;
+    vec3_sub(e1, p1, p0);
+    vec3_sub(e2, p2, p0);
+
+    vec3_cross(p, dir, e2);
+    float det = vec3_dot(e1, p);
+
+    if (fabsf(det) < 1e-12f)
+        return 0;
+
+    float inv_det = 1.0f / det;
+
+    vec3_sub(s, origin, p0);
+    float u = vec3_dot(s, p) * inv_det;
+    if (u < 0.0f || u > 1.0f)
+        return 0;
+
+    vec3_cross(q, s, e1);
+    float v = vec3_dot(dir, q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f)
+        return 0;
+
+    float t = vec3_dot(e2, q) * inv_det;
+    if (t < 0.0f || t >= hit->t)
+        return 0;
+
+    hit->t = t;
+    hit->u = u;
+    hit->v = v;
+    return 1;
+}
+
+// Entry distance of the ray into each child box, infinity for misses
+void intersect_children(const bvh4_node_t* node, const vec3 origin, const vec3 inv_dir, float max_t, float* dist) {
+#ifdef MESH_BVH_SSE
+    __m128 o[3] = {_mm_set1_ps(origin[0]), _mm_set1_ps(origin[1]), _mm_set1_ps(origin[2])};
+    __m128 inv[3] = {_mm_set1_ps(inv_dir[0]), _mm_set1_ps(inv_dir[1]), _mm_set1_ps(inv_dir[2])};
+
+    const float* mins[3] = {node->min_x, node->min_y, node->min_z};
+    const float* maxs[3] = {node->max_x, node->max_y, node->max_z};
+
+    __m128 entry = _mm_setzero_ps();
+    __m128 leave = _mm_set1_ps(max_t);
+
+    for (int i = 0; i < 3; i++) {
+        __m128 a = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(mins[i]), o[i]), inv[i]);
+        __m128 b = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxs[i]), o[i]), inv[i]);
+
+        entry = _mm_max_ps(entry, _mm_min_ps(a, b));
+        leave = _mm_min_ps(leave, _mm_max_ps(a, b));
+    }
+
+    __m128 miss = _mm_cmpgt_ps(entry, leave);
+    _mm_storeu_ps(dist, _mm_or_ps(_mm_and_ps(miss, _mm_set1_ps(INFINITY)), _mm_andnot_ps(miss, entry)));
+#else
+    for (int i = 0; i < 4; i++) {
+        vec3 min = {node->min_x[i], node->min_y[i], node->min_z[i]};
+        vec3 max = {node->max_x[i], node->max_y[i], node->max_z[i]};
+
+        if (!ray_aabb(origin, inv_dir, min, max, max_t, &dist[i]))
+            dist[i] = INFINITY;
+    }
+#endif
+}
+
+int raycast_mesh_bvh(const mesh_bvh_t* bvh, uint32_t root, const vec3 origin, const vec3 dir, float max_t,
+                     mesh_hit_t* hit) {
+    if (root == BVH4_EMPTY)
+        return 0;
+
+    vec3 inv_dir = {1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2]};
+
+    mesh_hit_t best = {max_t, 0.0f, 0.0f, 0};
+    int found = 0;
+
+    // Each visited node leaves at most three siblings behind
+    struct {
+        uint32_t node;
+        float dist;
+    } stack[BVH_MAX_DEPTH * 3 + 1];
+    int top = 0;
+
+    stack[top].node = root;
+    stack[top++].dist = 0.0f;
+
+    while (top > 0) {
+        top--;
+        if (stack[top].dist >= best.t)
+            continue;
+
+        const bvh4_node_t* node = &bvh->nodes[stack[top].node];
+
+        float dist[4];
+        intersect_children(node, origin, inv_dir, best.t, dist);
+
+        // Interior children sorted far to near so the nearest is popped first
+        int order[4], n = 0;
+
+        for (int i = 0; i < 4; i++) {
+            if (node->child[i] == BVH4_EMPTY || dist[i] == INFINITY)
+                continue;
+
+            if (node->count[i] == 0) {
+                int j = n++;
+                while (j > 0 && dist[order[j - 1]] < dist[i]) {
+                    order[j] = order[j - 1];
+                    j--;
+                }
+                order[j] = i;
+                continue;
+            }
+
+            for (uint32_t k = 0; k < node->count[i]; k++) {
+                uint32_t triangle = node->child[i] + k;
+                const uint32_t* v = bvh->triangles + (size_t)triangle * 3;
+
+                if (ray_triangle(origin, dir, bvh->positions[v[0]], bvh->positions[v[1]], bvh->positions[v[2]],
+                                 &best)) {
+                    best.triangle = bvh->triangle_ids[triangle];
+                    found = 1;
+                }
+            }
+        }
+
+        for (int i = 0; i < n; i++) {
+            stack[top].node = node->child[order[i]];
+            stack[top++].dist = dist[order[i]];
+        }
+    }
+
+    if (found)
+        *hit = best;
+
+    return found;
+}
@@ -0,0 +1,54 @@
+#ifndef MESH_BVH_H
+#define MESH_BVH_H
+
+#include <stdint.h>
+
+#include "linmath.h"
+
+#define BVH4_EMPTY UINT32_MAX
+
+// Child bounds are stored SoA so the four boxes are tested together
+struct _bvh4_node_t {
+    float min_x[4], min_y[4], min_z[4];
+    float max_x[4], max_y[4], max_z[4];
+
+    // A count of 0 means child is a node index, otherwise it is the first triangle of a leaf
+    uint32_t child[4], count[4];
+};
+
+// Triangle BVH over a CPU copy of the positions, one root per index range
+struct _mesh_bvh_t {
+    struct _bvh4_node_t* nodes;
+    uint32_t nodes_n, nodes_capacity;
+
+    vec3* positions;
+    uint32_t positions_n;
+
+    // Three vertex indices per triangle in leaf order, and the triangle each one came from
+    uint32_t* triangles;
+    uint32_t* triangle_ids;
+    uint32_t triangles_n;
+};
+
+struct _mesh_hit_t {
+    float t, u, v;
+    uint32_t triangle;
+};
+
+typedef struct _bvh4_node_t bvh4_node_t;
+typedef struct _mesh_bvh_t mesh_bvh_t;
+typedef struct _mesh_hit_t mesh_hit_t;
+
+// Ranges are in indices and must not overlap, roots receives one node index per range
+void build_mesh_bvh(mesh_bvh_t* bvh, const float* vertices, uint32_t stride, uint32_t vertices_n,
+                    const uint32_t* indices, uint32_t indices_n, const uint32_t* range_first,
+                    const uint32_t* range_count, uint32_t ranges_n, uint32_t* roots);
+void free_mesh_bvh(mesh_bvh_t* bvh);
+
+// Closest triangle under root hit before max_t, returns 0 on a miss
+int raycast_mesh_bvh(const mesh_bvh_t* bvh, uint32_t root, const vec3 origin, const vec3 dir, float max_t,
+                     mesh_hit_t* hit);
+
+int ray_triangle(const vec3 origin, const vec3 dir, const vec3 p0, const vec3 p1, const vec3 p2, mesh_hit_t* hit);
+
+#endif  // MESH_BVH_H
@@ -0,0 +1,272 @@
+#include "meshlet.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simplify.h"
+
+void compute_meshlet_bounds(meshlet_t* meshlet, const float* vertices, uint32_t stride, const uint32_t* indices) {
+    vec3 min = {INFINITY, INFINITY, INFINITY}, max = {-INFINITY, -INFINITY, -INFINITY};
+
+    for (uint32_t i = meshlet->first; i < meshlet->first + meshlet->count; i++) {
+        const float* p = vertices + (size_t)indices[i] * stride;
+
+        for (int k = 0; k < 3; k++) {
+            min[k] = p[k] < min[k] ? p[k] : min[k];
+            max[k] = p[k] > max[k] ? p[k] : max[k];
+        }
+    }
+
+    vec3_add(meshlet->centre, min, max);
+    vec3_scale(meshlet->centre, meshlet->centre, 0.5f);
+
+    meshlet->radius = 0.0f;
+    for (uint32_t i = meshlet->first; i < meshlet->first + meshlet->count; i++) {
+        vec3 d;
+        vec3_sub(d, vertices + (size_t)indices[i] * stride, meshlet->centre);
+
+        float distance = vec3_len(d);
+        meshlet->radius = distance > meshlet->radius ? distance : meshlet->radius;
+    }
+
+    // Normal cone around the average face normal
+    vec3 normals[MESHLET_TRIANGLES];
+    uint32_t normals_n = 0;
+
+    vec3 axis = {0.0f, 0.0f, 0.0f};
+
+    for (uint32_t i = meshlet->first; i < meshlet->first + meshlet->count; i += 3) {
+        const float* a = vertices + (size_t)indices[i + 0] * stride;
+        const float* b = vertices + (size_t)indices[i + 1] * stride;
+        const float* c = vertices + (size_t)indices[i + 2] * stride;
+
+        vec3 ab, ac, normal;
+        vec3_sub(ab, b, a);
+        vec3_sub(ac, c, a);
+        vec3_cross(normal, ab, ac);
+
+        float length = vec3_len(normal);
+        if (length <= 0.0f)
+            continue;
+
+        vec3_scale(normals[normals_n], normal, 1.0f / length);
+        vec3_add(axis, axis, normals[normals_n]);
+        normals_n++;
+    }
+
+    meshlet->cone_cutoff = 1.0f;
+    vec3_set(meshlet->cone_axis, 0.0f, 0.0f, 0.0f);
+
+    float length = vec3_len(axis);
+    if (normals_n == 0 || length <= 0.0f)
+        return;
+
+    vec3_scale(meshlet->cone_axis, axis, 1.0f / length);
+
+    float min_dot = 1.0f;
+    for (uint32_t i = 0; i < normals_n; i++) {
+        float d = vec3_dot(normals[i], meshlet->cone_axis);
+        min_dot = d < min_dot ? d : min_dot;
+    }
+
+    // Cones wider than a hemisphere can always be seen from somewhere
+    if (min_dot > 0.1f)
+        meshlet->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+uint32_t build_meshlets(meshlet_t** meshlets, uint32_t* meshlets_n, const float* vertices, uint32_t stride,
+                        uint32_t* indices, uint32_t first, uint32_t count) {
+    uint32_t triangles_n = count / 3;
+    if (triangles_n == 0)
+        return 0;
+
+    // Weld identical vertices, the vertex limit counts these while adjacency goes by position
+    uint32_t size = 1;
+    while (size < count * 2)
+        size <<= 1;
+
+    uint32_t* table = malloc(sizeof(uint32_t) * size);
+    uint32_t* unique = malloc(sizeof(uint32_t) * count);
+    uint32_t* corners = malloc(sizeof(uint32_t) * count);
+    uint32_t unique_n = 0;
+
+    memset(table, 0xff, sizeof(uint32_t) * size);
+    for (uint32_t i = 0; i < triangles_n * 3; i++)
+        corners[i] = dedupe(table, size - 1, vertices, stride, stride, indices[first + i], unique, &unique_n);
+
+    uint32_t* position_ids = malloc(sizeof(uint32_t) * count);
+    uint32_t* position_of = malloc(sizeof(uint32_t) * unique_n);
+    uint32_t positions_n = 0;
+
+    memset(table, 0xff, sizeof(uint32_t) * size);
+    for (uint32_t u = 0; u < unique_n; u++)
+        position_of[u] = dedupe(table, size - 1, vertices, stride, 3, unique[u], position_ids, &positions_n);
+
+    free(table);
+    free(position_ids);
+
+    // Triangles around each position
+    uint32_t* offsets = calloc(positions_n + 1, sizeof(uint32_t));
+    uint32_t* adjacency = malloc(sizeof(uint32_t) * triangles_n * 3);
+
+    for (uint32_t i = 0; i < triangles_n * 3; i++)
+        offsets[position_of[corners[i]] + 1]++;
+
+    for (uint32_t p = 0; p < positions_n; p++)
+        offsets[p + 1] += offsets[p];
+
+    uint32_t* fill = malloc(sizeof(uint32_t) * positions_n);
+    memcpy(fill, offsets, sizeof(uint32_t) * positions_n);
+
+    for (uint32_t i = 0; i < triangles_n * 3; i++)
+        adjacency[fill[position_of[corners[i]]]++] = i / 3;
+
+    free(fill);
+
+    // Greedy growth, always taking the neighbouring triangle that adds the fewest new vertices
+    uint8_t* assigned = calloc(triangles_n, 1);
+    uint32_t* in_meshlet = malloc(sizeof(uint32_t) * unique_n);
+    uint32_t* candidates = malloc(sizeof(uint32_t) * triangles_n * 3);
+    uint32_t* output = malloc(sizeof(uint32_t) * triangles_n * 3);
+
+    memset(in_meshlet, 0xff, sizeof(uint32_t) * unique_n);
+
+    uint32_t emitted = 0, seed = 0, added = 0;
+
+    while (emitted < triangles_n) {
+        uint32_t id = *meshlets_n;
+        uint32_t vertices_n = 0, meshlet_triangles = 0, candidates_n = 0;
+        uint32_t meshlet_first = emitted;
+
+        while (meshlet_triangles < MESHLET_TRIANGLES) {
+            uint32_t best = SIMPLIFY_NONE, best_new = 4, kept = 0;
+
+            for (uint32_t i = 0; i < candidates_n; i++) {
+                uint32_t t = candidates[i];
+                if (assigned[t])
+                    continue;
+
+                candidates[kept++] = t;
+
+                uint32_t new_vertices = 0;
+                for (int k = 0; k < 3; k++)
+                    new_vertices += in_meshlet[corners[t * 3 + k]] != id;
+
+                if (new_vertices < best_new && vertices_n + new_vertices <= MESHLET_VERTICES) {
+                    best = t;
+                    best_new = new_vertices;
+                }
+            }
+
+            candidates_n = kept;
+
+            if (best == SIMPLIFY_NONE) {
+                if (meshlet_triangles > 0)
+                    break;
+
+                while (assigned[seed])
+                    seed++;
+
+                best = seed;
+            }
+
+            assigned[best] = 1;
+            memcpy(output + emitted * 3, corners + best * 3, sizeof(uint32_t) * 3);
+            emitted++;
+            meshlet_triangles++;
+
+            for (int k = 0; k < 3; k++) {
+                uint32_t u = corners[best * 3 + k];
+                if (in_meshlet[u] == id)
+                    continue;
+
+                in_meshlet[u] = id;
+                vertices_n++;
+
+                uint32_t p = position_of[u];
+                for (uint32_t j = offsets[p]; j < offsets[p + 1]; j++)
+                    if (!assigned[adjacency[j]] && candidates_n < triangles_n * 3)
+                        candidates[candidates_n++] = adjacency[j];
+            }
+        }
+
+        if (*meshlets_n % 64 == 0)
+            *meshlets = realloc(*meshlets, sizeof(meshlet_t) * (*meshlets_n + 64));
+
+        meshlet_t* meshlet = &(*meshlets)[(*meshlets_n)++];
+        meshlet->first = first + meshlet_first * 3;
+        meshlet->count = meshlet_triangles * 3;
+
+        added++;
+    }
+
+    for (uint32_t i = 0; i < triangles_n * 3; i++)
+        indices[first + i] = unique[output[i]];
+
+    for (uint32_t i = *meshlets_n - added; i < *meshlets_n; i++)
+        compute_meshlet_bounds(&(*meshlets)[i], vertices, stride, indices);
+
+    free(unique);
+    free(corners);
+    free(position_of);
+    free(offsets);
+    free(adjacency);
+    free(assigned);
+    free(in_meshlet);
+    free(candidates);
+    free(output);
+
+    return added;
+}
+
+uint32_t cull_meshlets(const meshlet_t* meshlets, uint32_t n, const mat4x4 world, const frustum_t* frustum,
+                       const vec3 camera, uint32_t* firsts, uint32_t* counts, uint32_t* culled) {
+    // Largest axis scale keeps the spheres conservative under non-uniform scaling
+    float scale = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        float length = vec3_len(world[i]);
+        scale = length > scale ? length : scale;
+    }
+
+    uint32_t ranges_n = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        const meshlet_t* meshlet = &meshlets[i];
+
+        vec4 centre, local_centre;
+        vec4_from_vec3(local_centre, meshlet->centre, 1.0f);
+        mat4x4_mul_vec4(centre, world, local_centre);
+
+        float radius = meshlet->radius * scale;
+        int visible = !frustum_cull_sphere(frustum, centre, radius);
+
+        if (visible && meshlet->cone_cutoff < 1.0f) {
+            vec4 axis, local_axis;
+            vec4_from_vec3(local_axis, meshlet->cone_axis, 0.0f);
+            mat4x4_mul_vec4(axis, world, local_axis);
+            vec3_normalize(axis, axis);
+
+            // Every triangle faces away when the camera sits inside the cone's back side
+            vec3 view;
+            vec3_sub(view, centre, camera);
+
+            visible = vec3_dot(view, axis) < meshlet->cone_cutoff * vec3_len(view) + radius;
+        }
+
+        if (!visible) {
+            (*culled)++;
+            continue;
+        }
+
+        if (ranges_n > 0 && firsts[ranges_n - 1] + counts[ranges_n - 1] == meshlet->first) {
+            counts[ranges_n - 1] += meshlet->count;
+        } else {
+            firsts[ranges_n] = meshlet->first;
+            counts[ranges_n] = meshlet->count;
+            ranges_n++;
+        }
+    }
+
+    return ranges_n;
+}
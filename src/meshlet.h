@@ -0,0 +1,38 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <stdint.h>
+
+#include "frustum.h"
+#include "linmath.h"
+
+#define MESHLET_VERTICES 64
+#define MESHLET_TRIANGLES 124
+
+// A run of triangles in the index buffer with bounds for culling, a cutoff of 1 never culls by cone
+struct _meshlet_t {
+    vec3 centre;
+    float radius;
+
+    vec3 cone_axis;
+    float cone_cutoff;
+
+    uint32_t first, count;
+};
+
+typedef struct _meshlet_t meshlet_t;
+
+// Recomputes the sphere and normal cone from the meshlet's triangles
+void compute_meshlet_bounds(meshlet_t* meshlet, const float* vertices, uint32_t stride, const uint32_t* indices);
+
+// Welds identical vertices, then reorders the triangles in indices[first, first + count) into meshlets appended to
+// *meshlets, returns how many were added
+uint32_t build_meshlets(meshlet_t** meshlets, uint32_t* meshlets_n, const float* vertices, uint32_t stride,
+                        uint32_t* indices, uint32_t first, uint32_t count);
+
+// Writes the index ranges of the meshlets that survive frustum and backface cone tests, adjacent survivors are merged.
+// Returns the number of ranges, firsts and counts must hold n entries.
+uint32_t cull_meshlets(const meshlet_t* meshlets, uint32_t n, const mat4x4 world, const frustum_t* frustum,
+                       const vec3 camera, uint32_t* firsts, uint32_t* counts, uint32_t* culled);
+
+#endif  // MESHLET_H
@@ -1,26 +1,33 @@
 #include "model.h"
 
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
+#include "cook.h"
+#include "gltf.h"
+#include "job.h"
 #include "linmath.h"
+#include "simplify.h"
+#include "texture.h"
+#include "vfs.h"
 
 #define LARGE (float)10e+32
+#define OBJ_CHUNK_SIZE (256 * 1024)
 
 static const vec3 min = {+LARGE, +LARGE, +LARGE};
 static const vec3 max = {-LARGE, -LARGE, -LARGE};
 
-size_t indices_n;
+geometry_arena_t mesh_arena, bounds_arena;
 
-uint32_t *indices, *bb_indices;
-float* bb_vertices;
+submodel_t** finalise_submodel(model_data_t* data, submodel_t* submodel) {
+    size_t bb_vertices_n = data->bb_vertices_n;
+    size_t bb_indices_n = data->bb_indices_n;
 
-size_t bb_vertices_n, bb_indices_n, prev_indices_n;
-
-submodel_t** finalise_submodel(submodel_t* submodel) {
-    submodel->count = indices_n - prev_indices_n;
-    prev_indices_n = indices_n;
+    float* bb_vertices = data->bb_vertices;
+    uint32_t* bb_indices = data->bb_indices;
 
     bb_vertices = realloc(bb_vertices, sizeof(float) * 3 * (bb_vertices_n + 8));
     bb_indices = realloc(bb_indices, sizeof(uint32_t) * (bb_indices_n + 24));
@@ -65,189 +72,983 @@ submodel_t** finalise_submodel(submodel_t* submodel) {
     memcpy(bb_vertices + bb_vertices_n * 3, submodel->bbox_mid, sizeof(submodel->bbox_mid));
     bb_indices[bb_indices_n++] = bb_vertices_n++;
 
+    data->bb_vertices = bb_vertices;
+    data->bb_vertices_n = bb_vertices_n;
+
+    data->bb_indices = bb_indices;
+    data->bb_indices_n = bb_indices_n;
+
     return &(submodel->child);
 }
 
-void load_model(model_t* model, const char* path) {
-    FILE* file = fopen(path, "r");
+size_t line_length(const char* line, const char* end);
 
-    if (file == NULL) {
-        fprintf(stderr, "Failed to load model: %s\n", path);
-        return;
+// The file is split at line boundaries and every stage runs in parallel over chunks, faces or submodels
+struct _obj_chunk_t {
+    const char *begin, *end;
+
+    uint32_t positions_n, normals_n, uvs_n, faces_n, objects_n, uses_n;
+    uint32_t positions_base, normals_base, uvs_base, faces_base, objects_base, uses_base;
+
+    // First mtllib line of the chunk
+    const char* library;
+};
+
+struct _obj_use_t {
+    uint32_t face;
+    const char* name;
+};
+
+struct _obj_parse_t {
+    struct _obj_chunk_t* chunks;
+
+    float *positions, *normals, *uvs;
+    size_t positions_n, normals_n, uvs_n;
+
+    // Nine indices per triangle, position/texture/normal for each corner
+    uint32_t* faces;
+    size_t faces_n;
+
+    // Index of the first face of every o group
+    uint32_t* objects;
+    size_t objects_n;
+
+    // Every usemtl with the face it applies from
+    struct _obj_use_t* uses;
+    size_t uses_n;
+
+    float* vertices;
+    uint32_t* indices;
+};
+
+// Bounds and levels of detail run per submodel on any loader's vertices
+struct _submodel_build_t {
+    const float* vertices;
+    const uint32_t* indices;
+
+    submodel_t** submodels;
+
+    // Coarser levels of each submodel back to back, offsets relative until they are appended
+    uint32_t** lods;
+};
+
+typedef struct _obj_chunk_t obj_chunk_t;
+typedef struct _obj_use_t obj_use_t;
+typedef struct _obj_parse_t obj_parse_t;
+typedef struct _submodel_build_t submodel_build_t;
+
+const char* next_line(const char* line, const char* end) {
+    const char* newline = memchr(line, '\n', end - line);
+    return newline ? newline + 1 : end;
+}
+
+void count_chunks(void* arg, uint32_t begin, uint32_t end) {
+    obj_parse_t* parse = arg;
+
+    for (uint32_t i = begin; i < end; i++) {
+        obj_chunk_t* chunk = &parse->chunks[i];
+
+        for (const char* line = chunk->begin; line < chunk->end; line = next_line(line, chunk->end)) {
+            if (strncmp(line, "v ", 2) == 0)
+                chunk->positions_n++;
+            else if (strncmp(line, "vn ", 3) == 0)
+                chunk->normals_n++;
+            else if (strncmp(line, "vt ", 3) == 0)
+                chunk->uvs_n++;
+            else if (strncmp(line, "o ", 2) == 0)
+                chunk->objects_n++;
+            else if (strncmp(line, "f ", 2) == 0)
+                chunk->faces_n++;
+            else if (strncmp(line, "usemtl ", 7) == 0)
+                chunk->uses_n++;
+            else if (strncmp(line, "mtllib ", 7) == 0 && chunk->library == NULL)
+                chunk->library = line + 7;
+        }
     }
+}
 
-    char* line = NULL;
-    size_t len = 0;
+void parse_floats(const char* cursor, float* out, int n) {
+    char* end;
 
-    float *positions = NULL, *normals = NULL, *uvs = NULL;
-    size_t positions_n = 0, normals_n = 0, uvs_n = 0;
+    for (int i = 0; i < n; i++) {
+        out[i] = strtof(cursor, &end);
+        cursor = end;
+    }
+}
 
-    float* vertices = NULL;
-    size_t vertices_n = 0;
+// p/t/n triples, stops at the first one that does not match like sscanf would
+void parse_face(const char* cursor, uint32_t* face) {
+    char* end;
 
-    indices = NULL;
-    indices_n = 0;
+    for (int i = 0; i < 9; i++) {
+        face[i] = strtoul(cursor, &end, 10);
 
-    bb_vertices = NULL;
-    bb_vertices_n = 0;
+        if (end == cursor)
+            return;
 
-    bb_indices = NULL;
-    bb_indices_n = 0;
+        cursor = end;
 
-    prev_indices_n = 0;
+        if (i % 3 != 2) {
+            if (*cursor != '/')
+                return;
 
-    model->root = NULL;
-    submodel_t** submodel = &model->root;
+            cursor++;
+        }
+    }
+}
+
+void parse_chunks(void* arg, uint32_t begin, uint32_t end) {
+    obj_parse_t* parse = arg;
+
+    for (uint32_t i = begin; i < end; i++) {
+        obj_chunk_t* chunk = &parse->chunks[i];
+
+        float* position = parse->positions + chunk->positions_base * 3;
+        float* normal = parse->normals + chunk->normals_base * 3;
+        float* uv = parse->uvs + chunk->uvs_base * 2;
+
+        uint32_t* face = parse->faces + chunk->faces_base * 9;
+        uint32_t* object = parse->objects + chunk->objects_base;
+        obj_use_t* use = parse->uses + chunk->uses_base;
+        uint32_t faces_n = chunk->faces_base;
 
-    uint32_t submodel_n = 0;
+        for (const char* line = chunk->begin; line < chunk->end; line = next_line(line, chunk->end)) {
+            // sscanf measures the rest of the whole file on every call, so numbers are read with strto* instead
+            if (strncmp(line, "v ", 2) == 0) {
+                parse_floats(line + 2, position, 3);
+                position += 3;
 
-    vec3 buffer;
-    while (getline(&line, &len, file) != EOF) {
-        if (strncmp(line, "v ", 2) == 0) {
-            sscanf(line, "v %f %f %f", &buffer[0], &buffer[1], &buffer[2]);
+            } else if (strncmp(line, "vn ", 3) == 0) {
+                parse_floats(line + 3, normal, 3);
+                normal += 3;
 
-            positions = realloc(positions, sizeof(vec3) * (positions_n + 1));
-            memcpy(positions + positions_n * 3, buffer, sizeof(float) * 3);
-            positions_n += 1;
+            } else if (strncmp(line, "vt ", 3) == 0) {
+                parse_floats(line + 3, uv, 2);
+                uv += 2;
 
-            for (int i = 0; i < 3; i++) {
-                if (buffer[i] < (*submodel)->bbox_min[i])
-                    (*submodel)->bbox_min[i] = buffer[i];
+            } else if (strncmp(line, "o ", 2) == 0) {
+                *object++ = faces_n;
 
-                if (buffer[i] > (*submodel)->bbox_max[i])
-                    (*submodel)->bbox_max[i] = buffer[i];
+            } else if (strncmp(line, "usemtl ", 7) == 0) {
+                use->face = faces_n;
+                use->name = line + 7;
+                use++;
+
+            } else if (strncmp(line, "f ", 2) == 0) {
+                // a = vertex, p = position, t = texture, n = normal
+                memset(face, 0, sizeof(uint32_t) * 9);
+                parse_face(line + 2, face);
+
+                face += 9;
+                faces_n++;
             }
+        }
+    }
+}
 
-        } else if (strncmp(line, "vn ", 3) == 0) {
-            sscanf(line, "vn %f %f %f", &buffer[0], &buffer[1], &buffer[2]);
+void copy_attribute(float* dst, const float* src, uint32_t index, size_t count, int size) {
+    // OBJ indices are 1-based, zero means the attribute was missing or malformed
+    if (index == 0 || index > count)
+        memset(dst, 0, sizeof(float) * size);
+    else
+        memcpy(dst, src + (index - 1) * size, sizeof(float) * size);
+}
 
-            normals = realloc(normals, sizeof(vec3) * (normals_n + 1));
-            memcpy(normals + normals_n * 3, buffer, sizeof(float) * 3);
-            normals_n += 1;
+void build_vertices(void* arg, uint32_t begin, uint32_t end) {
+    obj_parse_t* parse = arg;
 
-        } else if (strncmp(line, "vt ", 3) == 0) {
-            sscanf(line, "vt %f %f %f", &buffer[0], &buffer[1], &buffer[2]);
+    for (uint32_t i = begin; i < end; i++) {
+        uint32_t* face = parse->faces + i * 9;
 
-            uvs = realloc(uvs, sizeof(vec2) * (uvs_n + 1));
-            memcpy(uvs + uvs_n * 2, buffer, sizeof(float) * 2);
-            uvs_n += 1;
+        for (int j = 0; j < 3; j++) {
+            uint32_t p = face[j * 3 + 0], t = face[j * 3 + 1], n = face[j * 3 + 2];
+            float* vertex = parse->vertices + (i * 3 + j) * 8;
 
-        } else if (strncmp(line, "o ", 2) == 0) {
-            if (*submodel != NULL)
-                submodel = finalise_submodel(*submodel);
+            copy_attribute(vertex + 0, parse->positions, p, parse->positions_n, 3);
+            copy_attribute(vertex + 3, parse->normals, n, parse->normals_n, 3);
+            copy_attribute(vertex + 6, parse->uvs, t, parse->uvs_n, 2);
 
-            *submodel = malloc(sizeof(submodel_t));
-            (*submodel)->offset = indices_n;
-            (*submodel)->child = NULL;
+            parse->indices[i * 3 + j] = i * 3 + j;
+        }
+    }
+}
 
-            (*submodel)->bb_index = submodel_n++;
-            memcpy(&(*submodel)->bbox_min, min, sizeof(vec3));
-            memcpy(&(*submodel)->bbox_max, max, sizeof(vec3));
+void compute_bounds(void* arg, uint32_t begin, uint32_t end) {
+    submodel_build_t* build = arg;
 
-        } else if (strncmp(line, "f ", 2) == 0) {
-            uint32_t ap, at, an;  // a = vertex, p = position, t = texture, n = normal
-            uint32_t bp, bt, bn;
-            uint32_t cp, ct, cn;
+    for (uint32_t i = begin; i < end; i++) {
+        submodel_t* submodel = build->submodels[i];
 
-            sscanf(line, "f %u/%u/%u %u/%u/%u %u/%u/%u", &ap, &at, &an, &bp, &bt, &bn, &cp, &ct, &cn);
+        memcpy(&submodel->bbox_min, min, sizeof(vec3));
+        memcpy(&submodel->bbox_max, max, sizeof(vec3));
 
-            vertices = realloc(vertices, sizeof(float) * 8 * (vertices_n + 3));
-            indices = realloc(indices, sizeof(uint32_t) * (indices_n + 3));
+        for (uint32_t j = submodel->offset; j < submodel->offset + submodel->count; j++) {
+            const float* position = build->vertices + build->indices[j] * 8;
+
+            for (int k = 0; k < 3; k++) {
+                if (position[k] < submodel->bbox_min[k])
+                    submodel->bbox_min[k] = position[k];
+
+                if (position[k] > submodel->bbox_max[k])
+                    submodel->bbox_max[k] = position[k];
+            }
+        }
 
-            // clang-format off
-            memcpy(vertices + (vertices_n + 0) * 8 + 0, positions   + (ap - 1) * 3, sizeof(float) * 3);
-            memcpy(vertices + (vertices_n + 0) * 8 + 3, normals     + (an - 1) * 3, sizeof(float) * 3);
-            memcpy(vertices + (vertices_n + 0) * 8 + 6, uvs         + (at - 1) * 2, sizeof(float) * 2);
-            indices[indices_n + 0] = vertices_n + 0;
+        double area = 0.0, uv_area = 0.0;
 
-            memcpy(vertices + (vertices_n + 1) * 8 + 0, positions   + (bp - 1) * 3, sizeof(float) * 3);
-            memcpy(vertices + (vertices_n + 1) * 8 + 3, normals     + (bn - 1) * 3, sizeof(float) * 3);
-            memcpy(vertices + (vertices_n + 1) * 8 + 6, uvs         + (bt - 1) * 2, sizeof(float) * 2);
-            indices[indices_n + 1] = vertices_n + 1;
+        for (uint32_t j = submodel->offset; j + 2 < submodel->offset + submodel->count; j += 3) {
+            const float* a = build->vertices + build->indices[j] * 8;
+            const float* b = build->vertices + build->indices[j + 1] * 8;
+            const float* c = build->vertices + build->indices[j + 2] * 8;
 
-            memcpy(vertices + (vertices_n + 2) * 8 + 0, positions   + (cp - 1) * 3, sizeof(float) * 3);
-            memcpy(vertices + (vertices_n + 2) * 8 + 3, normals     + (cn - 1) * 3, sizeof(float) * 3);
-            memcpy(vertices + (vertices_n + 2) * 8 + 6, uvs         + (ct - 1) * 2, sizeof(float) * 2);
-            indices[indices_n + 2] = vertices_n + 2;
-            // clang-format on
+            vec3 ab, ac, cross;
+            vec3_sub(ab, b, a);
+            vec3_sub(ac, c, a);
+            vec3_cross(cross, ab, ac);
 
-            vertices_n += 3;
-            indices_n += 3;
+            area += vec3_len(cross);
+            uv_area += fabsf((b[6] - a[6]) * (c[7] - a[7]) - (c[6] - a[6]) * (b[7] - a[7]));
         }
+
+        vec3 diagonal;
+        vec3_sub(diagonal, submodel->bbox_max, submodel->bbox_min);
+
+        submodel->uv_extent = area > 0.0 ? sqrt(uv_area / area) * vec3_len(diagonal) : 0.0f;
     }
+}
 
-    if (*submodel != NULL)
-        submodel = finalise_submodel(*submodel);
+void generate_lods(void* arg, uint32_t begin, uint32_t end) {
+    submodel_build_t* build = arg;
 
-    free(line);
-    free(positions);
-    free(normals);
-    free(uvs);
+    for (uint32_t i = begin; i < end; i++) {
+        submodel_t* submodel = build->submodels[i];
 
-    // Model
+        submodel->lod_offset[0] = submodel->offset;
+        submodel->lod_count[0] = submodel->count;
+        submodel->lods_n = 1;
+
+        uint32_t* lods = malloc(sizeof(uint32_t) * (submodel->count * (MODEL_LODS - 1) + 1));
+        uint32_t used = 0;
+
+        // Each level simplifies the previous one, so the chain stays cheap to build
+        const uint32_t* source = build->indices + submodel->offset;
+        uint32_t source_n = submodel->count;
+
+        for (uint32_t level = 1; level < MODEL_LODS; level++) {
+            uint32_t target = source_n / 6 * 3;
+            float error = MODEL_LOD_ERROR * (1 << (level - 1));
+
+            uint32_t n = simplify_mesh(lods + used, build->vertices, 8, source, source_n, target, error, NULL);
+
+            // Not worth a level of its own
+            if (n == 0 || n > source_n * 0.8f)
+                break;
 
-    glGenVertexArrays(1, &model->vao);
-    glBindVertexArray(model->vao);
+            submodel->lod_offset[level] = used;
+            submodel->lod_count[level] = n;
+            submodel->lods_n++;
 
-    glGenBuffers(1, &model->vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, model->vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 8 * vertices_n, vertices, GL_STATIC_DRAW);
+            source = lods + used;
+            source_n = n;
+            used += n;
+        }
+
+        build->lods[i] = lods;
+    }
+}
+
+void bound_submodels(model_data_t* data, submodel_t** submodels, uint32_t submodels_n) {
+    submodel_build_t build = {data->vertices, data->indices, submodels, NULL};
+
+    parallel_for(submodels_n, 1, compute_bounds, &build);
+
+    for (uint32_t i = 0; i < submodels_n; i++)
+        finalise_submodel(data, submodels[i]);
+}
+
+void simplify_submodels(model_data_t* data, submodel_t** submodels, uint32_t submodels_n) {
+    submodel_build_t build = {data->vertices, data->indices, submodels, NULL};
 
-    // Positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (void*)0);
+    build.lods = malloc(sizeof(uint32_t*) * (submodels_n + 1));
+    parallel_for(submodels_n, 1, generate_lods, &build);
 
-    // Normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (void*)(sizeof(float) * 3));
+    size_t indices_n = data->indices_n;
 
-    // UVs
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (void*)(sizeof(float) * 6));
+    for (uint32_t i = 0; i < submodels_n; i++) {
+        submodel_t* submodel = submodels[i];
 
-    glGenBuffers(1, &model->ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices_n, indices, GL_STATIC_DRAW);
+        for (uint32_t level = 1; level < submodel->lods_n; level++)
+            submodel->lod_offset[level] += indices_n;
 
-    free(vertices);
-    free(indices);
+        if (submodel->lods_n > 1)
+            indices_n = submodel->lod_offset[submodel->lods_n - 1] + submodel->lod_count[submodel->lods_n - 1];
+    }
+
+    data->indices = realloc(data->indices, sizeof(uint32_t) * (indices_n + 1));
+
+    for (uint32_t i = 0; i < submodels_n; i++) {
+        submodel_t* submodel = submodels[i];
+
+        if (submodel->lods_n > 1) {
+            uint32_t n = submodel->lod_offset[submodel->lods_n - 1] + submodel->lod_count[submodel->lods_n - 1] -
+                         submodel->lod_offset[1];
+            memcpy(data->indices + submodel->lod_offset[1], build.lods[i], sizeof(uint32_t) * n);
+        }
+
+        free(build.lods[i]);
+    }
+
+    data->indices_n = indices_n;
+    free(build.lods);
+}
 
-    model->count = indices_n;
+void build_submodels(model_data_t* data, submodel_t** submodels, uint32_t submodels_n) {
+    bound_submodels(data, submodels, submodels_n);
+    simplify_submodels(data, submodels, submodels_n);
+}
+
+submodel_t** list_submodels(const model_data_t* data, uint32_t* submodels_n) {
+    uint32_t n = 0;
+    for (submodel_t* submodel = data->root; submodel != NULL; submodel = submodel->child)
+        n++;
+
+    submodel_t** submodels = malloc(sizeof(submodel_t*) * (n + 1));
+
+    n = 0;
+    for (submodel_t* submodel = data->root; submodel != NULL; submodel = submodel->child)
+        submodels[n++] = submodel;
+
+    *submodels_n = n;
+    return submodels;
+}
+
+int parse_source_model(model_data_t* data, const char* path) {
+    // Parsed in place, straight out of a pack when one has the file
+    vfs_file_t file;
+
+    if (!vfs_open(&file, path)) {
+        memset(data, 0, sizeof(model_data_t));
+        fprintf(stderr, "Failed to load model: %s\n", path);
+        return 0;
+    }
+
+    int ok = parse_model_file(data, &file, path);
+    vfs_close(&file);
+
+    return ok;
+}
+
+int parse_model(model_data_t* data, const char* path) {
+    char cooked_path[MODEL_PATH_MAX];
+    vfs_file_t file;
+
+    // A stale or damaged cooked model falls back to the source
+    if (find_cooked_model(cooked_path, sizeof(cooked_path), path) && vfs_open(&file, cooked_path)) {
+        int ok = parse_cooked_model(data, &file, cooked_path);
+        vfs_close(&file);
+
+        if (ok)
+            return 1;
+    }
+
+    return parse_source_model(data, path);
+}
+
+int parse_model_file(model_data_t* data, const vfs_file_t* file, const char* path) {
+    size_t path_length = strlen(path);
+    size_t suffix_length = strlen(MODEL_COOKED_SUFFIX);
+
+    if (path_length > suffix_length && strcmp(path + path_length - suffix_length, MODEL_COOKED_SUFFIX) == 0)
+        return parse_cooked_model(data, file, path);
+
+    if (!parse_model_geometry(data, file, path))
+        return 0;
+
+    uint32_t submodels_n;
+    submodel_t** submodels = list_submodels(data, &submodels_n);
+
+    build_submodels(data, submodels, submodels_n);
+    free(submodels);
+
+    return 1;
+}
+
+int parse_model_geometry(model_data_t* data, const vfs_file_t* file, const char* path) {
+    // Binary glTF goes through its own parser, everything else is read as OBJ
+    size_t path_length = strlen(path);
+    if (path_length > 4 && strcmp(path + path_length - 4, ".glb") == 0)
+        return parse_glb(data, file, path);
+
+    memset(data, 0, sizeof(model_data_t));
+
+    const char* source = file->data;
+    size_t len = file->size;
+
+    obj_parse_t parse;
+    memset(&parse, 0, sizeof(obj_parse_t));
+
+    // Scratch arrays only live for the duration of the load and are released together
+    arena_t scratch;
+    init_arena(&scratch, len * 2 + OBJ_CHUNK_SIZE);
+
+    // Chunks
+
+    uint32_t chunks_n = len / OBJ_CHUNK_SIZE + 1;
+    parse.chunks = arena_alloc(&scratch, sizeof(obj_chunk_t) * chunks_n, 0);
+    memset(parse.chunks, 0, sizeof(obj_chunk_t) * chunks_n);
+
+    const char* cursor = source;
+    for (uint32_t i = 0; i < chunks_n; i++) {
+        const char* end = i == chunks_n - 1 ? source + len : source + (i + 1) * OBJ_CHUNK_SIZE;
+
+        if (end < cursor)
+            end = cursor;
+
+        parse.chunks[i].begin = cursor;
+        parse.chunks[i].end = end < source + len ? next_line(end, source + len) : end;
+        cursor = parse.chunks[i].end;
+    }
+
+    parallel_for(chunks_n, 1, count_chunks, &parse);
+
+    for (uint32_t i = 0; i < chunks_n; i++) {
+        obj_chunk_t* chunk = &parse.chunks[i];
+
+        chunk->positions_base = parse.positions_n;
+        chunk->normals_base = parse.normals_n;
+        chunk->uvs_base = parse.uvs_n;
+        chunk->faces_base = parse.faces_n;
+        chunk->objects_base = parse.objects_n;
+        chunk->uses_base = parse.uses_n;
+
+        parse.positions_n += chunk->positions_n;
+        parse.normals_n += chunk->normals_n;
+        parse.uvs_n += chunk->uvs_n;
+        parse.faces_n += chunk->faces_n;
+        parse.objects_n += chunk->objects_n;
+        parse.uses_n += chunk->uses_n;
+    }
+
+    parse.positions = arena_alloc(&scratch, sizeof(vec3) * parse.positions_n, 16);
+    parse.normals = arena_alloc(&scratch, sizeof(vec3) * parse.normals_n, 16);
+    parse.uvs = arena_alloc(&scratch, sizeof(vec2) * parse.uvs_n, 16);
+    parse.faces = arena_alloc(&scratch, sizeof(uint32_t) * 9 * parse.faces_n, 16);
+    parse.objects = arena_alloc(&scratch, sizeof(uint32_t) * parse.objects_n, 0);
+    parse.uses = arena_alloc(&scratch, sizeof(obj_use_t) * parse.uses_n, 0);
+
+    parallel_for(chunks_n, 1, parse_chunks, &parse);
+
+    // Vertices
+
+    parse.vertices = malloc(sizeof(float) * 8 * 3 * (parse.faces_n + 1));
+    parse.indices = malloc(sizeof(uint32_t) * 3 * (parse.faces_n + 1));
+
+    parallel_for(parse.faces_n, 4096, build_vertices, &parse);
+
+    // Materials, entry 0 stands in for missing libraries and unknown names
+
+    data->materials = malloc(sizeof(material_t));
+    data->materials_n = 1;
+    default_material(&data->materials[0]);
+
+    for (uint32_t i = 0; i < chunks_n; i++) {
+        const char* library = parse.chunks[i].library;
+        if (library == NULL)
+            continue;
+
+        char library_path[1024];
+        size_t length = line_length(library, source + len);
+
+        if (!resolve_path(library_path, sizeof(library_path), path, library, length) ||
+            !parse_materials(&data->materials, &data->materials_n, library_path))
+            fprintf(stderr, "Failed to load materials: %.*s\n", (int)length, library);
+    }
+
+    // Submodels start at every o and every usemtl, faces before the first one still get a group of their own
+
+    uint32_t* starts = arena_alloc(&scratch, sizeof(uint32_t) * (parse.objects_n + parse.uses_n + 1), 0);
+    uint32_t starts_n = 0;
+
+    for (size_t o = 0, u = 0; o < parse.objects_n || u < parse.uses_n;) {
+        uint32_t face;
+
+        if (u == parse.uses_n || (o < parse.objects_n && parse.objects[o] <= parse.uses[u].face))
+            face = parse.objects[o++];
+        else
+            face = parse.uses[u++].face;
+
+        if (starts_n == 0 || starts[starts_n - 1] != face)
+            starts[starts_n++] = face;
+    }
+
+    if (starts_n == 0 || (starts[0] > 0 && parse.faces_n > 0)) {
+        memmove(starts + 1, starts, sizeof(uint32_t) * starts_n);
+        starts[0] = 0;
+        starts_n++;
+    }
+
+    uint32_t groups_n = starts_n;
+
+    submodel_t** submodel = &data->root;
+
+    size_t use = 0;
+    uint32_t material = 0;
+
+    for (uint32_t i = 0; i < groups_n; i++) {
+        uint32_t first = starts[i];
+        uint32_t last = i + 1 < groups_n ? starts[i + 1] : parse.faces_n;
+
+        // The last usemtl at or before the group's first face applies to all of it
+        for (; use < parse.uses_n && parse.uses[use].face <= first; use++) {
+            const char* name = parse.uses[use].name;
+            size_t length = line_length(name, source + len);
+
+            material = find_material(data->materials, data->materials_n, name, length);
+
+            if (material == 0)
+                fprintf(stderr, "Unknown material: %.*s\n", (int)length, name);
+        }
+
+        *submodel = malloc(sizeof(submodel_t));
+        (*submodel)->offset = first * 3;
+        (*submodel)->count = (last - first) * 3;
+        (*submodel)->bb_index = i;
+        (*submodel)->material = material;
+        (*submodel)->child = NULL;
+
+        submodel = &(*submodel)->child;
+    }
+
+    data->vertices = parse.vertices;
+    data->vertices_n = parse.faces_n * 3;
+
+    data->indices = parse.indices;
+    data->indices_n = parse.faces_n * 3;
+
+    free_arena(&scratch);
+
+    return 1;
+}
+
+void init_model_arenas() {
+    // clang-format off
+    vertex_attrib_t mesh_attribs[] = {
+        {3, 0},                     // Positions
+        {3, sizeof(float) * 3},     // Normals
+        {2, sizeof(float) * 6},     // UVs
+    };
+
+    vertex_attrib_t bounds_attribs[] = {
+        {3, 0},                     // Positions
+    };
+    // clang-format on
+
+    init_geometry_arena(&mesh_arena, mesh_attribs, 3, sizeof(float) * 8, 1 << 16, 1 << 18);
+    init_geometry_arena(&bounds_arena, bounds_attribs, 1, sizeof(float) * 3, 1 << 12, 1 << 14);
+}
+
+// End of the full resolution indices, the simplified levels after them are not part of the whole model draw
+GLuint model_data_count(const model_data_t* data) {
+    GLuint count = 0;
+
+    for (submodel_t* submodel = data->root; submodel != NULL; submodel = submodel->child)
+        if (submodel->offset + submodel->count > count)
+            count = submodel->offset + submodel->count;
+
+    return count;
+}
+
+void build_model_bvh(model_data_t* data) {
+    uint32_t n = 0;
+    for (submodel_t* submodel = data->root; submodel != NULL; submodel = submodel->child)
+        n++;
+
+    uint32_t* ranges = malloc(sizeof(uint32_t) * n * 3);
+    uint32_t *first = ranges, *count = ranges + n, *roots = ranges + n * 2;
+
+    uint32_t i = 0;
+    for (submodel_t* submodel = data->root; submodel != NULL; submodel = submodel->child, i++) {
+        first[i] = submodel->offset;
+        count[i] = submodel->count;
+    }
+
+    data->bvh = malloc(sizeof(mesh_bvh_t));
+    build_mesh_bvh(data->bvh, data->vertices, 8, data->vertices_n, data->indices, model_data_count(data), first, count,
+                   n, roots);
+
+    i = 0;
+    for (submodel_t* submodel = data->root; submodel != NULL; submodel = submodel->child, i++)
+        submodel->bvh_root = roots[i];
+
+    free(ranges);
+}
+
+void prepare_model(model_data_t* data, uint32_t flags) {
+    // Cooked models come with meshlets whether they are wanted or not
+    if (!(flags & MODEL_MESHLETS) && data->meshlets != NULL) {
+        free(data->meshlets);
+        data->meshlets = NULL;
+        data->meshlets_n = 0;
+    }
+
+    // Meshlets reorder triangles, so they come before anything that records triangle positions
+    if ((flags & MODEL_MESHLETS) && data->meshlets == NULL) {
+        for (submodel_t* submodel = data->root; submodel != NULL; submodel = submodel->child) {
+            submodel->meshlet_first = data->meshlets_n;
+            submodel->meshlets_n = build_meshlets(&data->meshlets, &data->meshlets_n, data->vertices, 8,
+                                                  data->indices, submodel->offset, submodel->count);
+        }
+    }
+
+    if ((flags & MODEL_KEEP_POSITIONS) && data->bvh == NULL)
+        build_model_bvh(data);
+}
+
+void upload_model(model_t* model, model_data_t* data, uint32_t flags) {
+    if (mesh_arena.vao == 0)
+        init_model_arenas();
+
+    model->count = model_data_count(data);
+
+    model->root = data->root;
+    data->root = NULL;
+
+    model->transforms = NULL;
+    model->transform = 0;
+
+    model->flags = flags;
+
+    model->bvh = data->bvh;
+    data->bvh = NULL;
+
+    model->meshlets = data->meshlets;
+    model->meshlets_n = data->meshlets_n;
+    data->meshlets = NULL;
+    data->meshlets_n = 0;
+
+    // Without meshlets every submodel is drawn whole
+    if (model->meshlets == NULL)
+        for (submodel_t* submodel = model->root; submodel != NULL; submodel = submodel->child)
+            submodel->meshlet_first = submodel->meshlets_n = 0;
+
+    model->materials = data->materials;
+    model->materials_n = data->materials_n;
+    data->materials = NULL;
+    data->materials_n = 0;
+
+    // Materials past the block's length fall back to the default one
+    uint32_t uploaded = model->materials_n < SHADER_MATERIALS ? model->materials_n : SHADER_MATERIALS;
+
+    if (uploaded < model->materials_n)
+        fprintf(stderr, "Too many materials: %u, only %u are used\n", model->materials_n, uploaded);
+
+    for (submodel_t* submodel = model->root; submodel != NULL; submodel = submodel->child)
+        if (submodel->material >= uploaded)
+            submodel->material = 0;
+
+    material_data_t parameters[SHADER_MATERIALS];
+    memset(parameters, 0, sizeof(parameters));
+
+    for (uint32_t i = 0; i < uploaded; i++) {
+        parameters[i] = model->materials[i].data;
+
+        // Decoded in the background, update_model_materials points the material at its layer once it is ready
+        if (model->materials[i].diffuse_map != NULL)
+            model->materials[i].diffuse_texture = load_texture(&texture_cache, model->materials[i].diffuse_map);
+    }
+
+    glGenBuffers(1, &model->material_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, model->material_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(parameters), parameters, GL_STATIC_DRAW);
+
+    // Model
+
+    model->geometry = alloc_geometry(&mesh_arena, data->vertices, data->vertices_n, data->indices, data->indices_n);
 
     // Bounding Box
 
-    glGenVertexArrays(1, &model->bb_vao);
-    glBindVertexArray(model->bb_vao);
+    model->bb_geometry =
+        alloc_geometry(&bounds_arena, data->bb_vertices, data->bb_vertices_n, data->bb_indices, data->bb_indices_n);
+
+    free_model_data(data);
+}
+
+void init_model(model_t* model, uint32_t flags) {
+    // A failed load leaves these as they are here, so the model draws and frees as empty
+    model->geometry = GEOMETRY_NONE;
+    model->bb_geometry = GEOMETRY_NONE;
+    model->count = 0;
+
+    model->root = NULL;
+    model->transforms = NULL;
+    model->bvh = NULL;
+    model->meshlets = NULL;
+    model->meshlets_n = 0;
+    model->materials = NULL;
+    model->materials_n = 0;
+    model->material_buffer = 0;
+    model->flags = flags;
+}
+
+void load_model(model_t* model, const char* path, uint32_t flags) {
+    model_data_t data;
+
+    init_model(model, flags);
+    if (!parse_model(&data, path))
+        return;
+
+    prepare_model(&data, flags);
+    upload_model(model, &data, flags);
+}
+
+void parse_model_read(void* arg) {
+    model_load_t* load = arg;
+    load->read_time = glfwGetTime();
+
+    if (load->read.ok)
+        load->ok = parse_model_file(&load->data, &load->read.file, load->read.path);
+
+    vfs_close(&load->read.file);
+
+    // A stale or damaged cooked model falls back to a blocking parse of the source
+    if (!load->ok && load->read.path != load->source_path)
+        load->ok = parse_source_model(&load->data, load->source_path);
+    else if (!load->read.ok)
+        fprintf(stderr, "Failed to load model: %s\n", load->read.path);
+
+    if (load->ok)
+        prepare_model(&load->data, load->flags);
+
+    load->parse_time = glfwGetTime();
+    atomic_store_explicit(&load->parsed, 1, memory_order_release);
+}
+
+void begin_model_loads(model_batch_t* batch, model_t* models, const char** paths, uint32_t count, uint32_t flags) {
+    batch->models = models;
+    batch->loads = calloc(count, sizeof(model_load_t));
+    batch->count = count;
+    batch->uploaded = 0;
+    batch->flags = flags;
+    atomic_init(&batch->counter.value, 0);
+
+    double start = glfwGetTime();
 
-    glGenBuffers(1, &model->bb_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, model->bb_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * bb_vertices_n, bb_vertices, GL_STATIC_DRAW);
+    for (uint32_t i = 0; i < count; i++) {
+        model_load_t* load = &batch->loads[i];
 
-    // Positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (void*)0);
+        init_model(&models[i], flags);
 
-    glGenBuffers(1, &model->bb_ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->bb_ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * bb_indices_n, bb_indices, GL_STATIC_DRAW);
+        load->source_path = paths[i];
+        load->flags = flags;
+        load->read.path = paths[i];
 
-    free(bb_vertices);
-    free(bb_indices);
+        if (find_cooked_model(load->cooked_path, sizeof(load->cooked_path), paths[i]))
+            load->read.path = load->cooked_path;
+        load->read.func = parse_model_read;
+        load->read.data = load;
+        load->start_time = start;
+    }
+
+    // Each file's parse starts as soon as its own read lands, while the rest are still in flight
+    for (uint32_t i = 0; i < count; i++)
+        read_files(&batch->loads[i].read, 1, &batch->counter);
+}
+
+uint32_t upload_parsed_models(model_batch_t* batch) {
+    for (uint32_t i = 0; i < batch->count && batch->uploaded < batch->count; i++) {
+        model_load_t* load = &batch->loads[i];
+
+        if (load->uploaded || !atomic_load_explicit(&load->parsed, memory_order_acquire))
+            continue;
+
+        if (load->ok)
+            upload_model(&batch->models[i], &load->data, batch->flags);
+
+        load->upload_time = glfwGetTime();
+        load->uploaded = 1;
+        batch->uploaded++;
+    }
+
+    return batch->count - batch->uploaded;
+}
+
+void finish_model_loads(model_batch_t* batch) {
+    // Uploads go out in the order parses finish, between helping with the parses still running
+    while (upload_parsed_models(batch) > 0)
+        if (!run_pending_job())
+            sched_yield();
+
+    wait_for_counter(&batch->counter);
+}
+
+void free_model_batch(model_batch_t* batch) {
+    free(batch->loads);
+    memset(batch, 0, sizeof(model_batch_t));
+}
+
+void load_models(model_t* models, const char** paths, uint32_t count, uint32_t flags) {
+    model_batch_t batch;
+
+    begin_model_loads(&batch, models, paths, count, flags);
+    finish_model_loads(&batch);
+    free_model_batch(&batch);
+}
+
+void free_model_data(model_data_t* data) {
+    free(data->vertices);
+    free(data->indices);
+    free(data->bb_vertices);
+    free(data->bb_indices);
+    free_materials(data->materials, data->materials_n);
+    free(data->meshlets);
+
+    if (data->bvh != NULL) {
+        free_mesh_bvh(data->bvh);
+        free(data->bvh);
+    }
+
+    submodel_t *submodel = data->root, *next;
+    while (submodel != NULL) {
+        next = submodel->child;
+
+        free(submodel);
+        submodel = next;
+    }
+
+    memset(data, 0, sizeof(model_data_t));
+}
+
+void attach_model_transforms(model_t* model, transforms_t* transforms, int32_t parent) {
+    model->transforms = transforms;
+    model->transform = add_transform(transforms, parent);
+
+    for (submodel_t* submodel = model->root; submodel != NULL; submodel = submodel->child)
+        submodel->transform = add_transform(transforms, model->transform);
+}
+
+void inherit_model_transforms(model_t* model, const model_t* previous) {
+    if (previous->transforms == NULL)
+        return;
+
+    model->transforms = previous->transforms;
+    model->transform = previous->transform;
+
+    submodel_t* old = previous->root;
+
+    // Extra submodels get fresh nodes, nodes of removed ones are simply left unused
+    for (submodel_t* submodel = model->root; submodel != NULL; submodel = submodel->child) {
+        if (old != NULL) {
+            submodel->transform = old->transform;
+            old = old->child;
+        } else {
+            submodel->transform = add_transform(model->transforms, model->transform);
+        }
+    }
+}
+
+int raycast_submodel(const model_t* model, submodel_t* submodel, const vec3 origin, const vec3 dir, float max_t,
+                     ray_hit_t* hit) {
+    if (model->bvh == NULL)
+        return 0;
+
+    mesh_hit_t mesh_hit;
+    if (!raycast_mesh_bvh(model->bvh, submodel->bvh_root, origin, dir, max_t, &mesh_hit))
+        return 0;
+
+    hit->t = mesh_hit.t;
+    hit->u = mesh_hit.u;
+    hit->v = mesh_hit.v;
+    hit->triangle = mesh_hit.triangle;
+    hit->submodel = submodel;
+
+    return 1;
+}
+
+uint32_t select_lod(const submodel_t* submodel, float screen_size) {
+    uint32_t lod = 0;
+    float size = MODEL_LOD_SCREEN_SIZE;
+
+    while (lod + 1 < submodel->lods_n && screen_size < size) {
+        lod++;
+        size *= 0.5f;
+    }
+
+    return lod;
 }
 
 void draw_model(model_t* model) {
-    glBindVertexArray(model->vao);
-    glDrawElements(GL_TRIANGLES, model->count, GL_UNSIGNED_INT, (void*)0);
+    const geometry_alloc_t* geometry = get_geometry(&mesh_arena, model->geometry);
+    if (geometry == NULL)
+        return;
+
+    glBindVertexArray(mesh_arena.vao);
+    glDrawElementsBaseVertex(GL_TRIANGLES, model->count, GL_UNSIGNED_INT,
+                             (void*)(sizeof(uint32_t) * geometry->first_index), geometry->base_vertex);
+}
+
+int update_model_materials(model_t* model) {
+    uint32_t uploaded = model->materials_n < SHADER_MATERIALS ? model->materials_n : SHADER_MATERIALS;
+    int textured = 0;
+
+    for (uint32_t i = 0; i < uploaded; i++) {
+        material_t* material = &model->materials[i];
+        texture_t* texture = material->diffuse_texture;
+
+        int32_t slot = -1, layer = 0;
+
+        if (texture != NULL && atomic_load(&texture->status) == TEXTURE_READY) {
+            slot = texture->array->slot;
+            layer = texture->layer;
+        }
+
+        textured += slot >= 0;
+
+        if (slot == material->data.texture_slot && layer == material->data.texture_layer)
+            continue;
+
+        material->data.texture_slot = slot;
+        material->data.texture_layer = layer;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, model->material_buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(material_data_t) * i, sizeof(material_data_t), &material->data);
+    }
+
+    return textured;
 }
 
 void free_model(model_t* model) {
-    glDeleteVertexArrays(1, &model->vao);
-    glDeleteBuffers(1, &model->ebo);
-    glDeleteBuffers(1, &model->vbo);
+    free_geometry(&mesh_arena, model->geometry);
+    free_geometry(&bounds_arena, model->bb_geometry);
+
+    model->geometry = GEOMETRY_NONE;
+    model->bb_geometry = GEOMETRY_NONE;
+
+    // Freed ranges are reused first, only compact once the holes stop fitting new models
+    geometry_arena_t* arenas[] = {&mesh_arena, &bounds_arena};
+
+    for (int i = 0; i < 2; i++) {
+        geometry_stats_t stats;
+        geometry_stats(arenas[i], &stats);
+
+        if (stats.vertex_fragmentation > 0.5f || stats.index_fragmentation > 0.5f)
+            compact_geometry(arenas[i]);
+    }
+
+    if (model->bvh != NULL) {
+        free_mesh_bvh(model->bvh);
+        free(model->bvh);
+        model->bvh = NULL;
+    }
+
+    free(model->meshlets);
+    model->meshlets = NULL;
+
+    free_materials(model->materials, model->materials_n);
+    model->materials = NULL;
+    model->materials_n = 0;
 
-    glDeleteVertexArrays(1, &model->bb_vao);
-    glDeleteBuffers(1, &model->bb_ebo);
-    glDeleteBuffers(1, &model->bb_vbo);
+    glDeleteBuffers(1, &model->material_buffer);
+    model->material_buffer = 0;
 
     submodel_t *submodel = model->root, *next;
     while (submodel != NULL) {
@@ -1,32 +1,202 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "geometry.h"
 #include "glfw.h"
 #include "linmath.h"
+#include "material.h"
+#include "mesh_bvh.h"
+#include "meshlet.h"
+#include "reader.h"
+#include "transform.h"
+#include "vfs.h"
+
+#define MODEL_LODS 4
+
+// Longest asset path, cooked or not
+#define MODEL_PATH_MAX 1024
+
+// Screen size in pixels below which the first simplified level is used, halving for each further level
+#define MODEL_LOD_SCREEN_SIZE 256.0f
+
+// Error budget of the first simplified level relative to the submodel's extent, doubling per level
+#define MODEL_LOD_ERROR 0.01f
 
 struct _submodel_t {
     GLuint count;
     GLuint offset;
 
+    // Level 0 is offset and count, coarser levels are stored after every submodel's full resolution indices
+    GLuint lod_offset[MODEL_LODS], lod_count[MODEL_LODS];
+    uint32_t lods_n;
+
     vec3 bbox_min, bbox_max, bbox_mid;
     GLuint bb_index;
 
+    // Texture coordinate units across the box diagonal, estimated from the ratio of UV to surface area
+    float uv_extent;
+
+    // Submodels are split wherever usemtl changes, so each one has a single material
+    uint32_t material;
+
+    // Node in the owning model's transform store, parented to the model root
+    uint32_t transform;
+
+    // Root in the model's triangle BVH when positions are kept
+    uint32_t bvh_root;
+
+    // Range in the model's meshlets, which cover level 0
+    uint32_t meshlet_first, meshlets_n;
+
     struct _submodel_t* child;
 };
 
 struct _model_t {
-    GLuint vao, vbo, ebo;
+    // Handles into mesh_arena and bounds_arena
+    uint32_t geometry, bb_geometry;
     GLuint count;
 
-    GLuint bb_vao, bb_vbo, bb_ebo;
+    uint32_t flags;
+    struct _mesh_bvh_t* bvh;
+
+    // Entry 0 is the default material, parameters of the first SHADER_MATERIALS live in material_buffer
+    struct _material_t* materials;
+    uint32_t materials_n;
+    GLuint material_buffer;
+
+    struct _meshlet_t* meshlets;
+    uint32_t meshlets_n;
+
+    struct _transforms_t* transforms;
+    uint32_t transform;
+
+    struct _submodel_t* root;
+};
+
+// CPU side result of parsing, safe to produce off the GL thread
+struct _model_data_t {
+    float* vertices;
+    size_t vertices_n;
+
+    uint32_t* indices;
+    size_t indices_n;
+
+    float* bb_vertices;
+    size_t bb_vertices_n;
+
+    uint32_t* bb_indices;
+    size_t bb_indices_n;
+
+    struct _material_t* materials;
+    uint32_t materials_n;
+
+    // Filled in by prepare_model according to the load flags, the model takes them over on upload
+    struct _meshlet_t* meshlets;
+    uint32_t meshlets_n;
+    struct _mesh_bvh_t* bvh;
 
     struct _submodel_t* root;
 };
 
+// One file of a batch, the times are glfwGetTime stamps for startup reports
+struct _model_load_t {
+    // Reads the cooked model in place of the source when there is one
+    const char* source_path;
+    char cooked_path[MODEL_PATH_MAX];
+    uint32_t flags;
+
+    file_read_t read;
+    struct _model_data_t data;
+
+    // Set by the parse job, after which the GL thread may upload the data
+    atomic_int parsed;
+    int ok, uploaded;
+
+    double start_time, read_time, parse_time, upload_time;
+};
+
+struct _model_batch_t {
+    struct _model_t* models;
+    struct _model_load_t* loads;
+    uint32_t count, uploaded, flags;
+
+    job_counter_t counter;
+};
+
+struct _ray_hit_t {
+    float t, u, v;
+    uint32_t triangle;
+
+    struct _submodel_t* submodel;
+};
+
+enum {
+    // Keep a CPU copy of the positions and build a triangle BVH for ray queries
+    MODEL_KEEP_POSITIONS = 1,
+    // Reorder level 0 into meshlets with bounds for finer grained culling
+    MODEL_MESHLETS = 2,
+};
+
 typedef struct _model_t model_t;
 typedef struct _submodel_t submodel_t;
+typedef struct _model_data_t model_data_t;
+typedef struct _model_load_t model_load_t;
+typedef struct _model_batch_t model_batch_t;
+typedef struct _ray_hit_t ray_hit_t;
+
+extern geometry_arena_t mesh_arena, bounds_arena;
+
+void load_model(model_t* model, const char* path, uint32_t flags);
+
+// Reads every file in one batch and parses each as a job once its data arrives, then uploads them
+void load_models(model_t* models, const char** paths, uint32_t count, uint32_t flags);
+
+// The same in steps, so reads and parses can run before there is a GL context. Beginning needs none, uploading
+// needs one and returns how many models are still parsing. Finishing uploads the rest as their parses complete.
+void begin_model_loads(model_batch_t* batch, model_t* models, const char** paths, uint32_t count, uint32_t flags);
+uint32_t upload_parsed_models(model_batch_t* batch);
+void finish_model_loads(model_batch_t* batch);
+void free_model_batch(model_batch_t* batch);
+
+// Reads the cooked model when there is an up to date one, otherwise OBJ, or binary glTF when the path ends in .glb
+int parse_model(model_data_t* data, const char* path);
+int parse_source_model(model_data_t* data, const char* path);
+int parse_model_file(model_data_t* data, const vfs_file_t* file, const char* path);
+
+// Only level 0 of an OBJ or glTF source, with linked submodels but no bounds or levels of detail
+int parse_model_geometry(model_data_t* data, const vfs_file_t* file, const char* path);
+
+// Shared tail of the loaders. Takes level 0 in data's vertices and indices and the linked submodels, computes
+// bounds and box geometry and appends every submodel's levels of detail to the indices.
+void build_submodels(model_data_t* data, submodel_t** submodels, uint32_t submodels_n);
+void bound_submodels(model_data_t* data, submodel_t** submodels, uint32_t submodels_n);
+void simplify_submodels(model_data_t* data, submodel_t** submodels, uint32_t submodels_n);
+
+// The linked submodels as an array in order, free it when done
+submodel_t** list_submodels(const model_data_t* data, uint32_t* submodels_n);
+
+// The CPU work that depends on the load flags, meshlets and the triangle BVH, so the upload only has GL calls left
+void prepare_model(model_data_t* data, uint32_t flags);
+void upload_model(model_t* model, model_data_t* data, uint32_t flags);
+void free_model_data(model_data_t* data);
+
+// Adds a root node for the model under parent and one child node per submodel
+void attach_model_transforms(model_t* model, transforms_t* transforms, int32_t parent);
+// Takes over the transform nodes of a model being replaced, matching submodels in order
+void inherit_model_transforms(model_t* model, const model_t* previous);
+
+// The ray is in the submodel's local space, returns 0 on a miss or when the model has no BVH
+int raycast_submodel(const model_t* model, submodel_t* submodel, const vec3 origin, const vec3 dir, float max_t,
+                     ray_hit_t* hit);
+
+uint32_t select_lod(const submodel_t* submodel, float screen_size);
+
+// Points materials at the array layers of their ready textures, returns how many are textured
+int update_model_materials(model_t* model);
 
-void load_model(model_t* model, const char* path);
 void draw_model(model_t* model);
 void free_model(model_t* model);
 
@@ -0,0 +1,96 @@
+#include "pick.h"
+
+#include <stdlib.h>
+
+struct _pick_t {
+    const model_t* model;
+    const transforms_t* transforms;
+
+    submodel_t** submodels;
+    ray_hit_t hit;
+};
+
+typedef struct _pick_t pick_t;
+
+void unproject_ray(vec3 origin, vec3 dir, const mat4x4 view, const mat4x4 projection, float x, float y) {
+    mat4x4 view_projection, inverse;
+    mat4x4_mul(view_projection, projection, view);
+    mat4x4_invert(inverse, view_projection);
+
+    vec4 near_point = {x, y, -1.0f, 1.0f}, far_point = {x, y, 1.0f, 1.0f};
+    vec4 near_world, far_world;
+
+    mat4x4_mul_vec4(near_world, inverse, near_point);
+    mat4x4_mul_vec4(far_world, inverse, far_point);
+
+    for (int i = 0; i < 3; i++) {
+        origin[i] = near_world[i] / near_world[3];
+        dir[i] = far_world[i] / far_world[3] - origin[i];
+    }
+
+    vec3_normalize(dir, dir);
+}
+
+// Exact test for a scene item whose box was hit, done in the submodel's local space
+int pick_hit(void* data, uint32_t item, const vec3 origin, const vec3 dir, float* t) {
+    pick_t* pick = data;
+    submodel_t* submodel = pick->submodels[item];
+
+    mat4x4 inverse;
+    mat4x4_invert(inverse, pick->transforms->world[submodel->transform]);
+
+    // The direction is left unnormalised so distances stay comparable to world space
+    vec4 world_origin, world_dir, local_origin, local_dir;
+    vec4_from_vec3(world_origin, origin, 1.0f);
+    vec4_from_vec3(world_dir, dir, 0.0f);
+
+    mat4x4_mul_vec4(local_origin, inverse, world_origin);
+    mat4x4_mul_vec4(local_dir, inverse, world_dir);
+
+    ray_hit_t hit;
+
+    if (pick->model->bvh == NULL) {
+        // Without kept positions the submodel's box is the best there is
+        vec3 inv_dir = {1.0f / local_dir[0], 1.0f / local_dir[1], 1.0f / local_dir[2]};
+
+        if (!ray_aabb(local_origin, inv_dir, submodel->bbox_min, submodel->bbox_max, *t, &hit.t))
+            return 0;
+
+        hit.u = hit.v = 0.0f;
+        hit.triangle = 0;
+        hit.submodel = submodel;
+    } else if (!raycast_submodel(pick->model, submodel, local_origin, local_dir, *t, &hit)) {
+        return 0;
+    }
+
+    *t = hit.t;
+    pick->hit = hit;
+
+    return 1;
+}
+
+int pick_submodel(const scene_bvh_t* scene, const model_t* model, const transforms_t* transforms, const vec3 origin,
+                  const vec3 dir, ray_hit_t* hit) {
+    if (scene->items_n == 0)
+        return -1;
+
+    pick_t pick = {model, transforms, malloc(sizeof(submodel_t*) * scene->items_n)};
+
+    uint32_t n = 0;
+    for (submodel_t* submodel = model->root; submodel != NULL && n < scene->items_n; submodel = submodel->child)
+        pick.submodels[n++] = submodel;
+
+    // Items past the end of the list would mean the scene is stale, skip the pick rather than guess
+    int item = -1;
+
+    if (n == scene->items_n) {
+        float t;
+        item = raycast_scene_bvh(scene, origin, dir, INFINITY, pick_hit, &pick, &t);
+
+        if (item >= 0)
+            *hit = pick.hit;
+    }
+
+    free(pick.submodels);
+    return item;
+}
@@ -0,0 +1,16 @@
+#ifndef PICK_H
+#define PICK_H
+
+#include "bvh.h"
+#include "linmath.h"
+#include "model.h"
+#include "transform.h"
+
+// World space ray through a point in normalised device coordinates
+void unproject_ray(vec3 origin, vec3 dir, const mat4x4 view, const mat4x4 projection, float x, float y);
+
+// Scene items are the model's submodels in list order, returns the hit item or -1
+int pick_submodel(const scene_bvh_t* scene, const model_t* model, const transforms_t* transforms, const vec3 origin,
+                  const vec3 dir, ray_hit_t* hit);
+
+#endif  // PICK_H
@@ -0,0 +1,489 @@
+#include "reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// Largest single read, the length field of a submission is 32 bits
+#define READER_CHUNK_SIZE (1u << 30)
+
+enum { READER_BACKEND_NONE, READER_BACKEND_URING, READER_BACKEND_THREADS };
+
+struct _read_request_t {
+    file_read_t* read;
+    struct _read_request_t* next;
+};
+
+typedef struct _read_request_t read_request_t;
+
+int reader_type = READER_BACKEND_NONE;
+int reader_stopping;
+
+read_request_t *requests_head, *requests_tail;
+pthread_mutex_t reader_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t reader_wake = PTHREAD_COND_INITIALIZER;
+
+pthread_t reader_threads[READER_THREADS];
+int reader_threads_n;
+
+void finish_read(void* data) {
+    file_read_t* read = data;
+
+    if (read->func != NULL)
+        read->func(read->data);
+
+    atomic_fetch_sub_explicit(&read->counter->value, 1, memory_order_release);
+}
+
+void open_vfs_read(void* data) {
+    file_read_t* read = data;
+    read->ok = vfs_open(&read->file, read->path);
+
+    finish_read(read);
+}
+
+// Returns the next request, or NULL when stopping. With wait unset only returns what is already queued.
+file_read_t* take_read_request(int wait) {
+    pthread_mutex_lock(&reader_lock);
+
+    while (wait && requests_head == NULL && !reader_stopping)
+        pthread_cond_wait(&reader_wake, &reader_lock);
+
+    read_request_t* request = reader_stopping ? NULL : requests_head;
+    if (request != NULL) {
+        requests_head = request->next;
+        if (requests_head == NULL)
+            requests_tail = NULL;
+    }
+
+    pthread_mutex_unlock(&reader_lock);
+
+    if (request == NULL)
+        return NULL;
+
+    file_read_t* read = request->read;
+    free(request);
+
+    return read;
+}
+
+void complete_read(file_read_t* read, char* buffer, size_t size, int ok) {
+    if (ok) {
+        buffer[size] = '\0';
+
+        read->file.data = buffer;
+        read->file.size = size;
+        read->file.owned = buffer;
+    } else {
+        free(buffer);
+    }
+
+    read->ok = ok;
+    queue_job(finish_read, read, NULL);
+}
+
+void* read_thread_main(void* arg) {
+    (void)arg;
+
+    file_read_t* read;
+    while ((read = take_read_request(1)) != NULL) {
+        int fd = open(read->path, O_RDONLY);
+        struct stat info;
+
+        if (fd < 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            if (fd >= 0)
+                close(fd);
+
+            complete_read(read, NULL, 0, 0);
+            continue;
+        }
+
+        char* buffer = malloc(info.st_size + 1);
+        size_t size = 0;
+
+        while (size < (size_t)info.st_size) {
+            ssize_t n = pread(fd, buffer + size, info.st_size - size, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+
+            if (n <= 0)
+                break;
+
+            size += n;
+        }
+
+        close(fd);
+        complete_read(read, buffer, size, 1);
+    }
+
+    return NULL;
+}
+
+#ifdef __linux__
+enum { URING_OPEN, URING_STAT, URING_READ };
+
+// One file moving through open and stat, then as many reads as it takes
+struct _uring_slot_t {
+    file_read_t* read;
+
+    int fd, pending, failed;
+    struct statx info;
+
+    char* buffer;
+    size_t size, offset;
+};
+
+struct _uring_t {
+    int fd;
+
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size;
+
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe* cqes;
+
+    unsigned sq_local_tail, to_submit;
+
+    struct _uring_slot_t slots[READER_QUEUE_DEPTH];
+    int free_slots[READER_QUEUE_DEPTH];
+    int free_n, in_flight;
+};
+
+typedef struct _uring_slot_t uring_slot_t;
+typedef struct _uring_t uring_t;
+
+uring_t uring;
+
+int setup_uring() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    // Two submissions per file for the open and stat
+    uring.fd = syscall(__NR_io_uring_setup, READER_QUEUE_DEPTH * 2, &params);
+    if (uring.fd < 0)
+        return 0;
+
+    // Reads, opens and stats through the ring all predate this feature
+    if (!(params.features & IORING_FEAT_FAST_POLL)) {
+        close(uring.fd);
+        return 0;
+    }
+
+    uring.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    uring.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    uring.sq_ring = mmap(NULL, uring.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd,
+                         IORING_OFF_SQ_RING);
+    uring.cq_ring = mmap(NULL, uring.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd,
+                         IORING_OFF_CQ_RING);
+    uring.sqes = mmap(NULL, uring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd,
+                      IORING_OFF_SQES);
+
+    if (uring.sq_ring == MAP_FAILED || uring.cq_ring == MAP_FAILED || uring.sqes == MAP_FAILED) {
+        if (uring.sq_ring != MAP_FAILED)
+            munmap(uring.sq_ring, uring.sq_ring_size);
+        if (uring.cq_ring != MAP_FAILED)
+            munmap(uring.cq_ring, uring.cq_ring_size);
+        if (uring.sqes != MAP_FAILED)
+            munmap(uring.sqes, uring.sqes_size);
+
+        close(uring.fd);
+        return 0;
+    }
+
+    char* sq = uring.sq_ring;
+    uring.sq_head = (unsigned*)(sq + params.sq_off.head);
+    uring.sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    uring.sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    uring.sq_array = (unsigned*)(sq + params.sq_off.array);
+
+    char* cq = uring.cq_ring;
+    uring.cq_head = (unsigned*)(cq + params.cq_off.head);
+    uring.cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    uring.cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    uring.cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    uring.sq_local_tail = *uring.sq_tail;
+
+    for (int i = 0; i < READER_QUEUE_DEPTH; i++)
+        uring.free_slots[i] = READER_QUEUE_DEPTH - 1 - i;
+
+    uring.free_n = READER_QUEUE_DEPTH;
+    return 1;
+}
+
+void free_uring() {
+    munmap(uring.sq_ring, uring.sq_ring_size);
+    munmap(uring.cq_ring, uring.cq_ring_size);
+    munmap(uring.sqes, uring.sqes_size);
+    close(uring.fd);
+}
+
+struct io_uring_sqe* uring_sqe(int slot, int op) {
+    unsigned index = uring.sq_local_tail & *uring.sq_mask;
+    struct io_uring_sqe* sqe = &uring.sqes[index];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->user_data = (uint64_t)slot << 2 | op;
+
+    uring.sq_array[index] = index;
+    uring.sq_local_tail++;
+    uring.to_submit++;
+
+    return sqe;
+}
+
+void submit_uring_read(int index) {
+    uring_slot_t* slot = &uring.slots[index];
+    size_t remaining = slot->size - slot->offset;
+
+    struct io_uring_sqe* sqe = uring_sqe(index, URING_READ);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(slot->buffer + slot->offset);
+    sqe->len = remaining < READER_CHUNK_SIZE ? remaining : READER_CHUNK_SIZE;
+    sqe->off = slot->offset;
+}
+
+void start_uring_read(file_read_t* read) {
+    int index = uring.free_slots[--uring.free_n];
+    uring_slot_t* slot = &uring.slots[index];
+
+    memset(slot, 0, sizeof(uring_slot_t));
+    slot->read = read;
+    slot->fd = -1;
+    slot->pending = 2;
+    uring.in_flight++;
+
+    // Both only need the path, so they go out together
+    struct io_uring_sqe* sqe = uring_sqe(index, URING_OPEN);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)read->path;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+    sqe = uring_sqe(index, URING_STAT);
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)read->path;
+    sqe->len = STATX_TYPE | STATX_SIZE;
+    sqe->off = (uint64_t)(uintptr_t)&slot->info;
+}
+
+void finish_uring_slot(int index, int ok) {
+    uring_slot_t* slot = &uring.slots[index];
+
+    if (slot->fd >= 0)
+        close(slot->fd);
+
+    complete_read(slot->read, slot->buffer, slot->offset, ok);
+
+    uring.free_slots[uring.free_n++] = index;
+    uring.in_flight--;
+}
+
+void handle_uring_completion(uint64_t user_data, int result) {
+    int index = user_data >> 2;
+    uring_slot_t* slot = &uring.slots[index];
+
+    if ((user_data & 3) == URING_READ) {
+        if (result == -EINTR || result == -EAGAIN) {
+            submit_uring_read(index);
+        } else if (result < 0) {
+            finish_uring_slot(index, 0);
+        } else {
+            slot->offset += result;
+
+            // A short read at the end means the file shrank since the stat
+            if (result > 0 && slot->offset < slot->size)
+                submit_uring_read(index);
+            else
+                finish_uring_slot(index, 1);
+        }
+
+        return;
+    }
+
+    if (result < 0)
+        slot->failed = 1;
+    else if ((user_data & 3) == URING_OPEN)
+        slot->fd = result;
+
+    if (--slot->pending > 0)
+        return;
+
+    if (slot->failed || !S_ISREG(slot->info.stx_mode)) {
+        finish_uring_slot(index, 0);
+        return;
+    }
+
+    slot->size = slot->info.stx_size;
+    slot->buffer = malloc(slot->size + 1);
+
+    if (slot->size == 0)
+        finish_uring_slot(index, 1);
+    else
+        submit_uring_read(index);
+}
+
+void* uring_main(void* arg) {
+    (void)arg;
+
+    while (1) {
+        // Sleep on new requests only when nothing is in flight, otherwise completions wake the thread
+        file_read_t* read;
+        while (uring.free_n > 0 && (read = take_read_request(uring.in_flight == 0)) != NULL)
+            start_uring_read(read);
+
+        if (uring.in_flight == 0)
+            break;
+
+        __atomic_store_n(uring.sq_tail, uring.sq_local_tail, __ATOMIC_RELEASE);
+
+        int submitted = syscall(__NR_io_uring_enter, uring.fd, uring.to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            fprintf(stderr, "io_uring_enter failed: %s\n", strerror(errno));
+            break;
+        }
+
+        if (submitted > 0)
+            uring.to_submit -= submitted;
+
+        unsigned head = *uring.cq_head;
+        unsigned tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++) {
+            struct io_uring_cqe* cqe = &uring.cqes[head & *uring.cq_mask];
+            handle_uring_completion(cqe->user_data, cqe->res);
+        }
+
+        __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+#endif
+
+void start_reader() {
+    reader_stopping = 0;
+
+#ifdef __linux__
+    if (setup_uring()) {
+        if (pthread_create(&reader_threads[0], NULL, uring_main, NULL) == 0) {
+            reader_threads_n = 1;
+            reader_type = READER_BACKEND_URING;
+            return;
+        }
+
+        free_uring();
+    }
+#endif
+
+    start_reader_threads();
+}
+
+void start_reader_threads() {
+    reader_stopping = 0;
+
+    for (int i = 0; i < READER_THREADS; i++)
+        if (pthread_create(&reader_threads[reader_threads_n], NULL, read_thread_main, NULL) == 0)
+            reader_threads_n++;
+
+    reader_type = reader_threads_n > 0 ? READER_BACKEND_THREADS : READER_BACKEND_NONE;
+}
+
+void stop_reader() {
+    pthread_mutex_lock(&reader_lock);
+    reader_stopping = 1;
+    pthread_cond_broadcast(&reader_wake);
+    pthread_mutex_unlock(&reader_lock);
+
+    // Reads already in flight finish first so no buffer is written after its owner is gone
+    for (int i = 0; i < reader_threads_n; i++)
+        pthread_join(reader_threads[i], NULL);
+
+#ifdef __linux__
+    if (reader_type == READER_BACKEND_URING)
+        free_uring();
+#endif
+
+    while (requests_head != NULL) {
+        read_request_t* next = requests_head->next;
+        free(requests_head);
+        requests_head = next;
+    }
+
+    requests_tail = NULL;
+    reader_threads_n = 0;
+    reader_type = READER_BACKEND_NONE;
+}
+
+const char* reader_backend() {
+    switch (reader_type) {
+        case READER_BACKEND_URING:
+            return "io_uring";
+        case READER_BACKEND_THREADS:
+            return "threads";
+        default:
+            return "none";
+    }
+}
+
+void read_files(file_read_t* reads, uint32_t count, job_counter_t* counter) {
+    atomic_fetch_add_explicit(&counter->value, count, memory_order_relaxed);
+
+    read_request_t *head = NULL, **tail = &head, *last = NULL;
+
+    for (uint32_t i = 0; i < count; i++) {
+        file_read_t* read = &reads[i];
+
+        memset(&read->file, 0, sizeof(vfs_file_t));
+        read->ok = 0;
+        read->counter = counter;
+
+        // Packed files are already mapped, and without a reader there is nothing to hand the read to
+        if (vfs_packed(read->path) || reader_type == READER_BACKEND_NONE) {
+            queue_job(open_vfs_read, read, NULL);
+            continue;
+        }
+
+        last = malloc(sizeof(read_request_t));
+        last->read = read;
+        last->next = NULL;
+
+        *tail = last;
+        tail = &last->next;
+    }
+
+    if (head == NULL)
+        return;
+
+    pthread_mutex_lock(&reader_lock);
+
+    if (requests_tail != NULL)
+        requests_tail->next = head;
+    else
+        requests_head = head;
+
+    requests_tail = last;
+
+    pthread_cond_broadcast(&reader_wake);
+    pthread_mutex_unlock(&reader_lock);
+}
@@ -0,0 +1,46 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stdint.h>
+
+#include "job.h"
+#include "vfs.h"
+
+// Reads queued at once beyond this wait for earlier ones to finish, which also bounds the open descriptors
+#define READER_QUEUE_DEPTH 64
+
+// Blocking reads in flight when io_uring is unavailable
+#define READER_THREADS 4
+
+struct _file_read_t {
+    const char* path;
+
+    // Filled in before func runs and owned by the read, release with vfs_close
+    vfs_file_t file;
+    int ok;
+
+    // Runs as a job once the file's data is in memory
+    job_func_t func;
+    void* data;
+
+    // Set by read_files
+    job_counter_t* counter;
+};
+
+typedef struct _file_read_t file_read_t;
+
+// Uses io_uring where the kernel allows it and falls back to a few blocking reader threads
+void start_reader();
+void stop_reader();
+
+// Skips io_uring, for comparing the backends
+void start_reader_threads();
+
+const char* reader_backend();
+
+// Reads every file in the background and queues each one's job as soon as its data arrives, counter drops to zero
+// once all of the jobs have run. Files in a mounted pack skip the disk and go straight to their job. Reads must stay
+// alive until then.
+void read_files(file_read_t* reads, uint32_t count, job_counter_t* counter);
+
+#endif  // READER_H
@@ -1,49 +1,212 @@
 #include "shader.h"
 
+#include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vfs.h"
+
+#define CACHE_DIR ".cache"
+#define CACHE_MAGIC 0x52444853  // "SHDR"
+#define CACHE_VERSION 1
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+struct _cache_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint32_t format;
+    uint32_t length;
+};
+
+typedef struct _cache_header_t cache_header_t;
+
+shader_cache_stats_t shader_cache_stats;
+
+const char *shader_blocks[] = {"Frame", "Object", "Materials"};
 
 char *load_file(const char *filename);
 
-void load_shader(shader_t *shader, const char *vertex_shader_path, const char *fragment_shader_path) {
-    const char *const vertex_shader_source = load_file(vertex_shader_path);
-    const char *const fragment_shader_source = load_file(fragment_shader_path);
+uint64_t hash_string(uint64_t hash, const char *string) {
+    // FNV-1a
+    if (string == NULL)
+        return hash;
 
-    GLuint vertex_shader, fragment_shader;
-    GLint result = GL_FALSE;
-    GLint info_log_length;
-    GLchar *info_buffer;
+    while (*string) {
+        hash ^= (unsigned char)*string++;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+uint64_t hash_program(const char *vertex_shader_source, const char *fragment_shader_source) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    hash = hash_string(hash, vertex_shader_source);
+    hash = hash_string(hash, "\x1f");
+    hash = hash_string(hash, fragment_shader_source);
+
+    // Binaries are only valid for the driver that produced them
+    hash = hash_string(hash, (const char *)glGetString(GL_VENDOR));
+    hash = hash_string(hash, (const char *)glGetString(GL_RENDERER));
+    hash = hash_string(hash, (const char *)glGetString(GL_VERSION));
+
+    return hash;
+}
+
+void cache_path(char *path, size_t len, uint64_t hash) {
+    snprintf(path, len, CACHE_DIR "/%016llx.bin", (unsigned long long)hash);
+}
+
+int binary_cache_supported() {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+    return formats > 0;
+}
+
+int load_cached_program(shader_t *shader, uint64_t hash) {
+    char path[64];
+    cache_path(path, sizeof(path), hash);
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return 0;
+
+    // The length is checked against the file before anything is allocated for it
+    struct stat info;
+    cache_header_t header;
+
+    if (fstat(fileno(fp), &info) != 0 || (size_t)info.st_size < sizeof(header) ||
+        fread(&header, sizeof(header), 1, fp) != 1 || header.magic != CACHE_MAGIC ||
+        header.version != CACHE_VERSION || header.hash != hash || header.length == 0 ||
+        header.length > (size_t)info.st_size - sizeof(header)) {
+        fclose(fp);
+        return 0;
+    }
+
+    void *binary = malloc(header.length);
+    if (fread(binary, 1, header.length, fp) != header.length) {
+        free(binary);
+        fclose(fp);
+        return 0;
+    }
+
+    fclose(fp);
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary, header.length);
+    free(binary);
+
+    shader->program = program;
+    return 1;
+}
+
+void store_cached_program(shader_t *shader, uint64_t hash) {
+    GLint result = GL_FALSE, length = 0;
+    glGetProgramiv(shader->program, GL_LINK_STATUS, &result);
+    glGetProgramiv(shader->program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    if (result != GL_TRUE || length <= 0)
+        return;
+
+    cache_header_t header = {CACHE_MAGIC, CACHE_VERSION, hash, 0, 0};
+
+    void *binary = malloc(length);
+    glGetProgramBinary(shader->program, length, NULL, &header.format, binary);
+    header.length = length;
+
+    mkdir(CACHE_DIR, 0755);
+
+    char path[64], temporary[72];
+    cache_path(path, sizeof(path), hash);
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+
+    // Written aside and renamed so a crash never leaves a partial binary under the real name
+    FILE *fp = fopen(temporary, "wb");
+    int written = fp != NULL && fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                  fwrite(binary, 1, length, fp) == (size_t)length;
+
+    if (fp != NULL)
+        written = fclose(fp) == 0 && written;
+
+    if (!written || rename(temporary, path) != 0)
+        unlink(temporary);
+
+    free(binary);
+}
+
+int parallel_compile = -1;
+
+typedef void (*max_shader_compiler_threads_t)(GLuint count);
+
+void enable_parallel_compile() {
+    parallel_compile = 0;
+
+    max_shader_compiler_threads_t max_threads = NULL;
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+        max_threads = (max_shader_compiler_threads_t)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+        max_threads = (max_shader_compiler_threads_t)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+
+    if (max_threads != NULL) {
+        // 0xFFFFFFFF lets the driver pick as many threads as it likes
+        max_threads(0xFFFFFFFF);
+        parallel_compile = 1;
+    }
+}
 
-    vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex_shader, 1, &vertex_shader_source, NULL);
-    glCompileShader(vertex_shader);
+void start_compile(shader_t *shader) {
+    const char *vertex_shader_source = shader->vertex_source;
+    const char *fragment_shader_source = shader->fragment_source;
 
-    fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment_shader, 1, &fragment_shader_source, NULL);
-    glCompileShader(fragment_shader);
+    shader->vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(shader->vertex_shader, 1, &vertex_shader_source, NULL);
+    glCompileShader(shader->vertex_shader);
+
+    shader->fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(shader->fragment_shader, 1, &fragment_shader_source, NULL);
+    glCompileShader(shader->fragment_shader);
 
     shader->program = glCreateProgram();
-    glAttachShader(shader->program, vertex_shader);
-    glAttachShader(shader->program, fragment_shader);
+    glProgramParameteri(shader->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(shader->program, shader->vertex_shader);
+    glAttachShader(shader->program, shader->fragment_shader);
     glLinkProgram(shader->program);
 
-    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &result);
-    glGetShaderiv(vertex_shader, GL_INFO_LOG_LENGTH, &info_log_length);
+    shader->cached = 0;
+}
+
+int finish_compile(shader_t *shader) {
+    GLint result = GL_FALSE;
+    GLint info_log_length;
+    GLchar *info_buffer;
+
+    glGetShaderiv(shader->vertex_shader, GL_COMPILE_STATUS, &result);
+    glGetShaderiv(shader->vertex_shader, GL_INFO_LOG_LENGTH, &info_log_length);
 
     if (info_log_length > 0) {
         info_buffer = (char *)malloc(info_log_length + 1);
-        glGetShaderInfoLog(vertex_shader, info_log_length, NULL, info_buffer);
+        glGetShaderInfoLog(shader->vertex_shader, info_log_length, NULL, info_buffer);
 
         fprintf(stderr, "[Vertex Shader Error]\n%s\n", info_buffer);
         free(info_buffer);
     }
 
-    glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &result);
-    glGetShaderiv(fragment_shader, GL_INFO_LOG_LENGTH, &info_log_length);
+    glGetShaderiv(shader->fragment_shader, GL_COMPILE_STATUS, &result);
+    glGetShaderiv(shader->fragment_shader, GL_INFO_LOG_LENGTH, &info_log_length);
 
     if (info_log_length > 0) {
         info_buffer = (char *)malloc(info_log_length + 1);
-        glGetShaderInfoLog(fragment_shader, info_log_length, NULL, info_buffer);
+        glGetShaderInfoLog(shader->fragment_shader, info_log_length, NULL, info_buffer);
 
         fprintf(stderr, "[Fragment Shader Error]\n%s\n", info_buffer);
         free(info_buffer);
@@ -60,29 +223,260 @@ void load_shader(shader_t *shader, const char *vertex_shader_path, const char *f
         free(info_buffer);
     }
 
-    free((void *)vertex_shader_source);
-    free((void *)fragment_shader_source);
+    glDetachShader(shader->program, shader->vertex_shader);
+    glDetachShader(shader->program, shader->fragment_shader);
+    glDeleteShader(shader->vertex_shader);
+    glDeleteShader(shader->fragment_shader);
+
+    shader->vertex_shader = shader->fragment_shader = 0;
+
+    return result == GL_TRUE;
 }
 
-char *load_file(const char *filename) {
-    long int len;
-    char *buffer = NULL;
+void release_sources(shader_t *shader) {
+    free(shader->vertex_source);
+    free(shader->fragment_source);
 
-    FILE *fp;
-    fp = fopen(filename, "r");
+    shader->vertex_source = shader->fragment_source = NULL;
+}
 
-    if (!fp)
+void start_shader(shader_t *shader) {
+    if (parallel_compile < 0)
+        enable_parallel_compile();
+
+    shader->program = 0;
+    shader->vertex_shader = shader->fragment_shader = 0;
+    shader->status = SHADER_PENDING;
+
+    if (shader->vertex_source == NULL || shader->fragment_source == NULL) {
+        shader->status = SHADER_FAILED;
+        release_sources(shader);
+        return;
+    }
+
+    int cache = binary_cache_supported();
+    shader->hash = hash_program(shader->vertex_source, shader->fragment_source);
+
+    if (cache && load_cached_program(shader, shader->hash))
+        shader->cached = 1;
+    else
+        start_compile(shader);
+}
+
+int poll_shader(shader_t *shader) {
+    if (shader->status != SHADER_PENDING)
+        return 1;
+
+    // Without the extension there is no way to ask without blocking
+    if (!parallel_compile) {
+        finish_shader(shader);
+        return 1;
+    }
+
+    GLint complete = GL_FALSE;
+    glGetProgramiv(shader->program, GL_COMPLETION_STATUS_KHR, &complete);
+
+    if (complete == GL_TRUE)
+        finish_shader(shader);
+
+    return complete == GL_TRUE;
+}
+
+void finish_shader(shader_t *shader) {
+    if (shader->status != SHADER_PENDING)
+        return;
+
+    // Drivers reject binaries after an update, even with matching version strings
+    if (shader->cached) {
+        GLint result = GL_FALSE;
+        glGetProgramiv(shader->program, GL_LINK_STATUS, &result);
+
+        if (result != GL_TRUE) {
+            glDeleteProgram(shader->program);
+            start_compile(shader);
+        }
+    }
+
+    if (shader->cached) {
+        shader_cache_stats.hits++;
+    } else {
+        int linked = finish_compile(shader);
+        shader_cache_stats.misses++;
+
+        if (linked && binary_cache_supported())
+            store_cached_program(shader, shader->hash);
+    }
+
+    GLint result = GL_FALSE;
+    glGetProgramiv(shader->program, GL_LINK_STATUS, &result);
+
+    shader->status = result == GL_TRUE ? SHADER_READY : SHADER_FAILED;
+    release_sources(shader);
+
+    // GLSL 330 has no binding layout qualifier, so assign block slots after linking
+    for (GLuint i = 0; i < sizeof(shader_blocks) / sizeof(shader_blocks[0]); i++) {
+        GLuint index = glGetUniformBlockIndex(shader->program, shader_blocks[i]);
+
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader->program, index, i);
+    }
+
+    // Samplers likewise, textures[i] always reads texture unit i
+    GLint current;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+    glUseProgram(shader->program);
+
+    for (int i = 0; i < SHADER_TEXTURE_SLOTS; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "textures[%d]", i);
+
+        GLint location = glGetUniformLocation(shader->program, name);
+        if (location >= 0)
+            glUniform1i(location, i);
+    }
+
+    glUseProgram(current);
+}
+
+void use_shader(shader_t *shader) {
+    finish_shader(shader);
+    glUseProgram(shader->program);
+}
+
+void free_shader(shader_t *shader) {
+    if (shader->vertex_shader)
+        glDeleteShader(shader->vertex_shader);
+
+    if (shader->fragment_shader)
+        glDeleteShader(shader->fragment_shader);
+
+    glDeleteProgram(shader->program);
+    release_sources(shader);
+}
+
+const char *shader_features[SHADER_FEATURES] = {
+    "TEXTURE",
+    "LIGHTING",
+};
+
+// Offset just past the #version line, skipping a BOM, whitespace and comments before it, or 0 without one
+size_t version_line_end(const char *source) {
+    const char *cursor = source;
+
+    if (strncmp(cursor, "\xef\xbb\xbf", 3) == 0)
+        cursor += 3;
+
+    while (*cursor) {
+        if (isspace((unsigned char)*cursor)) {
+            cursor++;
+        } else if (strncmp(cursor, "//", 2) == 0) {
+            cursor += strcspn(cursor, "\n");
+        } else if (strncmp(cursor, "/*", 2) == 0) {
+            const char *end = strstr(cursor + 2, "*/");
+            cursor = end ? end + 2 : cursor + strlen(cursor);
+        } else {
+            break;
+        }
+    }
+
+    if (*cursor != '#')
+        return 0;
+
+    const char *directive = cursor + 1;
+    directive += strspn(directive, " \t");
+
+    if (strncmp(directive, "version", 7) != 0)
+        return 0;
+
+    const char *newline = strchr(directive, '\n');
+    return newline ? (size_t)(newline - source) + 1 : strlen(source);
+}
+
+char *inject_defines(const char *source, uint32_t features) {
+    size_t len = strlen(source);
+    size_t defines_len = 0;
+
+    for (int i = 0; i < SHADER_FEATURES; i++)
+        if (features & (1u << i))
+            defines_len += strlen("#define \n") + strlen(shader_features[i]);
+
+    // Defines have to come after #version, which must be the first statement
+    size_t split = version_line_end(source);
+
+    char *result = malloc(len + defines_len + 2);
+    char *cursor = result;
+
+    memcpy(cursor, source, split);
+    cursor += split;
+
+    if (split > 0 && source[split - 1] != '\n')
+        *cursor++ = '\n';
+
+    for (int i = 0; i < SHADER_FEATURES; i++)
+        if (features & (1u << i))
+            cursor += sprintf(cursor, "#define %s\n", shader_features[i]);
+
+    memcpy(cursor, source + split, len - split + 1);
+    return result;
+}
+
+void load_shader_set(shader_set_t *set, const char *vertex_shader_path, const char *fragment_shader_path) {
+    set->vertex_source = load_file(vertex_shader_path);
+    set->fragment_source = load_file(fragment_shader_path);
+
+    if (set->vertex_source == NULL || set->fragment_source == NULL)
+        fprintf(stderr, "Failed to load shader: %s, %s\n", vertex_shader_path, fragment_shader_path);
+
+    set->loaded = 0;
+}
+
+shader_t *get_shader_variant(shader_set_t *set, uint32_t features) {
+    features &= SHADER_VARIANTS - 1;
+    shader_t *shader = &set->variants[features];
+
+    if (set->loaded & (1u << features))
+        return shader;
+
+    shader->vertex_source = NULL;
+    shader->fragment_source = NULL;
+
+    if (set->vertex_source && set->fragment_source) {
+        shader->vertex_source = inject_defines(set->vertex_source, features);
+        shader->fragment_source = inject_defines(set->fragment_source, features);
+    }
+
+    start_shader(shader);
+    set->loaded |= 1u << features;
+
+    return shader;
+}
+
+void free_shader_set(shader_set_t *set) {
+    for (uint32_t i = 0; i < SHADER_VARIANTS; i++)
+        if (set->loaded & (1u << i))
+            free_shader(&set->variants[i]);
+
+    free(set->vertex_source);
+    free(set->fragment_source);
+
+    set->vertex_source = set->fragment_source = NULL;
+    set->loaded = 0;
+}
+
+char *load_file(const char *filename) {
+    vfs_file_t file;
+
+    if (!vfs_open(&file, filename))
         return NULL;
 
-    fseek(fp, 0, SEEK_END);
-    len = ftell(fp);
-    buffer = (char *)malloc(len + 1);
+    // Callers own and edit the result, so it is always a copy
+    char *buffer = (char *)malloc(file.size + 1);
 
     if (buffer) {
-        fseek(fp, 0, SEEK_SET);
-        fread(buffer, sizeof(char), len, fp);
-        buffer[len] = '\0';
+        memcpy(buffer, file.data, file.size);
+        buffer[file.size] = '\0';
     }
 
+    vfs_close(&file);
     return buffer;
 }
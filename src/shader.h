@@ -1,14 +1,97 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <stdint.h>
+
 #include "glfw.h"
+#include "linmath.h"
+
+enum { SHADER_PENDING, SHADER_READY, SHADER_FAILED };
+
+// Feature bits are injected as #defines after the #version line of both stages
+enum {
+    SHADER_TEXTURE = 1 << 0,
+    SHADER_LIGHTING = 1 << 1,
+};
+
+// Uniform blocks are bound to fixed slots so any program can read the same buffer ranges
+enum {
+    SHADER_BLOCK_FRAME,
+    SHADER_BLOCK_OBJECT,
+    SHADER_BLOCK_MATERIALS,
+};
+
+#define SHADER_FEATURES 2
+#define SHADER_VARIANTS (1 << SHADER_FEATURES)
 
 struct _shader_t {
     GLuint program;
+    int status;
+
+    // Only valid while the program is pending
+    GLuint vertex_shader, fragment_shader;
+    char *vertex_source, *fragment_source;
+    uint64_t hash;
+    int cached;
+};
+
+struct _shader_set_t {
+    char *vertex_source, *fragment_source;
+
+    // Variants are compiled on first request, keyed by feature mask
+    struct _shader_t variants[SHADER_VARIANTS];
+    uint32_t loaded;
+};
+
+// Length of the Materials block array, the shaders declare the same size
+#define SHADER_MATERIALS 64
+
+// Texture units holding the diffuse texture arrays, also the length of the shaders' sampler array
+#define SHADER_TEXTURE_SLOTS 8
+
+// std140 mirrors of the Frame, Object and Materials blocks
+struct _frame_data_t {
+    mat4x4 view, projection;
+};
+
+struct _object_data_t {
+    mat4x4 model, normal;
+
+    // Blended over the material by its alpha
+    vec4 color;
+    int32_t material, padding[3];
+};
+
+struct _material_data_t {
+    // Opacity in the diffuse alpha, shininess in the specular alpha
+    vec4 diffuse, specular;
+
+    // Layer of the diffuse texture in the array bound to texture_slot, which is -1 until the texture is ready
+    int32_t texture_slot, texture_layer, padding[2];
+};
+
+struct _shader_cache_stats_t {
+    int hits, misses;
 };
 
 typedef struct _shader_t shader_t;
+typedef struct _shader_set_t shader_set_t;
+typedef struct _frame_data_t frame_data_t;
+typedef struct _object_data_t object_data_t;
+typedef struct _material_data_t material_data_t;
+typedef struct _shader_cache_stats_t shader_cache_stats_t;
+
+extern shader_cache_stats_t shader_cache_stats;
+
+int poll_shader(shader_t *shader);
+void finish_shader(shader_t *shader);
+void use_shader(shader_t *shader);
+void free_shader(shader_t *shader);
+
+void load_shader_set(shader_set_t *set, const char *vertex_shader_path, const char *fragment_shader_path);
 
-void load_shader(shader_t *shader, const char *vertex_shader_path, const char *fragment_shader_path);
+// Starts compiling the variant on first request without waiting on the driver, status is resolved on first use
+shader_t *get_shader_variant(shader_set_t *set, uint32_t features);
+void free_shader_set(shader_set_t *set);
 
 #endif  // SHADER_H
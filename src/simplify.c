@@ -0,0 +1,481 @@
+#include "simplify.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "linmath.h"
+
+#define NONE SIMPLIFY_NONE
+
+// Symmetric 4x4, aa ab ac ad bb bc bd cc cd dd
+typedef float quadric_t[10];
+
+struct _collapse_t {
+    float cost;
+    uint32_t from, to;
+};
+
+// Vertices with identical attributes are merged, vertices on the same position form one node of the collapse graph
+struct _simplify_t {
+    const float* vertices;
+    uint32_t stride;
+
+    uint32_t* unique;
+    uint32_t unique_n;
+
+    uint32_t* position_of;
+    uint32_t* next_on_position;
+    uint32_t* first_on_position;
+    uint32_t positions_n;
+
+    quadric_t* quadrics;
+    uint8_t* locked;
+
+    // Three unique vertices per triangle
+    uint32_t* triangles;
+    uint32_t triangles_n;
+
+    float extent;
+};
+
+typedef struct _collapse_t collapse_t;
+typedef struct _simplify_t simplify_t;
+
+uint32_t hash_floats(const float* v, int n) {
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < n; i++) {
+        uint32_t bits;
+        memcpy(&bits, &v[i], sizeof(uint32_t));
+
+        hash = (hash ^ bits) * 16777619u;
+    }
+
+    // FNV only mixes upwards and the table is indexed by the low bits
+    hash ^= hash >> 15;
+    hash *= 0x2c1b3c6du;
+    hash ^= hash >> 12;
+
+    return hash;
+}
+
+// Id of the first vertex matching this one in its first n floats, registering it as new if there is none
+uint32_t dedupe(uint32_t* table, uint32_t mask, const float* vertices, uint32_t stride, int n, uint32_t vertex,
+                uint32_t* ids, uint32_t* ids_n) {
+    const float* key = vertices + (size_t)vertex * stride;
+    uint32_t slot = hash_floats(key, n) & mask;
+
+    while (table[slot] != NONE) {
+        uint32_t id = table[slot];
+
+        if (memcmp(vertices + (size_t)ids[id] * stride, key, sizeof(float) * n) == 0)
+            return id;
+
+        slot = (slot + 1) & mask;
+    }
+
+    ids[*ids_n] = vertex;
+    table[slot] = *ids_n;
+
+    return (*ids_n)++;
+}
+
+const float* position_coords(const simplify_t* simplify, uint32_t p) {
+    return simplify->vertices + (size_t)simplify->unique[simplify->first_on_position[p]] * simplify->stride;
+}
+
+void add_plane(quadric_t q, float a, float b, float c, float d) {
+    q[0] += a * a, q[1] += a * b, q[2] += a * c, q[3] += a * d;
+    q[4] += b * b, q[5] += b * c, q[6] += b * d;
+    q[7] += c * c, q[8] += c * d;
+    q[9] += d * d;
+}
+
+float quadric_error(const quadric_t q, const float* v) {
+    float x = v[0], y = v[1], z = v[2];
+
+    float error = q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x + q[4] * y * y +
+                  2 * q[5] * y * z + 2 * q[6] * y + q[7] * z * z + 2 * q[8] * z + q[9];
+
+    return error > 0.0f ? error : 0.0f;
+}
+
+float attribute_distance(const simplify_t* simplify, uint32_t a, uint32_t b) {
+    const float* x = simplify->vertices + (size_t)simplify->unique[a] * simplify->stride;
+    const float* y = simplify->vertices + (size_t)simplify->unique[b] * simplify->stride;
+
+    float distance = 0.0f;
+    for (uint32_t i = 3; i < simplify->stride; i++)
+        distance += (x[i] - y[i]) * (x[i] - y[i]);
+
+    return distance;
+}
+
+// Closest attributes among the vertices on position p
+uint32_t closest_on_position(const simplify_t* simplify, uint32_t u, uint32_t p, float* distance) {
+    uint32_t best = NONE;
+    *distance = INFINITY;
+
+    for (uint32_t v = simplify->first_on_position[p]; v != NONE; v = simplify->next_on_position[v]) {
+        float d = attribute_distance(simplify, u, v);
+
+        if (d < *distance) {
+            *distance = d;
+            best = v;
+        }
+    }
+
+    return best;
+}
+
+float collapse_cost(const simplify_t* simplify, uint32_t from, uint32_t to) {
+    quadric_t q;
+    for (int i = 0; i < 10; i++)
+        q[i] = simplify->quadrics[from][i] + simplify->quadrics[to][i];
+
+    float cost = quadric_error(q, position_coords(simplify, to)) / (simplify->extent * simplify->extent);
+
+    // Every attribute variant on the removed position has to find a match on the kept one
+    float worst = 0.0f;
+    for (uint32_t u = simplify->first_on_position[from]; u != NONE; u = simplify->next_on_position[u]) {
+        float distance;
+        closest_on_position(simplify, u, to, &distance);
+
+        worst = distance > worst ? distance : worst;
+    }
+
+    return cost + worst * SIMPLIFY_ATTRIBUTE_WEIGHT;
+}
+
+int compare_edges(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+int compare_collapses(const void* a, const void* b) {
+    float x = ((const collapse_t*)a)->cost, y = ((const collapse_t*)b)->cost;
+    return (x > y) - (x < y);
+}
+
+void triangle_normal(vec3 normal, const float* a, const float* b, const float* c) {
+    vec3 ab, ac;
+    vec3_sub(ab, b, a);
+    vec3_sub(ac, c, a);
+    vec3_cross(normal, ab, ac);
+}
+
+// Position level edges of the live triangles, sorted, shared edges appear once unless duplicates are asked for
+uint64_t* collect_edges(const simplify_t* simplify, uint32_t* edges_n, int with_duplicates) {
+    uint64_t* edges = malloc(sizeof(uint64_t) * simplify->triangles_n * 3);
+    uint32_t n = 0;
+
+    for (uint32_t t = 0; t < simplify->triangles_n; t++) {
+        for (int k = 0; k < 3; k++) {
+            uint32_t a = simplify->position_of[simplify->triangles[t * 3 + k]];
+            uint32_t b = simplify->position_of[simplify->triangles[t * 3 + (k + 1) % 3]];
+
+            edges[n++] = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+        }
+    }
+
+    qsort(edges, n, sizeof(uint64_t), compare_edges);
+
+    if (!with_duplicates) {
+        uint32_t unique = 0;
+
+        for (uint32_t i = 0; i < n; i++)
+            if (unique == 0 || edges[unique - 1] != edges[i])
+                edges[unique++] = edges[i];
+
+        n = unique;
+    }
+
+    *edges_n = n;
+    return edges;
+}
+
+void init_simplify(simplify_t* simplify, const float* vertices, uint32_t stride, const uint32_t* indices,
+                   uint32_t index_count) {
+    memset(simplify, 0, sizeof(simplify_t));
+
+    simplify->vertices = vertices;
+    simplify->stride = stride;
+
+    uint32_t size = 1;
+    while (size < index_count * 2)
+        size <<= 1;
+
+    uint32_t* table = malloc(sizeof(uint32_t) * size);
+
+    // Unique vertices
+    simplify->unique = malloc(sizeof(uint32_t) * index_count);
+    simplify->triangles = malloc(sizeof(uint32_t) * index_count);
+    simplify->triangles_n = index_count / 3;
+
+    memset(table, 0xff, sizeof(uint32_t) * size);
+    for (uint32_t i = 0; i < simplify->triangles_n * 3; i++)
+        simplify->triangles[i] =
+            dedupe(table, size - 1, vertices, stride, stride, indices[i], simplify->unique, &simplify->unique_n);
+
+    // Positions
+    uint32_t* position_vertex = malloc(sizeof(uint32_t) * simplify->unique_n);
+
+    simplify->position_of = malloc(sizeof(uint32_t) * simplify->unique_n);
+    simplify->next_on_position = malloc(sizeof(uint32_t) * simplify->unique_n);
+    simplify->first_on_position = malloc(sizeof(uint32_t) * simplify->unique_n);
+
+    memset(simplify->first_on_position, 0xff, sizeof(uint32_t) * simplify->unique_n);
+    memset(table, 0xff, sizeof(uint32_t) * size);
+    for (uint32_t u = 0; u < simplify->unique_n; u++) {
+        uint32_t p = dedupe(table, size - 1, vertices, stride, 3, simplify->unique[u], position_vertex,
+                            &simplify->positions_n);
+
+        simplify->position_of[u] = p;
+        simplify->next_on_position[u] = simplify->first_on_position[p];
+        simplify->first_on_position[p] = u;
+    }
+
+    free(position_vertex);
+    free(table);
+
+    // Extent, used to make errors independent of the mesh's scale
+    vec3 min = {INFINITY, INFINITY, INFINITY}, max = {-INFINITY, -INFINITY, -INFINITY};
+    for (uint32_t p = 0; p < simplify->positions_n; p++) {
+        const float* v = position_coords(simplify, p);
+
+        for (int k = 0; k < 3; k++) {
+            min[k] = v[k] < min[k] ? v[k] : min[k];
+            max[k] = v[k] > max[k] ? v[k] : max[k];
+        }
+    }
+
+    vec3 diagonal;
+    vec3_sub(diagonal, max, min);
+    simplify->extent = vec3_len(diagonal) > 0.0f ? vec3_len(diagonal) : 1.0f;
+
+    // Quadrics from the planes of the original triangles
+    simplify->quadrics = calloc(simplify->positions_n, sizeof(quadric_t));
+
+    for (uint32_t t = 0; t < simplify->triangles_n; t++) {
+        uint32_t p[3];
+        for (int k = 0; k < 3; k++)
+            p[k] = simplify->position_of[simplify->triangles[t * 3 + k]];
+
+        vec3 normal;
+        triangle_normal(normal, position_coords(simplify, p[0]), position_coords(simplify, p[1]), position_coords(simplify, p[2]));
+
+        float length = vec3_len(normal);
+        if (length <= 0.0f)
+            continue;
+
+        vec3_scale(normal, normal, 1.0f / length);
+        float d = -vec3_dot(normal, position_coords(simplify, p[0]));
+
+        for (int k = 0; k < 3; k++)
+            add_plane(simplify->quadrics[p[k]], normal[0], normal[1], normal[2], d);
+    }
+
+    // Border locking, any edge not shared by exactly two triangles pins both of its ends
+    simplify->locked = calloc(simplify->positions_n, 1);
+
+    uint32_t edges_n;
+    uint64_t* edges = collect_edges(simplify, &edges_n, 1);
+
+    for (uint32_t i = 0; i < edges_n;) {
+        uint32_t j = i;
+        while (j < edges_n && edges[j] == edges[i])
+            j++;
+
+        if (j - i != 2) {
+            simplify->locked[edges[i] >> 32] = 1;
+            simplify->locked[edges[i] & 0xffffffff] = 1;
+        }
+
+        i = j;
+    }
+
+    free(edges);
+}
+
+void free_simplify(simplify_t* simplify) {
+    free(simplify->unique);
+    free(simplify->triangles);
+    free(simplify->position_of);
+    free(simplify->next_on_position);
+    free(simplify->first_on_position);
+    free(simplify->quadrics);
+    free(simplify->locked);
+}
+
+// One round of independent collapses, cheapest first, returns how many were applied
+uint32_t simplify_pass(simplify_t* simplify, uint32_t target_triangles, float max_cost, float* result_error) {
+    uint32_t positions_n = simplify->positions_n;
+
+    // Triangles around each position
+    uint32_t* offsets = calloc(positions_n + 1, sizeof(uint32_t));
+    uint32_t* adjacency = malloc(sizeof(uint32_t) * simplify->triangles_n * 3);
+
+    for (uint32_t i = 0; i < simplify->triangles_n * 3; i++)
+        offsets[simplify->position_of[simplify->triangles[i]] + 1]++;
+
+    for (uint32_t p = 0; p < positions_n; p++)
+        offsets[p + 1] += offsets[p];
+
+    uint32_t* fill = malloc(sizeof(uint32_t) * positions_n);
+    memcpy(fill, offsets, sizeof(uint32_t) * positions_n);
+
+    for (uint32_t i = 0; i < simplify->triangles_n * 3; i++)
+        adjacency[fill[simplify->position_of[simplify->triangles[i]]]++] = i / 3;
+
+    free(fill);
+
+    // Candidates, the cheaper direction of every edge
+    uint32_t edges_n;
+    uint64_t* edges = collect_edges(simplify, &edges_n, 0);
+
+    collapse_t* collapses = malloc(sizeof(collapse_t) * edges_n);
+    uint32_t collapses_n = 0;
+
+    for (uint32_t i = 0; i < edges_n; i++) {
+        uint32_t a = edges[i] >> 32, b = edges[i] & 0xffffffff;
+
+        float ab = simplify->locked[a] ? INFINITY : collapse_cost(simplify, a, b);
+        float ba = simplify->locked[b] ? INFINITY : collapse_cost(simplify, b, a);
+
+        if (ab == INFINITY && ba == INFINITY)
+            continue;
+
+        collapse_t* collapse = &collapses[collapses_n++];
+        collapse->cost = ab <= ba ? ab : ba;
+        collapse->from = ab <= ba ? a : b;
+        collapse->to = ab <= ba ? b : a;
+    }
+
+    free(edges);
+    qsort(collapses, collapses_n, sizeof(collapse_t), compare_collapses);
+
+    uint32_t* remap = malloc(sizeof(uint32_t) * simplify->unique_n);
+    for (uint32_t u = 0; u < simplify->unique_n; u++)
+        remap[u] = u;
+
+    uint8_t* touched = calloc(positions_n, 1);
+    uint32_t triangles_n = simplify->triangles_n, applied = 0;
+
+    for (uint32_t i = 0; i < collapses_n && triangles_n > target_triangles; i++) {
+        collapse_t* collapse = &collapses[i];
+        uint32_t from = collapse->from, to = collapse->to;
+
+        if (collapse->cost > max_cost)
+            break;
+
+        if (touched[from] || touched[to])
+            continue;
+
+        // Reject collapses that would flip any remaining triangle around the removed position
+        int flips = 0;
+        uint32_t removed = 0;
+
+        for (uint32_t j = offsets[from]; j < offsets[from + 1] && !flips; j++) {
+            uint32_t* triangle = simplify->triangles + adjacency[j] * 3;
+
+            const float* corners[3];
+            int contains = 0;
+
+            for (int k = 0; k < 3; k++) {
+                uint32_t p = simplify->position_of[triangle[k]];
+                contains |= p == to;
+                corners[k] = position_coords(simplify, p);
+            }
+
+            if (contains) {
+                removed++;
+                continue;
+            }
+
+            vec3 before, after;
+            triangle_normal(before, corners[0], corners[1], corners[2]);
+
+            for (int k = 0; k < 3; k++)
+                if (simplify->position_of[triangle[k]] == from)
+                    corners[k] = position_coords(simplify, to);
+
+            triangle_normal(after, corners[0], corners[1], corners[2]);
+            flips = vec3_dot(before, after) <= 0.0f;
+        }
+
+        if (flips)
+            continue;
+
+        for (uint32_t u = simplify->first_on_position[from]; u != NONE; u = simplify->next_on_position[u]) {
+            float distance;
+            remap[u] = closest_on_position(simplify, u, to, &distance);
+        }
+
+        for (int k = 0; k < 10; k++)
+            simplify->quadrics[to][k] += simplify->quadrics[from][k];
+
+        // Everything around the collapse is off limits until the next pass rebuilds adjacency
+        for (uint32_t j = offsets[from]; j < offsets[from + 1]; j++)
+            for (int k = 0; k < 3; k++)
+                touched[simplify->position_of[simplify->triangles[adjacency[j] * 3 + k]]] = 1;
+
+        triangles_n -= removed;
+        applied++;
+
+        if (collapse->cost > *result_error)
+            *result_error = collapse->cost;
+    }
+
+    // Apply the remap and drop triangles that became degenerate
+    uint32_t kept = 0;
+
+    for (uint32_t t = 0; t < simplify->triangles_n; t++) {
+        uint32_t v[3], p[3];
+
+        for (int k = 0; k < 3; k++) {
+            v[k] = remap[simplify->triangles[t * 3 + k]];
+            p[k] = simplify->position_of[v[k]];
+        }
+
+        if (p[0] == p[1] || p[1] == p[2] || p[2] == p[0])
+            continue;
+
+        memcpy(simplify->triangles + kept * 3, v, sizeof(v));
+        kept++;
+    }
+
+    simplify->triangles_n = kept;
+
+    free(offsets);
+    free(adjacency);
+    free(collapses);
+    free(remap);
+    free(touched);
+
+    return applied;
+}
+
+uint32_t simplify_mesh(uint32_t* out, const float* vertices, uint32_t stride, const uint32_t* indices,
+                       uint32_t index_count, uint32_t target_count, float max_error, float* result_error) {
+    simplify_t simplify;
+    init_simplify(&simplify, vertices, stride, indices, index_count);
+
+    float error = 0.0f;
+
+    // Costs are squared relative distances plus weighted attribute differences
+    while (simplify.triangles_n * 3 > target_count)
+        if (simplify_pass(&simplify, target_count / 3, max_error * max_error, &error) == 0)
+            break;
+
+    for (uint32_t i = 0; i < simplify.triangles_n * 3; i++)
+        out[i] = simplify.unique[simplify.triangles[i]];
+
+    uint32_t count = simplify.triangles_n * 3;
+    free_simplify(&simplify);
+
+    if (result_error != NULL)
+        *result_error = sqrtf(error);
+
+    return count;
+}
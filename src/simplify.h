@@ -0,0 +1,25 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <stdint.h>
+
+#define SIMPLIFY_NONE UINT32_MAX
+
+// How much a squared normal/uv difference counts against the relative geometric error
+#define SIMPLIFY_ATTRIBUTE_WEIGHT 0.01f
+
+// Quadric error edge collapse over an indexed triangle list whose vertices start with a position.
+// Collapses only move vertices onto existing ones, so the output indexes the same vertex buffer.
+// Open borders are locked and collapses that would flip a triangle are rejected.
+// Stops at target_count indices or once the error relative to the mesh extent would exceed max_error.
+// Returns the number of indices written to out, which must hold index_count indices.
+uint32_t simplify_mesh(uint32_t* out, const float* vertices, uint32_t stride, const uint32_t* indices,
+                       uint32_t index_count, uint32_t target_count, float max_error, float* result_error);
+
+// Open addressing over vertex ids, shared with other passes that need to weld identical vertices.
+// The table holds a power of two number of SIMPLIFY_NONE initialised slots.
+uint32_t hash_floats(const float* v, int n);
+uint32_t dedupe(uint32_t* table, uint32_t mask, const float* vertices, uint32_t stride, int n, uint32_t vertex,
+                uint32_t* ids, uint32_t* ids_n);
+
+#endif  // SIMPLIFY_H
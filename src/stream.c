@@ -0,0 +1,156 @@
+#include "stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (*buffer_storage_t)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+buffer_storage_t get_buffer_storage() {
+    if (!glfwExtensionSupported("GL_ARB_buffer_storage"))
+        return NULL;
+
+    return (buffer_storage_t)glfwGetProcAddress("glBufferStorage");
+}
+
+void init_stream_buffer(stream_buffer_t* stream, GLenum target, size_t region_size) {
+    memset(stream, 0, sizeof(stream_buffer_t));
+
+    stream->target = target;
+
+    stream->alignment = 16;
+    if (target == GL_UNIFORM_BUFFER)
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &stream->alignment);
+
+    region_size = (region_size + stream->alignment - 1) / stream->alignment * stream->alignment;
+
+    glGenBuffers(1, &stream->buffer);
+    glBindBuffer(target, stream->buffer);
+
+    buffer_storage_t buffer_storage = get_buffer_storage();
+
+    if (buffer_storage != NULL) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        stream->region_size = region_size;
+        stream->size = region_size * STREAM_FRAMES;
+
+        buffer_storage(target, stream->size, NULL, flags);
+        stream->mapped = glMapBufferRange(target, 0, stream->size, flags);
+        stream->persistent = stream->mapped != NULL;
+    }
+
+    // GL 3.3 has no persistent mapping, stage on the CPU and orphan the buffer each frame instead
+    if (!stream->persistent) {
+        if (stream->mapped == NULL && buffer_storage != NULL) {
+            glDeleteBuffers(1, &stream->buffer);
+            glGenBuffers(1, &stream->buffer);
+            glBindBuffer(target, stream->buffer);
+        }
+
+        stream->region_size = region_size;
+        stream->size = region_size;
+
+        glBufferData(target, stream->size, NULL, GL_STREAM_DRAW);
+        stream->staging = malloc(stream->size);
+    }
+}
+
+void free_stream_buffer(stream_buffer_t* stream) {
+    for (int i = 0; i < STREAM_FRAMES; i++)
+        if (stream->fences[i])
+            glDeleteSync(stream->fences[i]);
+
+    if (stream->persistent) {
+        glBindBuffer(stream->target, stream->buffer);
+        glUnmapBuffer(stream->target);
+    }
+
+    glDeleteBuffers(1, &stream->buffer);
+    free(stream->staging);
+
+    memset(stream, 0, sizeof(stream_buffer_t));
+}
+
+size_t stream_aligned_size(const stream_buffer_t* stream, size_t size) {
+    return (size + stream->alignment - 1) / stream->alignment * stream->alignment;
+}
+
+void reserve_stream_buffer(stream_buffer_t* stream, size_t region_size) {
+    if (region_size <= stream->region_size)
+        return;
+
+    // GL keeps the old buffer alive until the frames still reading it are done
+    GLenum target = stream->target;
+    int stalls = stream->stalls;
+
+    free_stream_buffer(stream);
+    init_stream_buffer(stream, target, region_size + region_size / 2);
+
+    stream->stalls = stalls;
+}
+
+void begin_stream_frame(stream_buffer_t* stream) {
+    stream->head = 0;
+
+    if (!stream->persistent)
+        return;
+
+    stream->frame = (stream->frame + 1) % STREAM_FRAMES;
+
+    GLsync fence = stream->fences[stream->frame];
+    if (fence == NULL)
+        return;
+
+    // Only count it as a stall if the GPU has not already finished with this region
+    GLenum result = glClientWaitSync(fence, 0, 0);
+
+    if (result == GL_TIMEOUT_EXPIRED) {
+        stream->stalls++;
+
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        } while (result == GL_TIMEOUT_EXPIRED);
+    }
+
+    glDeleteSync(fence);
+    stream->fences[stream->frame] = NULL;
+}
+
+void* stream_alloc(stream_buffer_t* stream, size_t size, GLintptr* offset) {
+    size_t head = (stream->head + stream->alignment - 1) / stream->alignment * stream->alignment;
+
+    if (head + size > stream->region_size) {
+        if (!stream->overflowed)
+            fprintf(stderr, "Stream buffer overflow: %zu bytes requested, %zu per frame\n", size, stream->region_size);
+
+        stream->overflowed = 1;
+        return NULL;
+    }
+
+    stream->head = head + size;
+
+    size_t region = stream->persistent ? stream->region_size * stream->frame : 0;
+    *offset = region + head;
+
+    return (stream->persistent ? stream->mapped : stream->staging) + region + head;
+}
+
+void flush_stream(stream_buffer_t* stream) {
+    if (stream->persistent || stream->head == 0)
+        return;
+
+    glBindBuffer(stream->target, stream->buffer);
+    glBufferData(stream->target, stream->size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(stream->target, 0, stream->head, stream->staging);
+}
+
+void end_stream_frame(stream_buffer_t* stream) {
+    if (stream->persistent)
+        stream->fences[stream->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
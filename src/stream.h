@@ -0,0 +1,48 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+
+#include "glfw.h"
+
+#define STREAM_FRAMES 3
+
+// Ring of per-frame regions in one buffer, the CPU writes region N while the GPU reads N-1 and N-2
+struct _stream_buffer_t {
+    GLuint buffer;
+    GLenum target;
+
+    size_t size, region_size, head;
+    GLint alignment;
+    int frame;
+
+    int persistent;
+    unsigned char* mapped;
+    unsigned char* staging;
+
+    GLsync fences[STREAM_FRAMES];
+    int stalls;
+
+    // Overflows are reported once, they would otherwise repeat every frame
+    int overflowed;
+};
+
+typedef struct _stream_buffer_t stream_buffer_t;
+
+void init_stream_buffer(stream_buffer_t* stream, GLenum target, size_t region_size);
+void free_stream_buffer(stream_buffer_t* stream);
+
+// Space size takes up in a region once aligned
+size_t stream_aligned_size(const stream_buffer_t* stream, size_t size);
+
+// Recreates the buffer with regions of at least region_size, only call it between frames
+void reserve_stream_buffer(stream_buffer_t* stream, size_t region_size);
+
+void begin_stream_frame(stream_buffer_t* stream);
+void* stream_alloc(stream_buffer_t* stream, size_t size, GLintptr* offset);
+
+// Everything allocated this frame must be flushed before the draws that read it are issued
+void flush_stream(stream_buffer_t* stream);
+void end_stream_frame(stream_buffer_t* stream);
+
+#endif  // STREAM_H
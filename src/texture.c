@@ -0,0 +1,859 @@
+#include "texture.h"
+
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shader.h"
+#include "vfs.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#if defined(__SSE2__) || defined(__x86_64__)
+#define TEXTURE_SSE
+#include <emmintrin.h>
+#endif
+
+// Linear values are quantised this finely before encoding, enough to round every sRGB step correctly
+#define SRGB_ENCODE_SIZE 8192
+
+#define UPLOAD_SLICES 64
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+// Indexed by BCN_ format
+static const GLenum compressed_formats[] = {GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+                                            GL_COMPRESSED_RG_RGTC2, GL_COMPRESSED_RGBA_BPTC_UNORM};
+static const char* format_names[] = {"BC1", "BC3", "BC5", "BC7"};
+
+// Level offsets are from the start of the file, data follows the header
+struct _cooked_header_t {
+    char magic[4];
+    uint32_t version, format, width, height, levels;
+
+    // Cooked files older than their source are ignored
+    uint64_t source_size;
+    int64_t source_mtime;
+
+    uint64_t level_offset[TEXTURE_MAX_LEVELS];
+};
+
+typedef struct _cooked_header_t cooked_header_t;
+
+texture_cache_t texture_cache;
+
+float srgb_decode[256], alpha_decode[256];
+unsigned char srgb_encode[SRGB_ENCODE_SIZE];
+pthread_once_t srgb_once = PTHREAD_ONCE_INIT;
+
+void init_srgb_tables() {
+    for (int i = 0; i < 256; i++) {
+        float c = i / 255.0f;
+
+        srgb_decode[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        alpha_decode[i] = c;
+    }
+
+    for (int i = 0; i < SRGB_ENCODE_SIZE; i++) {
+        float l = i / (float)(SRGB_ENCODE_SIZE - 1);
+        float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+
+        srgb_encode[i] = (unsigned char)(c * 255.0f + 0.5f);
+    }
+}
+
+void downsample_srgb(unsigned char* out, const unsigned char* in, int width, int height) {
+    pthread_once(&srgb_once, init_srgb_tables);
+
+    int out_width = width > 1 ? width / 2 : 1;
+    int out_height = height > 1 ? height / 2 : 1;
+
+    // Odd sizes drop the last row or column, a single row or column repeats itself
+    int dx = width > 1 ? 4 : 0;
+    size_t dy = height > 1 ? (size_t)width * 4 : 0;
+
+#ifdef TEXTURE_SSE
+    // Colour channels index the encode table, alpha stays linear
+    const __m128 scale = _mm_set_ps(255.0f * 0.25f, (SRGB_ENCODE_SIZE - 1) * 0.25f, (SRGB_ENCODE_SIZE - 1) * 0.25f,
+                                    (SRGB_ENCODE_SIZE - 1) * 0.25f);
+#endif
+
+    for (int y = 0; y < out_height; y++) {
+        const unsigned char* row = in + (size_t)y * 2 * width * 4;
+        unsigned char* target = out + (size_t)y * out_width * 4;
+
+        for (int x = 0; x < out_width; x++) {
+            const unsigned char* p[4] = {row + x * 8, row + x * 8 + dx, row + x * 8 + dy, row + x * 8 + dx + dy};
+
+#ifdef TEXTURE_SSE
+            __m128 sum = _mm_setzero_ps();
+
+            for (int k = 0; k < 4; k++)
+                sum = _mm_add_ps(sum, _mm_set_ps(alpha_decode[p[k][3]], srgb_decode[p[k][2]], srgb_decode[p[k][1]],
+                                                 srgb_decode[p[k][0]]));
+
+            int32_t index[4];
+            _mm_storeu_si128((__m128i*)index, _mm_cvtps_epi32(_mm_mul_ps(sum, scale)));
+
+            target[x * 4 + 0] = srgb_encode[index[0]];
+            target[x * 4 + 1] = srgb_encode[index[1]];
+            target[x * 4 + 2] = srgb_encode[index[2]];
+            target[x * 4 + 3] = (unsigned char)index[3];
+#else
+            for (int c = 0; c < 4; c++) {
+                const float* decode = c == 3 ? alpha_decode : srgb_decode;
+                float sum = decode[p[0][c]] + decode[p[1][c]] + decode[p[2][c]] + decode[p[3][c]];
+
+                if (c == 3)
+                    target[x * 4 + c] = (unsigned char)(sum * 255.0f * 0.25f + 0.5f);
+                else
+                    target[x * 4 + c] = srgb_encode[(int)(sum * (SRGB_ENCODE_SIZE - 1) * 0.25f + 0.5f)];
+            }
+#endif
+        }
+    }
+}
+
+int level_size(int size, int level) {
+    size >>= level;
+    return size > 0 ? size : 1;
+}
+
+// Pixel rows for RGBA8, block rows for compressed formats
+int texture_rows(const texture_t* texture, int level) {
+    int height = level_size(texture->height, level);
+    return texture->format == TEXTURE_RGBA8 ? height : (height + 3) / 4;
+}
+
+size_t texture_pitch(const texture_t* texture, int level) {
+    int width = level_size(texture->width, level);
+
+    if (texture->format == TEXTURE_RGBA8)
+        return (size_t)width * 4;
+
+    return (size_t)((width + 3) / 4) * bcn_block_bytes(texture->format);
+}
+
+size_t texture_level_bytes(const texture_t* texture, int level) {
+    return texture_pitch(texture, level) * texture_rows(texture, level);
+}
+
+int choose_format(const unsigned char* pixels, size_t n, uint32_t formats) {
+    int opaque = 1;
+    for (size_t i = 0; i < n && opaque; i++)
+        opaque = pixels[i * 4 + 3] == 255;
+
+    if (opaque && (formats & (1u << BCN_BC1)))
+        return BCN_BC1;
+
+    if (formats & (1u << BCN_BC7))
+        return BCN_BC7;
+
+    if (formats & (1u << BCN_BC3))
+        return BCN_BC3;
+
+    return TEXTURE_RGBA8;
+}
+
+// Without a loose source, as when both ship in a pack, there is no stamp to compare against
+int map_cooked(texture_t* texture, const struct stat* source) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s%s", texture->path, TEXTURE_COOKED_SUFFIX) >= (int)sizeof(path))
+        return 0;
+
+    vfs_file_t* file = &texture->cooked;
+    if (!vfs_open(file, path))
+        return 0;
+
+    const cooked_header_t* header = (const cooked_header_t*)file->data;
+
+    int valid = file->size >= sizeof(cooked_header_t) && memcmp(header->magic, "BTEX", 4) == 0 &&
+                header->version == TEXTURE_COOKED_VERSION &&
+                (source == NULL ||
+                 (header->source_size == (uint64_t)source->st_size && header->source_mtime == source->st_mtime)) &&
+                header->format <= BCN_BC7 && (texture->formats & (1u << header->format)) && header->levels > 0 &&
+                header->levels <= TEXTURE_MAX_LEVELS && header->width > 0 && header->height > 0;
+
+    if (valid) {
+        texture->width = header->width;
+        texture->height = header->height;
+        texture->levels = header->levels;
+        texture->format = header->format;
+
+        // A truncated file fails here rather than faulting during the upload
+        for (int level = 0; level < texture->levels && valid; level++) {
+            texture->level_offset[level] = header->level_offset[level];
+            valid = header->level_offset[level] <= file->size &&
+                    texture_level_bytes(texture, level) <= file->size - header->level_offset[level];
+        }
+    }
+
+    if (!valid) {
+        vfs_close(file);
+        return 0;
+    }
+
+    // Uploads read the file front to back over several frames
+    if (file->mapped != NULL)
+        madvise(file->mapped, file->mapped_size, MADV_WILLNEED);
+
+    texture->data = (const unsigned char*)file->data;
+
+    return 1;
+}
+
+void write_cooked(const texture_t* texture, const struct stat* source, size_t size) {
+    char path[PATH_MAX], temporary[PATH_MAX + 4];
+    if (snprintf(path, sizeof(path), "%s%s", texture->path, TEXTURE_COOKED_SUFFIX) >= (int)sizeof(path))
+        return;
+
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+
+    cooked_header_t header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, "BTEX", 4);
+    header.version = TEXTURE_COOKED_VERSION;
+    header.format = texture->format;
+    header.width = texture->width;
+    header.height = texture->height;
+    header.levels = texture->levels;
+    header.source_size = source->st_size;
+    header.source_mtime = source->st_mtime;
+
+    for (int level = 0; level < texture->levels; level++)
+        header.level_offset[level] = sizeof(header) + texture->level_offset[level];
+
+    // Written aside and renamed so a reader never maps a partial file
+    FILE* file = fopen(temporary, "wb");
+    int written = file != NULL && fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(texture->pixels, 1, size, file) == size;
+
+    if (file != NULL)
+        written = fclose(file) == 0 && written;
+
+    if (!written || rename(temporary, path) != 0) {
+        fprintf(stderr, "Failed to write cooked texture: %s\n", path);
+        unlink(temporary);
+    }
+}
+
+// Replaces the RGBA8 chain in pixels with a compressed one
+void cook_texture(texture_t* texture, const struct stat* source) {
+    int format = choose_format(texture->pixels, (size_t)texture->width * texture->height, texture->formats);
+    if (format == TEXTURE_RGBA8)
+        return;
+
+    size_t offsets[TEXTURE_MAX_LEVELS], size = 0, uncompressed = 0, pixels_n = 0;
+
+    for (int level = 0; level < texture->levels; level++) {
+        int width = level_size(texture->width, level), height = level_size(texture->height, level);
+
+        offsets[level] = size;
+        size += bcn_size(format, width, height);
+
+        uncompressed += (size_t)width * height * 4;
+        pixels_n += (size_t)width * height;
+    }
+
+    unsigned char* compressed = malloc(size);
+    double start = glfwGetTime();
+
+    for (int level = 0; level < texture->levels; level++)
+        compress_image(compressed + offsets[level], texture->pixels + texture->level_offset[level],
+                       level_size(texture->width, level), level_size(texture->height, level), format);
+
+    double elapsed = glfwGetTime() - start;
+
+    printf("Cooked %s: %s %dx%d, %d levels at %.1f MPix/s, %.2f MB -> %.2f MB in VRAM\n", texture->path,
+           format_names[format], texture->width, texture->height, texture->levels,
+           elapsed > 0.0 ? pixels_n / elapsed / 1e6 : 0.0, uncompressed / (1024.0 * 1024.0), size / (1024.0 * 1024.0));
+
+    free(texture->pixels);
+    texture->pixels = compressed;
+    texture->format = format;
+    memcpy(texture->level_offset, offsets, sizeof(offsets));
+
+    if (source != NULL)
+        write_cooked(texture, source, size);
+}
+
+void decode_texture(void* data) {
+    texture_t* texture = data;
+    double start = glfwGetTime();
+
+    struct stat source;
+    int has_source = stat(texture->path, &source) == 0;
+
+    if (texture->formats != 0 && map_cooked(texture, has_source ? &source : NULL)) {
+        texture->decode_time = glfwGetTime() - start;
+        atomic_store_explicit(&texture->status, TEXTURE_DECODED, memory_order_release);
+        return;
+    }
+
+    // A rejected cooked file may have set the format already
+    texture->format = TEXTURE_RGBA8;
+
+    // OBJ texture coordinates start at the bottom left
+    stbi_set_flip_vertically_on_load_thread(1);
+
+    int width, height, channels;
+    unsigned char* image = NULL;
+
+    vfs_file_t file;
+    const char* reason = "not found";
+
+    if (vfs_open(&file, texture->path)) {
+        image = stbi_load_from_memory((const stbi_uc*)file.data, file.size, &width, &height, &channels, 4);
+        reason = stbi_failure_reason();
+        vfs_close(&file);
+    }
+
+    if (image == NULL) {
+        fprintf(stderr, "Failed to load texture: %s (%s)\n", texture->path, reason);
+        atomic_store_explicit(&texture->status, TEXTURE_FAILED, memory_order_release);
+        return;
+    }
+
+    texture->width = width;
+    texture->height = height;
+    texture->levels = 1;
+
+    while (texture->levels < TEXTURE_MAX_LEVELS &&
+           (level_size(width, texture->levels - 1) > 1 || level_size(height, texture->levels - 1) > 1))
+        texture->levels++;
+
+    size_t size = 0;
+    for (int level = 0; level < texture->levels; level++) {
+        texture->level_offset[level] = size;
+        size += (size_t)level_size(width, level) * level_size(height, level) * 4;
+    }
+
+    texture->pixels = malloc(size);
+    memcpy(texture->pixels, image, (size_t)width * height * 4);
+    stbi_image_free(image);
+
+    for (int level = 1; level < texture->levels; level++)
+        downsample_srgb(texture->pixels + texture->level_offset[level],
+                        texture->pixels + texture->level_offset[level - 1], level_size(width, level - 1),
+                        level_size(height, level - 1));
+
+    if (texture->formats != 0)
+        cook_texture(texture, has_source ? &source : NULL);
+
+    texture->data = texture->pixels;
+    texture->decode_time = glfwGetTime() - start;
+    atomic_store_explicit(&texture->status, TEXTURE_DECODED, memory_order_release);
+}
+
+void init_texture_cache(texture_cache_t* cache, size_t budget, size_t vram_budget) {
+    memset(cache, 0, sizeof(texture_cache_t));
+
+    cache->budget = budget;
+    cache->vram_budget = vram_budget;
+    init_stream_buffer(&cache->upload, GL_PIXEL_UNPACK_BUFFER, budget);
+
+    // RGTC is core since 3.0, the others are extensions every desktop driver has in practice
+    cache->formats = 1u << BCN_BC5;
+
+    if (glfwExtensionSupported("GL_EXT_texture_compression_s3tc"))
+        cache->formats |= 1u << BCN_BC1 | 1u << BCN_BC3;
+
+    if (glfwExtensionSupported("GL_ARB_texture_compression_bptc"))
+        cache->formats |= 1u << BCN_BC7;
+
+    // A bound unpack buffer turns every other texture upload into a buffer offset
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void free_texture_cache(texture_cache_t* cache) {
+    // Decode jobs still in flight write into the textures
+    wait_for_counter(&cache->counter);
+
+    for (uint32_t i = 0; i < cache->textures_n; i++) {
+        texture_t* texture = cache->textures[i];
+
+        vfs_close(&texture->cooked);
+
+        free(texture->pixels);
+        free(texture->path);
+        free(texture);
+    }
+
+    for (uint32_t i = 0; i < cache->arrays_n; i++) {
+        glDeleteTextures(1, &cache->arrays[i]->id);
+        free(cache->arrays[i]);
+    }
+
+    free(cache->textures);
+    free(cache->arrays);
+    free(cache->order);
+    free_stream_buffer(&cache->upload);
+
+    memset(cache, 0, sizeof(texture_cache_t));
+}
+
+texture_t* load_texture(texture_cache_t* cache, const char* path) {
+    for (uint32_t i = 0; i < cache->textures_n; i++)
+        if (strcmp(cache->textures[i]->path, path) == 0)
+            return cache->textures[i];
+
+    texture_t* texture = calloc(1, sizeof(texture_t));
+    texture->path = strdup(path);
+    texture->formats = cache->formats;
+    atomic_init(&texture->status, TEXTURE_QUEUED);
+
+    cache->textures = realloc(cache->textures, sizeof(texture_t*) * (cache->textures_n + 1));
+    cache->textures[cache->textures_n++] = texture;
+
+    // A pool of one is the GL thread itself, so update_textures decodes those instead
+    if (job_workers() > 1) {
+        job_decl_t decl = {decode_texture, texture};
+
+        atomic_store(&texture->status, TEXTURE_DECODING);
+        run_jobs(&decl, 1, &cache->counter);
+    }
+
+    return texture;
+}
+
+size_t uncompressed_level_bytes(const texture_t* texture, int level) {
+    return (size_t)level_size(texture->width, level) * level_size(texture->height, level) * 4;
+}
+
+// A level is allocated for every layer at once
+size_t array_level_bytes(const texture_array_t* array, int level) {
+    return texture_level_bytes(array->layers[0], level) * array->capacity;
+}
+
+void allocate_array_level(texture_cache_t* cache, texture_array_t* array, int level) {
+    int width = level_size(array->width, level), height = level_size(array->height, level);
+
+    // Shading happens on encoded colours, so texels stay as they are and only the mips are filtered in linear light
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array->id);
+
+    if (array->format == TEXTURE_RGBA8)
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, width, height, array->capacity, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, NULL);
+    else
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, compressed_formats[array->format], width, height,
+                               array->capacity, 0, array_level_bytes(array, level), NULL);
+
+    cache->resident += array_level_bytes(array, level);
+    cache->resident_uncompressed += uncompressed_level_bytes(array->layers[0], level) * array->capacity;
+}
+
+// The GL texture is only defined once its first layers are assigned, see resize_array
+texture_array_t* create_array(texture_cache_t* cache, texture_t* texture) {
+    texture_array_t* array = calloc(1, sizeof(texture_array_t));
+
+    array->width = texture->width;
+    array->height = texture->height;
+    array->levels = texture->levels;
+    array->format = texture->format;
+
+    array->slot = cache->arrays_n < SHADER_TEXTURE_SLOTS ? (int)cache->arrays_n : -1;
+
+    if (array->slot < 0)
+        fprintf(stderr, "Out of texture slots, %s is drawn untextured\n", texture->path);
+
+    while (array->tail_level + 1 < array->levels &&
+           (level_size(array->width, array->tail_level) > TEXTURE_TAIL_SIZE ||
+            level_size(array->height, array->tail_level) > TEXTURE_TAIL_SIZE))
+        array->tail_level++;
+
+    // The tail is always resident, finer levels are defined as they stream in
+    array->base_level = array->allocated_level = array->wanted_level = array->tail_level;
+
+    cache->arrays = realloc(cache->arrays, sizeof(texture_array_t*) * (cache->arrays_n + 1));
+    cache->arrays[cache->arrays_n++] = array;
+
+    return array;
+}
+
+void upload_layer_level(texture_cache_t* cache, const texture_t* texture, int level) {
+    int width = level_size(texture->width, level), height = level_size(texture->height, level);
+    const unsigned char* data = texture->data + texture->level_offset[level];
+
+    if (texture->format == TEXTURE_RGBA8)
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, texture->layer, width, height, 1, GL_RGBA,
+                        GL_UNSIGNED_BYTE, data);
+    else
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, texture->layer, width, height, 1,
+                                  compressed_formats[texture->format], texture_level_bytes(texture, level), data);
+
+    cache->uploaded += texture_level_bytes(texture, level);
+}
+
+// GL 3.3 cannot add layers to a texture or copy between them, so growing defines a new one with the same levels and
+// uploads what the existing layers already had straight from the data they keep
+void resize_array(texture_cache_t* cache, texture_array_t* array) {
+    if (array->id != 0) {
+        for (int level = array->allocated_level; level < array->levels; level++) {
+            cache->resident -= array_level_bytes(array, level);
+            cache->resident_uncompressed -= uncompressed_level_bytes(array->layers[0], level) * array->capacity;
+        }
+
+        glDeleteTextures(1, &array->id);
+    }
+
+    array->capacity = array->layers_n;
+
+    glGenTextures(1, &array->id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array->id);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    for (int level = array->levels - 1; level >= array->allocated_level; level--)
+        allocate_array_level(cache, array, level);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, array->base_level);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, array->levels - 1);
+
+    for (int i = 0; i < array->layers_n; i++) {
+        texture_t* texture = array->layers[i];
+
+        // A level that was part way through streaming starts over
+        texture->upload_level = -1;
+
+        int first = texture->base_level > array->allocated_level ? texture->base_level : array->allocated_level;
+        for (int level = first; level < texture->levels; level++)
+            upload_layer_level(cache, texture, level);
+    }
+}
+
+// Puts a decoded texture into the first array of its format and size with a free layer, arrays that gained layers
+// are resized once all of this frame's textures are assigned
+void assign_layer(texture_cache_t* cache, texture_t* texture) {
+    texture->base_level = texture->levels;
+    texture->upload_level = -1;
+
+    texture_array_t* array = NULL;
+
+    for (uint32_t i = 0; i < cache->arrays_n && array == NULL; i++)
+        if (cache->arrays[i]->format == texture->format && cache->arrays[i]->width == texture->width &&
+            cache->arrays[i]->height == texture->height && cache->arrays[i]->layers_n < TEXTURE_ARRAY_LAYERS)
+            array = cache->arrays[i];
+
+    if (array == NULL)
+        array = create_array(cache, texture);
+
+    texture->array = array;
+    texture->layer = array->layers_n;
+    array->layers[array->layers_n++] = texture;
+}
+
+// Drops the finest level of whichever array has the most detail beyond what its layers want
+int evict_level(texture_cache_t* cache) {
+    texture_array_t* victim = NULL;
+    int surplus = 0;
+
+    for (uint32_t i = 0; i < cache->arrays_n; i++) {
+        texture_array_t* array = cache->arrays[i];
+
+        if (array->allocated_level == array->base_level && array->wanted_level - array->base_level > surplus) {
+            victim = array;
+            surplus = array->wanted_level - array->base_level;
+        }
+    }
+
+    if (victim == NULL)
+        return 0;
+
+    int level = victim->base_level++;
+    victim->allocated_level++;
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, victim->id);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, victim->base_level);
+
+    cache->resident -= array_level_bytes(victim, level);
+    cache->resident_uncompressed -= uncompressed_level_bytes(victim->layers[0], level) * victim->capacity;
+    cache->evicted++;
+
+    // Redefining the level as empty is the only way GL 3.3 has to release it
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    for (int i = 0; i < victim->layers_n; i++) {
+        texture_t* texture = victim->layers[i];
+
+        if (texture->base_level < victim->base_level)
+            texture->base_level = victim->base_level;
+
+        if (texture->upload_level >= 0 && texture->upload_level < victim->base_level)
+            texture->upload_level = -1;
+    }
+
+    return 1;
+}
+
+// Allocates the next finer level of the array furthest from what it wants, once all of its layers caught up
+int refine_array(texture_cache_t* cache) {
+    texture_array_t* best = NULL;
+    int deficit = 0;
+
+    for (uint32_t i = 0; i < cache->arrays_n; i++) {
+        texture_array_t* array = cache->arrays[i];
+        int caught_up = array->allocated_level == array->base_level;
+
+        for (int j = 0; j < array->layers_n && caught_up; j++)
+            caught_up = array->layers[j]->base_level <= array->base_level;
+
+        if (caught_up && array->base_level - array->wanted_level > deficit) {
+            best = array;
+            deficit = array->base_level - array->wanted_level;
+        }
+    }
+
+    if (best == NULL)
+        return 0;
+
+    size_t bytes = array_level_bytes(best, best->base_level - 1);
+
+    while (cache->resident + bytes > cache->vram_budget)
+        if (!evict_level(cache))
+            return 0;
+
+    allocate_array_level(cache, best, --best->allocated_level);
+    return 1;
+}
+
+void request_texture(texture_t* texture, float texels) {
+    if (texels > texture->wanted_texels)
+        texture->wanted_texels = texels;
+}
+
+int compare_texture_priority(const void* a, const void* b) {
+    const texture_t* x = *(texture_t* const*)a;
+    const texture_t* y = *(texture_t* const*)b;
+
+    // Textures that cannot be drawn yet come first, then the ones missing the most levels
+    int x_ready = x->base_level <= x->array->base_level, y_ready = y->base_level <= y->array->base_level;
+    if (x_ready != y_ready)
+        return x_ready - y_ready;
+
+    return (y->base_level - y->array->allocated_level) - (x->base_level - x->array->allocated_level);
+}
+
+struct _upload_slice_t {
+    texture_t* texture;
+    int level, row, rows;
+    GLintptr offset;
+};
+
+void update_textures(texture_cache_t* cache) {
+    // Nothing else would ever run the decode jobs, one texture per frame keeps the hitch bounded
+    if (job_workers() <= 1) {
+        for (uint32_t i = 0; i < cache->textures_n; i++) {
+            if (atomic_load(&cache->textures[i]->status) == TEXTURE_QUEUED) {
+                decode_texture(cache->textures[i]);
+                break;
+            }
+        }
+    }
+
+    uint32_t order_n = 0;
+    cache->order = realloc(cache->order, sizeof(texture_t*) * (cache->textures_n + 1));
+
+    for (uint32_t i = 0; i < cache->textures_n; i++) {
+        texture_t* texture = cache->textures[i];
+
+        if (atomic_load_explicit(&texture->status, memory_order_acquire) == TEXTURE_DECODED) {
+            assign_layer(cache, texture);
+            atomic_store(&texture->status, TEXTURE_UPLOADING);
+        }
+    }
+
+    // Only layers in use are allocated and charged to the budget, which growing may push over
+    for (uint32_t i = 0; i < cache->arrays_n; i++)
+        if (cache->arrays[i]->capacity < cache->arrays[i]->layers_n)
+            resize_array(cache, cache->arrays[i]);
+
+    while (cache->resident > cache->vram_budget && evict_level(cache))
+        ;
+
+    for (uint32_t i = 0; i < cache->arrays_n; i++)
+        cache->arrays[i]->wanted_level = cache->arrays[i]->tail_level;
+
+    for (uint32_t i = 0; i < cache->textures_n; i++) {
+        texture_t* texture = cache->textures[i];
+        int status = atomic_load(&texture->status);
+
+        if (status != TEXTURE_UPLOADING && status != TEXTURE_READY)
+            continue;
+
+        // The level whose texels are closest to one per pixel, unseen textures only keep their tail
+        texture_array_t* array = texture->array;
+        int wanted = array->tail_level;
+
+        if (texture->wanted_texels > 0.0f) {
+            float size = texture->width > texture->height ? texture->width : texture->height;
+            float level = floorf(log2f(size / texture->wanted_texels));
+
+            wanted = level < 0.0f ? 0 : level < array->tail_level ? (int)level : array->tail_level;
+        }
+
+        texture->wanted_level = wanted;
+        texture->wanted_texels = 0.0f;
+
+        if (wanted < array->wanted_level)
+            array->wanted_level = wanted;
+
+        cache->order[order_n++] = texture;
+    }
+
+    // At most one new level per array and frame, the layers fill it in over the following frames
+    for (uint32_t i = 0; i < cache->arrays_n; i++)
+        if (!refine_array(cache))
+            break;
+
+    qsort(cache->order, order_n, sizeof(texture_t*), compare_texture_priority);
+
+    stream_buffer_t* upload = &cache->upload;
+    begin_stream_frame(upload);
+
+    struct _upload_slice_t slices[UPLOAD_SLICES];
+    int slices_n = 0;
+
+    // Rows are copied into the upload buffer first, the copies only become visible to GL after the flush
+    for (uint32_t i = 0; i < order_n && slices_n < UPLOAD_SLICES; i++) {
+        texture_t* texture = cache->order[i];
+        int out_of_space = 0;
+
+        while (slices_n < UPLOAD_SLICES && !out_of_space) {
+            if (texture->upload_level < 0) {
+                if (texture->base_level <= texture->array->allocated_level)
+                    break;
+
+                texture->upload_level = texture->base_level - 1;
+                texture->upload_row = 0;
+            }
+
+            int level = texture->upload_level;
+            int height = texture_rows(texture, level);
+            size_t pitch = texture_pitch(texture, level);
+
+            size_t head = (upload->head + upload->alignment - 1) / upload->alignment * upload->alignment;
+            size_t available = upload->region_size > head ? upload->region_size - head : 0;
+
+            int rows = height - texture->upload_row;
+            if ((size_t)rows > available / pitch) {
+                rows = available / pitch;
+                out_of_space = 1;
+            }
+
+            if (rows == 0)
+                break;
+
+            struct _upload_slice_t* slice = &slices[slices_n++];
+            slice->texture = texture;
+            slice->level = level;
+            slice->row = texture->upload_row;
+            slice->rows = rows;
+
+            unsigned char* target = stream_alloc(upload, pitch * rows, &slice->offset);
+            memcpy(target, texture->data + texture->level_offset[level] + pitch * texture->upload_row, pitch * rows);
+
+            cache->uploaded += pitch * rows;
+            texture->upload_row += rows;
+
+            if (texture->upload_row == height) {
+                texture->base_level = level;
+                texture->upload_level = -1;
+                cache->streamed++;
+            }
+        }
+
+        if (out_of_space)
+            break;
+    }
+
+    flush_stream(upload);
+
+    if (slices_n > 0) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload->buffer);
+
+        for (int i = 0; i < slices_n; i++) {
+            struct _upload_slice_t* slice = &slices[i];
+            texture_t* texture = slice->texture;
+
+            int width = level_size(texture->width, slice->level);
+            int height = level_size(texture->height, slice->level);
+
+            glBindTexture(GL_TEXTURE_2D_ARRAY, texture->array->id);
+
+            if (texture->format == TEXTURE_RGBA8) {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, slice->level, 0, slice->row, texture->layer, width,
+                                slice->rows, 1, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)slice->offset);
+            } else {
+                // Block rows, only the last one may cover fewer than four pixel rows
+                int y = slice->row * 4;
+                int rows = slice->rows * 4 < height - y ? slice->rows * 4 : height - y;
+
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, slice->level, 0, y, texture->layer, width, rows, 1,
+                                          compressed_formats[texture->format],
+                                          texture_pitch(texture, slice->level) * slice->rows,
+                                          (const void*)slice->offset);
+            }
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    end_stream_frame(upload);
+
+    // Sampling only reaches a level once every layer has it, layers are drawn with once they reach the base
+    for (uint32_t i = 0; i < cache->arrays_n; i++) {
+        texture_array_t* array = cache->arrays[i];
+        int complete = array->allocated_level < array->base_level;
+
+        for (int j = 0; j < array->layers_n && complete; j++)
+            complete = array->layers[j]->base_level <= array->allocated_level;
+
+        if (complete) {
+            array->base_level = array->allocated_level;
+
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array->id);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, array->base_level);
+        }
+
+        for (int j = 0; j < array->layers_n; j++) {
+            texture_t* texture = array->layers[j];
+
+            if (texture->base_level <= array->base_level && atomic_load(&texture->status) == TEXTURE_UPLOADING) {
+                atomic_store(&texture->status, TEXTURE_READY);
+
+                cache->ready++;
+                cache->decode_time += texture->decode_time;
+            }
+        }
+    }
+}
+
+void bind_texture_arrays(const texture_cache_t* cache) {
+    for (uint32_t i = 0; i < cache->arrays_n; i++) {
+        if (cache->arrays[i]->slot < 0)
+            continue;
+
+        glActiveTexture(GL_TEXTURE0 + cache->arrays[i]->slot);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, cache->arrays[i]->id);
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,136 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bcn.h"
+#include "glfw.h"
+#include "job.h"
+#include "stream.h"
+#include "vfs.h"
+
+#define TEXTURE_MAX_LEVELS 16
+
+// Uncompressed, every other format is one of the BCN_ block formats
+#define TEXTURE_RGBA8 -1
+
+// Compressed mip chains are cooked once and kept next to the source image under this suffix
+#define TEXTURE_COOKED_SUFFIX ".btex"
+#define TEXTURE_COOKED_VERSION 1
+
+// Bytes of pixel data copied into the upload buffer per frame
+#define TEXTURE_UPLOAD_BUDGET (4 << 20)
+
+// Default limit on resident mip levels across all textures
+#define TEXTURE_VRAM_BUDGET (256 << 20)
+
+// Levels this size and smaller are uploaded before a texture is drawn with and are never evicted
+#define TEXTURE_TAIL_SIZE 64
+
+// Textures of the same format and size share a GL_TEXTURE_2D_ARRAY of up to this many layers
+#define TEXTURE_ARRAY_LAYERS 16
+
+enum { TEXTURE_QUEUED, TEXTURE_DECODING, TEXTURE_DECODED, TEXTURE_UPLOADING, TEXTURE_READY, TEXTURE_FAILED };
+
+struct _texture_t {
+    char* path;
+    atomic_int status;
+
+    // Assigned once decoded, the layer is what materials refer to
+    struct _texture_array_t* array;
+    int layer;
+
+    int width, height, levels, format;
+
+    // Block formats the GL context can sample, cooking only picks from these
+    uint32_t formats;
+
+    // Mip chain written by the decode job, either owned pixels or the cooked file, from disk or a pack
+    unsigned char* pixels;
+    vfs_file_t cooked;
+
+    const unsigned char* data;
+    size_t level_offset[TEXTURE_MAX_LEVELS];
+
+    // Only touched on the GL thread. The layer holds base_level down to the smallest, finer levels of the
+    // array stream in one at a time.
+    int base_level, wanted_level;
+    int upload_level, upload_row;
+
+    // Largest on screen size this frame in pixels per unit of texture coordinates
+    float wanted_texels;
+
+    double decode_time;
+};
+
+struct _texture_array_t {
+    GLuint id;
+    int width, height, levels, format;
+
+    struct _texture_t* layers[TEXTURE_ARRAY_LAYERS];
+    int layers_n;
+
+    // Layers the GL texture was defined with, it is recreated at layers_n when textures join
+    int capacity;
+
+    // Texture unit and index into the shaders' sampler array, -1 when all SHADER_TEXTURE_SLOTS are taken
+    int slot;
+
+    // Residency is per array since a level exists for all layers or none. GL_TEXTURE_BASE_LEVEL is base_level,
+    // a finer allocated_level becomes the base once every layer has uploaded it.
+    int base_level, allocated_level, tail_level, wanted_level;
+};
+
+struct _texture_cache_t {
+    struct _texture_t** textures;
+    uint32_t textures_n;
+
+    struct _texture_array_t** arrays;
+    uint32_t arrays_n;
+
+    // Rows are staged through this ring before glTexSubImage2D reads them as a pixel buffer
+    stream_buffer_t upload;
+    size_t budget;
+
+    job_counter_t counter;
+    uint32_t formats;
+
+    // Textures in streaming priority order, rebuilt every frame
+    struct _texture_t** order;
+
+    size_t vram_budget, resident, resident_uncompressed;
+
+    uint32_t ready, streamed, evicted;
+    size_t uploaded;
+    double decode_time;
+};
+
+typedef struct _texture_t texture_t;
+typedef struct _texture_array_t texture_array_t;
+typedef struct _texture_cache_t texture_cache_t;
+
+extern texture_cache_t texture_cache;
+
+void init_texture_cache(texture_cache_t* cache, size_t budget, size_t vram_budget);
+void free_texture_cache(texture_cache_t* cache);
+
+// Returns immediately, the same path always gives the same texture.
+// When block formats are available the decode job maps the cooked file, or cooks and writes it if it is stale.
+texture_t* load_texture(texture_cache_t* cache, const char* path);
+
+// Asks for enough detail this frame to cover texels pixels per unit of texture coordinates
+void request_texture(texture_t* texture, float texels);
+
+// Call once per frame on the GL thread after the requests. Picks each texture's wanted level, evicts surplus
+// levels when the VRAM budget would be exceeded and uploads rows of missing levels until the frame budget is spent.
+void update_textures(texture_cache_t* cache);
+
+// Binds every array to the texture unit of its slot, leaves unit 0 active
+void bind_texture_arrays(const texture_cache_t* cache);
+
+// Box filter in linear light, width and height of the result are half the source rounded down but at least 1
+void downsample_srgb(unsigned char* out, const unsigned char* in, int width, int height);
+
+#endif  // TEXTURE_H
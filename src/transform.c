@@ -0,0 +1,111 @@
+#include "transform.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+
+void init_transforms(transforms_t* transforms) {
+    memset(transforms, 0, sizeof(transforms_t));
+}
+
+void free_transforms(transforms_t* transforms) {
+    free(transforms->local);
+    free(transforms->world);
+    free(transforms->normal);
+    free(transforms->parent);
+    free(transforms->dirty);
+    free(transforms->updated);
+
+    memset(transforms, 0, sizeof(transforms_t));
+}
+
+uint32_t add_transform(transforms_t* transforms, int32_t parent) {
+    if (transforms->count == transforms->capacity) {
+        uint32_t capacity = transforms->capacity ? transforms->capacity * 2 : 64;
+
+        transforms->local = realloc(transforms->local, sizeof(mat4x4) * capacity);
+        transforms->world = realloc(transforms->world, sizeof(mat4x4) * capacity);
+        transforms->normal = realloc(transforms->normal, sizeof(mat4x4) * capacity);
+        transforms->parent = realloc(transforms->parent, sizeof(int32_t) * capacity);
+        transforms->dirty = realloc(transforms->dirty, sizeof(uint8_t) * capacity);
+        transforms->updated = realloc(transforms->updated, sizeof(uint32_t) * capacity);
+
+        transforms->capacity = capacity;
+    }
+
+    uint32_t index = transforms->count++;
+
+    mat4x4_identity(transforms->local[index]);
+    mat4x4_identity(transforms->world[index]);
+    mat4x4_identity(transforms->normal[index]);
+
+    transforms->parent[index] = parent < (int32_t)index ? parent : NO_PARENT;
+    transforms->dirty[index] = 1;
+
+    return index;
+}
+
+void set_local_transform(transforms_t* transforms, uint32_t index, const mat4x4 local) {
+    mat4x4_copy(transforms->local[index], local);
+    transforms->dirty[index] = 1;
+}
+
+void update_transforms(transforms_t* transforms) {
+    transforms->updated_n = 0;
+
+    for (uint32_t i = 0; i < transforms->count; i++) {
+        int32_t parent = transforms->parent[i];
+
+        // Parents are always visited first, so their flag already reflects any dirty ancestor. Siblings are usually
+        // added together, like a model's submodels, so a moved parent's run of children is multiplied in one batch.
+        if (parent != NO_PARENT && transforms->dirty[parent]) {
+            uint32_t run = 1;
+            while (i + run < transforms->count && transforms->parent[i + run] == parent)
+                run++;
+
+            batch_mat4x4_mul(transforms->world + i, transforms->world[parent], transforms->local + i, run);
+
+            for (uint32_t j = i; j < i + run; j++) {
+                transforms->dirty[j] = 1;
+                transforms->updated[transforms->updated_n++] = j;
+            }
+
+            i += run - 1;
+            continue;
+        }
+
+        if (!transforms->dirty[i])
+            continue;
+
+        if (parent == NO_PARENT)
+            mat4x4_copy(transforms->world[i], transforms->local[i]);
+        else
+            mat4x4_mul(transforms->world[i], transforms->world[parent], transforms->local[i]);
+
+        transforms->updated[transforms->updated_n++] = i;
+    }
+
+    if (transforms->updated_n == 0)
+        return;
+
+    // Normal matrices only for what moved, gathered so the batch kernel sees contiguous input
+    uint32_t n = transforms->updated_n;
+
+    mat4x4* worlds = malloc(sizeof(mat4x4) * n * 2);
+    mat4x4* normals = worlds + n;
+
+    for (uint32_t i = 0; i < n; i++)
+        mat4x4_copy(worlds[i], transforms->world[transforms->updated[i]]);
+
+    batch_normal_matrix(normals, worlds, n);
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t index = transforms->updated[i];
+
+        mat4x4_copy(transforms->normal[index], normals[i]);
+        transforms->dirty[index] = 0;
+    }
+
+    free(worlds);
+}
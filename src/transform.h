@@ -0,0 +1,37 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <stdint.h>
+
+#include "linmath.h"
+
+#define NO_PARENT -1
+
+// Nodes are append only and always come after their parent, so one forward pass updates the hierarchy
+struct _transforms_t {
+    mat4x4* local;
+    mat4x4* world;
+    mat4x4* normal;
+
+    int32_t* parent;
+    uint8_t* dirty;
+
+    uint32_t count, capacity;
+
+    // Nodes whose world matrix changed in the last update_transforms
+    uint32_t* updated;
+    uint32_t updated_n;
+};
+
+typedef struct _transforms_t transforms_t;
+
+void init_transforms(transforms_t* transforms);
+void free_transforms(transforms_t* transforms);
+
+uint32_t add_transform(transforms_t* transforms, int32_t parent);
+void set_local_transform(transforms_t* transforms, uint32_t index, const mat4x4 local);
+
+// Recomputes world and normal matrices for dirty nodes and everything below them
+void update_transforms(transforms_t* transforms);
+
+#endif  // TRANSFORM_H
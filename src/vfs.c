@@ -0,0 +1,213 @@
+#include "vfs.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lz4.h"
+
+struct _pack_t {
+    void* mapped;
+    size_t size;
+
+    const pack_entry_t* entries;
+    uint32_t entries_n;
+
+    const char* names;
+};
+
+typedef struct _pack_t pack_t;
+
+pack_t* vfs_packs;
+uint32_t vfs_packs_n;
+
+int mount_pack(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat info;
+    void* mapped = MAP_FAILED;
+
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(pack_header_t))
+        mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+        return 0;
+
+    const pack_header_t* header = mapped;
+    size_t size = info.st_size;
+    size_t toc = sizeof(pack_header_t) + sizeof(pack_entry_t) * (size_t)header->entries_n;
+
+    int valid = memcmp(header->magic, PACK_MAGIC, 4) == 0 && header->version == PACK_VERSION &&
+                header->names_size > 0 && toc + header->names_size <= size;
+
+    const pack_entry_t* entries = (const pack_entry_t*)(header + 1);
+    const char* names = (const char*)mapped + toc;
+
+    valid = valid && names[header->names_size - 1] == '\0';
+
+    // Checked once here so lookups can trust every entry
+    for (uint32_t i = 0; i < header->entries_n && valid; i++)
+        valid = entries[i].name_offset < header->names_size && entries[i].offset <= size &&
+                entries[i].stored_size < size - entries[i].offset &&
+                ((entries[i].flags & PACK_LZ4) || entries[i].stored_size == entries[i].size);
+
+    if (!valid) {
+        fprintf(stderr, "Invalid pack: %s\n", path);
+        munmap(mapped, size);
+        return 0;
+    }
+
+    vfs_packs = realloc(vfs_packs, sizeof(pack_t) * (vfs_packs_n + 1));
+
+    pack_t* pack = &vfs_packs[vfs_packs_n++];
+    pack->mapped = mapped;
+    pack->size = size;
+    pack->entries = entries;
+    pack->entries_n = header->entries_n;
+    pack->names = names;
+
+    return 1;
+}
+
+void unmount_packs() {
+    for (uint32_t i = 0; i < vfs_packs_n; i++)
+        munmap(vfs_packs[i].mapped, vfs_packs[i].size);
+
+    free(vfs_packs);
+    vfs_packs = NULL;
+    vfs_packs_n = 0;
+}
+
+const pack_entry_t* find_pack_entry(const pack_t* pack, const char* name) {
+    uint32_t low = 0, high = pack->entries_n;
+
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        int order = strcmp(pack->names + pack->entries[mid].name_offset, name);
+
+        if (order == 0)
+            return &pack->entries[mid];
+
+        if (order < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return NULL;
+}
+
+int open_pack_entry(vfs_file_t* file, const pack_t* pack, const pack_entry_t* entry, const char* path) {
+    const char* data = (const char*)pack->mapped + entry->offset;
+    file->size = entry->size;
+
+    if (!(entry->flags & PACK_LZ4)) {
+        file->data = data;
+        return 1;
+    }
+
+    file->owned = malloc(entry->size + 1);
+
+    if (entry->size > 0 &&
+        lz4_decompress((uint8_t*)file->owned, entry->size, (const uint8_t*)data, entry->stored_size) != entry->size) {
+        fprintf(stderr, "Corrupt pack entry: %s\n", path);
+        vfs_close(file);
+        return 0;
+    }
+
+    file->owned[entry->size] = '\0';
+    file->data = file->owned;
+
+    return 1;
+}
+
+int vfs_packed(const char* path) {
+    while (strncmp(path, "./", 2) == 0)
+        path += 2;
+
+    for (uint32_t i = 0; i < vfs_packs_n; i++)
+        if (find_pack_entry(&vfs_packs[i], path) != NULL)
+            return 1;
+
+    return 0;
+}
+
+int vfs_open(vfs_file_t* file, const char* path) {
+    memset(file, 0, sizeof(vfs_file_t));
+
+    // Packs store paths relative to where they were built, without any leading ./
+    while (strncmp(path, "./", 2) == 0)
+        path += 2;
+
+    for (uint32_t i = vfs_packs_n; i-- > 0;) {
+        const pack_entry_t* entry = find_pack_entry(&vfs_packs[i], path);
+
+        if (entry != NULL)
+            return open_pack_entry(file, &vfs_packs[i], entry, path);
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return 0;
+    }
+
+    file->size = info.st_size;
+
+    // The rest of the last page reads as zeros, so only page multiples need a terminated copy
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    if (file->size % page != 0) {
+        file->mapped = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (file->mapped != MAP_FAILED) {
+            file->mapped_size = file->size;
+            file->data = file->mapped;
+
+            close(fd);
+            return 1;
+        }
+
+        file->mapped = NULL;
+    }
+
+    file->owned = malloc(file->size + 1);
+    size_t read_n = 0;
+
+    while (read_n < file->size) {
+        ssize_t n = read(fd, file->owned + read_n, file->size - read_n);
+        if (n <= 0)
+            break;
+
+        read_n += n;
+    }
+
+    close(fd);
+
+    file->owned[read_n] = '\0';
+    file->data = file->owned;
+    file->size = read_n;
+
+    return 1;
+}
+
+void vfs_close(vfs_file_t* file) {
+    free(file->owned);
+
+    if (file->mapped != NULL)
+        munmap(file->mapped, file->mapped_size);
+
+    memset(file, 0, sizeof(vfs_file_t));
+}
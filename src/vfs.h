@@ -0,0 +1,59 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Mounted at startup when present, built by make pack
+#define VFS_DEFAULT_PACK "assets.pack"
+
+#define PACK_MAGIC "PACK"
+#define PACK_VERSION 1
+
+// Blobs start on this boundary and are followed by at least one zero byte
+#define PACK_ALIGNMENT 64
+
+enum {
+    PACK_LZ4 = 1 << 0,
+};
+
+// Entries are sorted by name and followed by the names, each zero terminated
+struct _pack_header_t {
+    char magic[4];
+    uint32_t version, entries_n, names_size;
+};
+
+struct _pack_entry_t {
+    uint32_t name_offset, flags;
+
+    // Stored size differs from size when compressed
+    uint64_t offset, size, stored_size;
+};
+
+// Data is valid until vfs_close and always followed by a zero byte, so text can be parsed in place
+struct _vfs_file_t {
+    const char* data;
+    size_t size;
+
+    // At most one is set, pack entries stored uncompressed point straight into the pack's mapping
+    char* owned;
+    void* mapped;
+    size_t mapped_size;
+};
+
+typedef struct _pack_header_t pack_header_t;
+typedef struct _pack_entry_t pack_entry_t;
+typedef struct _vfs_file_t vfs_file_t;
+
+// Later mounts are searched first. Not thread safe against vfs_open, mount before loading anything.
+int mount_pack(const char* path);
+void unmount_packs();
+
+// Looks in the mounted packs, then on disk. Safe to call from jobs.
+int vfs_open(vfs_file_t* file, const char* path);
+
+// Whether a mounted pack has the file, which then needs no reading from disk
+int vfs_packed(const char* path);
+void vfs_close(vfs_file_t* file);
+
+#endif  // VFS_H
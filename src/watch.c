@@ -0,0 +1,449 @@
+#include "watch.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#include "cook.h"
+#include "vfs.h"
+
+#define MAX_WATCHES 64
+#define POLL_INTERVAL_MS 250
+
+enum { WATCH_SHADER, WATCH_MODEL };
+
+struct _watch_t {
+    int type;
+    void *target;
+
+    // Load flags of a watched model, the reload is prepared with them off the GL thread
+    uint32_t flags;
+
+    char paths[2][PATH_MAX];
+    int paths_n;
+
+    time_t mtimes[2];
+    int dirty;
+
+    // Produced by the watch thread, guarded by lock
+    int ready;
+    char *vertex_source, *fragment_source;
+    model_data_t data;
+
+    // Only touched on the GL thread
+    int compiling;
+    shader_set_t next;
+};
+
+typedef struct _watch_t watch_t;
+
+char *load_file(const char *filename);
+
+watch_t watches[MAX_WATCHES];
+int watches_n;
+
+pthread_mutex_t watch_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_t watch_thread;
+atomic_int watching;
+
+#ifdef __linux__
+int inotify_fd = -1;
+
+struct _watch_dir_t {
+    int wd;
+    char path[PATH_MAX];
+};
+
+struct _watch_dir_t watch_dirs[MAX_WATCHES * 2];
+int watch_dirs_n;
+#endif
+
+time_t file_mtime(const char *path) {
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return 0;
+
+    return info.st_mtime;
+}
+
+void split_path(const char *path, char *dir, const char **name) {
+    const char *slash = strrchr(path, '/');
+
+    if (slash == NULL) {
+        strcpy(dir, ".");
+        *name = path;
+    } else {
+        memcpy(dir, path, slash - path);
+        dir[slash - path] = '\0';
+        *name = slash + 1;
+    }
+}
+
+void add_watch_path(watch_t *watch, const char *path) {
+    int i = watch->paths_n++;
+
+    snprintf(watch->paths[i], PATH_MAX, "%s", path);
+    watch->mtimes[i] = file_mtime(path);
+
+#ifdef __linux__
+    if (inotify_fd < 0)
+        return;
+
+    // Editors often save by renaming over the file, so watch the directory rather than the inode
+    char dir[PATH_MAX];
+    const char *name;
+    split_path(path, dir, &name);
+
+    for (int j = 0; j < watch_dirs_n; j++)
+        if (strcmp(watch_dirs[j].path, dir) == 0)
+            return;
+
+    int wd = inotify_add_watch(inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd < 0) {
+        fprintf(stderr, "Failed to watch: %s\n", dir);
+        return;
+    }
+
+    watch_dirs[watch_dirs_n].wd = wd;
+    snprintf(watch_dirs[watch_dirs_n].path, PATH_MAX, "%s", dir);
+    watch_dirs_n++;
+#endif
+}
+
+watch_t *add_watch(int type, void *target) {
+    if (watches_n == MAX_WATCHES) {
+        fprintf(stderr, "Too many watched assets\n");
+        return NULL;
+    }
+
+    watch_t *watch = &watches[watches_n++];
+    memset(watch, 0, sizeof(watch_t));
+
+    watch->type = type;
+    watch->target = target;
+
+    return watch;
+}
+
+// Reloads go through the VFS, which would keep returning the packed copy however often the file on disk changes
+int served_from_pack(const char *path) {
+    if (vfs_packed(path)) {
+        fprintf(stderr, "Not watching %s, it is served from the pack\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+void watch_shader_set(shader_set_t *set, const char *vertex_shader_path, const char *fragment_shader_path) {
+    if (served_from_pack(vertex_shader_path) || served_from_pack(fragment_shader_path))
+        return;
+
+    pthread_mutex_lock(&watch_lock);
+
+    watch_t *watch = add_watch(WATCH_SHADER, set);
+    if (watch) {
+        add_watch_path(watch, vertex_shader_path);
+        add_watch_path(watch, fragment_shader_path);
+    }
+
+    pthread_mutex_unlock(&watch_lock);
+}
+
+void watch_model(model_t *model, const char *path) {
+    // A packed cooked model is parsed ahead of the source
+    char cooked_path[MODEL_PATH_MAX];
+    if (served_from_pack(path) ||
+        (find_cooked_model(cooked_path, sizeof(cooked_path), path) && served_from_pack(cooked_path)))
+        return;
+
+    pthread_mutex_lock(&watch_lock);
+
+    watch_t *watch = add_watch(WATCH_MODEL, model);
+    if (watch) {
+        watch->flags = model->flags;
+        add_watch_path(watch, path);
+    }
+
+    pthread_mutex_unlock(&watch_lock);
+}
+
+void mark_dirty(const char *path) {
+    for (int i = 0; i < watches_n; i++)
+        for (int j = 0; j < watches[i].paths_n; j++)
+            if (strcmp(watches[i].paths[j], path) == 0)
+                watches[i].dirty = 1;
+}
+
+void wait_for_changes() {
+#ifdef __linux__
+    if (inotify_fd >= 0) {
+        struct pollfd fds = {inotify_fd, POLLIN, 0};
+        if (poll(&fds, 1, POLL_INTERVAL_MS) <= 0)
+            return;
+
+        char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+
+        while ((len = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+            pthread_mutex_lock(&watch_lock);
+
+            for (char *cursor = buffer; cursor < buffer + len;) {
+                struct inotify_event *event = (struct inotify_event *)cursor;
+                cursor += sizeof(struct inotify_event) + event->len;
+
+                if (event->len == 0)
+                    continue;
+
+                for (int i = 0; i < watch_dirs_n; i++) {
+                    if (watch_dirs[i].wd != event->wd)
+                        continue;
+
+                    char path[PATH_MAX * 2];
+                    if (strcmp(watch_dirs[i].path, ".") == 0)
+                        snprintf(path, sizeof(path), "%s", event->name);
+                    else
+                        snprintf(path, sizeof(path), "%s/%s", watch_dirs[i].path, event->name);
+
+                    mark_dirty(path);
+                }
+            }
+
+            pthread_mutex_unlock(&watch_lock);
+        }
+
+        return;
+    }
+#endif
+
+    usleep(POLL_INTERVAL_MS * 1000);
+
+    pthread_mutex_lock(&watch_lock);
+
+    for (int i = 0; i < watches_n; i++) {
+        for (int j = 0; j < watches[i].paths_n; j++) {
+            time_t mtime = file_mtime(watches[i].paths[j]);
+
+            if (mtime != watches[i].mtimes[j]) {
+                watches[i].mtimes[j] = mtime;
+                watches[i].dirty = 1;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&watch_lock);
+}
+
+void reload_watch(int i) {
+    pthread_mutex_lock(&watch_lock);
+
+    watch_t *watch = &watches[i];
+    watch->dirty = 0;
+
+    int type = watch->type;
+    uint32_t flags = watch->flags;
+    char paths[2][PATH_MAX];
+    memcpy(paths, watch->paths, sizeof(paths));
+
+    pthread_mutex_unlock(&watch_lock);
+
+    // File reads and parsing happen here, only the GL work is left for the frame boundary
+    char *vertex_source = NULL, *fragment_source = NULL;
+    model_data_t data;
+
+    if (type == WATCH_SHADER) {
+        vertex_source = load_file(paths[0]);
+        fragment_source = load_file(paths[1]);
+
+        if (vertex_source == NULL || fragment_source == NULL) {
+            free(vertex_source);
+            free(fragment_source);
+            return;
+        }
+    } else if (!parse_model(&data, paths[0])) {
+        return;
+    }
+
+    if (type == WATCH_MODEL)
+        prepare_model(&data, flags);
+
+    pthread_mutex_lock(&watch_lock);
+
+    // A newer change supersedes one the render loop has not picked up yet
+    if (watch->ready) {
+        free(watch->vertex_source);
+        free(watch->fragment_source);
+
+        if (watch->type == WATCH_MODEL)
+            free_model_data(&watch->data);
+    }
+
+    watch->vertex_source = vertex_source;
+    watch->fragment_source = fragment_source;
+
+    if (type == WATCH_MODEL)
+        watch->data = data;
+
+    watch->ready = 1;
+
+    pthread_mutex_unlock(&watch_lock);
+}
+
+void *watch_main(void *arg) {
+    while (atomic_load(&watching)) {
+        wait_for_changes();
+
+        // Watches can be added from the GL thread at any time, so collect the dirty ones under the lock
+        int dirty[MAX_WATCHES], dirty_n = 0;
+
+        pthread_mutex_lock(&watch_lock);
+
+        for (int i = 0; i < watches_n; i++)
+            if (watches[i].dirty)
+                dirty[dirty_n++] = i;
+
+        pthread_mutex_unlock(&watch_lock);
+
+        for (int i = 0; i < dirty_n; i++)
+            reload_watch(dirty[i]);
+    }
+
+    return NULL;
+}
+
+void start_watch() {
+#ifdef __linux__
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0)
+        fprintf(stderr, "inotify unavailable, falling back to polling\n");
+#endif
+
+    atomic_store(&watching, 1);
+    if (pthread_create(&watch_thread, NULL, watch_main, NULL) != 0) {
+        fprintf(stderr, "Failed to start file watcher\n");
+        atomic_store(&watching, 0);
+    }
+}
+
+void stop_watch() {
+    if (atomic_exchange(&watching, 0))
+        pthread_join(watch_thread, NULL);
+
+#ifdef __linux__
+    if (inotify_fd >= 0)
+        close(inotify_fd);
+
+    inotify_fd = -1;
+    watch_dirs_n = 0;
+#endif
+
+    for (int i = 0; i < watches_n; i++) {
+        watch_t *watch = &watches[i];
+
+        if (watch->ready) {
+            free(watch->vertex_source);
+            free(watch->fragment_source);
+
+            if (watch->type == WATCH_MODEL)
+                free_model_data(&watch->data);
+        }
+
+        if (watch->compiling)
+            free_shader_set(&watch->next);
+    }
+
+    watches_n = 0;
+}
+
+void start_shader_reload(watch_t *watch, char *vertex_source, char *fragment_source) {
+    shader_set_t *set = watch->target;
+
+    if (watch->compiling)
+        free_shader_set(&watch->next);
+
+    watch->next.vertex_source = vertex_source;
+    watch->next.fragment_source = fragment_source;
+    watch->next.loaded = 0;
+
+    // Rebuild exactly the variants in use, swapped in once they have all finished compiling
+    for (uint32_t i = 0; i < SHADER_VARIANTS; i++)
+        if (set->loaded & (1u << i))
+            get_shader_variant(&watch->next, i);
+
+    watch->compiling = 1;
+}
+
+void finish_shader_reload(watch_t *watch) {
+    shader_set_t *set = watch->target;
+    int failed = 0;
+
+    for (uint32_t i = 0; i < SHADER_VARIANTS; i++) {
+        if (!(watch->next.loaded & (1u << i)))
+            continue;
+
+        if (!poll_shader(&watch->next.variants[i]))
+            return;
+
+        if (watch->next.variants[i].status == SHADER_FAILED)
+            failed = 1;
+    }
+
+    watch->compiling = 0;
+
+    // Keep drawing with the old program rather than a broken one
+    if (failed) {
+        fprintf(stderr, "Shader reload failed: %s\n", watch->paths[0]);
+        free_shader_set(&watch->next);
+        return;
+    }
+
+    free_shader_set(set);
+    *set = watch->next;
+
+    printf("Reloaded shader: %s, %s\n", watch->paths[0], watch->paths[1]);
+}
+
+void apply_reloads() {
+    for (int i = 0; i < watches_n; i++) {
+        watch_t *watch = &watches[i];
+
+        pthread_mutex_lock(&watch_lock);
+
+        int ready = watch->ready;
+        char *vertex_source = watch->vertex_source, *fragment_source = watch->fragment_source;
+        model_data_t data = watch->data;
+
+        watch->ready = 0;
+
+        pthread_mutex_unlock(&watch_lock);
+
+        if (ready && watch->type == WATCH_SHADER)
+            start_shader_reload(watch, vertex_source, fragment_source);
+
+        if (ready && watch->type == WATCH_MODEL) {
+            model_t *model = watch->target;
+
+            model_t next;
+            upload_model(&next, &data, model->flags);
+            inherit_model_transforms(&next, model);
+
+            free_model(model);
+            *model = next;
+
+            printf("Reloaded model: %s\n", watch->paths[0]);
+        }
+
+        if (watch->compiling)
+            finish_shader_reload(watch);
+    }
+}
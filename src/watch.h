@@ -0,0 +1,16 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "model.h"
+#include "shader.h"
+
+void start_watch();
+void stop_watch();
+
+void watch_shader_set(shader_set_t *set, const char *vertex_shader_path, const char *fragment_shader_path);
+void watch_model(model_t *model, const char *path);
+
+// Swaps in anything the watch thread has finished reloading, call between frames on the GL thread
+void apply_reloads();
+
+#endif  // WATCH_H
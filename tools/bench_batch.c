@@ -0,0 +1,367 @@
+// Times each batch math kernel against a loop of the linmath.h calls it replaces, for every instruction set the
+// machine supports, and checks the results agree.
+// Usage: bench_batch [count]
+//   count  matrices, boxes or points per batch, 4096 by default
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "batch.h"
+#include "linmath.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_X86
+#endif
+
+// Work per kernel, in items
+#define BENCH_ITEMS 20000000
+
+// Results further apart than this, relative to their magnitude, fail the benchmark
+#define BENCH_TOLERANCE 1e-4f
+
+void scalar_mat4x4_mul(mat4x4* out, const mat4x4 a, const mat4x4* b, size_t n);
+void scalar_normal_matrix(mat4x4* out, const mat4x4* m, size_t n);
+void scalar_transform_aabb(vec3* out_min, vec3* out_max, const mat4x4* m, const vec3* min, const vec3* max, size_t n);
+void scalar_transform_points(vec3* out, const mat4x4 m, const vec3* points, size_t n);
+
+#ifdef BENCH_X86
+void sse_mat4x4_mul(mat4x4* out, const mat4x4 a, const mat4x4* b, size_t n);
+void sse_normal_matrix(mat4x4* out, const mat4x4* m, size_t n);
+void sse_transform_aabb(vec3* out_min, vec3* out_max, const mat4x4* m, const vec3* min, const vec3* max, size_t n);
+void sse_transform_points(vec3* out, const mat4x4 m, const vec3* points, size_t n);
+
+void avx2_mat4x4_mul(mat4x4* out, const mat4x4 a, const mat4x4* b, size_t n);
+void avx2_normal_matrix(mat4x4* out, const mat4x4* m, size_t n);
+void avx2_transform_aabb(vec3* out_min, vec3* out_max, const mat4x4* m, const vec3* min, const vec3* max, size_t n);
+void avx2_transform_points(vec3* out, const mat4x4 m, const vec3* points, size_t n);
+#endif
+
+typedef void (*mat4x4_mul_func_t)(mat4x4*, const mat4x4, const mat4x4*, size_t);
+typedef void (*normal_matrix_func_t)(mat4x4*, const mat4x4*, size_t);
+typedef void (*transform_aabb_func_t)(vec3*, vec3*, const mat4x4*, const vec3*, const vec3*, size_t);
+typedef void (*transform_points_func_t)(vec3*, const mat4x4, const vec3*, size_t);
+
+struct _kernels_t {
+    const char* name;
+
+    mat4x4_mul_func_t mat4x4_mul;
+    normal_matrix_func_t normal_matrix;
+    transform_aabb_func_t transform_aabb;
+    transform_points_func_t transform_points;
+};
+
+typedef struct _kernels_t kernels_t;
+
+size_t count;
+int rounds;
+
+mat4x4 *matrices, *results, *expected_matrices;
+vec3 *mins, *maxs, *out_min, *out_max, *expected_min, *expected_max;
+vec3 *points, *out_points, *expected_points;
+mat4x4 shared;
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+float random_float(float min, float max) {
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+// Affine matrices with rotation, non-uniform scale and translation, the kind the transform store holds
+void random_affine(mat4x4 m) {
+    mat4x4 rotation;
+    mat4x4_translation(m, random_float(-100.0f, 100.0f), random_float(-100.0f, 100.0f), random_float(-100.0f, 100.0f));
+    mat4x4_rotation_y(rotation, random_float(0.0f, 6.28f));
+    mat4x4_mul(m, m, rotation);
+    mat4x4_rotate_x(m, m, random_float(0.0f, 6.28f));
+
+    for (int k = 0; k < 3; k++)
+        vec4_scale(m[k], m[k], random_float(0.25f, 4.0f));
+}
+
+void init_data() {
+    srand(1);
+
+    matrices = malloc(sizeof(mat4x4) * count);
+    results = malloc(sizeof(mat4x4) * count);
+    expected_matrices = malloc(sizeof(mat4x4) * count);
+
+    mins = malloc(sizeof(vec3) * count);
+    maxs = malloc(sizeof(vec3) * count);
+    out_min = malloc(sizeof(vec3) * count);
+    out_max = malloc(sizeof(vec3) * count);
+    expected_min = malloc(sizeof(vec3) * count);
+    expected_max = malloc(sizeof(vec3) * count);
+
+    points = malloc(sizeof(vec3) * count);
+    out_points = malloc(sizeof(vec3) * count);
+    expected_points = malloc(sizeof(vec3) * count);
+
+    for (size_t i = 0; i < count; i++) {
+        random_affine(matrices[i]);
+
+        for (int k = 0; k < 3; k++) {
+            mins[i][k] = random_float(-10.0f, 0.0f);
+            maxs[i][k] = mins[i][k] + random_float(0.0f, 10.0f);
+            points[i][k] = random_float(-100.0f, 100.0f);
+        }
+    }
+
+    // A view projection, like the one every draw is multiplied by
+    mat4x4 projection, view;
+    vec3 eye = {10.0f, 20.0f, 30.0f}, centre = {0.0f, 0.0f, 0.0f}, up = {0.0f, 1.0f, 0.0f};
+
+    mat4x4_perspective(projection, 1.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+    mat4x4_look_at(view, eye, centre, up);
+    mat4x4_mul(shared, projection, view);
+}
+
+void free_data() {
+    free(matrices);
+    free(results);
+    free(expected_matrices);
+    free(mins);
+    free(maxs);
+    free(out_min);
+    free(out_max);
+    free(expected_min);
+    free(expected_max);
+    free(points);
+    free(out_points);
+    free(expected_points);
+}
+
+// The linmath.h versions
+
+void linmath_mat4x4_mul(mat4x4* out, const mat4x4 a, const mat4x4* b, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        mat4x4_mul(out[i], a, b[i]);
+}
+
+void linmath_normal_matrix(mat4x4* out, const mat4x4* m, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        mat4x4 inverse;
+        mat4x4_invert(inverse, m[i]);
+        mat4x4_transpose(out[i], inverse);
+
+        // Only the upper 3x3 is used for normals, the kernels clear the rest
+        for (int k = 0; k < 3; k++)
+            out[i][3][k] = out[i][k][3] = 0.0f;
+
+        out[i][3][3] = 1.0f;
+    }
+}
+
+void linmath_transform_aabb(vec3* out_min, vec3* out_max, const mat4x4* m, const vec3* min, const vec3* max,
+                            size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        vec3_set(out_min[i], INFINITY, INFINITY, INFINITY);
+        vec3_set(out_max[i], -INFINITY, -INFINITY, -INFINITY);
+
+        for (int corner = 0; corner < 8; corner++) {
+            vec4 p = {corner & 1 ? max[i][0] : min[i][0], corner & 2 ? max[i][1] : min[i][1],
+                      corner & 4 ? max[i][2] : min[i][2], 1.0f};
+            vec4 world;
+            mat4x4_mul_vec4(world, m[i], p);
+
+            for (int k = 0; k < 3; k++) {
+                out_min[i][k] = world[k] < out_min[i][k] ? world[k] : out_min[i][k];
+                out_max[i][k] = world[k] > out_max[i][k] ? world[k] : out_max[i][k];
+            }
+        }
+    }
+}
+
+void linmath_transform_points(vec3* out, const mat4x4 m, const vec3* points, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        vec4 p, world;
+        vec4_from_vec3(p, points[i], 1.0f);
+        mat4x4_mul_vec4(world, m, p);
+
+        vec3_copy(out[i], world);
+    }
+}
+
+float max_error(const float* a, const float* b, size_t n) {
+    float error = 0.0f;
+
+    for (size_t i = 0; i < n; i++) {
+        float difference = fabsf(a[i] - b[i]) / (fabsf(b[i]) > 1.0f ? fabsf(b[i]) : 1.0f);
+        error = difference > error ? difference : error;
+    }
+
+    return error;
+}
+
+void print_result(const char* name, double elapsed, double reference, float error) {
+    printf("  %-8s %7.2f ns per item  %5.2fx  max error %.1e\n", name, elapsed / ((double)count * rounds) * 1e9,
+           reference / elapsed, error);
+}
+
+// Each benchmark returns the largest error of any kernel set against linmath.h
+
+float bench_mat4x4_mul(const kernels_t* kernels, int kernels_n) {
+    double start = now();
+    for (int round = 0; round < rounds; round++)
+        linmath_mat4x4_mul(expected_matrices, shared, matrices, count);
+    double reference = now() - start;
+
+    printf("mat4x4_mul by a shared view projection:\n");
+    print_result("linmath", reference, reference, 0.0f);
+
+    float worst = 0.0f;
+
+    for (int i = 0; i < kernels_n; i++) {
+        start = now();
+        for (int round = 0; round < rounds; round++)
+            kernels[i].mat4x4_mul(results, shared, matrices, count);
+        double elapsed = now() - start;
+
+        float error = max_error(*results[0], *expected_matrices[0], count * 16);
+        print_result(kernels[i].name, elapsed, reference, error);
+
+        worst = error > worst ? error : worst;
+    }
+
+    return worst;
+}
+
+float bench_normal_matrix(const kernels_t* kernels, int kernels_n) {
+    double start = now();
+    for (int round = 0; round < rounds; round++)
+        linmath_normal_matrix(expected_matrices, matrices, count);
+    double reference = now() - start;
+
+    printf("normal matrix, linmath.h inverts the whole 4x4 and transposes it:\n");
+    print_result("linmath", reference, reference, 0.0f);
+
+    float worst = 0.0f;
+
+    for (int i = 0; i < kernels_n; i++) {
+        start = now();
+        for (int round = 0; round < rounds; round++)
+            kernels[i].normal_matrix(results, matrices, count);
+        double elapsed = now() - start;
+
+        float error = max_error(*results[0], *expected_matrices[0], count * 16);
+        print_result(kernels[i].name, elapsed, reference, error);
+
+        worst = error > worst ? error : worst;
+    }
+
+    return worst;
+}
+
+float bench_transform_aabb(const kernels_t* kernels, int kernels_n) {
+    double start = now();
+    for (int round = 0; round < rounds; round++)
+        linmath_transform_aabb(expected_min, expected_max, matrices, mins, maxs, count);
+    double reference = now() - start;
+
+    printf("transform_aabb, linmath.h transforms all eight corners:\n");
+    print_result("linmath", reference, reference, 0.0f);
+
+    float worst = 0.0f;
+
+    for (int i = 0; i < kernels_n; i++) {
+        start = now();
+        for (int round = 0; round < rounds; round++)
+            kernels[i].transform_aabb(out_min, out_max, matrices, mins, maxs, count);
+        double elapsed = now() - start;
+
+        float error = max_error(out_min[0], expected_min[0], count * 3);
+        float error_max = max_error(out_max[0], expected_max[0], count * 3);
+        error = error_max > error ? error_max : error;
+
+        print_result(kernels[i].name, elapsed, reference, error);
+
+        worst = error > worst ? error : worst;
+    }
+
+    return worst;
+}
+
+float bench_transform_points(const kernels_t* kernels, int kernels_n) {
+    double start = now();
+    for (int round = 0; round < rounds; round++)
+        linmath_transform_points(expected_points, matrices[0], points, count);
+    double reference = now() - start;
+
+    printf("transform_points by a shared matrix:\n");
+    print_result("linmath", reference, reference, 0.0f);
+
+    float worst = 0.0f;
+
+    for (int i = 0; i < kernels_n; i++) {
+        start = now();
+        for (int round = 0; round < rounds; round++)
+            kernels[i].transform_points(out_points, matrices[0], points, count);
+        double elapsed = now() - start;
+
+        float error = max_error(out_points[0], expected_points[0], count * 3);
+        print_result(kernels[i].name, elapsed, reference, error);
+
+        worst = error > worst ? error : worst;
+    }
+
+    return worst;
+}
+
+int main(int argc, char** argv) {
+    count = argc > 1 ? strtoul(argv[1], NULL, 10) : 4096;
+
+    if (count == 0) {
+        fprintf(stderr, "Usage: bench_batch [count]\n");
+        return EXIT_FAILURE;
+    }
+
+    rounds = BENCH_ITEMS / count > 0 ? BENCH_ITEMS / count : 1;
+
+    kernels_t kernels[3] = {
+        {"scalar", scalar_mat4x4_mul, scalar_normal_matrix, scalar_transform_aabb, scalar_transform_points},
+    };
+    int kernels_n = 1;
+
+#ifdef BENCH_X86
+    __builtin_cpu_init();
+
+    kernels[kernels_n++] =
+        (kernels_t){"sse", sse_mat4x4_mul, sse_normal_matrix, sse_transform_aabb, sse_transform_points};
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        kernels[kernels_n++] =
+            (kernels_t){"avx2", avx2_mat4x4_mul, avx2_normal_matrix, avx2_transform_aabb, avx2_transform_points};
+#endif
+
+    init_batch_math();
+    init_data();
+
+    printf("%zu items per batch, %d batches, runtime dispatch picks %s\n", count, rounds, batch_math_isa());
+
+    float worst = bench_mat4x4_mul(kernels, kernels_n);
+
+    float error = bench_normal_matrix(kernels, kernels_n);
+    worst = error > worst ? error : worst;
+
+    error = bench_transform_aabb(kernels, kernels_n);
+    worst = error > worst ? error : worst;
+
+    error = bench_transform_points(kernels, kernels_n);
+    worst = error > worst ? error : worst;
+
+    free_data();
+
+    if (worst > BENCH_TOLERANCE) {
+        fprintf(stderr, "Kernels disagree with linmath.h by up to %.1e\n", worst);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
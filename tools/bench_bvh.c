@@ -0,0 +1,222 @@
+// Times the scene BVH on random boxes: build, refit after every box moved, frustum culling and ray queries. Culling
+// and rays are checked against testing every box.
+// Usage: bench_bvh [count...]
+//   count  boxes per scene, 10000, 100000 and 1000000 by default
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bvh.h"
+#include "frustum.h"
+#include "linmath.h"
+
+#define BENCH_BUILDS 3
+#define BENCH_REFITS 10
+#define BENCH_CULLS 20
+#define BENCH_RAYS 100000
+
+// Rays that are also traced against every box
+#define BENCH_CHECKED_RAYS 100
+
+// Boxes per unit volume stays the same at every count, so bigger scenes are bigger worlds
+#define BENCH_DENSITY 0.01f
+
+struct _boxes_t {
+    vec3 *min, *max;
+    uint32_t n;
+    float size;
+};
+
+typedef struct _boxes_t boxes_t;
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+float random_float(float min, float max) {
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+void init_boxes(boxes_t* boxes, uint32_t n) {
+    boxes->min = malloc(sizeof(vec3) * n);
+    boxes->max = malloc(sizeof(vec3) * n);
+    boxes->n = n;
+    boxes->size = cbrtf(n / BENCH_DENSITY);
+
+    for (uint32_t i = 0; i < n; i++) {
+        for (int k = 0; k < 3; k++) {
+            float extent = random_float(0.25f, 2.0f);
+
+            boxes->min[i][k] = random_float(0.0f, boxes->size);
+            boxes->max[i][k] = boxes->min[i][k] + extent;
+        }
+    }
+}
+
+void free_boxes(boxes_t* boxes) {
+    free(boxes->min);
+    free(boxes->max);
+}
+
+// Every box drifts a little, like objects animating between frames
+void move_boxes(boxes_t* boxes) {
+    for (uint32_t i = 0; i < boxes->n; i++) {
+        for (int k = 0; k < 3; k++) {
+            float offset = random_float(-0.5f, 0.5f);
+
+            boxes->min[i][k] += offset;
+            boxes->max[i][k] += offset;
+        }
+    }
+}
+
+// Looking across the world from the middle of one edge, so about half of it is inside
+void camera_frustum(frustum_t* frustum, const boxes_t* boxes) {
+    mat4x4 projection, view, view_projection;
+
+    vec3 eye = {0.0f, boxes->size * 0.5f, 0.0f};
+    vec3 centre = {boxes->size, boxes->size * 0.5f, boxes->size};
+    vec3 up = {0.0f, 1.0f, 0.0f};
+
+    mat4x4_perspective(projection, 1.0f, 16.0f / 9.0f, 0.1f, boxes->size);
+    mat4x4_look_at(view, eye, centre, up);
+    mat4x4_mul(view_projection, projection, view);
+
+    frustum_from_matrix(frustum, view_projection);
+}
+
+void random_ray(vec3 origin, vec3 dir, const boxes_t* boxes) {
+    for (int k = 0; k < 3; k++) {
+        origin[k] = random_float(0.0f, boxes->size);
+        dir[k] = random_float(-1.0f, 1.0f);
+    }
+
+    vec3_normalize(dir, dir);
+}
+
+// Returns 0 when the BVH disagrees with testing every box
+int bench(uint32_t n) {
+    boxes_t boxes;
+    init_boxes(&boxes, n);
+
+    scene_bvh_t bvh;
+    init_scene_bvh(&bvh);
+
+    double start = now();
+    for (int i = 0; i < BENCH_BUILDS; i++)
+        build_scene_bvh(&bvh, (const vec3*)boxes.min, (const vec3*)boxes.max, n);
+    double build = (now() - start) / BENCH_BUILDS;
+
+    double refit = 0.0;
+    for (int i = 0; i < BENCH_REFITS; i++) {
+        move_boxes(&boxes);
+
+        start = now();
+        refit_scene_bvh(&bvh, (const vec3*)boxes.min, (const vec3*)boxes.max);
+        refit += now() - start;
+    }
+    refit /= BENCH_REFITS;
+
+    frustum_t frustum;
+    camera_frustum(&frustum, &boxes);
+
+    uint8_t* visible = malloc(n);
+
+    start = now();
+    for (int i = 0; i < BENCH_CULLS; i++)
+        cull_scene_bvh(&bvh, &frustum, visible);
+    double cull = (now() - start) / BENCH_CULLS;
+
+    // Leaves are accepted whole, so the tree may keep a few extra boxes but must never drop one
+    uint32_t inside = 0, kept = 0, missed = 0;
+
+    start = now();
+    for (uint32_t i = 0; i < n; i++) {
+        int outside = frustum_cull_aabb(&frustum, boxes.min[i], boxes.max[i]);
+
+        inside += !outside;
+        missed += !outside && !visible[i];
+    }
+    double brute_cull = now() - start;
+
+    for (uint32_t i = 0; i < n; i++)
+        kept += visible[i];
+
+    uint32_t hits = 0, mismatches = 0;
+
+    start = now();
+    for (uint32_t i = 0; i < BENCH_RAYS; i++) {
+        vec3 origin, dir;
+        random_ray(origin, dir, &boxes);
+
+        float t;
+        hits += raycast_scene_bvh(&bvh, origin, dir, INFINITY, NULL, NULL, &t) >= 0;
+    }
+    double rays = now() - start;
+
+    for (uint32_t i = 0; i < BENCH_CHECKED_RAYS; i++) {
+        vec3 origin, dir;
+        random_ray(origin, dir, &boxes);
+
+        float t = INFINITY;
+        int item = raycast_scene_bvh(&bvh, origin, dir, INFINITY, NULL, NULL, &t);
+
+        vec3 inv_dir = {1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2]};
+        float best = INFINITY;
+
+        for (uint32_t j = 0; j < n; j++) {
+            float box_t;
+            if (ray_aabb(origin, inv_dir, boxes.min[j], boxes.max[j], best, &box_t) && box_t < best)
+                best = box_t;
+        }
+
+        mismatches += (item >= 0) != (best < INFINITY) || (item >= 0 && t != best);
+    }
+
+    printf("%u boxes: %u nodes, SAH cost %.2f after refits (%.2f built)\n", n, bvh.nodes_n, bvh.cost, bvh.built_cost);
+    printf("  build %.2f ms, refit %.2f ms\n", build * 1000.0, refit * 1000.0);
+    printf("  frustum %.3f ms (every box %.3f ms), %u kept for %u inside\n", cull * 1000.0, brute_cull * 1000.0, kept,
+           inside);
+    printf("  rays %.2f M/s, %.1f%% hit\n", BENCH_RAYS / rays * 1e-6, hits * 100.0 / BENCH_RAYS);
+
+    if (missed > 0)
+        fprintf(stderr, "  %u boxes inside the frustum were culled\n", missed);
+
+    if (mismatches > 0)
+        fprintf(stderr, "  %u of %u rays found a different closest box\n", mismatches, BENCH_CHECKED_RAYS);
+
+    free(visible);
+    free_scene_bvh(&bvh);
+    free_boxes(&boxes);
+
+    return missed == 0 && mismatches == 0;
+}
+
+int main(int argc, char** argv) {
+    uint32_t counts[] = {10000, 100000, 1000000};
+    int ok = 1;
+
+    srand(1);
+
+    for (int i = 1; i < argc; i++) {
+        uint32_t n = strtoul(argv[i], NULL, 10);
+
+        if (n == 0) {
+            fprintf(stderr, "Usage: bench_bvh [count...]\n");
+            return EXIT_FAILURE;
+        }
+
+        ok = bench(n) && ok;
+    }
+
+    for (int i = 0; argc == 1 && i < (int)(sizeof(counts) / sizeof(counts[0])); i++)
+        ok = bench(counts[i]) && ok;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
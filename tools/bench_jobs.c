@@ -0,0 +1,264 @@
+// Measures the job system: how many empty jobs it gets through per second, and how the per-frame object pass of a
+// synthetic 100k object scene scales with the number of workers.
+// Usage: bench_jobs [workers...]
+//   workers  pool sizes to run with, by default powers of two up to the number of cores
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "frustum.h"
+#include "job.h"
+#include "linmath.h"
+#include "transform.h"
+
+#define EMPTY_JOBS 1000000
+#define EMPTY_BATCH 1000
+
+#define SCENE_OBJECTS 100000
+#define SCENE_GROUPS 1000
+#define SCENE_FRAMES 50
+
+// Same grain as the draw update in main
+#define SCENE_GRAIN 256
+
+struct _scene_t {
+    transforms_t transforms;
+    uint32_t *roots, *nodes;
+
+    // Where each root starts, frames spin the roots from there so every run sees the same motion
+    mat4x4* placements;
+
+    vec3 *local_min, *local_max;
+    vec3 *world_min, *world_max;
+    uint32_t* keys;
+
+    mat4x4 view;
+    frustum_t frustum;
+};
+
+typedef struct _scene_t scene_t;
+
+scene_t scene;
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+void empty_job(void* data) {
+}
+
+void bench_empty_jobs() {
+    job_decl_t decls[EMPTY_BATCH];
+    for (int i = 0; i < EMPTY_BATCH; i++)
+        decls[i] = (job_decl_t){empty_job, NULL};
+
+    double start = now();
+
+    for (int i = 0; i < EMPTY_JOBS / EMPTY_BATCH; i++) {
+        job_counter_t counter;
+        atomic_init(&counter.value, 0);
+
+        run_jobs(decls, EMPTY_BATCH, &counter);
+        wait_for_counter(&counter);
+    }
+
+    double elapsed = now() - start;
+
+    printf("  empty jobs: %.2f M/s, %.0f ns each\n", EMPTY_JOBS / elapsed * 1e-6, elapsed / EMPTY_JOBS * 1e9);
+}
+
+void init_scene() {
+    srand(1);
+
+    init_transforms(&scene.transforms);
+
+    scene.roots = malloc(sizeof(uint32_t) * SCENE_GROUPS);
+    scene.placements = malloc(sizeof(mat4x4) * SCENE_GROUPS);
+    scene.nodes = malloc(sizeof(uint32_t) * SCENE_OBJECTS);
+    scene.local_min = malloc(sizeof(vec3) * SCENE_OBJECTS);
+    scene.local_max = malloc(sizeof(vec3) * SCENE_OBJECTS);
+    scene.world_min = malloc(sizeof(vec3) * SCENE_OBJECTS);
+    scene.world_max = malloc(sizeof(vec3) * SCENE_OBJECTS);
+    scene.keys = malloc(sizeof(uint32_t) * SCENE_OBJECTS);
+
+    // Groups of objects under a root each, like submodels under their model
+    uint32_t per_group = SCENE_OBJECTS / SCENE_GROUPS;
+
+    for (uint32_t group = 0; group < SCENE_GROUPS; group++) {
+        uint32_t root = add_transform(&scene.transforms, NO_PARENT);
+        scene.roots[group] = root;
+
+        mat4x4_translation(scene.placements[group], (rand() % 2000 - 1000) * 0.1f, (rand() % 200 - 100) * 0.1f,
+                         (rand() % 2000 - 1000) * 0.1f);
+        set_local_transform(&scene.transforms, root, scene.placements[group]);
+
+        mat4x4 local;
+        for (uint32_t i = 0; i < per_group; i++) {
+            uint32_t object = group * per_group + i;
+            scene.nodes[object] = add_transform(&scene.transforms, root);
+
+            mat4x4_translation(local, (rand() % 100 - 50) * 0.1f, (rand() % 100 - 50) * 0.1f, (rand() % 100 - 50) * 0.1f);
+            set_local_transform(&scene.transforms, scene.nodes[object], local);
+
+            float size = 0.1f + (rand() % 100) * 0.01f;
+            vec3_set(scene.local_min[object], -size, -size, -size);
+            vec3_set(scene.local_max[object], size, size, size);
+        }
+    }
+
+    mat4x4 projection, view_projection;
+    mat4x4_perspective(projection, 1.0f, 16.0f / 9.0f, 0.1f, 500.0f);
+
+    vec3 eye = {0.0f, 20.0f, 120.0f}, centre = {0.0f, 0.0f, 0.0f}, up = {0.0f, 1.0f, 0.0f};
+    mat4x4_look_at(scene.view, eye, centre, up);
+
+    mat4x4_mul(view_projection, projection, scene.view);
+    frustum_from_matrix(&scene.frustum, view_projection);
+}
+
+void free_scene() {
+    free_transforms(&scene.transforms);
+
+    free(scene.roots);
+    free(scene.placements);
+    free(scene.nodes);
+    free(scene.local_min);
+    free(scene.local_max);
+    free(scene.world_min);
+    free(scene.world_max);
+    free(scene.keys);
+}
+
+// The work main does per draw: world bounds, frustum test and a depth sort key
+void update_objects(void* data, uint32_t begin, uint32_t end) {
+    uint32_t n = end - begin;
+    mat4x4* worlds = malloc(sizeof(mat4x4) * n);
+
+    for (uint32_t i = 0; i < n; i++)
+        mat4x4_copy(worlds[i], scene.transforms.world[scene.nodes[begin + i]]);
+
+    batch_transform_aabb(scene.world_min + begin, scene.world_max + begin, worlds, scene.local_min + begin,
+                         scene.local_max + begin, n);
+
+    for (uint32_t i = begin; i < end; i++) {
+        vec4 centre, view_centre;
+
+        for (int k = 0; k < 3; k++)
+            centre[k] = (scene.world_min[i][k] + scene.world_max[i][k]) * 0.5f;
+
+        centre[3] = 1.0f;
+        mat4x4_mul_vec4(view_centre, scene.view, centre);
+
+        float depth = -view_centre[2] > 0.0f ? -view_centre[2] : 0.0f;
+
+        uint32_t depth_bits;
+        memcpy(&depth_bits, &depth, sizeof(float));
+
+        int culled = frustum_cull_aabb(&scene.frustum, scene.world_min[i], scene.world_max[i]);
+        scene.keys[i] = culled ? UINT32_MAX : depth_bits;
+    }
+
+    free(worlds);
+}
+
+void animate_scene(int frame) {
+    for (uint32_t group = 0; group < SCENE_GROUPS; group++) {
+        mat4x4 local;
+        mat4x4_rotate_y(local, scene.placements[group], 0.05f * frame);
+        set_local_transform(&scene.transforms, scene.roots[group], local);
+    }
+}
+
+// Returns the time of the object pass per frame, every object's transform moves each frame
+double bench_scene(uint32_t* visible) {
+    double transforms = 0.0, objects = 0.0;
+
+    for (int frame = 0; frame < SCENE_FRAMES; frame++) {
+        animate_scene(frame);
+
+        double start = now();
+        update_transforms(&scene.transforms);
+        double middle = now();
+        parallel_for(SCENE_OBJECTS, SCENE_GRAIN, update_objects, NULL);
+        double end = now();
+
+        transforms += middle - start;
+        objects += end - middle;
+    }
+
+    *visible = 0;
+    for (uint32_t i = 0; i < SCENE_OBJECTS; i++)
+        *visible += scene.keys[i] != UINT32_MAX;
+
+    printf("  %u objects: transforms %.2f ms, object pass %.2f ms per frame, %u visible\n", SCENE_OBJECTS,
+           transforms / SCENE_FRAMES * 1000.0, objects / SCENE_FRAMES * 1000.0, *visible);
+
+    return objects / SCENE_FRAMES;
+}
+
+int main(int argc, char** argv) {
+    int counts[MAX_WORKERS], counts_n = 0;
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc && counts_n < MAX_WORKERS; i++) {
+        counts[counts_n] = atoi(argv[i]);
+
+        if (counts[counts_n] < 1 || counts[counts_n] > MAX_WORKERS) {
+            fprintf(stderr, "Workers must be between 1 and %d: %s\n", MAX_WORKERS, argv[i]);
+            return EXIT_FAILURE;
+        }
+
+        counts_n++;
+    }
+
+    if (counts_n == 0) {
+        for (int workers = 1; workers < cores && workers < MAX_WORKERS; workers *= 2)
+            counts[counts_n++] = workers;
+
+        counts[counts_n++] = cores < MAX_WORKERS ? cores : MAX_WORKERS;
+    }
+
+    init_batch_math();
+    init_scene();
+
+    printf("%d cores, batch math %s\n", cores, batch_math_isa());
+
+    double baseline = 0.0;
+    uint32_t expected = 0;
+
+    for (int i = 0; i < counts_n; i++) {
+        start_jobs(counts[i]);
+        printf("%d workers:\n", job_workers());
+
+        bench_empty_jobs();
+
+        uint32_t visible;
+        double elapsed = bench_scene(&visible);
+
+        if (i == 0) {
+            baseline = elapsed;
+            expected = visible;
+        } else {
+            printf("  %.2fx the first run\n", baseline / elapsed);
+        }
+
+        stop_jobs();
+
+        if (visible != expected) {
+            fprintf(stderr, "Visible objects differ between runs: %u and %u\n", expected, visible);
+            free_scene();
+            return EXIT_FAILURE;
+        }
+    }
+
+    free_scene();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,259 @@
+// Times reading and parsing every OBJ model in a directory with each way of reading files, and writes the generated
+// scene tools/cold_start.sh runs it on. Drop the page cache before each run to measure a cold start.
+// Usage: bench_load generate dir count
+//        bench_load [-r] blocking|reader|threads dir
+//   generate  write count lathed models of roughly 75 to 450 KB each into dir
+//   blocking  read and parse the models one after another on this thread
+//   reader    read through start_reader, io_uring where the kernel allows it, and parse each as a job once it lands
+//   threads   the same with the blocking reader threads
+//   -r        only read the files, without parsing
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "job.h"
+#include "model.h"
+#include "reader.h"
+#include "vfs.h"
+
+struct _load_t {
+    file_read_t* read;
+    int ok;
+    size_t bytes;
+};
+
+typedef struct _load_t load_t;
+
+char** paths;
+uint32_t paths_n;
+int read_only;
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// A profile spun around the vertical axis, like the bulb in assets/, at a resolution picked per model
+int write_model(const char* path, int rings, int segments) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return 0;
+
+    float bulge = 0.3f + (rand() % 100) * 0.01f;
+
+    for (int i = 0; i <= rings; i++) {
+        float y = (float)i / rings * 2.0f;
+        float radius = 0.2f + bulge * sinf(y * 1.5f) * sinf(y * 1.5f);
+
+        for (int j = 0; j < segments; j++) {
+            float angle = 2.0f * (float)M_PI * j / segments;
+            fprintf(file, "v %f %f %f\n", radius * cosf(angle), y, radius * sinf(angle));
+        }
+    }
+
+    for (int i = 0; i <= rings; i++)
+        fprintf(file, "vt %f %f\n", (float)i / rings, 0.0f);
+
+    for (int j = 0; j < segments; j++) {
+        float angle = 2.0f * (float)M_PI * j / segments;
+        fprintf(file, "vn %f %f %f\n", cosf(angle), 0.0f, sinf(angle));
+    }
+
+    for (int i = 0; i < rings; i++) {
+        for (int j = 0; j < segments; j++) {
+            int a = i * segments + j + 1, b = i * segments + (j + 1) % segments + 1;
+            int c = a + segments, d = b + segments;
+            int na = j + 1, nb = (j + 1) % segments + 1;
+
+            fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, i + 1, na, c, i + 2, na, b, i + 1, nb);
+            fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", b, i + 1, nb, c, i + 2, na, d, i + 2, nb);
+        }
+    }
+
+    return fclose(file) == 0;
+}
+
+int generate(const char* dir, uint32_t count) {
+    mkdir(dir, 0755);
+    srand(1);
+
+    size_t bytes = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        char path[MODEL_PATH_MAX];
+        snprintf(path, sizeof(path), "%s/m%03u.obj", dir, i);
+
+        struct stat info;
+        if (!write_model(path, 20 + rand() % 40, 40 + rand() % 40) || stat(path, &info) != 0) {
+            fprintf(stderr, "Failed to write: %s\n", path);
+            return 0;
+        }
+
+        bytes += info.st_size;
+    }
+
+    printf("Wrote %u models to %s, %.1f MB\n", count, dir, bytes / (1024.0 * 1024.0));
+    return 1;
+}
+
+int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+int list_models(const char* dir) {
+    DIR* handle = opendir(dir);
+    if (handle == NULL)
+        return 0;
+
+    struct dirent* entry;
+
+    while ((entry = readdir(handle)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length < 4 || strcmp(entry->d_name + length - 4, ".obj") != 0)
+            continue;
+
+        paths = realloc(paths, sizeof(char*) * (paths_n + 1));
+        paths[paths_n] = malloc(strlen(dir) + length + 2);
+        sprintf(paths[paths_n++], "%s/%s", dir, entry->d_name);
+    }
+
+    closedir(handle);
+    qsort(paths, paths_n, sizeof(char*), compare_paths);
+
+    return paths_n > 0;
+}
+
+void parse_load(void* arg) {
+    load_t* load = arg;
+    load->bytes = load->read->file.size;
+
+    if (!load->read->ok) {
+        fprintf(stderr, "Failed to read: %s\n", load->read->path);
+    } else if (read_only) {
+        // vfs_open maps files from disk, touching every page is what reads them in the blocking mode
+        volatile char sum = 0;
+        for (size_t i = 0; i < load->bytes; i += 4096)
+            sum += load->read->file.data[i];
+
+        load->ok = 1;
+    } else {
+        model_data_t data;
+        load->ok = parse_model_file(&data, &load->read->file, load->read->path);
+
+        if (load->ok)
+            free_model_data(&data);
+    }
+
+    vfs_close(&load->read->file);
+}
+
+// Returns how many models loaded, bytes is what was read
+uint32_t load_blocking(size_t* bytes) {
+    uint32_t loaded = 0;
+
+    for (uint32_t i = 0; i < paths_n; i++) {
+        file_read_t read;
+        memset(&read, 0, sizeof(read));
+
+        read.path = paths[i];
+        read.ok = vfs_open(&read.file, paths[i]);
+
+        load_t load = {&read, 0, 0};
+        parse_load(&load);
+
+        loaded += load.ok;
+        *bytes += load.bytes;
+    }
+
+    return loaded;
+}
+
+uint32_t load_reader(size_t* bytes) {
+    file_read_t* reads = calloc(paths_n, sizeof(file_read_t));
+    load_t* loads = calloc(paths_n, sizeof(load_t));
+
+    for (uint32_t i = 0; i < paths_n; i++) {
+        reads[i].path = paths[i];
+        reads[i].func = parse_load;
+        reads[i].data = &loads[i];
+        loads[i].read = &reads[i];
+    }
+
+    job_counter_t counter;
+    atomic_init(&counter.value, 0);
+
+    read_files(reads, paths_n, &counter);
+    wait_for_counter(&counter);
+
+    uint32_t loaded = 0;
+
+    for (uint32_t i = 0; i < paths_n; i++) {
+        loaded += loads[i].ok;
+        *bytes += loads[i].bytes;
+    }
+
+    free(reads);
+    free(loads);
+    return loaded;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 4 && strcmp(argv[1], "generate") == 0)
+        return generate(argv[2], strtoul(argv[3], NULL, 10)) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    int arg = 1;
+
+    if (arg < argc && strcmp(argv[arg], "-r") == 0) {
+        read_only = 1;
+        arg++;
+    }
+
+    if (argc - arg != 2 || (strcmp(argv[arg], "blocking") != 0 && strcmp(argv[arg], "reader") != 0 &&
+                            strcmp(argv[arg], "threads") != 0)) {
+        fprintf(stderr, "Usage: bench_load generate dir count\n       bench_load [-r] blocking|reader|threads dir\n");
+        return EXIT_FAILURE;
+    }
+
+    const char* mode = argv[arg];
+
+    if (!list_models(argv[arg + 1])) {
+        fprintf(stderr, "No models in: %s\n", argv[arg + 1]);
+        return EXIT_FAILURE;
+    }
+
+    start_jobs(0);
+
+    if (strcmp(mode, "reader") == 0)
+        start_reader();
+    else if (strcmp(mode, "threads") == 0)
+        start_reader_threads();
+
+    size_t bytes = 0;
+    double start = now();
+
+    uint32_t loaded = strcmp(mode, "blocking") == 0 ? load_blocking(&bytes) : load_reader(&bytes);
+
+    double elapsed = now() - start;
+
+    printf("%s%s (%s): %u of %u models, %.1f MB in %.1f ms\n", mode, read_only ? ", reads only" : "",
+           strcmp(mode, "blocking") == 0 ? "this thread" : reader_backend(), loaded, paths_n,
+           bytes / (1024.0 * 1024.0), elapsed * 1000.0);
+
+    if (strcmp(mode, "blocking") != 0)
+        stop_reader();
+
+    stop_jobs();
+
+    for (uint32_t i = 0; i < paths_n; i++)
+        free(paths[i]);
+    free(paths);
+
+    return loaded == paths_n ? EXIT_SUCCESS : EXIT_FAILURE;
+}
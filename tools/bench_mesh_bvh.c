@@ -0,0 +1,260 @@
+// Measures closest-hit rays per second per core through the triangle BVH, on bumpy spheres of 10k, 100k and 1M
+// triangles or on the level 0 of the given models. A sample of rays is checked against testing every triangle.
+// Usage: bench_mesh_bvh [model...]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "job.h"
+#include "linmath.h"
+#include "mesh_bvh.h"
+#include "model.h"
+
+#define BENCH_RAYS 1000000
+
+// Rays that are also traced against every triangle
+#define BENCH_CHECKED_RAYS 200
+
+struct _mesh_t {
+    const char* name;
+
+    float* vertices;
+    uint32_t vertices_n, stride;
+
+    uint32_t* indices;
+    uint32_t indices_n;
+
+    vec3 centre;
+    float radius;
+};
+
+typedef struct _mesh_t mesh_t;
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+float random_float(float min, float max) {
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+void random_direction(vec3 dir) {
+    do {
+        for (int k = 0; k < 3; k++)
+            dir[k] = random_float(-1.0f, 1.0f);
+    } while (vec3_len(dir) > 1.0f || vec3_len(dir) < 1e-3f);
+
+    vec3_normalize(dir, dir);
+}
+
+// A unit sphere with ridges, so neighbouring triangles are not coplanar and the boxes overlap like a real mesh
+void bumpy_sphere(mesh_t* mesh, uint32_t triangles) {
+    uint32_t rings = (uint32_t)sqrtf(triangles / 4.0f), segments = rings * 2;
+
+    mesh->name = "sphere";
+    mesh->stride = 3;
+    mesh->vertices_n = (rings + 1) * (segments + 1);
+    mesh->vertices = malloc(sizeof(float) * 3 * mesh->vertices_n);
+    mesh->indices_n = rings * segments * 6;
+    mesh->indices = malloc(sizeof(uint32_t) * mesh->indices_n);
+
+    for (uint32_t i = 0; i <= rings; i++) {
+        for (uint32_t j = 0; j <= segments; j++) {
+            float theta = (float)M_PI * i / rings, phi = 2.0f * (float)M_PI * j / segments;
+            float r = 1.0f + 0.05f * sinf(theta * 40.0f) * cosf(phi * 40.0f);
+
+            float* p = mesh->vertices + (i * (segments + 1) + j) * 3;
+            p[0] = r * sinf(theta) * cosf(phi);
+            p[1] = r * cosf(theta);
+            p[2] = r * sinf(theta) * sinf(phi);
+        }
+    }
+
+    uint32_t* index = mesh->indices;
+
+    for (uint32_t i = 0; i < rings; i++) {
+        for (uint32_t j = 0; j < segments; j++) {
+            uint32_t a = i * (segments + 1) + j, b = a + segments + 1;
+
+            *index++ = a;
+            *index++ = b;
+            *index++ = a + 1;
+            *index++ = a + 1;
+            *index++ = b;
+            *index++ = b + 1;
+        }
+    }
+
+    vec3_set(mesh->centre, 0.0f, 0.0f, 0.0f);
+    mesh->radius = 1.05f;
+}
+
+// Level 0 of every submodel, the levels of detail after it are left out
+int load_mesh(mesh_t* mesh, const char* path) {
+    model_data_t data;
+    if (!parse_model(&data, path))
+        return 0;
+
+    mesh->name = path;
+    mesh->stride = 8;
+    mesh->vertices = data.vertices;
+    mesh->vertices_n = data.vertices_n;
+    mesh->indices = data.indices;
+    mesh->indices_n = 0;
+
+    for (submodel_t* submodel = data.root; submodel != NULL; submodel = submodel->child)
+        if (submodel->offset + submodel->count > mesh->indices_n)
+            mesh->indices_n = submodel->offset + submodel->count;
+
+    vec3 min = {INFINITY, INFINITY, INFINITY}, max = {-INFINITY, -INFINITY, -INFINITY};
+
+    for (uint32_t i = 0; i < mesh->vertices_n; i++) {
+        for (int k = 0; k < 3; k++) {
+            float x = mesh->vertices[i * 8 + k];
+            min[k] = x < min[k] ? x : min[k];
+            max[k] = x > max[k] ? x : max[k];
+        }
+    }
+
+    vec3 extent;
+    vec3_add(mesh->centre, min, max);
+    vec3_scale(mesh->centre, mesh->centre, 0.5f);
+    vec3_sub(extent, max, min);
+    mesh->radius = vec3_len(extent) * 0.5f;
+
+    // The mesh keeps the buffers, everything else goes
+    data.vertices = NULL;
+    data.indices = NULL;
+    free_model_data(&data);
+
+    return 1;
+}
+
+void free_mesh(mesh_t* mesh) {
+    free(mesh->vertices);
+    free(mesh->indices);
+}
+
+// From outside the bounding sphere towards a random point inside it, so most rays hit
+void random_ray(vec3 origin, vec3 dir, const mesh_t* mesh) {
+    vec3 offset, target;
+
+    random_direction(offset);
+    vec3_scale(offset, offset, mesh->radius * 2.0f);
+    vec3_add(origin, mesh->centre, offset);
+
+    random_direction(target);
+    vec3_scale(target, target, mesh->radius * random_float(0.0f, 1.0f));
+    vec3_add(target, mesh->centre, target);
+
+    vec3_sub(dir, target, origin);
+    vec3_normalize(dir, dir);
+}
+
+int brute_force(const mesh_t* mesh, const vec3 origin, const vec3 dir, mesh_hit_t* hit) {
+    int found = 0;
+    hit->t = INFINITY;
+
+    for (uint32_t i = 0; i + 2 < mesh->indices_n; i += 3) {
+        const float* p0 = mesh->vertices + (size_t)mesh->indices[i] * mesh->stride;
+        const float* p1 = mesh->vertices + (size_t)mesh->indices[i + 1] * mesh->stride;
+        const float* p2 = mesh->vertices + (size_t)mesh->indices[i + 2] * mesh->stride;
+
+        if (ray_triangle(origin, dir, p0, p1, p2, hit)) {
+            hit->triangle = i / 3;
+            found = 1;
+        }
+    }
+
+    return found;
+}
+
+// Returns 0 when the BVH disagrees with testing every triangle
+int bench(mesh_t* mesh) {
+    mesh_bvh_t bvh;
+    uint32_t first = 0, root;
+
+    double start = now();
+    build_mesh_bvh(&bvh, mesh->vertices, mesh->stride, mesh->vertices_n, mesh->indices, mesh->indices_n, &first,
+                   &mesh->indices_n, 1, &root);
+    double build = now() - start;
+
+    // Generated up front so only the traversal is timed
+    vec3* origins = malloc(sizeof(vec3) * BENCH_RAYS * 2);
+    vec3* dirs = origins + BENCH_RAYS;
+
+    for (uint32_t i = 0; i < BENCH_RAYS; i++)
+        random_ray(origins[i], dirs[i], mesh);
+
+    uint32_t hits = 0, mismatches = 0;
+
+    start = now();
+    for (uint32_t i = 0; i < BENCH_RAYS; i++) {
+        mesh_hit_t hit;
+        hits += raycast_mesh_bvh(&bvh, root, origins[i], dirs[i], INFINITY, &hit);
+    }
+    double rays = now() - start;
+
+    free(origins);
+
+    for (uint32_t i = 0; i < BENCH_CHECKED_RAYS; i++) {
+        vec3 origin, dir;
+        random_ray(origin, dir, mesh);
+
+        mesh_hit_t hit, expected;
+        int found = raycast_mesh_bvh(&bvh, root, origin, dir, INFINITY, &hit);
+
+        // Rays through a shared edge may report either triangle, the distance is what has to match
+        if (found != brute_force(mesh, origin, dir, &expected) || (found && hit.t != expected.t))
+            mismatches++;
+    }
+
+    printf("%s, %u triangles: %u nodes built in %.1f ms, %.2f M rays/s on one core, %.1f%% hit\n", mesh->name,
+           mesh->indices_n / 3, bvh.nodes_n, build * 1000.0, BENCH_RAYS / rays * 1e-6, hits * 100.0 / BENCH_RAYS);
+
+    if (mismatches > 0)
+        fprintf(stderr, "  %u of %u rays found a different closest hit\n", mismatches, BENCH_CHECKED_RAYS);
+
+    free_mesh_bvh(&bvh);
+    return mismatches == 0;
+}
+
+int main(int argc, char** argv) {
+    uint32_t sizes[] = {10000, 100000, 1000000};
+    int ok = 1;
+
+    srand(1);
+
+    // Parsing models spreads over the pool, the rays themselves are traced on this thread only
+    start_jobs(0);
+
+    for (int i = 1; i < argc; i++) {
+        mesh_t mesh;
+
+        if (!load_mesh(&mesh, argv[i])) {
+            fprintf(stderr, "Failed to load: %s\n", argv[i]);
+            ok = 0;
+            continue;
+        }
+
+        ok = bench(&mesh) && ok;
+        free_mesh(&mesh);
+    }
+
+    for (int i = 0; argc == 1 && i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        mesh_t mesh;
+        bumpy_sphere(&mesh, sizes[i]);
+
+        ok = bench(&mesh) && ok;
+        free_mesh(&mesh);
+    }
+
+    stop_jobs();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Loads a generated scene of OBJ models from a cold page cache with each way of reading files: one after another on
+# the main thread, through io_uring and through the blocking reader threads, each with and without parsing. The cache
+# is dropped before every run, which needs root.
+# Usage: tools/cold_start.sh [dir] [count] [runs]
+#   dir    where the scene is generated, /tmp/cold-scene by default, kept between calls
+#   count  models in the scene, 500 by default
+#   runs   runs per mode, 3 by default
+
+set -e
+
+DIR=${1:-/tmp/cold-scene}
+COUNT=${2:-500}
+RUNS=${3:-3}
+BENCH=tools/bench_load
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "Dropping the page cache needs root" >&2
+	exit 1
+fi
+
+make -s $BENCH
+
+# Regenerated when the count changed, the models are the same for the same count
+if [ "$(ls "$DIR"/*.obj 2>/dev/null | wc -l)" -ne "$COUNT" ]; then
+	rm -rf "$DIR"
+	./$BENCH generate "$DIR" "$COUNT"
+fi
+
+for flags in "" "-r"; do
+	for mode in blocking reader threads; do
+		run=0
+		while [ $run -lt "$RUNS" ]; do
+			sync
+			echo 3 > /proc/sys/vm/drop_caches
+			./$BENCH $flags $mode "$DIR"
+			run=$((run + 1))
+		done
+	done
+done
@@ -0,0 +1,473 @@
+// Cooks every OBJ and binary glTF model under the given directories into a .bmdl next to it, several models at a
+// time. Each directory keeps a manifest of content hashes for the sources and the material libraries they use, so
+// only models whose inputs changed are cooked again.
+// Usage: cook [-f] dir...
+//   -f  cook every model, ignoring the manifests
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cook.h"
+#include "job.h"
+#include "material.h"
+#include "model.h"
+#include "vfs.h"
+
+#define COOK_MANIFEST ".cook-manifest"
+#define COOK_MANIFEST_VERSION 1
+
+// Material libraries tracked per source, further mtllib lines are not looked at
+#define COOK_DEPENDENCIES 8
+
+enum {
+    STAGE_PARSE,
+    STAGE_WELD,
+    STAGE_MESHLETS,
+    STAGE_OPTIMIZE,
+    STAGE_QUANTIZE,
+    STAGE_LODS,
+    STAGE_BOUNDS,
+    STAGE_WRITE,
+    STAGES
+};
+
+const char* stage_names[STAGES] = {"parse", "weld", "meshlets", "optimize", "quantize", "lods", "bounds", "write"};
+
+enum { COOK_FAILED, COOK_SKIPPED, COOK_COOKED };
+
+struct _dependency_t {
+    char path[MODEL_PATH_MAX];
+    uint64_t hash;
+};
+
+// A source and what it was built from, as read from a manifest or found this run
+struct _cook_inputs_t {
+    char path[MODEL_PATH_MAX];
+    uint64_t hash;
+
+    struct _dependency_t dependencies[COOK_DEPENDENCIES];
+    uint32_t dependencies_n;
+};
+
+struct _cook_source_t {
+    struct _cook_inputs_t inputs;
+    const struct _cook_inputs_t* previous;
+
+    int status;
+    double stages[STAGES], elapsed;
+
+    uint32_t vertices_in, vertices_out;
+    float misses_in, misses_out;
+    size_t bytes;
+};
+
+typedef struct _dependency_t dependency_t;
+typedef struct _cook_inputs_t cook_inputs_t;
+typedef struct _cook_source_t cook_source_t;
+
+const char* next_line(const char* line, const char* end);
+size_t line_length(const char* line, const char* end);
+
+cook_source_t* sources;
+uint32_t sources_n;
+
+cook_inputs_t* manifest;
+uint32_t manifest_n;
+
+int force;
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// FNV-1a
+uint64_t hash_bytes(const char* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ull;
+
+    return hash;
+}
+
+uint64_t hash_file(const char* path) {
+    vfs_file_t file;
+
+    // Missing inputs hash to zero, so one appearing later still counts as a change
+    if (!vfs_open(&file, path))
+        return 0;
+
+    uint64_t hash = hash_bytes(file.data, file.size);
+    vfs_close(&file);
+
+    return hash;
+}
+
+int has_suffix(const char* path, const char* suffix) {
+    size_t length = strlen(path), suffix_length = strlen(suffix);
+    return length >= suffix_length && strcmp(path + length - suffix_length, suffix) == 0;
+}
+
+void add_sources(const char* path) {
+    DIR* dir = opendir(path);
+    if (dir == NULL)
+        return;
+
+    struct dirent* child;
+    while ((child = readdir(dir)) != NULL) {
+        // Hidden files are editor and cache leftovers
+        if (child->d_name[0] == '.')
+            continue;
+
+        char child_path[MODEL_PATH_MAX];
+        if ((size_t)snprintf(child_path, sizeof(child_path), "%s/%s", path, child->d_name) >= sizeof(child_path))
+            continue;
+
+        struct stat info;
+        if (stat(child_path, &info) != 0)
+            continue;
+
+        if (S_ISDIR(info.st_mode)) {
+            add_sources(child_path);
+            continue;
+        }
+
+        if (!S_ISREG(info.st_mode) || !(has_suffix(child_path, ".obj") || has_suffix(child_path, ".glb")))
+            continue;
+
+        const char* name = child_path;
+        while (strncmp(name, "./", 2) == 0)
+            name += 2;
+
+        sources = realloc(sources, sizeof(cook_source_t) * (sources_n + 1));
+
+        cook_source_t* source = &sources[sources_n++];
+        memset(source, 0, sizeof(cook_source_t));
+        strcpy(source->inputs.path, name);
+    }
+
+    closedir(dir);
+}
+
+int compare_inputs(const void* a, const void* b) {
+    return strcmp(((const cook_inputs_t*)a)->path, ((const cook_inputs_t*)b)->path);
+}
+
+int compare_sources(const void* a, const void* b) {
+    return compare_inputs(&((const cook_source_t*)a)->inputs, &((const cook_source_t*)b)->inputs);
+}
+
+// Entries are a hash and a path per line, each followed by its dependencies indented by two spaces
+void read_manifest(const char* path) {
+    manifest = NULL;
+    manifest_n = 0;
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return;
+
+    char line[MODEL_PATH_MAX + 32];
+    int version = 0;
+
+    // Another version means every model is cooked again
+    if (fgets(line, sizeof(line), file) == NULL || sscanf(line, "cook %d", &version) != 1 ||
+        version != COOK_MANIFEST_VERSION) {
+        fclose(file);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        int dependency = strncmp(line, "  ", 2) == 0;
+        char* end;
+
+        uint64_t hash = strtoull(line, &end, 16);
+        if (*end != ' ')
+            continue;
+
+        char* name = end + 1;
+        name[strcspn(name, "\n")] = '\0';
+
+        if (strlen(name) >= MODEL_PATH_MAX)
+            continue;
+
+        if (dependency) {
+            if (manifest_n == 0 || manifest[manifest_n - 1].dependencies_n == COOK_DEPENDENCIES)
+                continue;
+
+            cook_inputs_t* entry = &manifest[manifest_n - 1];
+            dependency_t* added = &entry->dependencies[entry->dependencies_n++];
+
+            strcpy(added->path, name);
+            added->hash = hash;
+            continue;
+        }
+
+        manifest = realloc(manifest, sizeof(cook_inputs_t) * (manifest_n + 1));
+
+        cook_inputs_t* entry = &manifest[manifest_n++];
+        memset(entry, 0, sizeof(cook_inputs_t));
+        strcpy(entry->path, name);
+        entry->hash = hash;
+    }
+
+    fclose(file);
+
+    qsort(manifest, manifest_n, sizeof(cook_inputs_t), compare_inputs);
+}
+
+int write_manifest(const char* path) {
+    char temporary[MODEL_PATH_MAX + 8];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+
+    FILE* file = fopen(temporary, "w");
+    if (file == NULL)
+        return 0;
+
+    fprintf(file, "cook %d\n", COOK_MANIFEST_VERSION);
+
+    // Failed models are left out so the next run tries them again
+    for (uint32_t i = 0; i < sources_n; i++) {
+        const cook_inputs_t* inputs = &sources[i].inputs;
+        if (sources[i].status == COOK_FAILED)
+            continue;
+
+        fprintf(file, "%016llx %s\n", (unsigned long long)inputs->hash, inputs->path);
+
+        for (uint32_t j = 0; j < inputs->dependencies_n; j++)
+            fprintf(file, "  %016llx %s\n", (unsigned long long)inputs->dependencies[j].hash,
+                    inputs->dependencies[j].path);
+    }
+
+    if (fclose(file) != 0 || rename(temporary, path) != 0) {
+        unlink(temporary);
+        return 0;
+    }
+
+    return 1;
+}
+
+void find_dependencies(cook_inputs_t* inputs, const vfs_file_t* file) {
+    if (!has_suffix(inputs->path, ".obj"))
+        return;
+
+    const char* end = file->data + file->size;
+
+    for (const char* line = file->data; line < end; line = next_line(line, end)) {
+        if (strncmp(line, "mtllib ", 7) != 0 || inputs->dependencies_n == COOK_DEPENDENCIES)
+            continue;
+
+        dependency_t* dependency = &inputs->dependencies[inputs->dependencies_n];
+        const char* name = line + 7;
+
+        if (!resolve_path(dependency->path, sizeof(dependency->path), inputs->path, name, line_length(name, end)))
+            continue;
+
+        dependency->hash = hash_file(dependency->path);
+        inputs->dependencies_n++;
+    }
+}
+
+int same_inputs(const cook_inputs_t* a, const cook_inputs_t* b) {
+    if (a == NULL || b == NULL || a->hash != b->hash || a->dependencies_n != b->dependencies_n)
+        return 0;
+
+    for (uint32_t i = 0; i < a->dependencies_n; i++)
+        if (a->dependencies[i].hash != b->dependencies[i].hash ||
+            strcmp(a->dependencies[i].path, b->dependencies[i].path) != 0)
+            return 0;
+
+    return 1;
+}
+
+void cook_source(cook_source_t* source) {
+    const char* path = source->inputs.path;
+    double start = now();
+
+    if (strlen(path) + strlen(MODEL_COOKED_SUFFIX) >= MODEL_PATH_MAX) {
+        fprintf(stderr, "Path too long: %s\n", path);
+        return;
+    }
+
+    vfs_file_t file;
+    struct stat info;
+
+    if (stat(path, &info) != 0 || !vfs_open(&file, path)) {
+        fprintf(stderr, "Failed to read: %s\n", path);
+        return;
+    }
+
+    source->inputs.hash = hash_bytes(file.data, file.size);
+    find_dependencies(&source->inputs, &file);
+
+    char cooked_path[MODEL_PATH_MAX];
+    int cooked = find_cooked_model(cooked_path, sizeof(cooked_path), path);
+
+    // Touched but unchanged sources only need the stamp the runtime checks brought up to date
+    if (!force && cooked && same_inputs(&source->inputs, source->previous) && restamp_cooked_model(cooked_path, &info)) {
+        vfs_close(&file);
+        source->status = COOK_SKIPPED;
+        return;
+    }
+
+    model_data_t data;
+    double stage = now();
+
+    int ok = parse_model_geometry(&data, &file, path);
+    vfs_close(&file);
+
+    if (!ok) {
+        fprintf(stderr, "Failed to parse: %s\n", path);
+        return;
+    }
+
+    source->stages[STAGE_PARSE] = now() - stage;
+    source->vertices_in = data.vertices_n;
+
+    stage = now();
+    weld_vertices(&data);
+    source->stages[STAGE_WELD] = now() - stage;
+
+    source->misses_in = vertex_cache_misses(&data, COOK_CACHE_SIZE);
+
+    // Meshlets come first so the cache order below survives, the runtime takes them without reordering
+    stage = now();
+    cook_meshlets(&data);
+    source->stages[STAGE_MESHLETS] = now() - stage;
+
+    stage = now();
+    optimize_vertex_cache(&data);
+    source->stages[STAGE_OPTIMIZE] = now() - stage;
+
+    source->vertices_out = data.vertices_n;
+    source->misses_out = vertex_cache_misses(&data, COOK_CACHE_SIZE);
+
+    quantization_t quantization;
+
+    stage = now();
+    cooked_vertex_t* vertices = quantize_vertices(&data, &quantization);
+    source->stages[STAGE_QUANTIZE] = now() - stage;
+
+    uint32_t submodels_n;
+    submodel_t** submodels = list_submodels(&data, &submodels_n);
+
+    stage = now();
+    simplify_submodels(&data, submodels, submodels_n);
+    source->stages[STAGE_LODS] = now() - stage;
+
+    stage = now();
+    bound_submodels(&data, submodels, submodels_n);
+    bound_meshlets(&data);
+    source->stages[STAGE_BOUNDS] = now() - stage;
+
+    stage = now();
+    source->bytes = write_cooked_model(cooked_path, &data, vertices, &quantization, &info);
+    source->stages[STAGE_WRITE] = now() - stage;
+
+    free(submodels);
+    free(vertices);
+    free_model_data(&data);
+
+    source->status = source->bytes > 0 ? COOK_COOKED : COOK_FAILED;
+    source->elapsed = now() - start;
+}
+
+void cook_sources(void* arg, uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++)
+        cook_source(&sources[i]);
+}
+
+int cook_directory(const char* dir, double* stages) {
+    char manifest_path[MODEL_PATH_MAX];
+    if ((size_t)snprintf(manifest_path, sizeof(manifest_path), "%s/%s", dir, COOK_MANIFEST) >= sizeof(manifest_path))
+        return 0;
+
+    struct stat info;
+    if (stat(dir, &info) != 0 || !S_ISDIR(info.st_mode)) {
+        fprintf(stderr, "Not a directory: %s\n", dir);
+        return 0;
+    }
+
+    sources = NULL;
+    sources_n = 0;
+
+    add_sources(dir);
+    qsort(sources, sources_n, sizeof(cook_source_t), compare_sources);
+
+    read_manifest(manifest_path);
+
+    for (uint32_t i = 0; i < sources_n; i++)
+        sources[i].previous = bsearch(&sources[i].inputs, manifest, manifest_n, sizeof(cook_inputs_t), compare_inputs);
+
+    double start = now();
+
+    // One model per job, their stages spread further over the pool where they can
+    parallel_for(sources_n, 1, cook_sources, NULL);
+
+    double elapsed = now() - start;
+    uint32_t counts[3] = {0};
+
+    for (uint32_t i = 0; i < sources_n; i++) {
+        const cook_source_t* source = &sources[i];
+        counts[source->status]++;
+
+        if (source->status != COOK_COOKED)
+            continue;
+
+        printf("Cooked %s: %u -> %u vertices, ACMR %.2f -> %.2f, %.2f MB in %.1f ms\n", source->inputs.path,
+               source->vertices_in, source->vertices_out, source->misses_in, source->misses_out,
+               source->bytes / (1024.0 * 1024.0), source->elapsed * 1000.0);
+
+        for (int stage = 0; stage < STAGES; stage++)
+            stages[stage] += source->stages[stage];
+    }
+
+    if (!write_manifest(manifest_path))
+        fprintf(stderr, "Failed to write: %s\n", manifest_path);
+
+    printf("%s: %u cooked, %u up to date, %u failed in %.1f ms\n", dir, counts[COOK_COOKED], counts[COOK_SKIPPED],
+           counts[COOK_FAILED], elapsed * 1000.0);
+
+    free(sources);
+    free(manifest);
+
+    return counts[COOK_FAILED] == 0;
+}
+
+int main(int argc, char** argv) {
+    int first = 1;
+
+    if (argc > 1 && strcmp(argv[1], "-f") == 0) {
+        force = 1;
+        first++;
+    }
+
+    if (argc - first < 1) {
+        fprintf(stderr, "Usage: %s [-f] dir...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    start_jobs(0);
+
+    double stages[STAGES] = {0};
+    int ok = 1;
+
+    for (int i = first; i < argc; i++)
+        ok = cook_directory(argv[i], stages) && ok;
+
+    stop_jobs();
+
+    // Summed over models, so with several in flight these add up to more than the wall time
+    printf("Stages:");
+    for (int stage = 0; stage < STAGES; stage++)
+        printf(" %s %.1f ms%s", stage_names[stage], stages[stage] * 1000.0, stage + 1 < STAGES ? "," : "\n");
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,223 @@
+// Builds a pack for the virtual file system from files and directories given relative to the working directory.
+// Usage: pack [-c] output.pack path...
+//   -c  store entries LZ4 compressed when that saves at least an eighth of their size
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "lz4.h"
+#include "vfs.h"
+
+struct _pack_input_t {
+    char* name;
+    pack_entry_t entry;
+
+    unsigned char* stored;
+};
+
+typedef struct _pack_input_t pack_input_t;
+
+pack_input_t* inputs;
+size_t inputs_n;
+
+const char* output_path;
+
+void add_path(const char* path) {
+    struct stat info;
+
+    if (stat(path, &info) != 0) {
+        fprintf(stderr, "Not found: %s\n", path);
+        return;
+    }
+
+    if (S_ISDIR(info.st_mode)) {
+        DIR* dir = opendir(path);
+        if (dir == NULL)
+            return;
+
+        struct dirent* child;
+        while ((child = readdir(dir)) != NULL) {
+            // Hidden files are editor and cache leftovers
+            if (child->d_name[0] == '.')
+                continue;
+
+            char child_path[4096];
+            snprintf(child_path, sizeof(child_path), "%s/%s", path, child->d_name);
+            add_path(child_path);
+        }
+
+        closedir(dir);
+        return;
+    }
+
+    if (!S_ISREG(info.st_mode) || strcmp(path, output_path) == 0)
+        return;
+
+    while (strncmp(path, "./", 2) == 0)
+        path += 2;
+
+    inputs = realloc(inputs, sizeof(pack_input_t) * (inputs_n + 1));
+
+    pack_input_t* input = &inputs[inputs_n++];
+    memset(input, 0, sizeof(pack_input_t));
+    input->name = strdup(path);
+    input->entry.size = info.st_size;
+}
+
+int compare_inputs(const void* a, const void* b) {
+    return strcmp(((const pack_input_t*)a)->name, ((const pack_input_t*)b)->name);
+}
+
+unsigned char* read_input(const char* path, size_t size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    unsigned char* data = malloc(size + 1);
+    size_t read_n = fread(data, 1, size, file);
+    fclose(file);
+
+    if (read_n != size) {
+        free(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+int main(int argc, char** argv) {
+    int compress = 0, first = 1;
+
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        compress = 1;
+        first++;
+    }
+
+    if (argc - first < 2) {
+        fprintf(stderr, "Usage: %s [-c] output.pack path...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    output_path = argv[first];
+
+    for (int i = first + 1; i < argc; i++)
+        add_path(argv[i]);
+
+    qsort(inputs, inputs_n, sizeof(pack_input_t), compare_inputs);
+
+    // The same file given twice would make lookups ambiguous
+    size_t unique = 0;
+    for (size_t i = 0; i < inputs_n; i++) {
+        if (unique > 0 && strcmp(inputs[unique - 1].name, inputs[i].name) == 0) {
+            free(inputs[i].name);
+            continue;
+        }
+
+        inputs[unique++] = inputs[i];
+    }
+
+    inputs_n = unique;
+
+    pack_header_t header;
+    memcpy(header.magic, PACK_MAGIC, 4);
+    header.version = PACK_VERSION;
+    header.entries_n = inputs_n;
+    header.names_size = 0;
+
+    for (size_t i = 0; i < inputs_n; i++) {
+        inputs[i].entry.name_offset = header.names_size;
+        header.names_size += strlen(inputs[i].name) + 1;
+    }
+
+    // Zero sized names would fail validation
+    if (header.names_size == 0)
+        header.names_size = 1;
+
+    size_t offset = sizeof(pack_header_t) + sizeof(pack_entry_t) * inputs_n + header.names_size;
+    size_t total = 0, stored_total = 0, compressed_n = 0;
+
+    clock_t start = clock();
+
+    for (size_t i = 0; i < inputs_n; i++) {
+        pack_input_t* input = &inputs[i];
+        size_t size = input->entry.size;
+
+        input->stored = read_input(input->name, size);
+        if (input->stored == NULL) {
+            fprintf(stderr, "Failed to read: %s\n", input->name);
+            return EXIT_FAILURE;
+        }
+
+        input->entry.stored_size = size;
+
+        if (compress && size > 0) {
+            unsigned char* compressed = malloc(LZ4_BOUND(size));
+            size_t compressed_size = lz4_compress(compressed, input->stored, size);
+
+            if (compressed_size < size - size / 8) {
+                free(input->stored);
+                input->stored = compressed;
+                input->entry.stored_size = compressed_size;
+                input->entry.flags |= PACK_LZ4;
+                compressed_n++;
+            } else {
+                free(compressed);
+            }
+        }
+
+        // Every blob is followed by at least one zero byte of padding
+        offset = (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+        input->entry.offset = offset;
+        offset += input->entry.stored_size + 1;
+
+        total += size;
+        stored_total += input->entry.stored_size;
+    }
+
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    FILE* file = fopen(output_path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open: %s\n", output_path);
+        return EXIT_FAILURE;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+
+    for (size_t i = 0; i < inputs_n; i++)
+        fwrite(&inputs[i].entry, sizeof(pack_entry_t), 1, file);
+
+    for (size_t i = 0; i < inputs_n; i++)
+        fwrite(inputs[i].name, strlen(inputs[i].name) + 1, 1, file);
+
+    if (inputs_n == 0)
+        fputc(0, file);
+
+    static const unsigned char zeros[PACK_ALIGNMENT + 1];
+
+    for (size_t i = 0; i < inputs_n; i++) {
+        long position = ftell(file);
+        fwrite(zeros, 1, inputs[i].entry.offset - position, file);
+        fwrite(inputs[i].stored, 1, inputs[i].entry.stored_size, file);
+
+        free(inputs[i].stored);
+        free(inputs[i].name);
+    }
+
+    fwrite(zeros, 1, 1, file);
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Failed to write: %s\n", output_path);
+        return EXIT_FAILURE;
+    }
+
+    printf("Packed %zu files into %s: %.2f MB -> %.2f MB, %zu compressed in %.1f ms\n", inputs_n, output_path,
+           total / (1024.0 * 1024.0), stored_total / (1024.0 * 1024.0), compressed_n, elapsed * 1000.0);
+
+    free(inputs);
+    return EXIT_SUCCESS;
+}